@@ -0,0 +1,98 @@
+# qmake .pro file for qdirstat/cache-writer
+#
+# This builds qdirstat-cache-writer, a command line tool that scans a
+# directory tree and writes a QDirStat cache file. It uses the same classes
+# as QDirStat itself from ../src, but only QtCore: It does not need any X
+# display, so it can run in cron jobs on headless servers.
+
+TEMPLATE	 = app
+
+QT		 = core
+CONFIG		+= debug console
+CONFIG		-= app_bundle
+DEPENDPATH	+= . ../src
+INCLUDEPATH	+= ../src
+VPATH		+= ../src
+MOC_DIR		 = .moc
+OBJECTS_DIR	 = .obj
+LIBS		+= -lz
+
+major_is_less_5 = $$find(QT_MAJOR_VERSION, [234])
+!isEmpty(major_is_less_5):DEFINES += 'Q_DECL_OVERRIDE=""'
+isEmpty(INSTALL_PREFIX):INSTALL_PREFIX = /usr
+
+TARGET		 = qdirstat-cache-writer
+TARGET.files	 = qdirstat-cache-writer
+TARGET.path	 = $$INSTALL_PREFIX/bin
+INSTALLS	+= TARGET
+
+QMAKE_CXXFLAGS	+=  -Wno-deprecated -Wno-deprecated-declarations
+
+
+# Optional: Use io_uring (liburing) for batched statx() calls (see src.pro)
+
+packagesExist( liburing ) {
+    CONFIG	+= link_pkgconfig
+    PKGCONFIG	+= liburing
+    DEFINES	+= HAVE_IO_URING=1
+}
+
+
+SOURCES	  = main.cpp			\
+	    Attic.cpp			\
+	    BinaryCache.cpp		\
+	    CacheBlocks.cpp		\
+	    CacheSnapshot.cpp		\
+	    ChildNameIndex.cpp		\
+	    DataColumns.cpp		\
+	    DebugHelpers.cpp		\
+	    DirInfo.cpp			\
+	    DirReadJob.cpp		\
+	    DirSaver.cpp		\
+	    DirTree.cpp			\
+	    DirTreeCache.cpp		\
+	    DotEntry.cpp		\
+	    DpkgPkgManager.cpp		\
+	    Exception.cpp		\
+	    ExcludeRules.cpp		\
+	    FileAggregate.cpp		\
+	    FileColumns.cpp		\
+	    FileInfo.cpp		\
+	    FileInfoIterator.cpp	\
+	    FileInfoSet.cpp		\
+	    FileInfoSorter.cpp		\
+	    Logger.cpp			\
+	    MountPoints.cpp		\
+	    NamePool.cpp		\
+	    NodeAttrTable.cpp		\
+	    NodeFile.cpp		\
+	    PacManPkgManager.cpp	\
+	    PkgFileListCache.cpp	\
+	    PkgFilter.cpp		\
+	    PkgInfo.cpp			\
+	    PkgManager.cpp		\
+	    PkgQuery.cpp		\
+	    PkgReader.cpp		\
+	    Process.cpp			\
+	    ProcessStarter.cpp		\
+	    RpmPkgManager.cpp		\
+	    ScanThrottle.cpp		\
+	    Settings.cpp		\
+	    SettingsHelpers.cpp		\
+	    SlabPool.cpp		\
+	    StatxBatch.cpp		\
+	    SysUtil.cpp			\
+	    TreeFinalizer.cpp
+
+
+HEADERS	  =				\
+	    DataColumns.h		\
+	    DirReadJob.h		\
+	    DirTree.h			\
+	    DirTreeCache.h		\
+	    ExcludeRules.h		\
+	    PkgReader.h			\
+	    Process.h			\
+	    ProcessStarter.h		\
+	    Settings.h			\
+	    TreeFinalizer.h
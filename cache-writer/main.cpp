@@ -0,0 +1,178 @@
+/*
+ *   File name: main.cpp
+ *   Summary:	Headless QDirStat cache writer for cron jobs
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <iostream>	// cout, cerr
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "DirTreeCache.h"
+#include "ExcludeRules.h"
+#include "Logger.h"
+#include "Exception.h"
+#include "Version.h"
+
+
+using std::cout;
+using std::cerr;
+using namespace QDirStat;
+
+static const char * progName = "qdirstat-cache-writer";
+
+
+void usage()
+{
+    cerr << "\n"
+	 << "Usage: \n"
+	 << "\n"
+	 << "  " << progName << " [-lmvdh] <directory> [<cache-file-name>]\n"
+	 << "\n"
+	 << "If not specified, <cache-file-name> defaults to \"" << DEFAULT_CACHE_NAME << "\"\n"
+	 << "in <directory>. If <cache-file-name> ends with \"" << BINARY_CACHE_SUFFIX << "\", "
+	 << "the cache file is\nwritten in the binary format, otherwise it is "
+	 << "compressed with gzip.\n"
+	 << "\n"
+	 << "  -l  long format - always add full path, even for plain files\n"
+	 << "  -m  scan mounted filesystems (cross filesystem boundaries)\n"
+	 << "  -v  verbose\n"
+	 << "  -d  debug (log debug messages)\n"
+	 << "  -h  help (this usage message)\n"
+	 << "\n"
+	 << "The exclude rules from the QDirStat settings of the current user\n"
+	 << "are applied. Existing cache files in the directory tree are not used.\n"
+	 << std::endl;
+}
+
+
+/**
+ * Scan 'dirName' and write the result to 'cacheFileName'. Return 'true' if
+ * everything went OK.
+ **/
+bool writeCacheFile( const QString & dirName,
+		     const QString & cacheFileName,
+		     bool	     longFormat,
+		     bool	     crossFilesystems,
+		     bool	     verbose )
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    DirTree tree;
+    tree.setCrossFilesystems( crossFilesystems );
+    tree.setReadCacheFiles( false );	// Don't simply copy the last cache file
+    tree.startReading( dirName );
+
+    // There is no need for a QEventLoop with a finished() signal: Just keep
+    // processing the events of the read jobs until the tree is done.
+
+    while ( tree.isBusy() )
+	QCoreApplication::processEvents( QEventLoop::WaitForMoreEvents );
+
+    FileInfo * toplevel = tree.firstToplevel();
+
+    if ( ! toplevel || ! toplevel->isDirInfo() )
+    {
+	cerr << progName << ": Can't read " << qPrintable( dirName ) << std::endl;
+	return false;
+    }
+
+    if ( verbose )
+    {
+	cout << "Read " << toplevel->totalItems() << " items in "
+	     << timer.elapsed() / 1000.0 << " sec" << std::endl;
+    }
+
+    timer.restart();
+
+    if ( ! tree.writeCache( cacheFileName, longFormat ) )
+    {
+	cerr << progName << ": Error writing " << qPrintable( cacheFileName ) << std::endl;
+	return false;
+    }
+
+    if ( verbose )
+    {
+	cout << "Wrote " << qPrintable( cacheFileName ) << " in "
+	     << timer.elapsed() / 1000.0 << " sec" << std::endl;
+    }
+
+    return true;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    Logger logger( "/tmp/qdirstat-$USER", "qdirstat-cache-writer.log" );
+    logger.setLogLevel( LogSeverityInfo );
+
+    logInfo() << progName << " from QDirStat-" << QDIRSTAT_VERSION
+	      << " built with Qt " << QT_VERSION_STR
+	      << endl;
+
+    // Set org/app name for QSettings: Use the same exclude rules as QDirStat
+
+    QCoreApplication::setOrganizationName( "QDirStat" );
+    QCoreApplication::setApplicationName ( "QDirStat" );
+
+    // Only a QCoreApplication, not a QApplication: This has to work in cron
+    // jobs and on servers without any X display.
+
+    QCoreApplication app( argc, argv );
+
+    QStringList argList = QCoreApplication::arguments();
+    argList.removeFirst(); // Remove program name
+
+    bool longFormat	  = false;
+    bool crossFilesystems = false;
+    bool verbose	  = false;
+
+    while ( ! argList.isEmpty() && argList.first().startsWith( "-" ) )
+    {
+	QString opt = argList.takeFirst();
+
+	// Allow combined options like "-mv"
+
+	for ( int i=1; i < opt.size(); ++i )
+	{
+	    switch ( opt[i].toLatin1() )
+	    {
+		case 'l': longFormat	   = true;				break;
+		case 'm': crossFilesystems = true;				break;
+		case 'v': verbose	   = true;				break;
+		case 'd': logger.setLogLevel( LogSeverityDebug );		break;
+
+		case 'h':
+		    usage();
+		    return 0;
+
+		default:
+		    usage();
+		    return 1;
+	    }
+	}
+    }
+
+    if ( argList.isEmpty() || argList.size() > 2 )
+    {
+	usage();
+	return 1;
+    }
+
+    QString dirName = QFileInfo( argList.first() ).absoluteFilePath();
+    QString cacheFileName = argList.size() > 1 ?
+	argList.at( 1 ) : dirName + "/" + DEFAULT_CACHE_NAME;
+
+    ExcludeRules::instance()->readSettings();
+
+    return writeCacheFile( dirName, cacheFileName,
+			   longFormat, crossFilesystems, verbose ) ? 0 : 1;
+}
@@ -9,7 +9,10 @@
 
 #include "Attic.h"
 #include "DotEntry.h"
+#include "DirTree.h"
+#include "ChildNameIndex.h"
 #include "Exception.h"
+#include "SlabPool.h"
 #include "Logger.h"
 
 
@@ -20,15 +23,13 @@ Attic::Attic( DirTree * tree,
 	      DirInfo * parent )
     : DirInfo( tree, parent )
 {
-    _name      = atticName();
+    setName( atticName() );
     _isIgnored = true;
 
     if ( parent )
     {
-	_device = parent->device();
+	setAttributes( parent->device(), 0, parent->uid(), parent->gid() );
 	_mode	= parent->mode();
-	_uid	= parent->uid();
-	_gid	= parent->gid();
 	_mtime	= 0;
     }
 }
@@ -40,6 +41,29 @@ Attic::~Attic()
 }
 
 
+void * Attic::operator new( size_t size, DirTree * tree )
+{
+    return slabPool( tree )->alloc( size );
+}
+
+
+void Attic::operator delete( void * ptr, size_t size )
+{
+    if ( size == sizeof( Attic ) )
+	SlabPool::releaseObject( ptr );
+    else
+	::operator delete( ptr );	// See FileInfo::operator delete()
+}
+
+
+SlabPool * Attic::slabPool( DirTree * tree )
+{
+    static SlabPool pool( sizeof( Attic ), "Attic" );
+
+    return tree ? tree->atticPool() : &pool;
+}
+
+
 DirReadState Attic::readState() const
 {
     if ( _parent )
@@ -61,18 +85,33 @@ void Attic::checkIgnored()
 }
 
 
-FileInfo * Attic::locate( QString url, bool findPseudoDirs )
+FileInfo * Attic::locate( const QString & url, int pos, bool findPseudoDirs )
 {
     if ( ! _tree || ! _parent )
 	return 0;
 
-    // Search all children
+    // Search all children. An attic is transparent in the path, so there is
+    // no name of its own to skip.
+
+    const ChildNameIndex * index = childNameIndex();
+
+    if ( index )
+    {
+	int end = url.indexOf( '/', pos );
+
+	if ( end < 0 )
+	    end = url.length();
+
+	FileInfo * child = index->find( url, pos, end - pos );
+
+	return child ? child->locate( url, pos, findPseudoDirs ) : 0;
+    }
 
     FileInfo * child = firstChild();
 
     while ( child )
     {
-	FileInfo * foundChild = child->locate( url, findPseudoDirs );
+	FileInfo * foundChild = child->locate( url, pos, findPseudoDirs );
 
 	if ( foundChild )
 	    return foundChild;
@@ -45,6 +45,18 @@ namespace QDirStat
 	 **/
 	virtual ~Attic();
 
+	/**
+	 * Allocate from the Attic SlabPool of 'tree'. See
+	 * FileInfo::operator new().
+	 **/
+	static void * operator new( size_t size, DirTree * tree );
+	static void operator delete( void * ptr, size_t size );
+
+	/**
+	 * Return the SlabPool for Attic objects of 'tree'.
+	 **/
+	static SlabPool * slabPool( DirTree * tree );
+
 	/**
 	 * Check if this is an attic entry where ignored files and directories
 	 * are stored.
@@ -87,12 +99,16 @@ namespace QDirStat
 
 	/**
 	 * Locate a child somewhere in this subtree whose URL (i.e. complete
-	 * path) matches the URL passed. Returns 0 if there is no such child.
+	 * path) matches the part of 'url' starting at 'pos'. Returns 0 if
+	 * there is no such child.
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual FileInfo * locate( QString url,
-				   bool	   findPseudoDirs = false ) Q_DECL_OVERRIDE;
+	virtual FileInfo * locate( const QString & url,
+				   int		   pos,
+				   bool		   findPseudoDirs ) Q_DECL_OVERRIDE;
+
+	using FileInfo::locate;
 
     };	// class Attic
 
@@ -0,0 +1,527 @@
+/*
+ *   File name: BinaryCache.cpp
+ *   Summary:	Binary memory-mapped QDirStat cache file format
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/mman.h>	// mmap(), munmap(), madvise()
+#include <sys/stat.h>	// fstat()
+#include <fcntl.h>	// open()
+#include <unistd.h>	// close()
+#include <string.h>	// memcmp(), memcpy(), memset(), strlen()
+#include <zlib.h>
+
+#include "BinaryCache.h"
+#include "Logger.h"
+
+using namespace QDirStat;
+
+
+BinaryCacheWriter::BinaryCacheWriter( const QString & fileName,
+				      bool	      compress ):
+    _fileName( fileName ),
+    _file( 0 ),
+    _ok( true ),
+    _compress( compress ),
+    _pos( 0 ),
+    _blockRecords( 0 ),
+    _blockFirstDir( 0 ),
+    _recordCount( 0 ),
+    _dirCount( 0 )
+{
+    // Reserving the capacity keeps it when the buffers are emptied for the
+    // next block
+
+    _records.reserve( BINARY_CACHE_BLOCK_RECORDS * sizeof( BinaryCacheRecord ) );
+    _names.reserve( BINARY_CACHE_BLOCK_RECORDS * 16 );
+}
+
+
+BinaryCacheWriter::~BinaryCacheWriter()
+{
+    if ( _file )
+	fclose( _file );
+}
+
+
+bool BinaryCacheWriter::write( CacheSnapshot * snapshot )
+{
+    if ( ! _ok )
+	return false;
+
+    if ( ! snapshot || ! snapshot->ok() )
+    {
+	_errorMsg = snapshot ? snapshot->errorMsg() : QString( "No snapshot" );
+	_ok = false;
+
+	return false;
+    }
+
+    _file = fopen( _fileName.toUtf8(), "wb" );
+
+    if ( ! _file )
+    {
+	_errorMsg = QString( "Can't open %1: %2" ).arg( _fileName ).arg( formatErrno() );
+	_ok = false;
+
+	return false;
+    }
+
+    // Write a placeholder for the header first; the real one is only known
+    // when everything else is written.
+
+    BinaryCacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+    write( &header, sizeof( header ) );
+
+    CacheSnapshotEntry entry;
+
+    while ( _ok && snapshot->next( entry ) )
+	addEntry( entry );
+
+    while ( ! _openDirs.isEmpty() )
+	closeDir();
+
+    flushBlock();
+
+    memcpy( header.magic, BINARY_CACHE_MAGIC, BINARY_CACHE_MAGIC_LEN );
+    header.version	    = BINARY_CACHE_FORMAT_VERSION;
+    header.flags	    = BinaryCacheDirIndex;
+    header.recordSize	    = sizeof( BinaryCacheRecord );
+    header.blockCount	    = _blocks.size();
+    header.recordCount	    = _recordCount;
+    header.dirCount	    = _dirCount;
+    header.blockTableOffset = _pos;
+
+    if ( _compress )
+	header.flags |= BinaryCacheCompressed;
+
+    write( _blocks.constData(), _blocks.size() * sizeof( BinaryCacheBlock ) );
+
+    header.dirIndexOffset = _pos;
+    write( _dirIndex.constData(), _dirIndex.size() * sizeof( BinaryCacheDir ) );
+
+    if ( _ok )
+    {
+	if ( fseek( _file, 0, SEEK_SET ) != 0 ||
+	     fwrite( &header, sizeof( header ), 1, _file ) != 1 )
+	{
+	    _ok = false;
+	}
+    }
+
+    if ( fclose( _file ) != 0 )
+	_ok = false;
+
+    _file = 0;
+
+    if ( ! _ok )
+    {
+	_errorMsg = QString( "Error writing %1: %2" ).arg( _fileName ).arg( formatErrno() );
+    }
+    else if ( ! snapshot->ok() )
+    {
+	_errorMsg = QString( "Error writing %1: %2" ).arg( _fileName ).arg( snapshot->errorMsg() );
+	_ok = false;
+    }
+
+    return _ok;
+}
+
+
+void BinaryCacheWriter::addEntry( const CacheSnapshotEntry & entry )
+{
+    // The subtrees of the open directories at the same or a deeper level
+    // are complete
+
+    while ( ! _openDirs.isEmpty() && _openDirs.last().entry.depth >= entry.depth )
+	closeDir();
+
+    quint32 parentDir = _openDirs.isEmpty() ? BINARY_CACHE_NO_PARENT : _openDirs.last().dirNo;
+
+    if ( entry.isDirInfo )
+    {
+	OpenDir dir;
+
+	dir.entry = entry;
+	memset( &dir.subtree, 0, sizeof( dir.subtree ) );
+
+	addDirIndex();
+	addRecord( entry, parentDir );
+
+	dir.dirNo = _dirCount++;
+	_openDirs << dir;
+    }
+    else
+    {
+	addRecord( entry, parentDir );
+
+	if ( ! _openDirs.isEmpty() )
+	{
+	    BinaryCacheDir nothing;
+	    memset( &nothing, 0, sizeof( nothing ) );
+
+	    addToTotals( &_openDirs.last().subtree, entry, nothing );
+	}
+    }
+}
+
+
+void BinaryCacheWriter::closeDir()
+{
+    OpenDir dir = _openDirs.takeLast();
+    BinaryCacheDir & entry = _dirIndex[ dir.dirNo ];
+
+    dir.subtree.record	    = entry.record;
+    dir.subtree.latestMtime = qMax( dir.subtree.latestMtime, dir.entry.mtime );
+    dir.subtree.endDir	    = _dirCount;
+    entry		    = dir.subtree;
+
+    if ( ! _openDirs.isEmpty() )
+	addToTotals( &_openDirs.last().subtree, dir.entry, dir.subtree );
+}
+
+
+void BinaryCacheWriter::addToTotals( BinaryCacheDir *	       totals,
+				     const CacheSnapshotEntry & item,
+				     const BinaryCacheDir &	subtree )
+{
+    // The same as SummaryDelta::add(), but without asking any directory for
+    // its totals: They are added up here anyway.
+
+    totals->totalSize	       += subtree.totalSize	     + item.totalSize;
+    totals->totalAllocatedSize += subtree.totalAllocatedSize + item.totalAllocatedSize;
+    totals->totalBlocks	       += subtree.totalBlocks	     + item.totalBlocks;
+
+    // A FileAggregate counts as one file plus the others more
+
+    int aggregated = item.files > 0 ? item.files - 1 : 0;
+
+    totals->totalItems	 += subtree.totalItems + 1 + aggregated;
+    totals->totalSubDirs += subtree.totalSubDirs + ( S_ISDIR( item.mode ) ? 1 : 0 );
+    totals->totalFiles	 += subtree.totalFiles	 + ( S_ISREG( item.mode ) ? 1 + aggregated : 0 );
+
+    qint64 latestMtime = qMax( subtree.latestMtime, item.mtime );
+
+    if ( latestMtime > totals->latestMtime )
+	totals->latestMtime = latestMtime;
+
+    // Just like FileInfo::oldestFileMtime()
+
+    qint64 oldestFileMtime = subtree.oldestFileMtime;
+
+    if ( ! item.isDirInfo )
+    {
+	if ( item.files > 0 )
+	    oldestFileMtime = item.oldestMtime;
+	else
+	    oldestFileMtime = S_ISREG( item.mode ) ? item.mtime : 0;
+    }
+
+    if ( oldestFileMtime > 0 )
+    {
+	if ( totals->oldestFileMtime == 0 || oldestFileMtime < totals->oldestFileMtime )
+	    totals->oldestFileMtime = oldestFileMtime;
+    }
+}
+
+
+void BinaryCacheWriter::addDirIndex()
+{
+    BinaryCacheDir entry;
+    memset( &entry, 0, sizeof( entry ) );
+
+    entry.record = _recordCount;	// The rest is filled in by closeDir()
+    _dirIndex << entry;
+}
+
+
+void BinaryCacheWriter::addRecord( const CacheSnapshotEntry & entry, quint32 parentDir )
+{
+    if ( _blockRecords == BINARY_CACHE_BLOCK_RECORDS )
+	flushBlock();
+
+    if ( _blockRecords == 0 )
+	_blockFirstDir = _dirCount;
+
+    BinaryCacheRecord record;
+
+    record.size	       = entry.size;
+    record.blocks      = entry.blocks;
+    record.mtime       = entry.mtime;
+    record.oldestMtime = entry.oldestMtime;
+    record.parent      = parentDir;
+    record.mode	       = entry.isDirInfo ? ( entry.mode & ~S_IFMT ) | S_IFDIR : entry.mode;
+    record.links       = entry.links;
+    record.nameOffset  = _names.size();
+    record.nameLen     = entry.nameLen;
+    record.files       = entry.files;
+
+    _records.append( (const char *) &record, sizeof( record ) );
+    _names.append( entry.name, entry.nameLen );
+    _names.append( '\0' );
+
+    ++_blockRecords;
+    ++_recordCount;
+}
+
+
+void BinaryCacheWriter::flushBlock()
+{
+    if ( _blockRecords == 0 )
+	return;
+
+    BinaryCacheBlock info;
+
+    info.offset	     = _pos;
+    info.rawSize     = _records.size() + _names.size();
+    info.storedSize  = info.rawSize;
+    info.recordCount = _blockRecords;
+    info.namesOffset = _records.size();
+    info.firstDir    = _blockFirstDir;
+    info.reserved    = 0;
+
+    _records.append( _names );
+    const char * data = _records.constData();
+
+    if ( _compress )
+    {
+	uLongf compressedSize = compressBound( info.rawSize );
+	_compressed.resize( compressedSize );
+
+	int result = compress2( (Bytef *) _compressed.data(), &compressedSize,
+				(const Bytef *) data, info.rawSize,
+				Z_DEFAULT_COMPRESSION );
+
+	// Store the block uncompressed if that does not save anything
+
+	if ( result == Z_OK && compressedSize < info.rawSize )
+	{
+	    info.storedSize = compressedSize;
+	    data = _compressed.constData();
+	}
+    }
+
+    write( data, info.storedSize );
+    _blocks << info;
+
+    // The buffers keep their capacity for the next block
+
+    _records.resize( 0 );
+    _names.resize( 0 );
+    _blockRecords = 0;
+}
+
+
+void BinaryCacheWriter::write( const void * data, size_t size )
+{
+    static const char padding[ 8 ] = { 0 };
+
+    if ( ! _ok )
+	return;
+
+    size_t paddingSize = ( 8 - size % 8 ) % 8;
+
+    if ( fwrite( data,	  1, size,	  _file ) != size ||
+	 fwrite( padding, 1, paddingSize, _file ) != paddingSize )
+    {
+	_ok = false;
+	return;
+    }
+
+    _pos += size + paddingSize;
+}
+
+
+
+
+BinaryCacheFile::BinaryCacheFile( const QString & fileName ):
+    _fileName( fileName ),
+    _data( 0 ),
+    _size( 0 ),
+    _blockTable( 0 ),
+    _dirIndex( 0 )
+{
+    int fd = ::open( fileName.toUtf8(), O_RDONLY | O_CLOEXEC );
+
+    if ( fd < 0 )
+    {
+	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	return;
+    }
+
+    struct stat statInfo;
+
+    if ( ::fstat( fd, &statInfo ) == 0 &&
+	 statInfo.st_size >= (off_t) sizeof( BinaryCacheHeader ) )
+    {
+	void * data = ::mmap( 0, statInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+	if ( data != MAP_FAILED )
+	{
+	    _data = (const char *) data;
+	    _size = statInfo.st_size;
+	    ::madvise( data, _size, MADV_SEQUENTIAL );
+	}
+	else
+	{
+	    logError() << "Can't map " << fileName << ": " << formatErrno() << endl;
+	}
+    }
+    else
+    {
+	logError() << fileName << ": Not a binary cache file" << endl;
+    }
+
+    ::close( fd ); // The mapping remains valid
+
+    if ( _data && ! checkFile() )
+    {
+	::munmap( (void *) _data, _size );
+	_data = 0;
+	_size = 0;
+    }
+}
+
+
+BinaryCacheFile::~BinaryCacheFile()
+{
+    if ( _data )
+	::munmap( (void *) _data, _size );
+}
+
+
+bool BinaryCacheFile::checkFile()
+{
+    const BinaryCacheHeader & hdr = header();
+
+    if ( memcmp( hdr.magic, BINARY_CACHE_MAGIC, BINARY_CACHE_MAGIC_LEN ) != 0 )
+    {
+	logError() << _fileName << ": Unknown file format" << endl;
+	return false;
+    }
+
+    if ( hdr.version != BINARY_CACHE_FORMAT_VERSION )
+    {
+	logError() << _fileName << ": Incompatible cache file version" << endl;
+	return false;
+    }
+
+    if ( hdr.recordSize != sizeof( BinaryCacheRecord ) ||
+	 hdr.blockTableOffset % 8 != 0			||
+	 hdr.blockTableOffset > _size			||
+	 ( _size - hdr.blockTableOffset ) / sizeof( BinaryCacheBlock ) < hdr.blockCount )
+    {
+	logError() << _fileName << ": Corrupt cache file header" << endl;
+	return false;
+    }
+
+    _blockTable = (const BinaryCacheBlock *) ( _data + hdr.blockTableOffset );
+    quint64 recordCount = 0;
+
+    for ( quint32 i=0; i < hdr.blockCount; ++i )
+    {
+	const BinaryCacheBlock & info = _blockTable[i];
+
+	bool compressed = info.storedSize != info.rawSize;
+
+	// Only the last block may have fewer records than the others
+
+	bool fullBlock = info.recordCount == BINARY_CACHE_BLOCK_RECORDS;
+	bool lastBlock = i + 1 == hdr.blockCount;
+
+	if ( info.offset % 8 != 0			||
+	     info.offset > _size			||
+	     info.storedSize > _size - info.offset	||
+	     info.namesOffset != (quint64) info.recordCount * sizeof( BinaryCacheRecord ) ||
+	     info.namesOffset > info.rawSize		||
+	     info.recordCount > BINARY_CACHE_BLOCK_RECORDS ||
+	     ( ! fullBlock && ! lastBlock )		||
+	     ( compressed && ! ( hdr.flags & BinaryCacheCompressed ) ) )
+	{
+	    logError() << _fileName << ": Corrupt block table entry " << i << endl;
+	    return false;
+	}
+
+	recordCount += info.recordCount;
+    }
+
+    if ( recordCount != hdr.recordCount )
+    {
+	logError() << _fileName << ": Expected " << hdr.recordCount
+		   << " records, found " << recordCount << endl;
+	return false;
+    }
+
+    if ( hdr.flags & BinaryCacheDirIndex )
+    {
+	if ( hdr.dirIndexOffset % 8 != 0 ||
+	     hdr.dirIndexOffset > _size	 ||
+	     ( _size - hdr.dirIndexOffset ) / sizeof( BinaryCacheDir ) < hdr.dirCount )
+	{
+	    logError() << _fileName << ": Corrupt directory index" << endl;
+	    return false;
+	}
+
+	_dirIndex = (const BinaryCacheDir *) ( _data + hdr.dirIndexOffset );
+    }
+
+    logDebug() << _fileName << ": " << hdr.recordCount << " items in "
+	       << hdr.blockCount << " blocks" << endl;
+
+    return true;
+}
+
+
+quint64 BinaryCacheFile::subtreeEnd( quint32 dirNo ) const
+{
+    const BinaryCacheHeader & hdr = header();
+    quint32 endDir = _dirIndex[ dirNo ].endDir;
+
+    return endDir < hdr.dirCount ? _dirIndex[ endDir ].record : hdr.recordCount;
+}
+
+
+const char * BinaryCacheFile::block( int blockNo, QByteArray & buffer ) const
+{
+    const BinaryCacheBlock & info = _blockTable[ blockNo ];
+    const char * stored = _data + info.offset;
+
+    if ( info.storedSize == info.rawSize )
+	return stored;
+
+    buffer.resize( info.rawSize );
+    uLongf rawSize = info.rawSize;
+
+    int result = uncompress( (Bytef *) buffer.data(), &rawSize,
+			     (const Bytef *) stored, info.storedSize );
+
+    if ( result != Z_OK || rawSize != info.rawSize )
+    {
+	logError() << _fileName << ": Can't decompress block " << blockNo << endl;
+	return 0;
+    }
+
+    return buffer.constData();
+}
+
+
+bool BinaryCacheFile::isBinaryCache( const QString & fileName )
+{
+    FILE * file = fopen( fileName.toUtf8(), "rb" );
+
+    if ( ! file )
+	return false;
+
+    char magic[ BINARY_CACHE_MAGIC_LEN ];
+
+    bool binary = fread( magic, 1, sizeof( magic ), file ) == sizeof( magic ) &&
+	memcmp( magic, BINARY_CACHE_MAGIC, BINARY_CACHE_MAGIC_LEN ) == 0;
+
+    fclose( file );
+
+    return binary;
+}
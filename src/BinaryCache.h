@@ -0,0 +1,396 @@
+/*
+ *   File name: BinaryCache.h
+ *   Summary:	Binary memory-mapped QDirStat cache file format
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef BinaryCache_h
+#define BinaryCache_h
+
+
+#include <stdio.h>
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QList>
+
+#include "CacheSnapshot.h"
+
+
+// The first 16 bytes of a binary cache file. The ^Z makes "cat" and "type"
+// stop there, the newline makes "head -1" show something useful.
+#define BINARY_CACHE_MAGIC		"QDirStatCache\n\032"
+#define BINARY_CACHE_MAGIC_LEN		16
+
+#define BINARY_CACHE_FORMAT_VERSION	2
+
+// Number of records in one block of a binary cache file
+#define BINARY_CACHE_BLOCK_RECORDS	16384
+
+// Parent dir number of the toplevel directory of a binary cache file
+#define BINARY_CACHE_NO_PARENT		0xFFFFFFFFu
+
+
+namespace QDirStat
+{
+    /**
+     * Flags in BinaryCacheHeader::flags
+     **/
+    enum BinaryCacheFlags
+    {
+	BinaryCacheCompressed = 0x01,	// Blocks may be zlib-compressed
+	BinaryCacheDirIndex   = 0x02	// The file has a directory index
+    };
+
+
+    /**
+     * The header at the start of a binary cache file.
+     *
+     * All numbers are in the native byte order of the machine that wrote
+     * the file; a reader on a machine with a different byte order will
+     * not recognize the version number and refuse the file.
+     **/
+    struct BinaryCacheHeader
+    {
+	char	magic[ BINARY_CACHE_MAGIC_LEN ];
+	quint32 version;		// BINARY_CACHE_FORMAT_VERSION
+	quint32 flags;			// BinaryCacheFlags
+	quint32 recordSize;		// sizeof( BinaryCacheRecord )
+	quint32 blockCount;
+	quint64 recordCount;
+	quint64 dirCount;
+	quint64 blockTableOffset;	// Offset of blockCount BinaryCacheBlocks
+	quint64 dirIndexOffset;		// Offset of dirCount BinaryCacheDirs or 0
+    };
+
+
+    /**
+     * One entry of the block table of a binary cache file.
+     *
+     * A block is 'recordCount' BinaryCacheRecords followed by the names of
+     * those records, each one terminated with a 0 byte. If the block is
+     * stored compressed (storedSize != rawSize), it is compressed as a
+     * whole with zlib's compress2().
+     *
+     * All blocks but the last one have BINARY_CACHE_BLOCK_RECORDS records,
+     * so record no. 'n' of the file is in block no. 'n' /
+     * BINARY_CACHE_BLOCK_RECORDS.
+     **/
+    struct BinaryCacheBlock
+    {
+	quint64 offset;			// File offset of the block (8-aligned)
+	quint32 storedSize;		// Size in the file
+	quint32 rawSize;		// Size after decompressing
+	quint32 recordCount;
+	quint32 namesOffset;		// Offset of the names in the raw block
+	quint32 firstDir;		// Dir number of the first dir in the block
+	quint32 reserved;
+    };
+
+
+    /**
+     * One item in a binary cache file.
+     *
+     * The records are in the same order as the items of a text cache file:
+     * Each directory is followed by its files and then by its
+     * subdirectories, so a parent always comes before its children. The
+     * directories are numbered in the order they appear in the file;
+     * 'parent' is the number of the parent directory, not a record index.
+     *
+     * The toplevel directory has the full path as its name; all others only
+     * their name without path.
+     *
+     * A FileAggregate has the number of its files in 'files' and the mtime
+     * of its oldest file in 'oldestMtime'.
+     **/
+    struct BinaryCacheRecord
+    {
+	qint64	size;			// Byte size as in FileInfo::rawByteSize()
+	qint64	blocks;			// 512 byte blocks or -1 if not sparse
+	qint64	mtime;
+	qint64	oldestMtime;		// Oldest file of a FileAggregate, otherwise 0
+	quint32 parent;			// Dir number or BINARY_CACHE_NO_PARENT
+	quint32 mode;
+	quint32 links;
+	quint32 nameOffset;		// Offset in the names of the block
+	quint32 nameLen;		// Without the terminating 0 byte
+	quint32 files;			// Files of a FileAggregate, otherwise 0
+    };
+
+
+    /**
+     * One entry of the directory index of a binary cache file: Where the
+     * subtree of a directory is, and what it adds up to.
+     *
+     * The subtree of a directory are the records after the directory's own
+     * record up to the record of directory no. 'endDir' (or the end of the
+     * file): Files are written before the subdirectories, so that is
+     * always a directory.
+     *
+     * The totals are those of the subtree without the directory itself.
+     * With them, a reader can show a directory with the correct sums and
+     * read its subtree only when somebody wants to see it.
+     **/
+    struct BinaryCacheDir
+    {
+	quint64 record;			// Record number of the directory
+	qint64	totalSize;
+	qint64	totalAllocatedSize;
+	qint64	totalBlocks;
+	qint64	latestMtime;		// Including the directory itself
+	qint64	oldestFileMtime;	// 0 if there are no files
+	quint32 totalItems;
+	quint32 totalSubDirs;
+	quint32 totalFiles;
+	quint32 endDir;			// Number of the first dir after the subtree
+    };
+
+
+    /**
+     * Writer for binary cache files.
+     *
+     * This writes the same items as the text format (see CacheWriter), but
+     * as fixed-size records in blocks that a reader can use directly from
+     * a memory-mapped file without any parsing, and a directory index (see
+     * BinaryCacheDir) so a reader can skip subtrees.
+     **/
+    class BinaryCacheWriter
+    {
+    public:
+
+	/**
+	 * Constructor for a writer for file 'fileName'. If 'compress' is
+	 * true, each block is compressed with zlib if that makes it any
+	 * smaller.
+	 *
+	 * This does not write anything yet; see write().
+	 **/
+	BinaryCacheWriter( const QString & fileName,
+			   bool		   compress = true );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~BinaryCacheWriter();
+
+	/**
+	 * Write the items of 'snapshot' to the cache file. Each block is
+	 * compressed and written as soon as it is full; only the block table
+	 * and the directory index are kept in memory until the end.
+	 *
+	 * This does not access any tree and does not log anything, so it can
+	 * run in any thread; see errorMsg().
+	 *
+	 * Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool write( CacheSnapshot * snapshot );
+
+	/**
+	 * Returns true if writing the cache file went OK.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Return what went wrong if ok() returns 'false'.
+	 **/
+	const QString & errorMsg() const { return _errorMsg; }
+
+	/**
+	 * Return the number of records written so far.
+	 **/
+	quint64 recordCount() const { return _recordCount; }
+
+
+    protected:
+
+	/**
+	 * A directory whose subtree is still being written.
+	 **/
+	struct OpenDir
+	{
+	    CacheSnapshotEntry	entry;
+	    quint32		dirNo;
+	    BinaryCacheDir	subtree;	// The totals so far
+	};
+
+	/**
+	 * Add the record for 'entry' after closing the directories that
+	 * 'entry' is not in.
+	 **/
+	void addEntry( const CacheSnapshotEntry & entry );
+
+	/**
+	 * Finish the directory index entry of the innermost open directory
+	 * and add what it adds up to to the totals of its parent.
+	 **/
+	void closeDir();
+
+	/**
+	 * Add what 'item' with the totals 'subtree' of everything below it
+	 * adds to the totals of its parent to 'totals'.
+	 **/
+	static void addToTotals( BinaryCacheDir *	      totals,
+				 const CacheSnapshotEntry & item,
+				 const BinaryCacheDir &	      subtree );
+
+	/**
+	 * Add the directory index entry for the directory record that is
+	 * about to be written. Everything else in that entry is only known
+	 * after its subtree was written.
+	 **/
+	void addDirIndex();
+
+	/**
+	 * Add one record for 'entry' to the current block.
+	 **/
+	void addRecord( const CacheSnapshotEntry & entry, quint32 parentDir );
+
+	/**
+	 * Compress and write the current block if it is not empty.
+	 **/
+	void flushBlock();
+
+	/**
+	 * Write 'size' bytes of 'data' and pad them to a multiple of 8 bytes.
+	 **/
+	void write( const void * data, size_t size );
+
+
+	//
+	// Data members
+	//
+
+	QString			    _fileName;
+	FILE *			    _file;
+	bool			    _ok;
+	QString			    _errorMsg;
+	bool			    _compress;
+	qint64			    _pos;
+	QByteArray		    _records;
+	QByteArray		    _names;
+	QByteArray		    _compressed;
+	quint32			    _blockRecords;
+	quint32			    _blockFirstDir;
+	quint64			    _recordCount;
+	quint32			    _dirCount;
+	QVector<BinaryCacheBlock>   _blocks;
+	QVector<BinaryCacheDir>	    _dirIndex;
+	QList<OpenDir>		    _openDirs;
+
+    };	// class BinaryCacheWriter
+
+
+    /**
+     * Read access to a binary cache file: The complete file is mapped into
+     * memory, and blocks that are stored uncompressed are used right from
+     * there.
+     **/
+    class BinaryCacheFile
+    {
+    public:
+
+	/**
+	 * Open and map 'fileName' and check its header and block table.
+	 * Check ok() to see if that went OK.
+	 **/
+	BinaryCacheFile( const QString & fileName );
+
+	/**
+	 * Destructor. This unmaps the file.
+	 **/
+	virtual ~BinaryCacheFile();
+
+	/**
+	 * Return 'true' if the file is a valid binary cache file.
+	 **/
+	bool ok() const { return _data != 0; }
+
+	/**
+	 * Return the name of the file.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Return the header of the file.
+	 **/
+	const BinaryCacheHeader & header() const
+	    { return *( (const BinaryCacheHeader *) _data ); }
+
+	/**
+	 * Return the number of blocks.
+	 **/
+	int blockCount() const { return ok() ? header().blockCount : 0; }
+
+	/**
+	 * Return the block table entry for block no. 'blockNo'.
+	 **/
+	const BinaryCacheBlock & blockInfo( int blockNo ) const
+	    { return _blockTable[ blockNo ]; }
+
+	/**
+	 * Return 'true' if the file has a directory index.
+	 **/
+	bool hasDirIndex() const { return _dirIndex != 0; }
+
+	/**
+	 * Return the directory index entry for directory no. 'dirNo'. Use
+	 * this only if hasDirIndex() returns 'true'.
+	 **/
+	const BinaryCacheDir & dirInfo( quint32 dirNo ) const
+	    { return _dirIndex[ dirNo ]; }
+
+	/**
+	 * Return the number of the record after the subtree of directory
+	 * no. 'dirNo'. Use this only if hasDirIndex() returns 'true'.
+	 **/
+	quint64 subtreeEnd( quint32 dirNo ) const;
+
+	/**
+	 * Return the raw (uncompressed) content of block no. 'blockNo': The
+	 * records start at the returned pointer, the names at
+	 * blockInfo().namesOffset after it. If the block needs to be
+	 * decompressed, that happens in 'buffer', so the result is only valid
+	 * as long as 'buffer' is not modified.
+	 *
+	 * This does not change the BinaryCacheFile, so different threads can
+	 * do this for different blocks at the same time, each with its own
+	 * buffer.
+	 *
+	 * Return 0 if the block cannot be decompressed.
+	 **/
+	const char * block( int blockNo, QByteArray & buffer ) const;
+
+	/**
+	 * Return 'true' if 'fileName' starts with the binary cache magic.
+	 **/
+	static bool isBinaryCache( const QString & fileName );
+
+
+    protected:
+
+	/**
+	 * Check the header and the block table. Return 'true' if OK.
+	 **/
+	bool checkFile();
+
+
+	//
+	// Data members
+	//
+
+	QString			    _fileName;
+	const char *		    _data;
+	size_t			    _size;
+	const BinaryCacheBlock *    _blockTable;
+	const BinaryCacheDir *	    _dirIndex;
+
+    };	// class BinaryCacheFile
+
+}	// namespace QDirStat
+
+
+#endif // ifndef BinaryCache_h
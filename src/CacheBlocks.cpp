@@ -0,0 +1,562 @@
+/*
+ *   File name: CacheBlocks.cpp
+ *   Summary:	Independently compressed blocks of QDirStat text cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/mman.h>	// mmap(), munmap(), madvise()
+#include <sys/stat.h>	// fstat()
+#include <fcntl.h>	// open()
+#include <unistd.h>	// close()
+#include <string.h>	// memchr(), memcpy(), memset()
+#include <limits.h>	// INT_MAX
+
+#include <QThread>
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QUrl>
+
+#include "CacheBlocks.h"
+#include "DirTreeCache.h"
+#include "Logger.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Runnable for QThreadPool that parses one block of a cache file.
+     **/
+    class CacheBlockParser: public QRunnable
+    {
+    public:
+
+	CacheBlockParser( CacheBlockFile * file, int blockNo ):
+	    _file( file ),
+	    _blockNo( blockNo )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    _file->blockParsed( _blockNo, _file->parseBlock( _blockNo ) );
+	}
+
+    protected:
+
+	CacheBlockFile * _file;
+	int		 _blockNo;
+    };
+
+
+    /**
+     * Runnable for QThreadPool that compresses one block of a cache file.
+     **/
+    class CacheBlockCompressor: public QRunnable
+    {
+    public:
+
+	CacheBlockCompressor( CacheBlockWriter * writer, int blockNo, const QByteArray & block ):
+	    _writer( writer ),
+	    _blockNo( blockNo ),
+	    _block( block )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    _writer->blockCompressed( _blockNo, CacheBlockWriter::compressBlock( _block ) );
+	}
+
+    protected:
+
+	CacheBlockWriter * _writer;
+	int		   _blockNo;
+	QByteArray	   _block;
+    };
+}
+
+
+static void putLE32( unsigned char * dest, quint32 value )
+{
+    dest[0] = value	  & 0xFF;
+    dest[1] = ( value >> 8  ) & 0xFF;
+    dest[2] = ( value >> 16 ) & 0xFF;
+    dest[3] = ( value >> 24 ) & 0xFF;
+}
+
+
+static quint32 getLE32( const unsigned char * src )
+{
+    return (quint32) src[0]	    |
+	( (quint32) src[1] << 8	  ) |
+	( (quint32) src[2] << 16  ) |
+	( (quint32) src[3] << 24  );
+}
+
+
+/**
+ * Return the unescaped UTF-8 version of 'rawPath' with duplicate slashes
+ * removed. This is the same as CacheReader::unescapedPath(), but without a
+ * QRegExp that would have to be shared between the threads.
+ **/
+static QByteArray unescapedPath( const char * rawPath )
+{
+    // Using a protocol part to avoid directory names with a colon ":"
+    // being cut off because it looks like a URL protocol.
+
+    QByteArray url( "foo:" );
+
+    for ( const char * pos = rawPath; *pos; ++pos )
+    {
+	if ( *pos != '/' || ! url.endsWith( '/' ) )
+	    url += *pos;
+    }
+
+    return QUrl::fromEncoded( url ).path().toUtf8();
+}
+
+
+
+
+CacheBlockWriter::CacheBlockWriter( const QString & fileName ):
+    _file( 0 ),
+    _ok( false ),
+    _nextBlockNo( 0 ),
+    _writtenBlockNo( 0 )
+{
+    int threads = qMax( QThread::idealThreadCount(), 1 );
+    _threadPool.setMaxThreadCount( threads );
+    _maxAhead = threads * CACHE_BLOCKS_AHEAD_PER_THREAD;
+
+    _file = fopen( fileName.toUtf8(), "wb" );
+
+    if ( ! _file )
+    {
+	_errorMsg = QString( "Can't open %1: %2" ).arg( fileName ).arg( formatErrno() );
+	return;
+    }
+
+    _ok = true;
+}
+
+
+CacheBlockWriter::~CacheBlockWriter()
+{
+    // The workers must not call blockCompressed() any more
+
+    _threadPool.waitForDone();
+
+    if ( _file )
+	fclose( _file );
+}
+
+
+void CacheBlockWriter::writeBlock( const QByteArray & block )
+{
+    if ( ! _ok || block.isEmpty() )
+	return;
+
+    // Don't let the caller run away too far with blocks that all need to
+    // be kept in memory
+
+    writeCompressed( _nextBlockNo - _maxAhead + 1 );
+
+    CacheBlockCompressor * compressor = new CacheBlockCompressor( this, _nextBlockNo++, block );
+    CHECK_NEW( compressor );
+
+    _threadPool.start( compressor );
+}
+
+
+void CacheBlockWriter::blockCompressed( int blockNo, const QByteArray & compressed )
+{
+    QMutexLocker locker( &_mutex );
+
+    _compressedBlocks.insert( blockNo, compressed );
+    _blockDone.wakeAll();
+}
+
+
+void CacheBlockWriter::writeCompressed( int endBlockNo )
+{
+    while ( _writtenBlockNo < endBlockNo )
+    {
+	QByteArray compressed;
+
+	{
+	    QMutexLocker locker( &_mutex );
+
+	    while ( ! _compressedBlocks.contains( _writtenBlockNo ) )
+		_blockDone.wait( &_mutex );
+
+	    compressed = _compressedBlocks.take( _writtenBlockNo++ );
+	}
+
+	if ( ! _ok )
+	    continue;
+
+	if ( compressed.isEmpty() )
+	{
+	    _errorMsg = "Compressing a cache block failed";
+	    _ok = false;
+	}
+	else if ( fwrite( compressed.constData(), 1, compressed.size(), _file ) != (size_t) compressed.size() )
+	{
+	    _errorMsg = QString( "Write error: %1" ).arg( formatErrno() );
+	    _ok = false;
+	}
+    }
+}
+
+
+QByteArray CacheBlockWriter::compressBlock( const QByteArray & block )
+{
+    z_stream zStream;
+    memset( &zStream, 0, sizeof( zStream ) );
+
+    // Raw deflate data: The gzip header and trailer are written here
+
+    if ( deflateInit2( &zStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+		       -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+    {
+	return QByteArray();
+    }
+
+    int size	= block.size();
+    int maxSize = CACHE_BLOCK_HEADER_SIZE + deflateBound( &zStream, size ) + 8;
+    QByteArray compressed( maxSize, '\0' );
+    unsigned char * out = (unsigned char *) compressed.data();
+
+    zStream.next_in   = (Bytef *) block.constData();
+    zStream.avail_in  = size;
+    zStream.next_out  = out + CACHE_BLOCK_HEADER_SIZE;
+    zStream.avail_out = maxSize - CACHE_BLOCK_HEADER_SIZE - 8;
+
+    int result = deflate( &zStream, Z_FINISH );
+    quint32 storedSize = CACHE_BLOCK_HEADER_SIZE + zStream.total_out + 8;
+    deflateEnd( &zStream );
+
+    if ( result != Z_STREAM_END )
+	return QByteArray();
+
+
+    // gzip header with an extra field with the "QB" subfield
+
+    static const unsigned char gzipHeader[] =
+    {
+	0x1f, 0x8b,		// Magic
+	8,			// Deflate
+	0x04,			// FEXTRA
+	0, 0, 0, 0,		// MTIME
+	0,			// XFL
+	3,			// OS: Unix
+	12, 0,			// XLEN
+	'Q', 'B',		// Subfield ID
+	8, 0			// Subfield length
+    };
+
+    memcpy( out, gzipHeader, sizeof( gzipHeader ) );
+    putLE32( out + 16, storedSize );
+    putLE32( out + 20, size );
+
+
+    // gzip trailer
+
+    unsigned char * trailer = out + storedSize - 8;
+    putLE32( trailer,	  crc32( 0, (const Bytef *) block.constData(), size ) );
+    putLE32( trailer + 4, size );
+
+    compressed.resize( storedSize );
+
+    return compressed;
+}
+
+
+bool CacheBlockWriter::close()
+{
+    if ( _file )
+    {
+	writeCompressed( _nextBlockNo );
+
+	if ( fclose( _file ) != 0 && _ok )
+	{
+	    _errorMsg = QString( "Write error: %1" ).arg( formatErrno() );
+	    _ok = false;
+	}
+
+	_file = 0;
+    }
+
+    return _ok;
+}
+
+
+
+
+CacheBlockFile::CacheBlockFile( const QString & fileName ):
+    _fileName( fileName ),
+    _data( 0 ),
+    _size( 0 ),
+    _nextBlockNo( 0 )
+{
+    int threads = qMax( QThread::idealThreadCount(), 1 );
+    _threadPool.setMaxThreadCount( threads );
+    _maxAhead = threads * CACHE_BLOCKS_AHEAD_PER_THREAD;
+
+    int fd = ::open( fileName.toUtf8(), O_RDONLY | O_CLOEXEC );
+
+    if ( fd < 0 )
+	return;
+
+    struct stat statInfo;
+
+    if ( ::fstat( fd, &statInfo ) == 0 && statInfo.st_size > 0 )
+    {
+	void * data = ::mmap( 0, statInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+	if ( data != MAP_FAILED )
+	{
+	    _data = (const char *) data;
+	    _size = statInfo.st_size;
+	}
+    }
+
+    ::close( fd ); // The mapping remains valid
+
+    if ( _data && ! findBlocks() )
+    {
+	_blocks.clear();
+	::munmap( (void *) _data, _size );
+	_data = 0;
+	_size = 0;
+    }
+}
+
+
+CacheBlockFile::~CacheBlockFile()
+{
+    _threadPool.clear();
+    _threadPool.waitForDone();
+    qDeleteAll( _parsedBlocks );
+
+    if ( _data )
+	::munmap( (void *) _data, _size );
+}
+
+
+bool CacheBlockFile::findBlocks()
+{
+    size_t offset = 0;
+
+    while ( offset < _size )
+    {
+	const unsigned char * header = (const unsigned char *) _data + offset;
+
+	if ( _size - offset < CACHE_BLOCK_HEADER_SIZE + 8 ||
+	     header[0]	!= 0x1f || header[1]  != 0x8b ||
+	     header[2]	!= 8	|| header[3]  != 0x04 ||
+	     header[10] != 12	|| header[11] != 0    ||
+	     header[12] != 'Q'	|| header[13] != 'B'  ||
+	     header[14] != 8	|| header[15] != 0 )
+	{
+	    // Not written by CacheBlockWriter (or truncated)
+	    return false;
+	}
+
+	CacheBlock block;
+	block.offset	 = offset;
+	block.storedSize = getLE32( header + 16 );
+	block.rawSize	 = getLE32( header + 20 );
+
+	if ( block.storedSize < CACHE_BLOCK_HEADER_SIZE + 8 ||
+	     block.storedSize > _size - offset		    ||
+	     block.rawSize    > INT_MAX - 1 )
+	{
+	    return false;
+	}
+
+	_blocks << block;
+	offset += block.storedSize;
+    }
+
+    logDebug() << _fileName << ": " << _blocks.size() << " blocks" << endl;
+
+    return ! _blocks.isEmpty();
+}
+
+
+ParsedCacheBlock * CacheBlockFile::takeBlock( int blockNo )
+{
+    startParsing( qMin( blockNo + _maxAhead, _blocks.size() ) );
+
+    QMutexLocker locker( &_mutex );
+
+    while ( ! _parsedBlocks.contains( blockNo ) )
+	_blockDone.wait( &_mutex );
+
+    return _parsedBlocks.take( blockNo );
+}
+
+
+void CacheBlockFile::startParsing( int endBlockNo )
+{
+    while ( _nextBlockNo < endBlockNo )
+    {
+	CacheBlockParser * parser = new CacheBlockParser( this, _nextBlockNo++ );
+	CHECK_NEW( parser );
+
+	_threadPool.start( parser );
+    }
+}
+
+
+void CacheBlockFile::blockParsed( int blockNo, ParsedCacheBlock * block )
+{
+    QMutexLocker locker( &_mutex );
+
+    _parsedBlocks.insert( blockNo, block );
+    _blockDone.wakeAll();
+}
+
+
+ParsedCacheBlock * CacheBlockFile::parseBlock( int blockNo ) const
+{
+    const CacheBlock & info = _blocks[ blockNo ];
+
+    ParsedCacheBlock * block = new ParsedCacheBlock;
+    CHECK_NEW( block );
+
+    block->syntaxErrors = 0;
+    block->ok		= false;
+
+
+    // Decompress the block
+
+    const unsigned char * stored = (const unsigned char *) _data + info.offset;
+    QByteArray raw( info.rawSize + 1, '\0' );
+
+    z_stream zStream;
+    memset( &zStream, 0, sizeof( zStream ) );
+
+    if ( inflateInit2( &zStream, -MAX_WBITS ) != Z_OK )
+    {
+	block->errorMsg = "Can't initialize zlib";
+	return block;
+    }
+
+    zStream.next_in   = (Bytef *) stored + CACHE_BLOCK_HEADER_SIZE;
+    zStream.avail_in  = info.storedSize - CACHE_BLOCK_HEADER_SIZE - 8;
+    zStream.next_out  = (Bytef *) raw.data();
+    zStream.avail_out = info.rawSize;
+
+    int result = inflate( &zStream, Z_FINISH );
+    inflateEnd( &zStream );
+
+    const unsigned char * trailer = stored + info.storedSize - 8;
+
+    if ( result != Z_STREAM_END ||
+	 zStream.total_out != info.rawSize ||
+	 crc32( 0, (const Bytef *) raw.constData(), info.rawSize ) != getLE32( trailer ) )
+    {
+	// This runs in a worker thread: Leave logging to the main thread
+
+	block->errorMsg = QString( "Can't decompress block %1" ).arg( blockNo );
+	return block;
+    }
+
+    block->ok = true;
+
+
+    // Split it into lines and the lines into fields
+
+    block->items.reserve( info.rawSize / 32 );
+    block->names.reserve( info.rawSize / 2 );
+
+    char * line	    = raw.data();
+    char * end	    = line + info.rawSize;
+    char * fields[ MAX_FIELDS_PER_LINE ];
+
+    while ( line < end )
+    {
+	char * newline = (char *) memchr( line, '\n', end - line );
+	char * next    = newline ? newline + 1 : end;
+
+	if ( newline )
+	    *newline = 0;
+
+	line = CacheReader::skipWhiteSpace( line );
+	CacheReader::killTrailingWhiteSpace( line );
+
+	// Skip empty lines, comments and the file header
+
+	if ( *line && *line != '#' && *line != '[' )
+	{
+	    int fieldsCount = 0;
+	    char * current  = line;
+
+	    while ( current && *current && fieldsCount < MAX_FIELDS_PER_LINE-1 )
+	    {
+		fields[ fieldsCount++ ] = current;
+		current = CacheReader::findNextWhiteSpace( current );
+
+		if ( current )
+		{
+		    *current++ = 0;
+		    current = CacheReader::skipWhiteSpace( current );
+		}
+	    }
+
+	    if ( ! addItem( fields, fieldsCount, block ) )
+		++block->syntaxErrors;
+	}
+
+	line = next;
+    }
+
+    return block;
+}
+
+
+bool CacheBlockFile::addItem( char ** fields, int fieldsCount, ParsedCacheBlock * block )
+{
+    CacheItem item;
+
+    if ( ! CacheReader::parseItem( fields, fieldsCount, item ) )
+	return false;
+
+    ParsedCacheItem parsed;
+
+    parsed.size	      = item.size;
+    parsed.blocks     = item.blocks;
+    parsed.mtime      = item.mtime;
+    parsed.mode	      = item.mode;
+    parsed.links      = item.links;
+    parsed.files      = item.files;
+    parsed.oldestMtime = item.oldestMtime;
+    parsed.absolute   = *item.rawPath == '/';
+    parsed.nameOffset = block->names.size();
+
+    if ( CacheReader::isPlainName( item.rawPath ) )
+	block->names.append( item.rawPath );
+    else
+	block->names.append( unescapedPath( item.rawPath ) );
+
+    // Remove a trailing slash unless this is the root directory
+
+    if ( parsed.absolute &&
+	 block->names.size() - parsed.nameOffset > 1 &&
+	 block->names.endsWith( '/' ) )
+    {
+	block->names.chop( 1 );
+    }
+
+    parsed.nameLen = block->names.size() - parsed.nameOffset;
+    block->names.append( '\0' );
+    block->items << parsed;
+
+    return true;
+}
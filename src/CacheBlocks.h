@@ -0,0 +1,285 @@
+/*
+ *   File name: CacheBlocks.h
+ *   Summary:	Independently compressed blocks of QDirStat text cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheBlocks_h
+#define CacheBlocks_h
+
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "FileInfo.h"	// FileSize
+
+
+// Uncompressed size after which the cache writer starts a new block with the
+// next directory
+#define CACHE_BLOCK_SIZE		( 1024 * 1024 )
+
+// Size of the gzip header of one block including the extra field
+#define CACHE_BLOCK_HEADER_SIZE		24
+
+// Number of blocks to parse ahead for each thread
+#define CACHE_BLOCKS_AHEAD_PER_THREAD	2
+
+
+namespace QDirStat
+{
+    /**
+     * One block of a text cache file in the file: A complete gzip member.
+     **/
+    struct CacheBlock
+    {
+	qint64	offset;
+	quint32 storedSize;	// Complete gzip member
+	quint32 rawSize;	// Uncompressed
+    };
+
+
+    /**
+     * Writer for the blocks of a text cache file.
+     *
+     * Each block is written as a gzip member of its own, so the file can
+     * still be read by anything that reads gzip files, including older
+     * versions of QDirStat: gzip files may consist of any number of
+     * members that are simply concatenated.
+     *
+     * The gzip header of each block has an extra field with subfield ID
+     * "QB" that contains the size of the block in the file and
+     * uncompressed (like the "BC" subfield of BGZF). This is the block
+     * index: A reader can find all the blocks by reading only their
+     * headers, and decompress them independently of each other.
+     *
+     * Since the blocks are independent, they are compressed in a thread
+     * pool while the caller formats the next ones; they are written to the
+     * file in order as they become ready.
+     *
+     * This does not log anything, so it can be used from any thread; see
+     * errorMsg().
+     **/
+    class CacheBlockWriter
+    {
+    public:
+
+	/**
+	 * Open 'fileName' for writing. Check ok() to see if that worked.
+	 **/
+	CacheBlockWriter( const QString & fileName );
+
+	/**
+	 * Destructor. This waits for the blocks that are still being
+	 * compressed and closes the file if that did not happen yet.
+	 **/
+	virtual ~CacheBlockWriter();
+
+	/**
+	 * Returns true if everything went OK so far.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Return what went wrong if ok() returns 'false'.
+	 **/
+	const QString & errorMsg() const { return _errorMsg; }
+
+	/**
+	 * Compress 'block' and write it as one block. This only waits if
+	 * too many blocks are already waiting to be compressed.
+	 *
+	 * 'block' is implicitly shared, so the caller should not modify it
+	 * afterwards, but start a new one.
+	 **/
+	void writeBlock( const QByteArray & block );
+
+	/**
+	 * Write all remaining blocks and close the file. Return 'true' if
+	 * everything went OK.
+	 **/
+	bool close();
+
+	/**
+	 * Compress 'block' to a complete gzip member with the "QB" extra
+	 * field. Return an empty byte array if that fails. This is called in
+	 * the worker threads.
+	 **/
+	static QByteArray compressBlock( const QByteArray & block );
+
+	/**
+	 * Store the result of a worker thread and wake up the writing thread
+	 * if it is waiting for it.
+	 **/
+	void blockCompressed( int blockNo, const QByteArray & compressed );
+
+
+    protected:
+
+	/**
+	 * Wait for the compressed blocks up to 'endBlockNo' (excluding) and
+	 * write them to the file.
+	 **/
+	void writeCompressed( int endBlockNo );
+
+
+	//
+	// Data members
+	//
+
+	FILE *			_file;
+	bool			_ok;
+	QString			_errorMsg;
+	QThreadPool		_threadPool;
+	int			_nextBlockNo;	// Next one to start
+	int			_writtenBlockNo; // Next one to write
+	int			_maxAhead;
+	QMutex			_mutex;
+	QWaitCondition		_blockDone;
+	QHash<int, QByteArray>	_compressedBlocks;
+
+    };	// class CacheBlockWriter
+
+
+    /**
+     * One item of a text cache file that was parsed in a worker thread.
+     **/
+    struct ParsedCacheItem
+    {
+	FileSize	size;
+	FileSize	blocks;		// -1 if not sparse
+	time_t		mtime;
+	mode_t		mode;
+	nlink_t		links;
+	int		files;		// Files of a FileAggregate, otherwise 0
+	time_t		oldestMtime;	// Oldest mtime of a FileAggregate
+	quint32		nameOffset;	// In ParsedCacheBlock::names
+	quint32		nameLen;
+	bool		absolute;	// Name is an absolute path
+    };
+
+
+    /**
+     * The parsed content of one block.
+     **/
+    struct ParsedCacheBlock
+    {
+	QVector<ParsedCacheItem> items;
+	QByteArray		 names;		// Unescaped, 0-terminated
+	int			 syntaxErrors;
+	bool			 ok;		// false if decompressing failed
+	QString			 errorMsg;	// Why it failed; logged by the reader
+    };
+
+
+    /**
+     * Read access to a text cache file that consists of blocks written by
+     * CacheBlockWriter: The blocks are decompressed and parsed in a thread
+     * pool, a few blocks ahead of the block that the main thread currently
+     * adds to the tree.
+     *
+     * Only the creation of the tree nodes is left for the main thread: The
+     * node memory pools and the name pools are not thread-safe.
+     **/
+    class CacheBlockFile
+    {
+    public:
+
+	/**
+	 * Open and map 'fileName' and find its blocks. Check ok() to see if
+	 * this is a file with blocks; if not, it has to be read as a single
+	 * gzip stream.
+	 **/
+	CacheBlockFile( const QString & fileName );
+
+	/**
+	 * Destructor. This waits for the blocks that are currently being
+	 * parsed and discards all unused results.
+	 **/
+	virtual ~CacheBlockFile();
+
+	/**
+	 * Return 'true' if the file consists of blocks.
+	 **/
+	bool ok() const { return ! _blocks.isEmpty(); }
+
+	/**
+	 * Return the number of blocks.
+	 **/
+	int blockCount() const { return _blocks.size(); }
+
+	/**
+	 * Return the parsed content of block no. 'blockNo'. This waits until
+	 * a worker thread has parsed it. The caller takes over ownership.
+	 *
+	 * The blocks are expected to be taken in order: This starts parsing
+	 * the next blocks.
+	 **/
+	ParsedCacheBlock * takeBlock( int blockNo );
+
+	/**
+	 * Decompress and parse block no. 'blockNo'. This is called in the
+	 * worker threads.
+	 **/
+	ParsedCacheBlock * parseBlock( int blockNo ) const;
+
+	/**
+	 * Store the result of a worker thread and wake up the main thread if
+	 * it is waiting for it.
+	 **/
+	void blockParsed( int blockNo, ParsedCacheBlock * block );
+
+
+    protected:
+
+	/**
+	 * Find the blocks from their gzip headers. Return 'false' if this is
+	 * not a file that consists of blocks only.
+	 **/
+	bool findBlocks();
+
+	/**
+	 * Start parsing all blocks up to 'endBlockNo' (excluding) that were
+	 * not started yet.
+	 **/
+	void startParsing( int endBlockNo );
+
+	/**
+	 * Add the item for the split line 'fields' to 'block'. Return 'false'
+	 * if it has a syntax error.
+	 **/
+	static bool addItem( char ** fields, int fieldsCount, ParsedCacheBlock * block );
+
+
+	//
+	// Data members
+	//
+
+	QString				_fileName;
+	const char *			_data;
+	size_t				_size;
+	QVector<CacheBlock>		_blocks;
+	QThreadPool			_threadPool;
+	int				_nextBlockNo;	// Next one to start
+	int				_maxAhead;
+	QMutex				_mutex;
+	QWaitCondition			_blockDone;
+	QHash<int, ParsedCacheBlock *>	_parsedBlocks;
+
+    };	// class CacheBlockFile
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheBlocks_h
@@ -0,0 +1,349 @@
+/*
+ *   File name: CacheSnapshot.cpp
+ *   Summary:	Snapshot of a DirTree for the QDirStat cache writers
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>	// S_ISDIR() etc.
+#include <string.h>	// strlen()
+
+#include "CacheSnapshot.h"
+#include "BinaryCache.h"
+#include "DirInfo.h"
+#include "DotEntry.h"
+#include "FileAggregate.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+CacheSnapshot::CacheSnapshot( DirTree * tree ):
+    _ok( true ),
+    _ignoreHardLinks( FileInfo::ignoreHardLinks() ),
+    _itemCount( 0 ),
+    _nextItem( 0 ),
+    _cacheFile( 0 ),
+    _nextRecord( 0 ),
+    _endRecord( 0 ),
+    _dirBase( 0 ),
+    _dirNo( 0 ),
+    _blockNo( -1 ),
+    _blockData( 0 )
+{
+    if ( ! tree || ! tree->root() )
+    {
+	setError( "No tree" );
+	return;
+    }
+
+    addTree( tree->root()->firstChild(), 0 );
+}
+
+
+CacheSnapshot::~CacheSnapshot()
+{
+    foreach ( Item * chunk, _chunks )
+	delete[] chunk;
+}
+
+
+void CacheSnapshot::addTree( FileInfo * item, int depth )
+{
+    if ( ! item || ! _ok )
+	return;
+
+    // A dot entry is not written itself; its files are written like
+    // children of its parent.
+
+    int childDepth = depth;
+
+    if ( ! item->isDotEntry() )
+    {
+	addItem( item, depth );
+	++childDepth;
+
+	// Nothing of a pending subtree is in the tree yet; next() reads it
+	// from its cache file.
+
+	if ( item->isDirInfo() && item->toDirInfo()->subtreePending() )
+	    return;
+    }
+
+    if ( item->dotEntry() )
+	addTree( item->dotEntry(), childDepth );
+
+    FileInfo * child = item->firstChild();
+
+    while ( child )
+    {
+	addTree( child, childDepth );
+	child = child->next();
+    }
+}
+
+
+void CacheSnapshot::addItem( FileInfo * item, int depth )
+{
+    if ( depth > 0xFFFF )
+    {
+	setError( "Directory tree too deep" );
+	return;
+    }
+
+    int index = _itemCount % CACHE_SNAPSHOT_CHUNK_ITEMS;
+
+    if ( index == 0 )
+    {
+	Item * chunk = new Item[ CACHE_SNAPSHOT_CHUNK_ITEMS ];
+	CHECK_NEW( chunk );
+
+	_chunks << chunk;
+    }
+
+    Item & snap = _chunks.last()[ index ];
+    ++_itemCount;
+
+    snap.name		= item->rawName();
+    snap.size		= item->rawByteSize();
+    snap.allocatedSize	= item->rawAllocatedSize();
+    snap.mtime		= item->mtime();
+    snap.mode		= item->mode();
+    snap.links		= item->links();
+    snap.depth		= depth;
+    snap.flags		= 0;
+    snap.extra		= 0;
+
+    // Only the toplevel directory has its full path in the cache
+
+    if ( depth == 0 )
+    {
+	_url = item->url().toUtf8();
+	snap.name = _url.constData();
+    }
+
+    if ( item->isDirInfo() )
+    {
+	snap.flags |= DirInfoItem;
+
+	if ( item->toDirInfo()->subtreePending() )
+	{
+	    snap.flags |= PendingItem;
+	    snap.extra	= _pending.size();
+	    _pending << item->toDirInfo()->tree()->pendingSubtree( item->toDirInfo() );
+	}
+    }
+
+    if ( item->isSparseFile() )
+	snap.flags |= SparseItem;
+
+    if ( item->isFile() && item->links() > 1 && ! _ignoreHardLinks )
+	snap.flags |= SharedLinksItem;
+
+    if ( item->isAggregate() )
+    {
+	Aggregate aggregate;
+
+	aggregate.count	      = static_cast<FileAggregate *>( item )->count();
+	aggregate.blocks      = item->totalBlocks();
+	aggregate.oldestMtime = item->oldestFileMtime();
+
+	snap.flags |= AggregateItem;
+	snap.extra  = _aggregates.size();
+	_aggregates << aggregate;
+    }
+}
+
+
+bool CacheSnapshot::next( CacheSnapshotEntry & entry )
+{
+    if ( _cacheFile )
+    {
+	if ( _ok && _nextRecord < _endRecord )
+	    return nextRecord( entry );
+
+	_cacheFile = 0;
+	_blockData = 0;
+	_blockBuffer = QByteArray();
+    }
+
+    if ( ! _ok || _nextItem >= _itemCount )
+	return false;
+
+    int chunkNo = _nextItem / CACHE_SNAPSHOT_CHUNK_ITEMS;
+    const Item & snap = _chunks[ chunkNo ][ _nextItem % CACHE_SNAPSHOT_CHUNK_ITEMS ];
+
+    entry.name	      = snap.name;
+    entry.nameLen     = strlen( snap.name );
+    entry.depth	      = snap.depth;
+    entry.isDirInfo   = ( snap.flags & DirInfoItem ) != 0;
+    entry.mode	      = snap.mode;
+    entry.links	      = snap.links;
+    entry.size	      = snap.size;
+    entry.mtime	      = snap.mtime;
+    entry.files	      = 0;
+    entry.oldestMtime = 0;
+
+    setTotals( entry, snap.allocatedSize,
+	       ( snap.flags & SparseItem      ) != 0,
+	       ( snap.flags & SharedLinksItem ) != 0 );
+
+    entry.blocks = ( snap.flags & SparseItem ) ? entry.totalBlocks : -1;
+
+    if ( snap.flags & AggregateItem )
+    {
+	const Aggregate & aggregate = _aggregates[ snap.extra ];
+
+	entry.blocks	  = aggregate.blocks;
+	entry.totalBlocks = aggregate.blocks;
+	entry.files	  = aggregate.count;
+	entry.oldestMtime = aggregate.oldestMtime;
+    }
+
+    if ( snap.flags & PendingItem )
+	startPendingSubtree( snap );
+
+    // Free each chunk as soon as all of its items are done
+
+    if ( ++_nextItem % CACHE_SNAPSHOT_CHUNK_ITEMS == 0 || _nextItem == _itemCount )
+    {
+	delete[] _chunks[ chunkNo ];
+	_chunks[ chunkNo ] = 0;
+    }
+
+    return true;
+}
+
+
+void CacheSnapshot::startPendingSubtree( const Item & dir )
+{
+    const PendingSubtree & pending = _pending[ dir.extra ];
+
+    if ( ! pending.cacheFile )
+	return;
+
+    const BinaryCacheDir & info = pending.cacheFile->dirInfo( pending.dirNo );
+
+    if ( info.endDir <= pending.dirNo )
+    {
+	setError( QString( "Corrupt directory index entry %1 of %2" )
+		  .arg( pending.dirNo ).arg( pending.cacheFile->fileName() ) );
+	return;
+    }
+
+    _cacheFile	= pending.cacheFile;
+    _nextRecord = info.record + 1;
+    _endRecord	= pending.cacheFile->subtreeEnd( pending.dirNo );
+    _dirBase	= pending.dirNo;
+    _dirNo	= pending.dirNo + 1;
+    _blockData	= 0;
+
+    _dirDepths.fill( 0, info.endDir - pending.dirNo );
+    _dirDepths[ 0 ] = dir.depth;
+}
+
+
+bool CacheSnapshot::nextRecord( CacheSnapshotEntry & entry )
+{
+    // The same as CacheReader::readBinary() and addBinaryRecord(), but
+    // only for the records of one subtree
+
+    int blockNo = _nextRecord / BINARY_CACHE_BLOCK_RECORDS;
+
+    if ( ! _blockData || blockNo != _blockNo )
+    {
+	_blockNo   = blockNo;
+	_blockData = _cacheFile->block( _blockNo, _blockBuffer );
+
+	if ( ! _blockData )
+	{
+	    setError( QString( "Can't read block %1 of %2" )
+		      .arg( _blockNo ).arg( _cacheFile->fileName() ) );
+	    return false;
+	}
+    }
+
+    const BinaryCacheBlock & info = _cacheFile->blockInfo( _blockNo );
+    const BinaryCacheRecord * records = (const BinaryCacheRecord *) _blockData;
+    const BinaryCacheRecord & record  = records[ _nextRecord++ % BINARY_CACHE_BLOCK_RECORDS ];
+    bool isDir = S_ISDIR( record.mode );
+
+    if ( record.nameOffset + (quint64) record.nameLen >= info.rawSize - info.namesOffset ||
+	 record.parent < _dirBase || record.parent >= _dirNo ||
+	 ( isDir && _dirNo - _dirBase >= (quint32) _dirDepths.size() ) )
+    {
+	setError( QString( "Corrupt record in block %1 of %2" )
+		  .arg( _blockNo ).arg( _cacheFile->fileName() ) );
+	return false;
+    }
+
+    entry.name	      = _blockData + info.namesOffset + record.nameOffset;
+    entry.nameLen     = record.nameLen;
+    entry.depth	      = _dirDepths[ record.parent - _dirBase ] + 1;
+    entry.isDirInfo   = isDir;
+    entry.mode	      = record.mode;
+    entry.links	      = record.links;
+    entry.size	      = record.size;
+    entry.blocks      = -1;
+    entry.mtime	      = record.mtime;
+    entry.files	      = 0;
+    entry.oldestMtime = 0;
+
+    if ( isDir )
+	_dirDepths[ _dirNo++ - _dirBase ] = entry.depth;
+
+    // The same sizes as the items that CacheReader would create from this
+
+    if ( record.files > 0 )
+    {
+	entry.mode	  = S_IFREG;
+	entry.links	  = 1;
+	entry.blocks	  = record.blocks;
+	entry.files	  = record.files;
+	entry.oldestMtime = record.oldestMtime;
+
+	setTotals( entry, record.blocks * STD_BLOCK_SIZE, false, false );
+	entry.totalBlocks = record.blocks;
+    }
+    else if ( ! isDir && record.blocks >= 0 )
+    {
+	entry.blocks = record.blocks;
+	setTotals( entry, record.blocks * STD_BLOCK_SIZE, true,
+		   S_ISREG( record.mode ) && record.links > 1 && ! _ignoreHardLinks );
+    }
+    else
+    {
+	setTotals( entry, record.size, false,
+		   ! isDir && S_ISREG( record.mode ) && record.links > 1 && ! _ignoreHardLinks );
+    }
+
+    return true;
+}
+
+
+void CacheSnapshot::setTotals( CacheSnapshotEntry & entry,
+			       FileSize		    allocatedSize,
+			       bool		    sparse,
+			       bool		    sharedLinks )
+{
+    // The same as FileInfo::size(), allocatedSize() and blocks()
+
+    entry.totalSize	     = sparse ? allocatedSize : entry.size;
+    entry.totalAllocatedSize = allocatedSize;
+    entry.totalBlocks	     = ( allocatedSize + STD_BLOCK_SIZE - 1 ) / STD_BLOCK_SIZE;
+
+    if ( sharedLinks )
+    {
+	entry.totalSize		 /= entry.links;
+	entry.totalAllocatedSize /= entry.links;
+    }
+}
+
+
+void CacheSnapshot::setError( const QString & errorMsg )
+{
+    _errorMsg = errorMsg;
+    _ok	      = false;
+}
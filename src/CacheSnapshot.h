@@ -0,0 +1,218 @@
+/*
+ *   File name: CacheSnapshot.h
+ *   Summary:	Snapshot of a DirTree for the QDirStat cache writers
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheSnapshot_h
+#define CacheSnapshot_h
+
+
+#include <sys/types.h>
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+
+#include "DirTree.h"	// PendingSubtree
+#include "FileInfo.h"	// FileSize
+
+
+// Number of items in one chunk of a snapshot
+#define CACHE_SNAPSHOT_CHUNK_ITEMS	16384
+
+
+namespace QDirStat
+{
+    class BinaryCacheFile;
+
+
+    /**
+     * One item of a CacheSnapshot as the cache writers get it from
+     * CacheSnapshot::next(): Everything that goes into a cache file, and
+     * what the item adds to the totals of its parent directory.
+     **/
+    struct CacheSnapshotEntry
+    {
+	const char *	name;		// Full path for the toplevel directory
+	int		nameLen;
+	int		depth;		// 0 for the toplevel directory
+	bool		isDirInfo;	// A directory with its own path
+	mode_t		mode;
+	nlink_t		links;
+	FileSize	size;		// As FileInfo::rawByteSize()
+	FileSize	blocks;		// Sparse files and aggregates, otherwise -1
+	qint64		mtime;
+	int		files;		// Files of a FileAggregate, otherwise 0
+	qint64		oldestMtime;	// Oldest file of a FileAggregate
+
+	// What the item itself adds to the totals of its parent: For a
+	// directory its own sizes, otherwise FileInfo::totalSize() etc.
+
+	FileSize	totalSize;
+	FileSize	totalAllocatedSize;
+	FileSize	totalBlocks;
+    };
+
+
+    /**
+     * A snapshot of a DirTree for writing it to a cache file in another
+     * thread while the tree is used and changed.
+     *
+     * Taking the snapshot only copies a few numbers for each item in the
+     * order of the cache files: Each directory is followed by its files and
+     * then by its subdirectories. Nothing is formatted yet, and the names
+     * are not copied: They stay in the NamePool of the tree, so that pool
+     * has to be pinned while anybody else has the snapshot (see
+     * NamePool::pin()). Subtrees that are still pending in a binary cache
+     * file are not loaded either; their records are read from that file
+     * by next(), so that file has to stay, too.
+     *
+     * The snapshot can be read only once: next() frees each part of it as
+     * soon as it is done with it. Reading it does not access the tree, so
+     * it can happen in any thread.
+     **/
+    class CacheSnapshot
+    {
+    public:
+
+	/**
+	 * Take a snapshot of the first toplevel item of 'tree' and
+	 * everything below it. Check ok() to see if that went OK.
+	 **/
+	CacheSnapshot( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~CacheSnapshot();
+
+	/**
+	 * Return 'true' if there was no error so far.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Return what went wrong if ok() returns 'false'.
+	 **/
+	const QString & errorMsg() const { return _errorMsg; }
+
+	/**
+	 * Return the next item in 'entry'. The name in 'entry' is only
+	 * valid until the next call.
+	 *
+	 * Return 'false' at the end of the snapshot or upon error (see
+	 * ok()).
+	 **/
+	bool next( CacheSnapshotEntry & entry );
+
+
+    protected:
+
+	/**
+	 * What the snapshot keeps for one tree item.
+	 **/
+	struct Item
+	{
+	    const char *    name;	// In the pinned NamePool of the tree
+	    FileSize	    size;	// FileInfo::rawByteSize()
+	    FileSize	    allocatedSize; // FileInfo::rawAllocatedSize()
+	    qint64	    mtime;
+	    quint32	    mode;
+	    quint32	    links;
+	    quint16	    depth;	// Paths are much shorter than 64k dirs
+	    quint16	    flags;	// ItemFlags
+	    quint32	    extra;	// Index in _aggregates or _pending
+	};
+
+	enum ItemFlags
+	{
+	    DirInfoItem	    = 0x01,
+	    SparseItem	    = 0x02,
+	    SharedLinksItem = 0x04,	// The links share the size; see FileInfo::size()
+	    AggregateItem   = 0x08,
+	    PendingItem	    = 0x10	// The subtree is still in a cache file
+	};
+
+	/**
+	 * What the snapshot keeps in addition for a FileAggregate.
+	 **/
+	struct Aggregate
+	{
+	    int		count;
+	    FileSize	blocks;
+	    qint64	oldestMtime;
+	};
+
+	/**
+	 * Add 'item' and everything below it with depth 'depth'.
+	 **/
+	void addTree( FileInfo * item, int depth );
+
+	/**
+	 * Add 'item' itself with depth 'depth'.
+	 **/
+	void addItem( FileInfo * item, int depth );
+
+	/**
+	 * Start reading the records of the pending subtree of the directory
+	 * 'dir' that was just returned by next().
+	 **/
+	void startPendingSubtree( const Item & dir );
+
+	/**
+	 * Return the next record of the current pending subtree in 'entry'.
+	 **/
+	bool nextRecord( CacheSnapshotEntry & entry );
+
+	/**
+	 * Set the totals of 'entry' from its allocated size without taking
+	 * hard links into account, just like FileInfo does for its own sizes.
+	 **/
+	static void setTotals( CacheSnapshotEntry & entry,
+			       FileSize		    allocatedSize,
+			       bool		    sparse,
+			       bool		    sharedLinks );
+
+	/**
+	 * Set an error that makes next() stop.
+	 **/
+	void setError( const QString & errorMsg );
+
+
+	//
+	// Data members
+	//
+
+	bool			_ok;
+	QString			_errorMsg;
+	bool			_ignoreHardLinks;
+	QByteArray		_url;		// Full path of the toplevel dir
+	QList<Item *>		_chunks;
+	quint64			_itemCount;
+	quint64			_nextItem;
+	QVector<Aggregate>	_aggregates;
+	QVector<PendingSubtree> _pending;
+
+	// The pending subtree that next() is reading
+
+	BinaryCacheFile *	_cacheFile;
+	quint64			_nextRecord;
+	quint64			_endRecord;
+	quint32			_dirBase;
+	quint32			_dirNo;
+	QVector<int>		_dirDepths;	// For the dirs from _dirBase on
+	int			_blockNo;
+	const char *		_blockData;
+	QByteArray		_blockBuffer;
+
+    };	// class CacheSnapshot
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheSnapshot_h
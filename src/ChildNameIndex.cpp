@@ -0,0 +1,151 @@
+/*
+ *   File name: ChildNameIndex.cpp
+ *   Summary:	Hash index of the children names of a directory for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// strchr()
+
+#include <QAtomicInt>
+
+#include "ChildNameIndex.h"
+#include "FileInfo.h"
+
+using namespace QDirStat;
+
+
+// Indexes are created in the main thread, but they may be deleted when
+// finalizing a tree in other threads.
+
+static QAtomicInt indexedCount;
+
+
+ChildNameIndex::ChildNameIndex( FileInfo * firstChild ):
+    _usable( true )
+{
+    for ( FileInfo * child = firstChild; child; child = child->next() )
+	add( child );
+}
+
+
+ChildNameIndex::~ChildNameIndex()
+{
+    indexedCount.fetchAndAddRelaxed( -_children.size() );
+}
+
+
+void ChildNameIndex::add( FileInfo * child )
+{
+    const char * name = child->rawName();
+
+    if ( strchr( name, '/' ) )
+	_usable = false;
+
+    _children.insert( hashName( name ), child );
+    indexedCount.ref();
+}
+
+
+void ChildNameIndex::remove( FileInfo * child )
+{
+    int removed = _children.remove( hashName( child->rawName() ), child );
+    indexedCount.fetchAndAddRelaxed( -removed );
+}
+
+
+void ChildNameIndex::rename( FileInfo * child, const char * oldName )
+{
+    if ( _children.remove( hashName( oldName ), child ) > 0 )
+    {
+	indexedCount.deref();
+	add( child );
+    }
+}
+
+
+FileInfo * ChildNameIndex::find( const QString & url, int pos, int len ) const
+{
+    uint hash = hashName( url.constData() + pos, len );
+    QMultiHash<uint, FileInfo *>::const_iterator it = _children.constFind( hash );
+
+    while ( it != _children.constEnd() && it.key() == hash )
+    {
+	if ( matchPrefix( it.value()->rawName(), url, pos ) == len )
+	    return it.value();
+
+	++it;
+    }
+
+    return 0;
+}
+
+
+int ChildNameIndex::matchPrefix( const char * name, const QString & url, int pos )
+{
+    const QChar * urlChars = url.constData() + pos;
+    int len = url.length() - pos;
+    int i = 0;
+
+    for ( ; name[i]; ++i )
+    {
+	unsigned char c = (unsigned char) name[i];
+
+	if ( c >= 0x80 )	// Non-ASCII: Do it the expensive way
+	{
+	    QString qName = QString::fromUtf8( name );
+	    return url.midRef( pos ).startsWith( qName ) ? qName.length() : -1;
+	}
+
+	if ( i >= len || urlChars[i].unicode() != c )
+	    return -1;
+    }
+
+    return i;
+}
+
+
+int ChildNameIndex::indexedChildren()
+{
+    return indexedCount.load();
+}
+
+
+uint ChildNameIndex::hashName( const QChar * str, int len )
+{
+    // FNV-1a
+
+    uint hash = 2166136261u;
+
+    for ( int i=0; i < len; ++i )
+    {
+	hash ^= str[i].unicode();
+	hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+uint ChildNameIndex::hashName( const char * name )
+{
+    uint hash = 2166136261u;
+
+    for ( int i=0; name[i]; ++i )
+    {
+	unsigned char c = (unsigned char) name[i];
+
+	if ( c >= 0x80 )	// Non-ASCII: Hash the UTF-16 code units
+	{
+	    QString qName = QString::fromUtf8( name );
+	    return hashName( qName.constData(), qName.length() );
+	}
+
+	hash ^= c;
+	hash *= 16777619u;
+    }
+
+    return hash;
+}
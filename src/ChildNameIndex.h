@@ -0,0 +1,124 @@
+/*
+ *   File name: ChildNameIndex.h
+ *   Summary:	Hash index of the children names of a directory for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ChildNameIndex_h
+#define ChildNameIndex_h
+
+
+#include <QString>
+#include <QMultiHash>
+
+
+// Min. number of children of a directory to build an index for it; for
+// fewer children, a linear search is just as fast.
+#define CHILD_NAME_INDEX_MIN_CHILDREN	32
+
+
+namespace QDirStat
+{
+    class FileInfo;
+
+    /**
+     * Hash index of the direct children of a directory by name, so
+     * FileInfo::locate() does not need to compare the path against each
+     * child of large directories.
+     *
+     * The hash value is computed over the UTF-16 code units of a name, so
+     * a path component can be looked up directly in a QString without
+     * converting it to UTF-8 or copying it. Different names with the same
+     * hash value are resolved by comparing the names.
+     *
+     * DirInfo builds this lazily for directories with many children (see
+     * DirInfo::childNameIndex()) and keeps it up to date when children are
+     * added or removed.
+     **/
+    class ChildNameIndex
+    {
+    public:
+
+	/**
+	 * Constructor: Index 'firstChild' and all its next() siblings.
+	 **/
+	ChildNameIndex( FileInfo * firstChild );
+
+	/**
+	 * Destructor.
+	 **/
+	~ChildNameIndex();
+
+	/**
+	 * Return 'false' if any of the children has a name that contains a
+	 * '/' (only toplevel items do), so it can't be looked up as one
+	 * path component.
+	 **/
+	bool isUsable() const { return _usable; }
+
+	/**
+	 * Add a child.
+	 **/
+	void add( FileInfo * child );
+
+	/**
+	 * Remove a child.
+	 **/
+	void remove( FileInfo * child );
+
+	/**
+	 * Notification that 'child' was renamed from 'oldName'. This does
+	 * nothing if 'child' is not in this index.
+	 **/
+	void rename( FileInfo * child, const char * oldName );
+
+	/**
+	 * Return the child whose name is the 'len' characters of 'url'
+	 * starting at 'pos', or 0 if there is none.
+	 **/
+	FileInfo * find( const QString & url, int pos, int len ) const;
+
+	/**
+	 * Return the number of characters of 'url' starting at 'pos' that
+	 * match the UTF-8 name 'name', or -1 if 'url' does not continue with
+	 * 'name' at that position.
+	 **/
+	static int matchPrefix( const char * name, const QString & url, int pos );
+
+	/**
+	 * Return the total number of children in all indexes.
+	 **/
+	static int indexedChildren();
+
+
+    protected:
+
+	/**
+	 * Hash function for the UTF-16 code units 'str' with 'len'
+	 * characters.
+	 **/
+	static uint hashName( const QChar * str, int len );
+
+	/**
+	 * Hash function for the UTF-8 name 'name'. This returns the same
+	 * value as for the name as UTF-16.
+	 **/
+	static uint hashName( const char * name );
+
+
+	//
+	// Data members
+	//
+
+	QMultiHash<uint, FileInfo *>	_children;
+	bool				_usable;
+
+    };	// class ChildNameIndex
+
+}	// namespace QDirStat
+
+
+#endif // ifndef ChildNameIndex_h
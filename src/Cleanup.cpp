@@ -69,6 +69,9 @@ bool Cleanup::worksFor( FileInfo *item ) const
     if ( ! _active || ! item )
 	return false;
 
+    if ( item->isAggregate() )	// There is no such file on disk
+	return false;
+
     if	( item->isPseudoDir() )	return worksForDotEntry();
     if	( item->isDir() )	return worksForDir();
 
@@ -141,6 +141,7 @@ void CleanupCollection::updateActions()
     bool dirSelected	  = sel.containsDir();
     bool fileSelected	  = sel.containsFile();
     bool pkgSelected      = sel.containsPkg();
+    bool aggrSelected	  = sel.containsAggregate();
     bool dotEntrySelected = sel.containsDotEntry();
     bool busy		  = sel.containsBusyItem();
     bool treeBusy	  = sel.treeIsBusy();
@@ -165,7 +166,7 @@ void CleanupCollection::updateActions()
 	    if ( fileSelected && ! cleanup->worksForFile() )
 		enabled = false;
 
-            if ( pkgSelected )
+            if ( pkgSelected || aggrSelected )
                 enabled = false;
 
 	    cleanup->setEnabled( enabled );
@@ -9,24 +9,129 @@
 
 #include <algorithm>
 
+#include <QAtomicInt>
+#include <QHash>
+#include <QThreadStorage>
+
 #include "DirInfo.h"
 #include "DirTree.h"
 #include "DotEntry.h"
 #include "Attic.h"
 #include "FileInfoIterator.h"
 #include "FileInfoSorter.h"
+#include "ChildNameIndex.h"
 #include "ExcludeRules.h"
 #include "Exception.h"
+#include "SlabPool.h"
 #include "DebugHelpers.h"
 
 #define DIRECT_CHILDREN_COUNT_SANITY_CHECK 0
 
+// Compare the incremental summary values with a complete recalc() for each
+// directory when it is finalized. This is very expensive; debugging only.
+#define VERIFY_SUMMARY 0
+
+// Min. number of sorted children to look up the row of a child in a hash
+// rather than searching the list
+#define SORTED_ROWS_MIN_CHILDREN 64
+
+// Max. number of sorted children lists (with different sort parameters) to
+// keep for each directory
+#define SORT_CACHE_MAX_LISTS 3
+
 using namespace QDirStat;
 
 
+// Dot entries and attics that became obsolete while finalizing a subtree in a
+// worker thread: Tree nodes are only deleted in the main thread (the slab
+// pools are not thread-safe), so they are collected here. See TreeFinalizer.
+static QThreadStorage<FileInfoList *> deferredDeletes;
+
+// Statistics about the sort caches of all directories. Those are created
+// and deleted in the main thread, but finalizing in other threads may call
+// dropSortCache(), too.
+
+static QAtomicInt sortCaches;
+static QAtomicInt sortCacheItems;
+static QAtomicInt sortedRowItems;
+
+
+namespace QDirStat
+{
+    /**
+     * One sorted list of the children of a directory with the parameters
+     * it was sorted with. Each directory keeps a few of them, the most
+     * recently used one first. See DirInfo::sortedChildren().
+     **/
+    struct SortedChildren
+    {
+	DataColumn			sortCol;
+	Qt::SortOrder			sortOrder;
+	bool				includeAttic;
+	FileInfoList			children;
+	QHash<const FileInfo *, int> *	rows;	// Row of each child, on demand
+	SortedChildren *		next;
+    };
+}
+
+
+/**
+ * Delete a sorted children list and everything that belongs to it.
+ **/
+static void deleteSortedChildren( SortedChildren * list )
+{
+    sortCaches.deref();
+    sortCacheItems.fetchAndAddRelaxed( -list->children.size() );
+
+    if ( list->rows )
+    {
+	sortedRowItems.fetchAndAddRelaxed( -list->rows->size() );
+	delete list->rows;
+    }
+
+    delete list;
+}
+
+
+/**
+ * Return 'true' if the order of a list of children sorted by 'sortCol' may
+ * be different after 'change'.
+ **/
+static bool sortOrderAffected( DataColumn sortCol, DirInfo::SortCacheChange change )
+{
+    switch ( change )
+    {
+	case DirInfo::ChildrenChanged:
+	    return true;
+
+	case DirInfo::SummaryChanged:
+	    // Only the columns with the summary values of the subtrees
+
+	    return sortCol == PercentBarCol	 ||
+		   sortCol == PercentNumCol	 ||
+		   sortCol == SizeCol		 ||
+		   sortCol == TotalItemsCol	 ||
+		   sortCol == TotalFilesCol	 ||
+		   sortCol == TotalSubDirsCol	 ||
+		   sortCol == LatestMTimeCol	 ||
+		   sortCol == OldestFileMTimeCol;
+
+	case DirInfo::ReadJobsChanged:
+	    // The percentages are not shown while there are pending read jobs
+
+	    return sortCol == ReadJobsCol   ||
+		   sortCol == PercentBarCol ||
+		   sortCol == PercentNumCol;
+    }
+
+    return true;
+}
+
+
 DirInfo::DirInfo( DirTree * tree,
 		  DirInfo * parent )
     : FileInfo( tree, parent )
+    , _tree( tree )
 {
     init();
     _readState = DirFinished;
@@ -41,11 +146,27 @@ DirInfo::DirInfo( const QString & filenameWithoutPath,
 		statInfo,
 		tree,
 		parent )
+    , _tree( tree )
 {
     init();
-    ensureDotEntry();
+    initDotEntry();
+}
+
 
-    _directChildrenCount++;	// One for the newly created dot entry
+DirInfo::DirInfo( const char  * utf8Name,
+		  int		len,
+		  struct stat * statInfo,
+		  DirTree     * tree,
+		  DirInfo     * parent )
+    : FileInfo( utf8Name,
+		len,
+		statInfo,
+		tree,
+		parent )
+    , _tree( tree )
+{
+    init();
+    initDotEntry();
 }
 
 
@@ -61,11 +182,10 @@ DirInfo::DirInfo( DirTree *	  tree,
 		mode,
 		size,
 		mtime )
+    , _tree( tree )
 {
     init();
-    ensureDotEntry();
-
-    _directChildrenCount++;	// One for the newly created dot entry
+    initDotEntry();
 }
 
 
@@ -79,12 +199,15 @@ void DirInfo::init()
     _deletingAll	 = false;
     _locked		 = false;
     _touched		 = false;
+    _sizesPending	 = false;
+    _subtreePending	 = false;
+    _heapOwner		 = false;
     _pendingReadJobs	 = 0;
     _dotEntry		 = 0;
     _firstChild		 = 0;
     _totalSize		 = _size;
     _totalAllocatedSize	 = _allocatedSize;
-    _totalBlocks	 = _blocks;
+    _totalBlocks	 = blocks();
     _totalItems		 = 0;
     _totalSubDirs	 = 0;
     _totalFiles		 = 0;
@@ -95,19 +218,87 @@ void DirInfo::init()
     _latestMtime	 = _mtime;
     _oldestFileMtime	 = 0;
     _readState		 = DirQueued;
-    _sortedChildren	 = 0;
-    _lastSortCol	 = UndefinedCol;
-    _lastSortOrder	 = Qt::AscendingOrder;
+    _sortCache		 = 0;
+    _childNameIndex	 = 0;
 }
 
 
 DirInfo::~DirInfo()
 {
-    clear();
+    // Whoever deletes this directory takes care of the summary values of
+    // the ancestors: Either the parent is being cleared as well, or this
+    // was unlinked from it in deletingChild().
+
+    if ( _subtreePending && _tree )
+	_tree->dropPendingSubtree( this );
+
+    if ( _heapOwner && _tree )
+	_tree->removeHeapOwner( this );
+
+    deleteAllChildren();
+}
+
+
+void * DirInfo::operator new( size_t size, DirTree * tree )
+{
+    return slabPool( tree )->alloc( size );
+}
+
+
+void DirInfo::operator delete( void * ptr, size_t size )
+{
+    if ( size == sizeof( DirInfo ) )
+	SlabPool::releaseObject( ptr );
+    else
+	::operator delete( ptr );	// See FileInfo::operator delete()
+}
+
+
+SlabPool * DirInfo::slabPool( DirTree * tree )
+{
+    static SlabPool pool( sizeof( DirInfo ), "DirInfo" );
+
+    return tree ? tree->dirInfoPool() : &pool;
 }
 
 
 void DirInfo::clear()
+{
+    if ( ! _firstChild && ! _dotEntry && ! _attic && ! _subtreePending )
+	return;
+
+    // Take the contents from the ancestors just once, not for every single
+    // child: Doing that for each child made clearing a large tree
+    // O(n * depth). And if the parent is being cleared as well, there is
+    // nothing to tell.
+
+    bool tellAncestors = _parent && ! _parent->_deletingAll;
+    SummaryDelta contents;
+
+    if ( tellAncestors )
+	contents = contentsDelta();
+
+    deleteAllChildren();
+    _sizesPending = false;	// No children left to lstat()
+
+    if ( _subtreePending )
+    {
+	// The subtree in the cache file is gone, too
+
+	_subtreePending = false;
+
+	if ( _tree )
+	    _tree->dropPendingSubtree( this );
+    }
+
+    recalc();	// Only this directory's own values are left: Cheap
+
+    if ( tellAncestors )
+	addToAncestorsSummary( contents, -1 );
+}
+
+
+void DirInfo::deleteAllChildren()
 {
     _deletingAll = true;
 
@@ -117,8 +308,8 @@ void DirInfo::clear()
     {
 	FileInfo * nextChild = _firstChild->next();
 
-	if ( _parent )
-	    _parent->deletingChild( _firstChild );
+	if ( _tree )
+	    _tree->namePool()->release( _firstChild->rawName() );
 
 	delete _firstChild;
 	_firstChild = nextChild; // unlink the old first child
@@ -139,9 +330,64 @@ void DirInfo::clear()
 	_attic = 0;
     }
 
-    _summaryDirty = true;
-    _deletingAll  = false;
+    _deletingAll = false;
     dropSortCache();
+    dropChildNameIndex();
+}
+
+
+void DirInfo::abandonChildren()
+{
+    _firstChild	    = 0;
+    _dotEntry	    = 0;
+    _attic	    = 0;
+    _subtreePending = false;
+
+    dropSortCache();
+    dropChildNameIndex();
+}
+
+
+void DirInfo::registerHeapOwner()
+{
+    // The tree only needs to know about this once: Even if the caches are
+    // dropped later, cleaning up a directory without them is harmless.
+
+    if ( ! _heapOwner && _tree )
+    {
+	_heapOwner = true;
+	_tree->addHeapOwner( this );
+    }
+}
+
+
+SummaryDelta DirInfo::contentsDelta()
+{
+    // What this directory adds to its parent minus its own part
+
+    SummaryDelta delta;
+    delta.add( this );
+
+    delta.size		-= _size;
+    delta.allocatedSize -= _allocatedSize;
+    delta.blocks	-= blocks();
+    delta.items--;
+
+    if ( isDir() )
+	delta.subDirs--;
+
+    if ( isDir() && readError() )
+	delta.errSubDirs--;
+
+    if ( ! isDir() )
+    {
+	if ( isIgnored() )
+	    delta.ignoredItems--;
+	else
+	    delta.unignoredItems--;
+    }
+
+    return delta;
 }
 
 
@@ -150,16 +396,23 @@ void DirInfo::reset()
     if ( _firstChild || _dotEntry || _attic )
 	clear();
 
+    if ( readError() && _parent )
+    {
+	// The ancestors counted this as a subdirectory with a read error
+
+	SummaryDelta delta;
+	delta.errSubDirs = 1;
+	addToAncestorsSummary( delta, -1 );
+    }
+
     _readState	     = DirQueued;
     _pendingReadJobs = 0;
-    _summaryDirty    = true;
 
     ensureDotEntry();
 
     if ( _tree )
 	_tree->childAddedNotify( _dotEntry );
 
-    recalc();
     dropSortCache();
 }
 
@@ -170,21 +423,44 @@ DotEntry * DirInfo::ensureDotEntry()
     {
 	// logDebug() << "Creating dot entry for " << this << endl;
 
-	_dotEntry = new DotEntry( _tree, this );
+	_dotEntry = new ( _tree ) DotEntry( _tree, this );
 	CHECK_NEW( _dotEntry );
+
+	childAdded( _dotEntry );
     }
 
     return _dotEntry;
 }
 
 
+void DirInfo::initDotEntry()
+{
+    _dotEntry = new ( _tree ) DotEntry( _tree, this );
+    CHECK_NEW( _dotEntry );
+
+    // This directory is not in its parent's children list yet, so only
+    // count the dot entry here: The parent will add all of this directory
+    // in insertChild().
+
+    SummaryDelta delta;
+    delta.add( _dotEntry );
+    addToLocalSummary( delta, 1, AllFields );
+    _directChildrenCount++;
+}
+
+
 void DirInfo::deleteEmptyDotEntry()
 {
     if ( ! _dotEntry->firstChild() && ! _dotEntry->hasAtticChildren() )
     {
-	delete _dotEntry;
+	SummaryDelta delta;
+	delta.add( _dotEntry );
+
+	deleteNode( _dotEntry );
 	_dotEntry = 0;
+	dropSortCache();
 
+	addToSummary( delta, -1 );
 	countDirectChildren();
     }
 }
@@ -196,8 +472,9 @@ Attic * DirInfo::ensureAttic()
     {
 	// logDebug() << "Creating attic for " << this << endl;
 
-	_attic = new Attic( _tree, this );
+	_attic = new ( _tree ) Attic( _tree, this );
 	CHECK_NEW( _attic );
+	dropSortCache();
     }
 
     return _attic;
@@ -208,9 +485,39 @@ void DirInfo::deleteEmptyAttic()
 {
     if ( _attic && ! _attic->firstChild() )
     {
-	delete _attic;
+	deleteNode( _attic );
 	_attic = 0;
+	dropSortCache();
+    }
+}
+
+
+void DirInfo::deleteNode( DirInfo * node )
+{
+    if ( deferredDeletes.hasLocalData() )
+	*deferredDeletes.localData() << node;
+    else
+	delete node;
+}
+
+
+void DirInfo::deferDeletes()
+{
+    deferredDeletes.setLocalData( new FileInfoList() );
+}
+
+
+FileInfoList DirInfo::takeDeferredDeletes()
+{
+    FileInfoList nodes;
+
+    if ( deferredDeletes.hasLocalData() )
+    {
+	nodes = *deferredDeletes.localData();
+	deferredDeletes.setLocalData( 0 ); // This deletes the old list
     }
+
+    return nodes;
 }
 
 
@@ -224,9 +531,18 @@ void DirInfo::recalc()
 {
     // logDebug() << this << endl;
 
+    if ( _subtreePending )
+    {
+	// There are no children to add up; the summary fields were set for
+	// the subtree that is still in the cache file.
+
+	_summaryDirty = false;
+	return;
+    }
+
     _totalSize		 = _size;
     _totalAllocatedSize	 = _allocatedSize;
-    _totalBlocks	 = _blocks;
+    _totalBlocks	 = blocks();
     _totalItems		 = 0;
     _totalSubDirs	 = 0;
     _totalFiles		 = 0;
@@ -300,6 +616,277 @@ void DirInfo::recalc()
 }
 
 
+bool DirInfo::verifySummary()
+{
+    if ( _summaryDirty || _subtreePending )
+	return true;
+
+    FileSize totalSize		 = _totalSize;
+    FileSize totalAllocatedSize	 = _totalAllocatedSize;
+    FileSize totalBlocks	 = _totalBlocks;
+    int	     totalItems		 = _totalItems;
+    int	     totalSubDirs	 = _totalSubDirs;
+    int	     totalFiles		 = _totalFiles;
+    int	     totalIgnoredItems	 = _totalIgnoredItems;
+    int	     totalUnignoredItems = _totalUnignoredItems;
+    int	     directChildrenCount = _directChildrenCount;
+    int	     errSubDirCount	 = _errSubDirCount;
+    time_t   latestMtime	 = _latestMtime;
+    time_t   oldestFileMtime	 = _oldestFileMtime;
+
+    recalc();
+
+    bool ok =
+	totalSize	    == _totalSize	    &&
+	totalAllocatedSize  == _totalAllocatedSize  &&
+	totalBlocks	    == _totalBlocks	    &&
+	totalItems	    == _totalItems	    &&
+	totalSubDirs	    == _totalSubDirs	    &&
+	totalFiles	    == _totalFiles	    &&
+	totalIgnoredItems   == _totalIgnoredItems   &&
+	totalUnignoredItems == _totalUnignoredItems &&
+	directChildrenCount == _directChildrenCount &&
+	errSubDirCount	    == _errSubDirCount	    &&
+	latestMtime	    == _latestMtime	    &&
+	oldestFileMtime	    == _oldestFileMtime;
+
+    if ( ! ok )
+    {
+	logError() << "Summary mismatch for " << this
+		   << ": size "	     << totalSize	    << " / " << _totalSize
+		   << " alloc "	     << totalAllocatedSize  << " / " << _totalAllocatedSize
+		   << " blocks "     << totalBlocks	    << " / " << _totalBlocks
+		   << " items "	     << totalItems	    << " / " << _totalItems
+		   << " subdirs "    << totalSubDirs	    << " / " << _totalSubDirs
+		   << " files "	     << totalFiles	    << " / " << _totalFiles
+		   << " ignored "    << totalIgnoredItems   << " / " << _totalIgnoredItems
+		   << " unignored "  << totalUnignoredItems << " / " << _totalUnignoredItems
+		   << " children "   << directChildrenCount << " / " << _directChildrenCount
+		   << " errSubDirs " << errSubDirCount	    << " / " << _errSubDirCount
+		   << " latest "     << latestMtime	    << " / " << _latestMtime
+		   << " oldest "     << oldestFileMtime	    << " / " << _oldestFileMtime
+		   << endl;
+    }
+
+    return ok;
+}
+
+
+SummaryDelta::SummaryDelta():
+    size( 0 ),
+    allocatedSize( 0 ),
+    blocks( 0 ),
+    items( 0 ),
+    subDirs( 0 ),
+    files( 0 ),
+    ignoredItems( 0 ),
+    unignoredItems( 0 ),
+    errSubDirs( 0 ),
+    latestMtime( 0 ),
+    oldestFileMtime( 0 )
+{
+    // NOP
+}
+
+
+void SummaryDelta::add( FileInfo * child )
+{
+    // This must add exactly what recalc() adds for each child
+
+    size	   += child->totalSize();
+    allocatedSize  += child->totalAllocatedSize();
+    blocks	   += child->totalBlocks();
+    items	   += child->totalItems() + 1;
+    subDirs	   += child->totalSubDirs();
+    files	   += child->totalFiles();
+    ignoredItems   += child->totalIgnoredItems();
+    unignoredItems += child->totalUnignoredItems();
+    errSubDirs	   += child->errSubDirCount();
+
+    if ( child->isDir() )
+    {
+	subDirs++;
+
+	if ( child->readError() )
+	    errSubDirs++;
+    }
+
+    if ( child->isFile() )
+	files++;
+
+    if ( ! child->isDir() )
+    {
+	if ( child->isIgnored() )
+	    ignoredItems++;
+	else
+	    unignoredItems++;
+    }
+
+    time_t childLatestMtime = child->latestMtime();
+
+    if ( childLatestMtime > latestMtime )
+	latestMtime = childLatestMtime;
+
+    time_t childOldestFileMtime = child->oldestFileMtime();
+
+    if ( childOldestFileMtime > 0 )
+    {
+	if ( oldestFileMtime == 0 || childOldestFileMtime < oldestFileMtime )
+	    oldestFileMtime = childOldestFileMtime;
+    }
+}
+
+
+bool SummaryDelta::operator==( const SummaryDelta & other ) const
+{
+    return
+	size		== other.size		 &&
+	allocatedSize	== other.allocatedSize	 &&
+	blocks		== other.blocks		 &&
+	items		== other.items		 &&
+	subDirs		== other.subDirs	 &&
+	files		== other.files		 &&
+	ignoredItems	== other.ignoredItems	 &&
+	unignoredItems	== other.unignoredItems	 &&
+	errSubDirs	== other.errSubDirs	 &&
+	latestMtime	== other.latestMtime	 &&
+	oldestFileMtime == other.oldestFileMtime;
+}
+
+
+void DirInfo::addToSummary( const SummaryDelta & delta, int sign )
+{
+    addToLocalSummary( delta, sign, AllFields );
+    dropSortCache( SummaryChanged );
+
+    addToAncestorsSummary( delta, sign );
+}
+
+
+void DirInfo::addToAncestorsSummary( const SummaryDelta & delta, int sign )
+{
+    // An attic only adds its ignored items and its subdirectories with
+    // read errors to its parent, and so on further up.
+
+    SummaryFields fields = isAttic() ? AtticFields : AllFields;
+
+    for ( DirInfo * dir = _parent; dir; dir = dir->parent() )
+    {
+	dir->addToLocalSummary( delta, sign, fields );
+	dir->dropSortCache( SummaryChanged );
+
+	if ( dir->isAttic() )
+	    fields = AtticFields;
+    }
+}
+
+
+void DirInfo::addToLocalSummary( const SummaryDelta & delta,
+				 int		      sign,
+				 SummaryFields	      fields )
+{
+    if ( _summaryDirty )
+	return;	 // recalc() will take care of everything
+
+    if ( fields != NonAtticFields )
+    {
+	_totalIgnoredItems += sign * delta.ignoredItems;
+	_errSubDirCount	   += sign * delta.errSubDirs;
+    }
+
+    if ( fields == AtticFields )
+	return;
+
+    _totalSize		 += sign * delta.size;
+    _totalAllocatedSize	 += sign * delta.allocatedSize;
+    _totalBlocks	 += sign * delta.blocks;
+    _totalItems		 += sign * delta.items;
+    _totalSubDirs	 += sign * delta.subDirs;
+    _totalFiles		 += sign * delta.files;
+    _totalUnignoredItems += sign * delta.unignoredItems;
+
+    if ( sign > 0 )
+    {
+	if ( delta.latestMtime > _latestMtime )
+	    _latestMtime = delta.latestMtime;
+
+	if ( delta.oldestFileMtime > 0 )
+	{
+	    if ( _oldestFileMtime == 0 || delta.oldestFileMtime < _oldestFileMtime )
+		_oldestFileMtime = delta.oldestFileMtime;
+	}
+    }
+    else
+    {
+	// If what was removed had the latest or the oldest mtime, there is
+	// no way to find the next one without looking at all the children.
+	// Leave that to recalc() when anybody wants to know.
+
+	if ( ( delta.latestMtime >= _latestMtime && _latestMtime > _mtime ) ||
+	     ( delta.oldestFileMtime > 0 && delta.oldestFileMtime <= _oldestFileMtime ) )
+	{
+	    _summaryDirty = true;
+	}
+    }
+}
+
+
+void DirInfo::moveSummary( DirInfo * oldParent, const SummaryDelta & delta )
+{
+    // Remove the delta from the old parent and from everything between it
+    // and this directory.
+
+    SummaryFields oldFields = AllFields;
+    DirInfo * dir = oldParent;
+
+    while ( dir && dir != this )
+    {
+	dir->addToLocalSummary( delta, -1, oldFields );
+	dir->dropSortCache();
+
+	if ( dir->isAttic() )
+	    oldFields = AtticFields;
+
+	dir = dir->parent();
+    }
+
+    if ( ! dir )
+    {
+	// This directory was not above the old parent (e.g. the attic of the
+	// dot entry was moved to the attic of the directory), so the delta
+	// is now removed all the way up. Add it again from here.
+
+	addToSummary( delta, 1 );
+	return;
+    }
+
+    // From here on, the delta was counted before and it is counted now,
+    // but maybe not with the same fields if there is an attic involved.
+
+    SummaryFields newFields = AllFields;
+
+    for ( ; dir; dir = dir->parent() )
+    {
+	if ( oldFields != newFields )
+	{
+	    // One of them is AllFields, the other one AtticFields
+
+	    dir->addToLocalSummary( delta,
+				    newFields == AllFields ? 1 : -1,
+				    NonAtticFields );
+	}
+
+	dir->dropSortCache();
+
+	if ( dir->isAttic() )
+	    oldFields = newFields = AtticFields;
+
+	if ( oldFields == newFields )
+	    break;	// Nothing changes further up
+    }
+}
+
+
 void DirInfo::setMountPoint( bool isMountPoint )
 {
     _isMountPoint = isMountPoint;
@@ -474,6 +1061,20 @@ void DirInfo::setReadState( DirReadState newReadState )
 }
 
 
+void DirInfo::setReadError( DirReadState errorState )
+{
+    bool hadError = readError();
+    setReadState( errorState );
+
+    if ( ! hadError && readError() && _parent )
+    {
+	SummaryDelta delta;
+	delta.errSubDirs = 1;
+	addToAncestorsSummary( delta, 1 );
+    }
+}
+
+
 bool DirInfo::isBusy()
 {
     if ( _pendingReadJobs > 0 && _readState != DirAborted )
@@ -512,6 +1113,9 @@ void DirInfo::insertChild( FileInfo * newChild )
 	_firstChild = newChild;
 	newChild->setParent( this );	// make sure the parent pointer is correct
 
+	if ( _childNameIndex )
+	    _childNameIndex->add( newChild );
+
 	childAdded( newChild );		// update summaries
     }
     else
@@ -546,11 +1150,6 @@ void DirInfo::addToAttic( FileInfo * newChild )
 
     newChild->setIgnored( true );
 
-    if ( newChild->isDir() )
-	_totalIgnoredItems += newChild->totalIgnoredItems();
-    else
-	_totalIgnoredItems++;
-
     CHECK_PTR( attic );
     attic->insertChild( newChild );
 }
@@ -558,101 +1157,19 @@ void DirInfo::addToAttic( FileInfo * newChild )
 
 void DirInfo::childAdded( FileInfo * newChild )
 {
-    bool addToTotal = true;
-
-    if ( newChild->isIgnored() )
-    {
-	if ( newChild->isDir() )
-	    _totalIgnoredItems += newChild->totalIgnoredItems();
-	else
-	    _totalIgnoredItems++;
-
-	// Add ignored items only to all the totals if this directory is also
-	// ignored or if this is the attic.
-
-	if ( ! _isIgnored &&  ! isAttic() )
-	    addToTotal = false;
-    }
-    else
-    {
-	if ( ! newChild->isDir() )
-	    _totalUnignoredItems++;
-    }
-
-    if ( addToTotal )
-    {
-	if ( ! _summaryDirty )
-	{
-	    _totalSize		+= newChild->size();
-	    _totalAllocatedSize += newChild->allocatedSize();
-	    _totalBlocks	+= newChild->blocks();
-	    _totalItems++;
-
-	    if ( newChild->parent() == this )
-		_directChildrenCount++;
-
-	    if ( newChild->isDir() )
-		_totalSubDirs++;
-
-	    if ( newChild->isFile() )
-		_totalFiles++;
-
-	    if ( newChild->mtime() > _latestMtime )
-		_latestMtime = newChild->mtime();
-
-	    time_t childOldestFileMTime = newChild->oldestFileMtime();
-
-	    if ( childOldestFileMTime > 0 && newChild->isFile() )
-	    {
-		if ( _oldestFileMtime == 0 ||
-		     childOldestFileMTime < _oldestFileMtime )
-		{
-		    _oldestFileMtime = childOldestFileMTime;
-		}
-	    }
-	}
-	else
-	{
-	    // NOP
-
-	    /*
-	     * Don't bother updating the summary fields if the summary is dirty
-	     * (i.e. outdated) anyway: As soon as anybody wants to know some
-	     * exact value a complete recalculation of the entire subtree will
-	     * be triggered. On the other hand, if nobody wants to know (which
-	     * is very likely) we can save this effort.
-	     */
-	}
-    }
+    if ( newChild->parent() == this && ! _summaryDirty )
+	_directChildrenCount++;
 
-    if ( _lastSortCol != ReadJobsCol )
-	dropSortCache();
+    dropSortCache();
 
-    if ( _parent )
-	_parent->childAdded( newChild );
+    SummaryDelta delta;
+    delta.add( newChild );
+    addToSummary( delta, 1 );
 }
 
 
 void DirInfo::deletingChild( FileInfo * child )
 {
-    /**
-     * When children are deleted, things go downhill: Marking the summary
-     * fields as dirty (i.e. outdated) is the only thing that can be done here.
-     *
-     * The accumulated sizes could be updated (by subtracting this deleted
-     * child's values from them), but the latest mtime definitely has to be
-     * recalculated: The child now being deleted might just be the one with the
-     * latest mtime, and figuring out the second-latest cannot easily be
-     * done. So we merely mark the summary as dirty and wait until a recalc()
-     * will be triggered from outside - which might as well never happen if
-     * nobody wants to know some summary field anyway.
-     **/
-
-    _summaryDirty = true;
-
-    if ( _parent )
-	_parent->deletingChild( child );
-
     if ( child->parent() == this )
     {
 	if ( ! _deletingAll )
@@ -662,6 +1179,9 @@ void DirInfo::deletingChild( FileInfo * child )
 	     * doesn't happen recursively for all children of this object: No
 	     * use bothering about the validity of the children's list if this
 	     * will all be history anyway in a moment.
+	     *
+	     * This also subtracts the child's values from the summary fields
+	     * of this directory and all its ancestors.
 	     **/
 
 	    unlinkChild( child );
@@ -671,6 +1191,10 @@ void DirInfo::deletingChild( FileInfo * child )
 	    dropSortCache();
 	}
     }
+    else if ( _parent )
+    {
+	_parent->deletingChild( child );
+    }
 }
 
 
@@ -684,41 +1208,54 @@ void DirInfo::unlinkChild( FileInfo * deletedChild )
     }
 
     dropSortCache();
-    _summaryDirty = true;
+    bool unlinked = false;
 
     if ( deletedChild == _firstChild )
     {
 	// logDebug() << "Unlinking first child " << deletedChild << endl;
 	_firstChild = deletedChild->next();
-	return;
+	unlinked = true;
     }
-
-    FileInfo * child = firstChild();
-
-    while ( child )
+    else
     {
-	if ( child->next() == deletedChild )
+	FileInfo * child = firstChild();
+
+	while ( child && ! unlinked )
 	{
-	    // logDebug() << "Unlinking " << deletedChild << endl;
-	    child->setNext( deletedChild->next() );
+	    if ( child->next() == deletedChild )
+	    {
+		// logDebug() << "Unlinking " << deletedChild << endl;
+		child->setNext( deletedChild->next() );
+		unlinked = true;
+	    }
 
-	    return;
+	    child = child->next();
 	}
+    }
 
-	child = child->next();
+    if ( ! unlinked )
+    {
+	logError() << "Couldn't unlink " << deletedChild << " from "
+		   << this << " children list" << endl;
+	return;
     }
 
-    logError() << "Couldn't unlink " << deletedChild << " from "
-	       << this << " children list" << endl;
+    if ( _childNameIndex )
+	_childNameIndex->remove( deletedChild );
+
+    if ( ! _summaryDirty )
+	_directChildrenCount--;
+
+    SummaryDelta delta;
+    delta.add( deletedChild );
+    addToSummary( delta, -1 );
 }
 
 
 void DirInfo::readJobAdded()
 {
     _pendingReadJobs++;
-
-    if ( _lastSortCol == ReadJobsCol )
-	dropSortCache();
+    dropSortCache( ReadJobsChanged );
 
     if ( _parent )
 	_parent->readJobAdded();
@@ -728,9 +1265,7 @@ void DirInfo::readJobAdded()
 void DirInfo::readJobFinished( DirInfo * dir )
 {
     _pendingReadJobs--;
-
-    if ( _lastSortCol == ReadJobsCol )
-	dropSortCache();
+    dropSortCache( ReadJobsChanged );
 
     if ( dir && dir != this && dir->readError() )
 	_errSubDirCount++;
@@ -810,6 +1345,10 @@ void DirInfo::finalizeLocal()
     cleanupDotEntries();
     cleanupAttics();
     checkIgnored();
+
+#if VERIFY_SUMMARY
+    verifySummary();
+#endif
 }
 
 
@@ -855,8 +1394,10 @@ void DirInfo::cleanupDotEntries()
 
 	if ( _dotEntry->hasAtticChildren() )
 	{
-	    ensureAttic();
-	    _attic->takeAllChildren( _dotEntry->attic() );
+	    if ( _attic )
+		_attic->takeAllChildren( _dotEntry->attic() );
+	    else
+		adoptDotEntryAttic();
 	}
     }
 
@@ -872,6 +1413,31 @@ void DirInfo::cleanupDotEntries()
 }
 
 
+void DirInfo::adoptDotEntryAttic()
+{
+    // Just move the complete attic instead of creating a new one: This is
+    // cheaper, and it does not create any tree nodes, so this can also be
+    // done in a worker thread.
+
+    Attic * attic = _dotEntry->_attic;
+
+    SummaryDelta delta;
+    delta.ignoredItems = attic->totalIgnoredItems();
+    delta.errSubDirs   = attic->errSubDirCount();
+
+    // For this directory and all its ancestors nothing changes: They got
+    // all the values of the attic through the dot entry.
+
+    _dotEntry->addToLocalSummary( delta, -1, AtticFields );
+    _dotEntry->_attic = 0;
+    _dotEntry->dropSortCache();
+
+    _attic = attic;
+    _attic->setParent( this );
+    dropSortCache();
+}
+
+
 void DirInfo::cleanupAttics()
 {
     if ( _dotEntry )
@@ -883,13 +1449,9 @@ void DirInfo::cleanupAttics()
 
 	if ( ! _attic->firstChild() && ! _attic->dotEntry() )
 	{
-	    delete _attic;
+	    deleteNode( _attic );
 	    _attic = 0;
-
-	    if ( _lastIncludeAttic )
-		dropSortCache();
-
-	    _summaryDirty = true;
+	    dropSortCache();
 	}
     }
 }
@@ -927,7 +1489,6 @@ void DirInfo::ignoreEmptySubDirs()
 	    {
 		// logDebug() << "Ignoring empty subdir " << (*it) << endl;
 		(*it)->setIgnored( true );
-		_summaryDirty = true;
 	    }
 	}
 
@@ -968,126 +1529,225 @@ const FileInfoList & DirInfo::sortedChildren( DataColumn    sortCol,
 					      Qt::SortOrder sortOrder,
 					      bool	    includeAttic )
 {
-    if ( _sortedChildren &&
-	 sortCol      == _lastSortCol	   &&
-	 sortOrder    == _lastSortOrder	   &&
-	 includeAttic == _lastIncludeAttic    )
+    // Use a list with the same parameters if there is one; move it to the
+    // front so the least recently used one is the last one.
+
+    SortedChildren * prev = 0;
+
+    for ( SortedChildren * list = _sortCache; list; list = list->next )
     {
-	return *_sortedChildren;
-    }
+	if ( list->sortCol	== sortCol   &&
+	     list->sortOrder	== sortOrder &&
+	     list->includeAttic == includeAttic )
+	{
+	    if ( prev )
+	    {
+		prev->next = list->next;
+		list->next = _sortCache;
+		_sortCache = list;
+	    }
 
+	    return list->children;
+	}
 
-    // Clean old sorted children list and create a new one
+	prev = list;
+    }
 
-    dropSortCache( true ); // recursive
-    _sortedChildren = new FileInfoList();
-    CHECK_NEW( _sortedChildren );
 
+    // Create a new list. Lists with other sort parameters, both here and
+    // in the subtree, are left alone: They may still be needed, e.g. when
+    // the user switches back to another sort column.
 
-    // Populate with unsorted children list
+    SortedChildren * list = new SortedChildren;
+    CHECK_NEW( list );
+
+    list->sortCol      = sortCol;
+    list->sortOrder    = sortOrder;
+    list->includeAttic = includeAttic;
+    list->rows	       = 0;
+    list->children.reserve( qMax( _directChildrenCount, 0 ) );
 
     FileInfo * child = _firstChild;
 
     while ( child )
     {
-	_sortedChildren->append( child );
+	list->children.append( child );
 	child = child->next();
     }
 
     if ( _dotEntry )
-	_sortedChildren->append( _dotEntry );
+	list->children.append( _dotEntry );
 
+    // logDebug() << "Sorting children of " << this << " by " << sortCol << endl;
 
-    // Sort
+    // One pass by sortCol ascending or descending (as specified in
+    // sortOrder) with secondary sorting by NameCol (always ascending)
 
-    // logDebug() << "Sorting children of " << this << " by " << sortCol << endl;
+    std::stable_sort( list->children.begin(),
+		      list->children.end(),
+		      FileInfoSorter( sortCol, sortOrder, true ) ); // nameTiebreak
 
-    if ( sortCol != NameCol )
-    {
-	// Do secondary sorting by NameCol (always in ascending order)
+    if ( includeAttic && _attic )
+	list->children.append( _attic );
 
-	std::stable_sort( _sortedChildren->begin(),
-			  _sortedChildren->end(),
-			  FileInfoSorter( NameCol, Qt::AscendingOrder ) );
-    }
+    sortCaches.ref();
+    sortCacheItems.fetchAndAddRelaxed( list->children.size() );
 
+    list->next = _sortCache;
+    _sortCache = list;
+    registerHeapOwner();
 
-    // Primary sorting by sortCol ascending or descending (as specified in sortOrder)
 
-    std::stable_sort( _sortedChildren->begin(),
-		      _sortedChildren->end(),
-		      FileInfoSorter( sortCol, sortOrder ) );
+    // Drop the least recently used lists if there are too many
 
-    if ( includeAttic && _attic )
-	_sortedChildren->append( _attic );
+    int count = 1;
 
-    _lastSortCol      = sortCol;
-    _lastSortOrder    = sortOrder;
-    _lastIncludeAttic = includeAttic;
+    for ( SortedChildren * keep = _sortCache; keep->next; keep = keep->next )
+    {
+	if ( ++count > SORT_CACHE_MAX_LISTS )
+	{
+	    deleteSortedChildren( keep->next );
+	    keep->next = 0;
+	    break;
+	}
+    }
 
 
 #if DIRECT_CHILDREN_COUNT_SANITY_CHECK
 
-    if ( _sortedChildren->size() != _directChildrenCount )
+    if ( list->children.size() != _directChildrenCount )
     {
-	Debug::dumpChildrenList( this, *_sortedChildren );
+	Debug::dumpChildrenList( this, list->children );
 
 	THROW( Exception( QString( "_directChildrenCount of %1 corrupted; is %2, should be %3" )
 			  .arg( debugUrl() )
 			  .arg( _directChildrenCount )
-			  .arg( _sortedChildren->size() ) ) );
+			  .arg( list->children.size() ) ) );
     }
 #endif
 
-    return *_sortedChildren;
+    return list->children;
 }
 
 
-void DirInfo::dropSortCache( bool recursive )
+void DirInfo::dropSortCache( SortCacheChange change )
 {
-    if ( _sortedChildren )
+    // logDebug() << "Dropping sort cache for " << this << endl;
+
+    // Intentionally deleting the lists and creating new ones when needed
+    // since QList never shrinks, it always just grows (this is documented):
+    // QList.clear() would not free the allocated space.
+    //
+    // This only affects this directory: The sort order of the children of
+    // the subdirectories does not change if anything changes here.
+
+    SortedChildren ** link = &_sortCache;
+
+    while ( *link )
     {
-	// logDebug() << "Dropping sort cache for " << this << endl;
-
-	// Intentionally deleting the list and creating a new one since
-	// QList never shrinks, it always just grows (this is documented):
-	// QList.clear() would not free the allocated space.
-	//
-	// If we get lucky, we won't even need the _sortedChildren list any
-	// more if nobody asks for it. This prevents pathological cases where
-	// the user opened all tree branches at once (there are menu entries to
-	// open to a certain tree level), then closed them again and now opens
-	// select branches manually.
-
-	delete _sortedChildren;
-	_sortedChildren = 0;
-
-	// Optimization: If this dir didn't have any sort cache, there won't be
-	// any in the subtree, either. And dot entries don't have dir children
-	// that could have a sort cache.
-
-	if ( recursive )
+	SortedChildren * list = *link;
+
+	if ( sortOrderAffected( list->sortCol, change ) )
 	{
-	    if ( ! isDotEntry() )
-	    {
-		FileInfo * child = _firstChild;
+	    *link = list->next;
+	    deleteSortedChildren( list );
+	}
+	else
+	{
+	    link = &list->next;
+	}
+    }
+}
 
-		while ( child )
-		{
-		    if ( child->isDirInfo() )
-			child->toDirInfo()->dropSortCache( recursive );
 
-		    child = child->next();
-		}
+int DirInfo::sortedRow( FileInfo *    child,
+			DataColumn    sortCol,
+			Qt::SortOrder sortOrder,
+			bool	      includeAttic )
+{
+    const FileInfoList & children = sortedChildren( sortCol, sortOrder, includeAttic );
 
-		if ( _dotEntry )
-		    _dotEntry->dropSortCache( recursive );
-	    }
+    if ( children.size() < SORTED_ROWS_MIN_CHILDREN )
+	return children.indexOf( child );
 
-	    if ( _attic )
-		_attic->dropSortCache( recursive );
+    // sortedChildren() moved the list to the front
+
+    SortedChildren * list = _sortCache;
+
+    if ( ! list->rows )
+    {
+	list->rows = new QHash<const FileInfo *, int>();
+	CHECK_NEW( list->rows );
+
+	list->rows->reserve( children.size() );
+
+	for ( int row = 0; row < children.size(); ++row )
+	    list->rows->insert( children.at( row ), row );
+
+	sortedRowItems.fetchAndAddRelaxed( list->rows->size() );
+    }
+
+    return list->rows->value( child, -1 );
+}
+
+
+int DirInfo::sortCacheCount()
+{
+    return sortCaches.load();
+}
+
+
+int DirInfo::sortCacheEntries()
+{
+    return sortCacheItems.load();
+}
+
+
+int DirInfo::sortedRowEntries()
+{
+    return sortedRowItems.load();
+}
+
+
+const ChildNameIndex * DirInfo::childNameIndex()
+{
+    if ( ! _childNameIndex )
+    {
+	int count = 0;
+
+	for ( FileInfo * child = _firstChild;
+	      child && count < CHILD_NAME_INDEX_MIN_CHILDREN;
+	      child = child->next() )
+	{
+	    ++count;
 	}
+
+	if ( count < CHILD_NAME_INDEX_MIN_CHILDREN )
+	    return 0;
+
+	_childNameIndex = new ChildNameIndex( _firstChild );
+	CHECK_NEW( _childNameIndex );
+	registerHeapOwner();
     }
+
+    return _childNameIndex->isUsable() ? _childNameIndex : 0;
+}
+
+
+void DirInfo::dropChildNameIndex()
+{
+    if ( _childNameIndex )
+    {
+	delete _childNameIndex;
+	_childNameIndex = 0;
+    }
+}
+
+
+void DirInfo::childRenamed( FileInfo * child, const char * oldName )
+{
+    if ( _childNameIndex )
+	_childNameIndex->rename( child, oldName );
 }
 
 
@@ -1102,6 +1762,42 @@ const DirInfo * DirInfo::findNearestMountPoint() const
 }
 
 
+FileInfo * DirInfo::replaceAllChildren( FileInfo * newChild )
+{
+    CHECK_PTR( newChild );
+
+    FileInfo * oldChildren = _firstChild;
+    SummaryDelta removed;
+    int count = 0;
+
+    for ( FileInfo * child = oldChildren; child; child = child->next() )
+    {
+	removed.add( child );
+	++count;
+    }
+
+    _firstChild = newChild;
+    newChild->setNext( 0 );
+    newChild->setParent( this );
+    dropSortCache();
+    dropChildNameIndex();
+
+    if ( ! _summaryDirty )
+	_directChildrenCount += 1 - count;
+
+    SummaryDelta added;
+    added.add( newChild );
+
+    if ( ! ( added == removed ) )
+    {
+	addToSummary( removed, -1 );
+	addToSummary( added,	1 );
+    }
+
+    return oldChildren;
+}
+
+
 void DirInfo::takeAllChildren( DirInfo * oldParent )
 {
     FileInfo * child = oldParent->firstChild();
@@ -1113,20 +1809,26 @@ void DirInfo::takeAllChildren( DirInfo * oldParent )
 	FileInfo * oldFirstChild = _firstChild;
 	_firstChild = child;
 	FileInfo * lastChild = child;
+	SummaryDelta delta;
+	int count = 0;
 
 	oldParent->setFirstChild( 0 );
-	oldParent->recalc();
-
-	_directChildrenCount = -1;
-	_summaryDirty	     = true;
 
 	while ( child )
 	{
 	    child->setParent( this );
+	    delta.add( child );
+	    ++count;
 	    lastChild = child;
 	    child = child->next();
 	}
 
 	lastChild->setNext( oldFirstChild );
+
+	oldParent->_directChildrenCount -= count;
+	_directChildrenCount		+= count;
+	dropChildNameIndex();
+	dropSortCache();
+	moveSummary( oldParent, delta );
     }
 }
@@ -20,6 +20,42 @@ namespace QDirStat
     // Forward declarations
     class DirTree;
     class DotEntry;
+    class ChildNameIndex;
+    struct SortedChildren;
+
+
+    /**
+     * The contribution of one child (including its subtree) to the summary
+     * fields of its parent and the other ancestors. Additions, deletions
+     * and changes of children are pushed up the tree as such deltas.
+     **/
+    struct SummaryDelta
+    {
+	SummaryDelta();
+
+	/**
+	 * Add the contribution of 'child' to this delta.
+	 **/
+	void add( FileInfo * child );
+
+	/**
+	 * Return 'true' if all values are the same as in 'other'.
+	 **/
+	bool operator==( const SummaryDelta & other ) const;
+
+	FileSize	size;
+	FileSize	allocatedSize;
+	FileSize	blocks;
+	int		items;
+	int		subDirs;
+	int		files;
+	int		ignoredItems;
+	int		unignoredItems;
+	int		errSubDirs;
+	time_t		latestMtime;
+	time_t		oldestFileMtime;
+    };
+
 
     /**
      * A more specialized version of FileInfo: This class can actually manage
@@ -41,6 +77,16 @@ namespace QDirStat
 		 DirTree       * tree,
 		 DirInfo       * parent = 0 );
 
+	/**
+	 * Constructor from a stat buffer with the name as it was read from
+	 * the directory: UTF-8, 'len' bytes.
+	 **/
+	DirInfo( const char  * utf8Name,
+		 int	       len,
+		 struct stat * statInfo,
+		 DirTree     * tree,
+		 DirInfo     * parent = 0 );
+
 	/**
 	 * Constructor from the bare necessary fields for use from a cache file
 	 * reader.
@@ -67,6 +113,18 @@ namespace QDirStat
 	 **/
 	virtual ~DirInfo();
 
+	/**
+	 * Allocate from the DirInfo SlabPool of 'tree'. See
+	 * FileInfo::operator new().
+	 **/
+	static void * operator new( size_t size, DirTree * tree );
+	static void operator delete( void * ptr, size_t size );
+
+	/**
+	 * Return the SlabPool for DirInfo objects of 'tree'.
+	 **/
+	static SlabPool * slabPool( DirTree * tree );
+
 	/**
 	 * Returns the total size in bytes of this subtree.
 	 *
@@ -93,6 +151,13 @@ namespace QDirStat
 	 **/
 	virtual FileSize totalBlocks() Q_DECL_OVERRIDE;
 
+	/**
+	 * Returns a pointer to the DirTree this entry belongs to.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual DirTree * tree() const Q_DECL_OVERRIDE { return _tree; }
+
 	/**
 	 * Returns the total number of children in this subtree, excluding this
 	 * item.
@@ -255,7 +320,7 @@ namespace QDirStat
 	 * Reimplemented - inherited from FileInfo.
 	 **/
 	virtual void setFirstChild( FileInfo * newfirstChild ) Q_DECL_OVERRIDE
-	    { _firstChild = newfirstChild; }
+	    { _firstChild = newfirstChild; dropChildNameIndex(); }
 
 	/**
 	 * Insert a child into the children list.
@@ -325,13 +390,29 @@ namespace QDirStat
 	 **/
 	virtual void deleteEmptyAttic();
 
+	/**
+	 * Start collecting the dot entries and attics that are deleted in
+	 * the current thread instead of deleting them right away. Tree nodes
+	 * may only be deleted in the main thread.
+	 **/
+	static void deferDeletes();
+
+	/**
+	 * Return the nodes collected since deferDeletes() in the current
+	 * thread and stop collecting them. The caller has to delete them in
+	 * the main thread.
+	 **/
+	static FileInfoList takeDeferredDeletes();
+
 	/**
 	 * Return 'true' if there is an attic and it has any children.
 	 **/
 	bool hasAtticChildren() const;
 
 	/**
-	 * Notification that a child has been added somewhere in the subtree.
+	 * Notification that a direct child has been added. This adds its
+	 * values to the summary fields of this directory and all its
+	 * ancestors.
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
@@ -432,24 +513,91 @@ namespace QDirStat
 	 **/
 	void setReadState( DirReadState newReadState );
 
+	/**
+	 * Set the read state of this directory after it was finished to an
+	 * error state (DirError or DirPermissionDenied) and count it as a
+	 * subdirectory with a read error in the ancestors. This is for errors
+	 * that only show up later, e.g. in DirTree::fillSizes().
+	 **/
+	void setReadError( DirReadState errorState = DirError );
+
 	/**
 	 * Return a list of (direct) children sorted by 'sortCol' and
 	 * 'sortOrder' (Qt::AscendingOrder or Qt::DescendingOrder).  If
 	 * 'includeAttic' is 'true', the attic (if there is one) is added to
 	 * the list.
 	 *
-	 * This might return cached information if all parameters are the same
-	 * as for the last call to this function, and there were no children
-	 * added or removed in the meantime.
+	 * The lists for the last few different parameters are cached until
+	 * anything changes that affects their order. Sorting is done lazily
+	 * for each directory when its children are requested, i.e. only for
+	 * the directories that are visible in the view.
 	 **/
 	const FileInfoList & sortedChildren( DataColumn	   sortCol,
 					     Qt::SortOrder sortOrder,
 					     bool	   includeAttic = false );
 
 	/**
-	 * Drop all cached information about children sorting.
+	 * What changed so the sorted lists of children may be invalid.
+	 **/
+	enum SortCacheChange
+	{
+	    ChildrenChanged,	// Children added or removed
+	    SummaryChanged,	// Summary values (size etc.) of the children
+	    ReadJobsChanged	// Pending read jobs
+	};
+
+	/**
+	 * Drop the cached sorted lists of children whose order may be
+	 * different after 'change'. This does not affect the subdirectories.
+	 **/
+	void dropSortCache( SortCacheChange change = ChildrenChanged );
+
+	/**
+	 * Return the row of 'child' in the list that sortedChildren() returns
+	 * for the same parameters, or -1 if it is not in that list.
+	 *
+	 * For large lists, this uses a hash of the rows that is created on
+	 * demand and dropped along with the sort cache, so this is O(1)
+	 * instead of searching the list.
+	 **/
+	int sortedRow( FileInfo *    child,
+		       DataColumn    sortCol,
+		       Qt::SortOrder sortOrder,
+		       bool	     includeAttic = false );
+
+	/**
+	 * Return the number of sort caches of all directories.
+	 **/
+	static int sortCacheCount();
+
+	/**
+	 * Return the total number of entries in all sort caches.
+	 **/
+	static int sortCacheEntries();
+
+	/**
+	 * Return the total number of entries in all hashes of sorted rows.
+	 **/
+	static int sortedRowEntries();
+
+	/**
+	 * Return the index of the direct children (not those in the dot
+	 * entry or the attic) by name, or 0 if this directory has too few
+	 * children for that or their names can't be indexed. The index is
+	 * built on demand and kept up to date as children are added or
+	 * removed.
+	 **/
+	const ChildNameIndex * childNameIndex();
+
+	/**
+	 * Drop the index of the children by name.
+	 **/
+	void dropChildNameIndex();
+
+	/**
+	 * Notification that 'child' was renamed from 'oldName'.
 	 **/
-	void dropSortCache( bool recursive = false );
+	void childRenamed( FileInfo * child, const char * oldName );
 
 	/**
 	 * Check if this directory is locked. This is purely a user lock
@@ -502,6 +650,45 @@ namespace QDirStat
 	 **/
 	void clearTouched( bool recursive = false );
 
+	/**
+	 * Set or clear the flag that the non-directory children of this
+	 * directory were created without an lstat() call (structure-only
+	 * scan), so they don't have any sizes yet.
+	 **/
+	void setSizesPending( bool pending = true ) { _sizesPending = pending; }
+
+	/**
+	 * Return 'true' if the sizes of the non-directory children of this
+	 * directory still need to be filled in. See DirTree::fillSizes().
+	 **/
+	bool sizesPending() const { return _sizesPending; }
+
+	/**
+	 * Set or clear the flag that the subtree of this directory was not
+	 * read from a cache file yet: This directory does not have any
+	 * children, but its summary fields already include them. See
+	 * DirTree::loadSubtree().
+	 **/
+	void setSubtreePending( bool pending = true ) { _subtreePending = pending; }
+
+	/**
+	 * Return 'true' if the subtree of this directory still needs to be
+	 * read from a cache file.
+	 **/
+	bool subtreePending() const { return _subtreePending; }
+
+	/**
+	 * Add 'delta' to the summary fields of this directory and of all its
+	 * ancestors ('sign' 1) or subtract it from them ('sign' -1). Use this
+	 * with a delta taken before and one taken after changing the values
+	 * of a child that is already in the tree.
+	 *
+	 * This is O(depth). Above an attic, only the ignored items and the
+	 * subdirectories with read errors are changed, just like recalc()
+	 * does it.
+	 **/
+	void addToSummary( const SummaryDelta & delta, int sign );
+
 	/**
 	 * Returns true if this is a DirInfo object.
 	 *
@@ -540,14 +727,44 @@ namespace QDirStat
 	 **/
 	virtual void takeAllChildren( DirInfo * oldParent );
 
+	/**
+	 * Replace all children with 'newChild' and return the old ones as a
+	 * list linked with next(). The caller has to delete them (after
+	 * DirTree::deletingChildNotify() if any views know them).
+	 *
+	 * The ancestors are only updated if 'newChild' does not add up to
+	 * exactly the same summary values as the old children.
+	 **/
+	FileInfo * replaceAllChildren( FileInfo * newChild );
+
+	/**
+	 * Forget all children, the dot entry and the attic without deleting
+	 * them, and release the sort caches and the child name index. This is
+	 * only for DirTree::releaseNodes() which releases all the children at
+	 * once afterwards. This does not update any summary fields.
+	 **/
+	void abandonChildren();
+
 	/**
 	 * Recursively recalculate the summary fields when they are dirty.
 	 *
 	 * This is a _very_ expensive operation since the entire subtree may
 	 * recursively be traversed.
+	 *
+	 * Normally this is only needed when a child with the latest or the
+	 * oldest mtime was removed; all other changes are propagated up the
+	 * tree as SummaryDelta.
 	 **/
 	void recalc();
 
+	/**
+	 * Compare the summary fields with the result of recalc() and log any
+	 * differences. Return 'true' if they are all the same.
+	 *
+	 * This is for debugging the incremental summary updates.
+	 **/
+	bool verifySummary();
+
 
     protected:
 
@@ -565,6 +782,71 @@ namespace QDirStat
 	 **/
 	virtual void cleanupAttics();
 
+	/**
+	 * Tell the tree that this directory owns memory outside of the
+	 * SlabPools of the tree (see DirTree::addHeapOwner()).
+	 **/
+	void registerHeapOwner();
+
+	/**
+	 * Delete all children, the dot entry and the attic without updating
+	 * any summary fields.
+	 **/
+	void deleteAllChildren();
+
+	/**
+	 * Delete a dot entry or an attic, or add it to the deferred deletes
+	 * of this thread. See deferDeletes().
+	 **/
+	static void deleteNode( DirInfo * node );
+
+	/**
+	 * Move the dot entry's attic to this directory which does not have
+	 * one yet.
+	 **/
+	void adoptDotEntryAttic();
+
+	/**
+	 * Create the dot entry from a constructor.
+	 **/
+	void initDotEntry();
+
+	/**
+	 * Return the summary delta of the contents of this directory, i.e.
+	 * without its own values.
+	 **/
+	SummaryDelta contentsDelta();
+
+	/**
+	 * Which summary fields to change in addToLocalSummary().
+	 **/
+	enum SummaryFields
+	{
+	    AllFields,		// All fields
+	    AtticFields,	// Only the ones that include the attic
+	    NonAtticFields	// All but those
+	};
+
+	/**
+	 * Add 'delta' to the summary fields of this directory only.
+	 **/
+	void addToLocalSummary( const SummaryDelta & delta,
+				int		     sign,
+				SummaryFields	     fields );
+
+	/**
+	 * Add 'delta' to the summary fields of this directory's ancestors,
+	 * but not to this directory itself.
+	 **/
+	void addToAncestorsSummary( const SummaryDelta & delta, int sign );
+
+	/**
+	 * Update the summary fields after 'delta' was moved from the subtree
+	 * of 'oldParent' to this directory. 'oldParent' is a pseudo
+	 * directory below this one, so for most ancestors nothing changes.
+	 **/
+	void moveSummary( DirInfo * oldParent, const SummaryDelta & delta );
+
 
 	//
 	// Data members
@@ -576,7 +858,11 @@ namespace QDirStat
 	bool		_deletingAll:1;		// Deleting complete children tree?
 	bool		_locked:1;		// App lock
 	bool		_touched:1;		// App 'touch' flag
+	bool		_sizesPending:1;	// Files not lstat()ed yet
+	bool		_subtreePending:1;	// Children not read from cache yet
+	bool		_heapOwner:1;		// Registered with the tree
 	int		_pendingReadJobs;	// number of open directories in this subtree
+	DirTree *	_tree;			// pointer to the parent tree
 
 	// Children management
 
@@ -599,10 +885,9 @@ namespace QDirStat
 	time_t		_latestMtime;
 	time_t		_oldestFileMtime;
 
-	FileInfoList *	_sortedChildren;
-	DataColumn	_lastSortCol;
-	Qt::SortOrder	_lastSortOrder;
-	bool		_lastIncludeAttic;
+	SortedChildren * _sortCache;		// Most recently used first
+
+	ChildNameIndex * _childNameIndex;
 
 	DirReadState	_readState;
 
@@ -9,12 +9,20 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>	// SYS_getdents64
 #include <fcntl.h>	// AT_ constants (fstatat() flags)
 #include <unistd.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>	// strerror()
+#include <errno.h>
+#include <algorithm>	// std::sort()
 
 #include <QMutableListIterator>
-#include <QMultiMap>
+#include <QThreadStorage>
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QMutableMapIterator>
 
 #include "DirReadJob.h"
 #include "DirTree.h"
@@ -22,19 +30,63 @@
 #include "Attic.h"
 #include "ExcludeRules.h"
 #include "MountPoints.h"
+#include "StatxBatch.h"
 #include "Exception.h"
 
 #define DONT_TRUST_NTFS_HARD_LINKS      1
 #define VERBOSE_NTFS_HARD_LINKS         0
 
+// Minimum number of directory entries to use io_uring for; for smaller
+// directories, setting up the batch costs more than it saves.
+#define MIN_IO_URING_BATCH		8
+
+// Number of lstat() calls to take from the throttle at once in low-impact
+// scans
+#define THROTTLED_STAT_BATCH		32
+
+// Size of the buffer for one getdents64() call
+#define GETDENTS_BUFFER_SIZE		( 256 * 1024 )
+
+#ifndef DTTOIF
+#  define DTTOIF( dirtype )		( (dirtype) << 12 )
+#endif
+
 using namespace QDirStat;
 
 
+#ifdef SYS_getdents64
+
+// The record getdents64() returns; glibc doesn't have a declaration for it.
+struct LinuxDirent64
+{
+    uint64_t		d_ino;
+    int64_t		d_off;
+    unsigned short	d_reclen;
+    unsigned char	d_type;
+    char		d_name[1];	// Actually variable length, 0-terminated
+};
+
+static QThreadStorage<QByteArray> getdentsBuffers;
+
+#endif
+
+
+/**
+ * Sort order for LocalDirEntry: By i-number.
+ **/
+struct LocalDirEntryInodeLess
+{
+    bool operator() ( const LocalDirEntry & a, const LocalDirEntry & b ) const
+	{ return a.ino < b.ino; }
+};
+
+
 DirReadJob::DirReadJob( DirTree * tree,
 			DirInfo * dir  ):
     _tree( tree ),
     _dir( dir ),
-    _queue( 0 )
+    _queue( 0 ),
+    _queuePos( 0 )
 {
     _started = false;
 
@@ -45,7 +97,9 @@ DirReadJob::DirReadJob( DirTree * tree,
 
 DirReadJob::~DirReadJob()
 {
-    if ( ! _tree->beingDestroyed() )
+    // A canceled job might outlive its tree: Check _dir first
+
+    if ( _dir && ! _tree->beingDestroyed() )
     {
 	// Only do this if the tree is not in the process of being destroyed;
 	// otherwise all FileInfo / DirInfo pointers pointing into that tree
@@ -55,12 +109,22 @@ DirReadJob::~DirReadJob()
 	//
 	// https://github.com/shundhammer/qdirstat/issues/122
 
-	if ( _dir )
-	    _dir->readJobFinished( _dir );
+	_dir->readJobFinished( _dir );
     }
 }
 
 
+void DirReadJob::cancel()
+{
+    _canceled.fetchAndStoreOrdered( 1 );
+
+    if ( _dir && ! _tree->beingDestroyed() )
+	_dir->readJobFinished( _dir );
+
+    _dir = 0;
+}
+
+
 /**
  * Default implementation - derived classes should overwrite this method or
  * startReading() (or both).
@@ -187,17 +251,57 @@ bool DirReadJob::shouldCrossIntoFilesystem( const DirInfo * dir ) const
 
 
 bool LocalDirReadJob::_warnedAboutNtfsHardLinks = false;
+bool LocalDirReadJob::_useIoUring		= true;
+
+
+QAtomicInt DirFd::_openCount;
 
 
-LocalDirReadJob::LocalDirReadJob( DirTree * tree,
-				  DirInfo * dir ):
+DirFd::DirFd( int fd ):
+    _fd( fd )
+{
+    _openCount.ref();
+}
+
+
+DirFd::~DirFd()
+{
+    ::close( _fd );
+    _openCount.deref();
+}
+
+
+bool DirFd::mayKeepOpen()
+{
+    return _openCount.load() < MAX_KEPT_DIR_FDS;
+}
+
+
+
+
+LocalDirReadJob::LocalDirReadJob( DirTree *	   tree,
+				  DirInfo *	   dir,
+				  const QString &  dirName,
+				  const DirFdPtr & parentFd ):
     DirReadJob( tree, dir ),
+    _dirName( dirName ),
+    _parentFd( parentFd ),
     _applyFileChildExcludeRules( false ),
     _checkedForNtfs( false ),
-    _isNtfs( false )
+    _isNtfs( false ),
+    _structureOnly( tree->structureOnly() ),
+    _readResult( DirFinished ),
+    _statCount( 0 ),
+    _statsThrottled( false )
 {
     if ( _dir )
-	_dirName = _dir->url();
+    {
+	if ( _dirName.isEmpty() )
+	    _dirName = _dir->url();
+
+	if ( _parentFd )
+	    _nameInParent = _dir->name().toUtf8();
+    }
 }
 
 
@@ -209,85 +313,310 @@ LocalDirReadJob::~LocalDirReadJob()
 
 void LocalDirReadJob::startReading()
 {
-    struct dirent * entry;
-    struct stat	    statInfo;
-    QString	    defaultCacheName = DEFAULT_CACHE_NAME;
-    DIR *	    diskDir;
+    readEntries( 0 );
+    processEntries();
+}
 
-    // logDebug() << _dir << endl;
 
-    bool ok = true;
+void LocalDirReadJob::readEntries( ScanThrottle * throttle )
+{
+    // This might be called in a worker thread:
+    // Don't touch _dir, _tree or anything else outside this object here,
+    // and don't log anything.
+
+    _entries.clear();
+    _names.clear();
+    _dirFd.clear();
+    _readResult = DirFinished;
+    _statCount	= 0;
+    _statsThrottled = throttle != 0;
+
+    // No separate access() check: open() reports a missing read permission,
+    // and a missing execute permission shows up as EACCES from lstat().
 
-    if ( access( _dirName.toUtf8(), X_OK | R_OK ) != 0 )
+    int dirFd = openDir();
+
+    if ( dirFd < 0 )
     {
-	ok = false;
-	logWarning() << "No permission to read directory " << _dirName << endl;
-	finishReading( _dir, DirPermissionDenied );
+	_readResult = errno == EACCES ? DirPermissionDenied : DirError;
+	return;
     }
 
-    if ( ok )
+    if ( ! readRawEntries( dirFd ) )
     {
-	diskDir = ::opendir( _dirName.toUtf8() );
-
-	if ( ! diskDir )
-	{
-	    logWarning() << "opendir(" << _dirName << ") failed" << endl;
-	    ok = false;
-	    // opendir() doesn't set 'errno' according to POSIX	 :-(
-	    finishReading( _dir, DirError );
-	}
+	::close( dirFd );
+	_entries.clear();
+	_names.clear();
+	_readResult = DirError;
+	return;
     }
 
-    if ( ok )
-    {
-	_dir->setReadState( DirReading );
-	int dirFd = dirfd( diskDir );
-	int flags = AT_SYMLINK_NOFOLLOW;
+    // The names don't move anymore now that _names is complete
+
+    for ( int i=0; i < _entries.size(); ++i )
+	_entries[i].name = _names.constData() + _entries[i].nameOffset;
+
+    // Sort by i-number: Most filesystems will benefit from that since they
+    // store i-nodes sorted by i-number on disk, so (at least with rotational
+    // disks) seek times are minimized by this strategy. Multiple hard links
+    // to the same file in this directory simply end up next to each other.
+
+    std::sort( _entries.begin(), _entries.end(), LocalDirEntryInodeLess() );
+
+    int flags = AT_SYMLINK_NOFOLLOW;
 
 #ifdef AT_NO_AUTOMOUNT
-	flags |= AT_NO_AUTOMOUNT;
+    flags |= AT_NO_AUTOMOUNT;
 #endif
 
-	QMultiMap<ino_t, QString> entryMap;
+    // If possible, let the kernel do all the statx() calls for this
+    // directory in one batch; otherwise (or if that fails) fall back to one
+    // fstatat() call after the other. A throttled scan is not about
+    // throughput, and the throttle could not pace the io_uring batch.
+    //
+    // In a structure-only scan, only directories and entries of unknown type
+    // are stat()ed: The directories are needed for the device number (so we
+    // don't cross filesystems) and for further reading. Everything else just
+    // gets its type from d_type.
+
+    bool statDone = false;
+
+    if ( ! _structureOnly && ! throttle && _useIoUring && _entries.size() >= MIN_IO_URING_BATCH )
+	statDone = StatxBatch::forCurrentThread()->statAll( dirFd, _entries, flags );
 
-	while ( ( entry = readdir( diskDir ) ) )
+    if ( statDone )
+    {
+	_statCount = _entries.size();
+    }
+    else
+    {
+	for ( int i=0; i < _entries.size() && ! isCanceled(); ++i )
 	{
-	    QString entryName = QString::fromUtf8( entry->d_name );
+	    LocalDirEntry & dirEntry = _entries[i];
+
+	    if ( _structureOnly && dirEntry.type != DT_UNKNOWN && dirEntry.type != DT_DIR )
+	    {
+		memset( &dirEntry.statInfo, 0, sizeof( dirEntry.statInfo ) );
+		dirEntry.statInfo.st_mode  = DTTOIF( dirEntry.type );
+		dirEntry.statInfo.st_nlink = 1;
+		dirEntry.statInfo.st_ino   = dirEntry.ino;
+		continue;
+	    }
 
-	    if ( entryName != "."  &&
-		 entryName != ".."   )
+	    if ( throttle && _statCount % THROTTLED_STAT_BATCH == 0 )
 	    {
-		entryMap.insert( entry->d_ino, entryName );
+		if ( ! throttle->waitForStats( qMin( THROTTLED_STAT_BATCH, _entries.size() - i ), &_canceled ) )
+		    break;
 	    }
+
+	    ++_statCount;
+
+	    if ( fstatat( dirFd, dirEntry.name, &dirEntry.statInfo, flags ) != 0 )
+		dirEntry.statErrno = errno;
 	}
+    }
 
-	// QMultiMap (just like QMap) guarantees sort order by keys, so we are
-	// now iterating over the directory entries by i-number order. Most
-	// filesystems will benefit from that since they store i-nodes sorted
-	// by i-number on disk, so (at least with rotational disks) seek times
-	// are minimized by this strategy.
-	//
-	// Notice that we need a QMultiMap, not just a map: If a file has
-	// multiple hard links in the same directory, a QMap would store only
-	// one of them, all others would go missing in the DirTree.
+    if ( isCanceled() )
+    {
+	// Nobody will look at the results
+
+	::close( dirFd );
+	_entries.clear();
+	_names.clear();
+	_readResult = DirAborted;
+	return;
+    }
+
+    // Without execute permission for the directory, every single lstat()
+    // fails with EACCES. Treat that just like a missing read permission.
+
+    bool haveSubDirs  = false;
+    int	 accessErrors = 0;
+
+    for ( int i=0; i < _entries.size(); ++i )
+    {
+	const LocalDirEntry & dirEntry = _entries.at(i);
+
+	if ( dirEntry.statErrno == EACCES )
+	    ++accessErrors;
+	else if ( dirEntry.statErrno == 0 && S_ISDIR( dirEntry.statInfo.st_mode ) )
+	    haveSubDirs = true;
+    }
+
+    if ( accessErrors > 0 && accessErrors == _statCount )
+    {
+	::close( dirFd );
+	_entries.clear();
+	_names.clear();
+	_readResult = DirPermissionDenied;
+	return;
+    }
+
+    // Keep the directory open for the subdirectories if possible
+
+    if ( haveSubDirs && DirFd::mayKeepOpen() )
+	_dirFd = DirFdPtr( new DirFd( dirFd ) );
+    else
+	::close( dirFd );
+}
+
+
+int LocalDirReadJob::openDir()
+{
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    int fd;
+
+    if ( _parentFd )
+    {
+	// If the directory was replaced by a symlink since it was found in
+	// the parent, don't follow it.
+
+	fd = ::openat( _parentFd->fd(), _nameInParent.constData(), flags | O_NOFOLLOW );
+
+	// Don't hold on to the parent any longer than needed. This might
+	// close it, so take care of 'errno'.
+
+	int savedErrno = errno;
+	_parentFd.clear();
+	errno = savedErrno;
+    }
+    else
+    {
+	fd = ::open( _dirName.toUtf8(), flags );
+    }
+
+    return fd;
+}
+
+
+bool LocalDirReadJob::readRawEntries( int dirFd )
+{
+#ifdef SYS_getdents64
+
+    // Read the entries with getdents64() in large chunks directly into a
+    // per-thread buffer, bypassing the small buffer of readdir().
+
+    if ( ! getdentsBuffers.hasLocalData() )
+	getdentsBuffers.setLocalData( QByteArray( GETDENTS_BUFFER_SIZE, Qt::Uninitialized ) );
+
+    QByteArray & buffer = getdentsBuffers.localData();
+    char * buf = buffer.data();
+    long   len = 0;
+
+    while ( ! isCanceled() &&
+	    ( len = syscall( SYS_getdents64, dirFd, buf, buffer.size() ) ) > 0 )
+    {
+	long pos = 0;
 
-	foreach ( QString entryName, entryMap )
+	while ( pos < len )
 	{
-	    if ( fstatat( dirFd, entryName.toUtf8(), &statInfo, flags ) == 0 )	// OK?
+	    const LinuxDirent64 * entry = (const LinuxDirent64 *) ( buf + pos );
+	    pos += entry->d_reclen;
+	    addRawEntry( entry->d_ino, entry->d_type, entry->d_name );
+	}
+    }
+
+    return len == 0;
+
+#else
+
+    int fd = dup( dirFd );	// closedir() will close it
+    DIR * diskDir = fd >= 0 ? fdopendir( fd ) : 0;
+
+    if ( ! diskDir )
+    {
+	if ( fd >= 0 )
+	    ::close( fd );
+
+	return false;
+    }
+
+    struct dirent * entry;
+
+    while ( ! isCanceled() && ( entry = readdir( diskDir ) ) )
+    {
+#ifdef _DIRENT_HAVE_D_TYPE
+	addRawEntry( entry->d_ino, entry->d_type, entry->d_name );
+#else
+	addRawEntry( entry->d_ino, DT_UNKNOWN, entry->d_name );
+#endif
+    }
+
+    closedir( diskDir );
+
+    return true;
+
+#endif
+}
+
+
+void LocalDirReadJob::addRawEntry( ino_t ino, unsigned char type, const char * name )
+{
+    if ( name[0] == '.' &&
+	 ( name[1] == '\0' || ( name[1] == '.' && name[2] == '\0' ) ) )
+    {
+	return; // Skip "." and ".."
+    }
+
+    LocalDirEntry dirEntry;
+    dirEntry.ino	= ino;
+    dirEntry.name	= 0;	// Set when all names are read
+    dirEntry.nameOffset = _names.size();
+    dirEntry.nameLen	= strlen( name );
+    dirEntry.type	= type;
+    dirEntry.statErrno	= 0;
+    _entries.append( dirEntry );
+
+    _names.append( name, dirEntry.nameLen + 1 ); // including the terminating 0
+}
+
+
+void LocalDirReadJob::processEntries()
+{
+    // logDebug() << _dir << endl;
+
+    if ( _readResult == DirPermissionDenied )
+    {
+	logWarning() << "No permission to read directory " << _dirName << endl;
+	finishReading( _dir, DirPermissionDenied );
+    }
+    else if ( _readResult == DirError )
+    {
+	logWarning() << "opendir(" << _dirName << ") failed" << endl;
+	finishReading( _dir, DirError );
+    }
+    else
+    {
+	_dir->setReadState( DirReading );
+
+	for ( int i=0; i < _entries.size(); ++i )
+	{
+	    LocalDirEntry & dirEntry = _entries[i];
+	    const char *    name     = dirEntry.name;
+	    struct stat &   statInfo = dirEntry.statInfo;
+
+	    // Only decode the name where a QString is really needed: The new
+	    // items intern the raw UTF-8 name.
+
+	    if ( dirEntry.statErrno == 0 )	// OK?
 	    {
 		if ( S_ISDIR( statInfo.st_mode ) )	// directory child?
 		{
-		    DirInfo *subDir = new DirInfo( entryName, &statInfo, _tree, _dir );
+		    DirInfo *subDir = new ( _tree ) DirInfo( name, dirEntry.nameLen, &statInfo, _tree, _dir );
 		    CHECK_NEW( subDir );
 
-		    processSubDir( entryName, subDir );
+		    // For the exclude rules and the mount point check
+		    processSubDir( QString::fromUtf8( name, dirEntry.nameLen ), subDir );
 
 		}
 		else  // non-directory child
 		{
-		    if ( entryName == defaultCacheName )	// .qdirstat.cache.gz found?
+		    if ( ( strcmp( name, DEFAULT_CACHE_NAME ) == 0 ||	// .qdirstat.cache.gz found?
+			   strcmp( name, DEFAULT_BINARY_CACHE_NAME ) == 0 ) &&
+			 _tree->readCacheFiles() )
 		    {
-			logDebug() << "Found cache file " << defaultCacheName << endl;
+			QString entryName = QString::fromUtf8( name, dirEntry.nameLen );
+			logDebug() << "Found cache file " << entryName << endl;
 
 			// Try to read the cache file. If that was successful and the toplevel
 			// path in that cache file matches the path of the directory we are
@@ -311,7 +640,7 @@ void LocalDirReadJob::startReading()
 #endif
                         {
                             logWarning() << "Not trusting NTFS with hard links: \""
-                                         << _dir->url() << "/" << entryName
+                                         << _dir->url() << "/" << QString::fromUtf8( name )
                                          << "\" links: " << statInfo.st_nlink
                                          << " -> resetting to 1"
                                          << endl;
@@ -321,10 +650,10 @@ void LocalDirReadJob::startReading()
                         statInfo.st_nlink = 1;
                     }
 #endif
-		    FileInfo * child = new FileInfo( entryName, &statInfo, _tree, _dir );
+		    FileInfo * child = new ( _tree ) FileInfo( name, dirEntry.nameLen, &statInfo, _tree, _dir );
 		    CHECK_NEW( child );
 
-		    if ( checkIgnoreFilters( entryName ) )
+		    if ( checkIgnoreFilters( name ) )
 		    {
 			// logDebug() << "Ignoring " << child << endl;
 			_dir->addToAttic( child );
@@ -337,11 +666,15 @@ void LocalDirReadJob::startReading()
 	    }
 	    else  // lstat() error
 	    {
-		handleLstatError( entryName );
+		handleLstatError( QString::fromUtf8( name, dirEntry.nameLen ), dirEntry.statErrno );
 	    }
 	}
 
-	closedir( diskDir );
+	if ( _statCount < _entries.size() )
+	    _dir->setSizesPending();
+
+	_entries.clear();
+	_names.clear();
 	DirReadState readState = DirFinished;
 
 	//
@@ -383,6 +716,10 @@ void LocalDirReadJob::finishReading( DirInfo * dir, DirReadState readState )
     CHECK_PTR( dir );
 
     dir->setReadState( readState );
+
+    if ( _tree->memoryBudgetExceeded() )
+	_tree->foldSmallFiles( dir );
+
     dir->finalizeLocal();
     _tree->sendReadJobFinished( dir );
 }
@@ -402,7 +739,7 @@ void LocalDirReadJob::processSubDir( const QString & entryName, DirInfo * subDir
     {
 	if ( ! crossingFilesystems(_dir, subDir ) ) // normal case
 	{
-	    LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir );
+	    LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir, fullName( entryName ), _dirFd );
 	    CHECK_NEW( job );
 	    job->setApplyFileChildExcludeRules( true );
 	    _tree->addJob( job );
@@ -413,7 +750,7 @@ void LocalDirReadJob::processSubDir( const QString & entryName, DirInfo * subDir
 
 	    if ( _tree->crossFilesystems() && shouldCrossIntoFilesystem( subDir ) )
 	    {
-		LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir );
+		LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir, fullName( entryName ), _dirFd );
 		CHECK_NEW( job );
 		job->setApplyFileChildExcludeRules( true );
 		_tree->addJob( job );
@@ -441,12 +778,12 @@ bool LocalDirReadJob::matchesExcludeRule( const QString & entryName ) const
 }
 
 
-bool LocalDirReadJob::checkIgnoreFilters( const QString & entryName ) const
+bool LocalDirReadJob::checkIgnoreFilters( const char * entryName ) const
 {
     if ( ! _tree->hasFilters() )
 	return false;
 
-    return _tree->checkIgnoreFilters( fullName( entryName ) );
+    return _tree->checkIgnoreFilters( fullName( QString::fromUtf8( entryName ) ) );
 }
 
 
@@ -524,23 +861,26 @@ void LocalDirReadJob::excludeDirLate()
 }
 
 
-void LocalDirReadJob::handleLstatError( const QString & entryName )
+void LocalDirReadJob::handleLstatError( const QString & entryName, int errorNo )
 {
     logWarning() << "lstat(" << fullName( entryName ) << ") failed: "
-		 << formatErrno() << endl;
+		 << QString::fromUtf8( strerror( errorNo ) ) << endl;
 
     /*
      * Not much we can do when lstat() didn't work; let's at
      * least create an (almost empty) entry as a placeholder.
      */
-    DirInfo *child = new DirInfo( _tree, _dir, entryName,
+    DirInfo *child = new ( _tree ) DirInfo( _tree, _dir, entryName,
 				  0,   // mode
 				  0,   // size
 				  0 ); // mtime
     CHECK_NEW( child );
-    child->finalizeLocal();
     child->setReadState( DirError );
     _dir->insertChild( child );
+
+    // Only now that it is in the tree, so the parent gets the summary
+    // changes from removing the empty dot entry
+    child->finalizeLocal();
     childAdded( child );
 }
 
@@ -574,7 +914,7 @@ FileInfo * LocalDirReadJob::stat( const QString & url,
 
 	if ( S_ISDIR( statInfo.st_mode ) )	// directory?
 	{
-	    DirInfo * dir = new DirInfo( name, &statInfo, tree, parent );
+	    DirInfo * dir = new ( tree ) DirInfo( name, &statInfo, tree, parent );
 	    CHECK_NEW( dir );
 
 	    if ( parent )
@@ -593,7 +933,7 @@ FileInfo * LocalDirReadJob::stat( const QString & url,
 	}
 	else					// no directory
 	{
-	    FileInfo * file = new FileInfo( name, &statInfo, tree, parent );
+	    FileInfo * file = new ( tree ) FileInfo( name, &statInfo, tree, parent );
 	    CHECK_NEW( file );
 
 	    if ( parent )
@@ -612,6 +952,15 @@ FileInfo * LocalDirReadJob::stat( const QString & url,
 }
 
 
+void LocalDirReadJob::setUseIoUring( bool use )
+{
+    _useIoUring = use && HAVE_IO_URING;
+
+    logInfo() << ( _useIoUring ? "Using" : "Not using" )
+	      << " io_uring for stat() calls" << endl;
+}
+
+
 bool LocalDirReadJob::isNtfs()
 {
     if ( ! _checkedForNtfs )
@@ -661,12 +1010,17 @@ CacheReadJob::CacheReadJob( DirTree	  * tree,
 
 void CacheReadJob::init()
 {
+    _finalizing = false;
+
     if ( _reader )
     {
 	if ( _reader->ok() )
 	{
 	    connect( _reader,	SIGNAL( childAdded    ( FileInfo * ) ),
 		     this,	SLOT  ( slotChildAdded( FileInfo * ) ) );
+
+	    connect( _reader,	SIGNAL( finalized() ),
+		     this,	SLOT  ( finalized() ) );
 	}
 	else
 	{
@@ -692,8 +1046,11 @@ CacheReadJob::read()
      * finished() is called.
      */
 
-    if ( ! _reader )
+    if ( ! _reader || _finalizing )
+    {
 	finished();
+	return;
+    }
 
     // logDebug() << "Reading 1000 cache lines" << endl;
     _reader->read( 1000 );
@@ -701,25 +1058,99 @@ CacheReadJob::read()
     if ( _reader->eof() || ! _reader->ok() )
     {
 	// logDebug() << "Cache reading finished - ok: " << _reader->ok() << endl;
-	finished();
+
+	// Large trees are finalized in worker threads: Wait for that with
+	// the blocked jobs, so the tree is still busy, but the main thread
+	// is free in the meantime.
+
+	_finalizing = _reader->startFinalizing();
+
+	if ( _finalizing )
+	    queue()->block( this );
+	else
+	    finished();
     }
 }
 
 
+void CacheReadJob::finalized()
+{
+    queue()->unblock( this );
+}
+
+
+
+
+
+namespace QDirStat
+{
+    /**
+     * Runnable for QThreadPool that does the I/O-bound part of one read job
+     * in a worker thread and reports back to the queue when done.
+     **/
+    class DirReadWorker: public QRunnable
+    {
+    public:
+
+	DirReadWorker( DirReadJob * job, DirReadJobQueue * queue, ScanThrottle * throttle ):
+	    _job( job ),
+	    _queue( queue ),
+	    _throttle( throttle )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    ScanThrottle::setThreadIdleIoPriority( _throttle != 0 );
+	    _job->readEntries( _throttle );
+	    _queue->threadedReadDone( _job );
+	}
+
+    protected:
+
+	DirReadJob *	  _job;
+	DirReadJobQueue * _queue;
+	ScanThrottle *	  _throttle;	// 0 if not throttled
+    };
+}
+
 
 
 
 DirReadJobQueue::DirReadJobQueue()
-    : QObject()
+    : QObject(),
+      _nextPos( 0 ),
+      _nextBoostedPos( -1 ),
+      _maxThreads( DEFAULT_READER_THREADS ),
+      _nextDevice( 0 )
 {
+    _threadPool.setMaxThreadCount( qMax( _maxThreads, 1 ) );
+
     connect( &_timer, SIGNAL( timeout() ),
 	     this,    SLOT  ( timeSlicedRead() ) );
+
+    _throttleTimer.setSingleShot( true );
+
+    connect( &_throttleTimer, SIGNAL( timeout()	     ),
+	     this,	      SLOT  ( resumeThrottled() ) );
 }
 
 
 DirReadJobQueue::~DirReadJobQueue()
 {
     clear();
+
+    // The workers still need this queue to report the canceled jobs
+
+    _threadPool.waitForDone();
+    qDeleteAll( _orphans );
+}
+
+
+void DirReadJobQueue::setMaxThreads( int maxThreads )
+{
+    _maxThreads = qMax( maxThreads, 0 );
+    _threadPool.setMaxThreadCount( qMax( _maxThreads, 1 ) );
+    logInfo() << "Using " << _maxThreads << " threads for reading directories" << endl;
 }
 
 
@@ -727,13 +1158,33 @@ void DirReadJobQueue::enqueue( DirReadJob * job )
 {
     if ( job )
     {
-	_queue.append( job );
-	job->setQueue( this );
-
-	if ( ! _timer.isActive() )
+	if ( _queue.isEmpty() )
 	{
 	    // logDebug() << "First job queued" << endl;
 	    emit startingReading();
+	}
+
+	job->setQueuePos( isBoosted( job ) ? _nextBoostedPos-- : _nextPos++ );
+	_queue.insert( job->queuePos(), job );
+
+	if ( job->dir() )
+	    _jobsByDir.insert( job->dir(), job );
+
+	job->setQueue( this );
+
+	if ( _maxThreads > 0 && job->canReadInThread() )
+	{
+	    dev_t device = jobDevice( job );
+
+	    if ( ! _deviceMaxThreads.contains( device ) )
+		_deviceMaxThreads.insert( device, maxThreadsForDevice( job ) );
+
+	    _deviceQueues[ device ].insert( job->queuePos(), job );
+
+	    startThreadedJobs();
+	}
+	else if ( ! _timer.isActive() )
+	{
 	    _timer.start( 0 );
 	}
     }
@@ -742,10 +1193,13 @@ void DirReadJobQueue::enqueue( DirReadJob * job )
 
 DirReadJob * DirReadJobQueue::dequeue()
 {
-    DirReadJob * job = _queue.takeFirst();
+    DirReadJob * job = _queue.first();
 
     if ( job )
+    {
+	removeFromQueue( job );
 	job->setQueue( 0 );
+    }
 
     return job;
 }
@@ -753,10 +1207,22 @@ DirReadJob * DirReadJobQueue::dequeue()
 
 void DirReadJobQueue::clear()
 {
-    qDeleteAll( _queue );
+    foreach ( DirReadJob * job, _queue )
+	deleteJob( job );
+
     qDeleteAll( _blocked );
     _queue.clear();
+    _jobsByDir.clear();
+    _nextPos = 0;
+    _nextBoostedPos = -1;
     _blocked.clear();
+    _prioritySubtrees.clear();
+    _throttleTimer.stop();
+    _threadedJobs.clear();
+    _deviceQueues.clear();
+    _deviceBusyThreads.clear();
+    _deviceMaxThreads.clear();
+    _nextDevice = 0;
 }
 
 
@@ -783,12 +1249,12 @@ void DirReadJobQueue::killAll( DirInfo * subtree, DirReadJob * exceptJob )
     if ( ! subtree )
 	return;
 
-    QMutableListIterator<DirReadJob *> it( _queue );
+    QMutableMapIterator<qint64, DirReadJob *> it( _queue );
     int count = 0;
 
     while ( it.hasNext() )
     {
-	DirReadJob * job = it.next();
+	DirReadJob * job = it.next().value();
 
 	if ( exceptJob && job == exceptJob )
 	{
@@ -801,15 +1267,17 @@ void DirReadJobQueue::killAll( DirInfo * subtree, DirReadJob * exceptJob )
 	    // logDebug() << "Killing " << job << endl;
 	    ++count;
 	    it.remove();
-	    delete job;
+	    _jobsByDir.remove( job->dir() );
+	    removeFromDeviceQueue( job );
+	    deleteJob( job );
 	}
     }
 
-    it = QMutableListIterator<DirReadJob *>( _blocked );
+    QMutableListIterator<DirReadJob *> blockedIt( _blocked );
 
-    while ( it.hasNext() )
+    while ( blockedIt.hasNext() )
     {
-	DirReadJob * job = it.next();
+	DirReadJob * job = blockedIt.next();
 
 	if ( exceptJob && job == exceptJob )
 	{
@@ -821,19 +1289,334 @@ void DirReadJobQueue::killAll( DirInfo * subtree, DirReadJob * exceptJob )
 	{
 	    // logDebug() << "Killing " << job << endl;
 	    ++count;
-	    it.remove();
+	    blockedIt.remove();
 	    delete job;
 	}
     }
 
+    // The subtree might be about to be deleted: Don't keep any pointers
+    // into it.
+
+    QMutableListIterator<DirInfo *> prioIt( _prioritySubtrees );
+
+    while ( prioIt.hasNext() )
+    {
+	if ( prioIt.next()->isInSubtree( subtree ) )
+	    prioIt.remove();
+    }
+
     logDebug() << "Killed " << count << " read jobs for " << subtree << endl;
 }
 
 
+void DirReadJobQueue::prioritize( DirInfo * subtree )
+{
+    if ( ! subtree || _queue.isEmpty() || ! subtree->isBusy() )
+	return;
+
+    _prioritySubtrees.removeOne( subtree );
+    _prioritySubtrees.prepend( subtree );
+
+    while ( _prioritySubtrees.size() > MAX_PRIORITY_SUBTREES )
+	_prioritySubtrees.removeLast();
+
+    // Only directories that are still busy can have any queued jobs, so
+    // there is no need to search the whole queue for the jobs in that
+    // subtree.
+
+    JobMap jobs;
+    QList<DirInfo *> dirs;
+    dirs << subtree;
+
+    while ( ! dirs.isEmpty() )
+    {
+	DirInfo * dir = dirs.takeLast();
+	DirReadJob * job = _jobsByDir.value( dir );
+
+	if ( job )
+	    jobs.insert( job->queuePos(), job );
+
+	for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+	{
+	    if ( child->isDirInfo() && child->toDirInfo()->isBusy() )
+		dirs << child->toDirInfo();
+	}
+    }
+
+    // Move them to the front, keeping their relative order
+
+    JobMap::const_iterator it = jobs.constEnd();
+
+    while ( it != jobs.constBegin() )
+    {
+	--it;
+	moveToFront( it.value() );
+    }
+
+    // logDebug() << "Prioritized " << subtree << endl;
+}
+
+
+void DirReadJobQueue::moveToFront( DirReadJob * job )
+{
+    QMap<dev_t, JobMap>::iterator devIt = _deviceQueues.find( jobDevice( job ) );
+    bool waitingForWorker = devIt != _deviceQueues.end() && devIt.value().remove( job->queuePos() ) > 0;
+
+    _queue.remove( job->queuePos() );
+    job->setQueuePos( _nextBoostedPos-- );
+    _queue.insert( job->queuePos(), job );
+
+    if ( waitingForWorker )
+	devIt.value().insert( job->queuePos(), job );
+}
+
+
+void DirReadJobQueue::removeFromQueue( DirReadJob * job )
+{
+    if ( _queue.remove( job->queuePos() ) > 0 && _jobsByDir.value( job->dir() ) == job )
+	_jobsByDir.remove( job->dir() );
+}
+
+
+void DirReadJobQueue::removeFromDeviceQueue( DirReadJob * job )
+{
+    QMap<dev_t, JobMap>::iterator it = _deviceQueues.find( jobDevice( job ) );
+
+    if ( it != _deviceQueues.end() )
+	it.value().remove( job->queuePos() );
+}
+
+
+bool DirReadJobQueue::isBoosted( DirReadJob * job )
+{
+    if ( _prioritySubtrees.isEmpty() || ! job->dir() )
+	return false;
+
+    QMutableListIterator<DirInfo *> it( _prioritySubtrees );
+
+    while ( it.hasNext() )
+    {
+	DirInfo * subtree = it.next();
+
+	if ( ! subtree->isBusy() )	// Completely read meanwhile
+	{
+	    it.remove();
+	    continue;
+	}
+
+	if ( job->dir()->isInSubtree( subtree ) )
+	    return true;
+    }
+
+    return false;
+}
+
+
 void DirReadJobQueue::timeSlicedRead()
 {
-    if ( ! _queue.isEmpty() )
-	_queue.first()->read();
+    if ( _queue.isEmpty() )
+	return;
+
+    DirReadJob * job = _queue.first();
+
+    if ( _maxThreads > 0 && job->canReadInThread() )
+    {
+	// Nothing to do in the main thread right now: The head of the queue
+	// is (or will soon be) handled by a worker thread. The timer is
+	// restarted when the next job is finished.
+
+	startThreadedJobs();
+	_timer.stop();
+    }
+    else
+    {
+	// Only reading local directories is throttled; a cache file is
+	// just one file, and it is read in many time slices.
+
+	if ( job->canReadInThread() && ! mayStartJob() )
+	{
+	    _timer.stop();
+	    return;
+	}
+
+	job->read();
+    }
+}
+
+
+bool DirReadJobQueue::mayStartJob()
+{
+    if ( _throttle.startJob() )
+	return true;
+
+    if ( ! _throttleTimer.isActive() )
+	_throttleTimer.start( _throttle.delayMillisec() );
+
+    return false;
+}
+
+
+void DirReadJobQueue::resumeThrottled()
+{
+    if ( _queue.isEmpty() )
+	return;
+
+    startThreadedJobs();
+
+    if ( ! _timer.isActive() )
+	_timer.start( 0 );
+}
+
+
+void DirReadJobQueue::startThreadedJobs()
+{
+    if ( _maxThreads < 1 )
+	return;
+
+    // Hand out idle workers round robin to all devices that have pending
+    // jobs and that did not reach their limit yet. Each round starts after
+    // the device that got a worker last, so with more devices than idle
+    // workers the devices with the lowest numbers don't get all of them.
+
+    bool started = true;
+
+    while ( started && _threadedJobs.size() < _maxThreads )
+    {
+	started = false;
+	QList<dev_t> devices = _deviceQueues.keys();
+	int start = 0;
+
+	while ( start < devices.size() && devices[ start ] < _nextDevice )
+	    ++start;
+
+	for ( int i = 0; i < devices.size() && _threadedJobs.size() < _maxThreads; ++i )
+	{
+	    dev_t device = devices[ ( start + i ) % devices.size() ];
+	    JobMap & jobs = _deviceQueues[ device ];
+
+	    if ( jobs.isEmpty() )
+	    {
+		_deviceQueues.remove( device );
+		continue;
+	    }
+
+	    if ( _deviceBusyThreads.value( device ) < _deviceMaxThreads.value( device, _maxThreads ) )
+	    {
+		if ( ! mayStartJob() )
+		    return;
+
+		startThreadedJob( jobs.take( jobs.firstKey() ), device );
+		_nextDevice = device + 1;
+		started = true;
+	    }
+	}
+    }
+}
+
+
+void DirReadJobQueue::startThreadedJob( DirReadJob * job, dev_t device )
+{
+    _threadedJobs.insert( job, device );
+    _deviceBusyThreads[ device ]++;
+
+    DirReadWorker * worker = new DirReadWorker( job, this,
+						_throttle.isEnabled() ? &_throttle : 0 );
+    CHECK_NEW( worker );
+    _threadPool.start( worker ); // The pool takes over ownership
+}
+
+
+dev_t DirReadJobQueue::jobDevice( DirReadJob * job )
+{
+    return job->dir() ? job->dir()->device() : 0;
+}
+
+
+int DirReadJobQueue::maxThreadsForDevice( DirReadJob * job ) const
+{
+    if ( ! job->dir() )
+	return _maxThreads;
+
+    MountPoint * mountPoint = MountPoints::findNearestMountPoint( job->dir()->url() );
+
+    if ( mountPoint && mountPoint->isRotational() )
+    {
+	int maxThreads = qMin( _maxThreads, ROTATIONAL_DEVICE_THREADS );
+
+	logInfo() << mountPoint->device() << " is a rotational disk; using max. "
+		  << maxThreads << " threads for reading it" << endl;
+
+	return maxThreads;
+    }
+
+    return _maxThreads;
+}
+
+
+void DirReadJobQueue::threadedReadDone( DirReadJob * job )
+{
+    // This is called in the worker thread
+
+    {
+	QMutexLocker locker( &_threadedResultsMutex );
+	_threadedResults << job;
+    }
+
+    QMetaObject::invokeMethod( this, "processThreadedResult", Qt::QueuedConnection );
+}
+
+
+void DirReadJobQueue::processThreadedResult()
+{
+    DirReadJob * job = 0;
+
+    {
+	QMutexLocker locker( &_threadedResultsMutex );
+
+	if ( ! _threadedResults.isEmpty() )
+	    job = _threadedResults.takeFirst();
+    }
+
+    // There might be none if the job was killed in the meantime
+
+    if ( job && _orphans.remove( job ) )
+    {
+	delete job;	// Canceled while it was in the worker
+    }
+    else if ( job )
+    {
+	_deviceBusyThreads[ _threadedJobs.take( job ) ]--;
+	job->processEntries();
+
+	// The job might be deleted now; don't access it any more.
+    }
+}
+
+
+void DirReadJobQueue::deleteJob( DirReadJob * job )
+{
+    if ( _threadedJobs.contains( job ) )
+    {
+	_deviceBusyThreads[ _threadedJobs.take( job ) ]--;
+	bool workerDone;
+
+	{
+	    QMutexLocker locker( &_threadedResultsMutex );
+	    workerDone = _threadedResults.removeOne( job );
+	}
+
+	if ( ! workerDone )
+	{
+	    // processThreadedResult() deletes it when the worker is done
+
+	    job->cancel();
+	    _orphans.insert( job );
+	    _throttle.wakeAll();	// In case it is waiting for the throttle
+	    return;
+	}
+    }
+
+    delete job;
 }
 
 
@@ -843,7 +1626,8 @@ void DirReadJobQueue::jobFinishedNotify( DirReadJob *job )
     {
 	// Get rid of the old (finished) job.
 
-	_queue.removeOne( job );
+	_throttle.jobDone( job->statCount() );
+	removeFromQueue( job );
 	delete job;
     }
 
@@ -857,6 +1641,13 @@ void DirReadJobQueue::jobFinishedNotify( DirReadJob *job )
 	if ( _blocked.isEmpty() )
 	    emit finished();
     }
+    else
+    {
+	startThreadedJobs();
+
+	if ( ! _timer.isActive() )
+	    _timer.start( 0 );
+    }
 }
 
 
@@ -876,6 +1667,17 @@ void DirReadJobQueue::addBlocked( DirReadJob * job )
 }
 
 
+void DirReadJobQueue::block( DirReadJob * job )
+{
+    removeFromQueue( job );
+    removeFromDeviceQueue( job );
+    _blocked.append( job );
+
+    if ( _queue.isEmpty() )
+	_timer.stop();
+}
+
+
 void DirReadJobQueue::unblock( DirReadJob * job )
 {
     _blocked.removeAll( job );
@@ -13,9 +13,35 @@
 
 #include <dirent.h>
 #include <QTimer>
+#include <QThreadPool>
+#include <QMutex>
+#include <QVector>
+#include <QHash>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QMap>
+#include <QSet>
 
 #include "FileInfo.h"
 #include "Logger.h"
+#include "ScanThrottle.h"
+
+// Default number of worker threads for reading local directories. 0 means
+// read everything in the main thread (time-sliced).
+#define DEFAULT_READER_THREADS	4
+
+// Maximum number of directory file descriptors that are kept open for
+// reading their subdirectories with openat() (see DirFd).
+#define MAX_KEPT_DIR_FDS	256
+
+// Maximum number of subtrees that are remembered for boosting the read jobs
+// in them (see DirReadJobQueue::prioritize()).
+#define MAX_PRIORITY_SUBTREES	32
+
+// Maximum number of worker threads reading from the same rotational disk at
+// the same time. More would only make the disk heads seek back and forth and
+// defeat reading the entries of each directory in i-number order.
+#define ROTATIONAL_DEVICE_THREADS	1
 
 
 namespace QDirStat
@@ -74,6 +100,46 @@ namespace QDirStat
 	 **/
 	virtual void read();
 
+	/**
+	 * Return 'true' if the I/O-bound part of this job (reading the
+	 * directory and stat()ing its entries) can be done in a worker
+	 * thread. Such jobs are not read with read(); the DirReadJobQueue
+	 * calls readEntries() in a worker thread and then processEntries() in
+	 * the main thread instead.
+	 *
+	 * This default implementation returns 'false'.
+	 **/
+	virtual bool canReadInThread() const { return false; }
+
+	/**
+	 * Do the I/O-bound part of reading this directory. If 'throttle' is
+	 * non-null, wait for it as needed (see ScanThrottle::waitForStats()).
+	 *
+	 * This is called in a worker thread, so it must not access the
+	 * DirTree, any of its items or anything else that is not thread-safe.
+	 *
+	 * This default implementation does nothing.
+	 **/
+	virtual void readEntries( ScanThrottle * throttle ) { Q_UNUSED( throttle ); }
+
+	/**
+	 * Process the results of readEntries() in the main thread: Create the
+	 * tree items, add them to the tree and call finished().
+	 *
+	 * This default implementation simply calls read().
+	 **/
+	virtual void processEntries() { read(); }
+
+	/**
+	 * Return the number of lstat() calls (or equivalent) that reading
+	 * this directory took and that were not already taken from the
+	 * throttle in readEntries(). This is used for throttling low-impact
+	 * scans.
+	 *
+	 * This default implementation returns 0.
+	 **/
+	virtual int statCount() const { return 0; }
+
 	/**
 	 * Returns the corresponding DirInfo item.
 	 * Caution: This may be 0.
@@ -100,6 +166,34 @@ namespace QDirStat
 	 **/
 	void setQueue( DirReadJobQueue * queue ) { _queue = queue; }
 
+	/**
+	 * Return the position of this job in its queue. Jobs with lower
+	 * positions are read first.
+	 **/
+	qint64 queuePos() const { return _queuePos; }
+
+	/**
+	 * Set the position of this job in its queue.
+	 **/
+	void setQueuePos( qint64 pos ) { _queuePos = pos; }
+
+	/**
+	 * Cancel this job while a worker thread may still be busy with its
+	 * readEntries(): Tell the directory that this job is done just like
+	 * the destructor would, and forget the directory, so the job can be
+	 * deleted later when the worker is done with it, even if the
+	 * directory is gone by then. readEntries() stops as soon as it
+	 * notices.
+	 *
+	 * This has to be called in the main thread.
+	 **/
+	void cancel();
+
+	/**
+	 * Return 'true' if this job was canceled. This is thread-safe.
+	 **/
+	bool isCanceled() const { return _canceled.load() != 0; }
+
 
     protected:
 
@@ -160,7 +254,9 @@ namespace QDirStat
 	DirTree *	   _tree;
 	DirInfo *	   _dir;
 	DirReadJobQueue *  _queue;
+	qint64		   _queuePos;
 	bool		   _started;
+	QAtomicInt	   _canceled;
 
     };	// class DirReadJob
 
@@ -189,6 +285,76 @@ namespace QDirStat
 
 
 
+    /**
+     * An open directory file descriptor that is shared between the read job
+     * of a directory and the read jobs of its subdirectories, so they can
+     * open their directory with openat() relative to it rather than letting
+     * the kernel resolve the complete path again.
+     *
+     * The file descriptor is closed when the last DirFdPtr to it goes away.
+     * Since each one of them uses up a file descriptor while read jobs are
+     * waiting in the queue, only a limited number of them are kept open at
+     * the same time (see mayKeepOpen()); read jobs without one fall back to
+     * the absolute path.
+     *
+     * This is thread-safe.
+     **/
+    class DirFd
+    {
+    public:
+
+	/**
+	 * Constructor. This takes over ownership of 'fd'.
+	 **/
+	DirFd( int fd );
+
+	/**
+	 * Destructor. This closes the file descriptor.
+	 **/
+	~DirFd();
+
+	/**
+	 * Return the file descriptor.
+	 **/
+	int fd() const { return _fd; }
+
+	/**
+	 * Return 'true' if another directory file descriptor may be kept
+	 * open, i.e. if there are fewer than MAX_KEPT_DIR_FDS right now.
+	 **/
+	static bool mayKeepOpen();
+
+    private:
+
+	Q_DISABLE_COPY( DirFd )
+
+	int		  _fd;
+	static QAtomicInt _openCount;
+    };
+
+    typedef QSharedPointer<DirFd> DirFdPtr;
+
+
+
+    /**
+     * One entry of a local directory as read by
+     * LocalDirReadJob::readEntries().
+     *
+     * The name is kept as the raw bytes from the directory; it is only
+     * converted to a QString when the FileInfo is created.
+     **/
+    struct LocalDirEntry
+    {
+	ino_t		ino;
+	const char *	name;		// Points into LocalDirReadJob::_names
+	int		nameOffset;	// Offset of 'name' in _names
+	int		nameLen;	// Without the terminating 0
+	unsigned char	type;		// d_type; DT_UNKNOWN if not supported
+	struct stat	statInfo;
+	int		statErrno;	// 0 if fstatat() was successful
+    };
+
+
     /**
      * Impementation of the abstract DirReadJob class that reads a local
      * directory.
@@ -207,8 +373,15 @@ namespace QDirStat
     public:
 	/**
 	 * Constructor.
+	 *
+	 * 'dirName' is the path of 'dir' if the caller already knows it;
+	 * otherwise it is taken from dir->url(). If 'parentFd' is set, the
+	 * directory is opened relative to that.
 	 **/
-	LocalDirReadJob( DirTree * tree, DirInfo * dir );
+	LocalDirReadJob( DirTree *	  tree,
+			 DirInfo *	  dir,
+			 const QString &  dirName  = QString(),
+			 const DirFdPtr & parentFd = DirFdPtr() );
 
 	/**
 	 * Destructor.
@@ -246,11 +419,68 @@ namespace QDirStat
 	void setApplyFileChildExcludeRules( bool val )
 	    { _applyFileChildExcludeRules = val; }
 
+	/**
+	 * Set the policy whether to use io_uring (if available) to lstat() all
+	 * entries of a directory in one batch. If io_uring is not available
+	 * in this build or in the running kernel, this falls back to one
+	 * fstatat() call per entry anyway.
+	 *
+	 * This flag will be read from the config file from the outside
+	 * (DirTreeModel) and set from there using this function.
+	 **/
+	static void setUseIoUring( bool use );
+
+	/**
+	 * Return the current io_uring policy. See setUseIoUring().
+	 **/
+	static bool useIoUring() { return _useIoUring; }
+
+	/**
+	 * Return 'true' since the I/O-bound part of reading a local directory
+	 * can be done in a worker thread.
+	 *
+	 * Reimplemented from DirReadJob.
+	 **/
+	virtual bool canReadInThread() const Q_DECL_OVERRIDE { return true; }
+
+	/**
+	 * Open the directory, read all entries and lstat() them, sorted by
+	 * i-number. This only uses _dirName or _parentFd and stores the
+	 * results in _entries, _readResult and _dirFd; it does not touch the
+	 * tree, so it can be called from a worker thread.
+	 *
+	 * With a 'throttle', the lstat() calls are done in batches, each one
+	 * waiting for the throttle, and without io_uring. Canceling the job
+	 * interrupts that wait.
+	 *
+	 * Reimplemented from DirReadJob.
+	 **/
+	virtual void readEntries( ScanThrottle * throttle ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Create FileInfo / DirInfo items from the results of readEntries(),
+	 * add them to the tree and queue read jobs for subdirectories. This
+	 * has to be called in the main thread.
+	 *
+	 * Reimplemented from DirReadJob.
+	 **/
+	virtual void processEntries() Q_DECL_OVERRIDE;
+
+	/**
+	 * Return the number of lstat() calls of the last readEntries() if it
+	 * was not throttled, 0 otherwise.
+	 **/
+	virtual int statCount() const Q_DECL_OVERRIDE
+	    { return _statsThrottled ? 0 : _statCount; }
+
     protected:
 
 	/**
 	 * Read the directory. Prior to this nothing happens.
 	 *
+	 * This does readEntries() and processEntries() in one go in the
+	 * current thread.
+	 *
 	 * Inherited and reimplemented from DirReadJob.
 	 **/
 	virtual void startReading();
@@ -261,6 +491,25 @@ namespace QDirStat
 	 **/
 	void finishReading( DirInfo * dir, DirReadState readState );
 
+	/**
+	 * Open the directory: With openat() relative to the parent directory
+	 * if possible, otherwise with its absolute path. Return the file
+	 * descriptor or -1 on error (with 'errno' set).
+	 **/
+	int openDir();
+
+	/**
+	 * Read all entries except "." and ".." of the open directory 'dirFd'
+	 * into _entries and _names in the order the filesystem returns them.
+	 * Return 'false' on error.
+	 **/
+	bool readRawEntries( int dirFd );
+
+	/**
+	 * Add an entry to _entries and its name to _names.
+	 **/
+	void addRawEntry( ino_t ino, unsigned char type, const char * name );
+
 	/**
 	 * Process one subdirectory entry.
 	 **/
@@ -274,9 +523,9 @@ namespace QDirStat
 	bool matchesExcludeRule( const QString & entryName ) const;
 
 	/**
-	 * Return 'true' if 'entryName' should be ignored.
+	 * Return 'true' if 'entryName' (UTF-8) should be ignored.
 	 **/
-	bool checkIgnoreFilters( const QString & entryName ) const;
+	bool checkIgnoreFilters( const char * entryName ) const;
 
 	/**
 	 * Read a cache file that was picked up along the way:
@@ -297,8 +546,9 @@ namespace QDirStat
 
 	/**
 	 * Handle an error during lstat() of a directory entry.
+	 * 'errorNo' is the errno value of that failed call.
 	 **/
-	void handleLstatError( const QString & entryName );
+	void handleLstatError( const QString & entryName, int errorNo );
 
 	/**
 	 * Exclude the directory of this read job after it is almost completely
@@ -325,12 +575,22 @@ namespace QDirStat
 	// Data members
 	//
 
-	QString _dirName;
-	bool	_applyFileChildExcludeRules;
-	bool	_checkedForNtfs;
-	bool	_isNtfs;
+	QString			_dirName;
+	QByteArray		_nameInParent;	// For openat() relative to _parentFd
+	DirFdPtr		_parentFd;
+	DirFdPtr		_dirFd;		// Kept open for the subdirectories
+	bool			_applyFileChildExcludeRules;
+	bool			_checkedForNtfs;
+	bool			_isNtfs;
+	bool			_structureOnly;
+	QVector<LocalDirEntry>	_entries;
+	QByteArray		_names;		// All entry names, 0-terminated
+	DirReadState		_readResult;
+	int			_statCount;
+	bool			_statsThrottled;
 
 	static bool _warnedAboutNtfsHardLinks;
+	static bool _useIoUring;
 
     };	// LocalDirReadJob
 
@@ -384,6 +644,15 @@ namespace QDirStat
 	CacheReader * reader() const { return _reader; }
 
 
+    protected slots:
+
+	/**
+	 * Notification that the reader finalized the tree: Continue in the
+	 * queue to finish this job.
+	 **/
+	void finalized();
+
+
     protected:
 
 	/**
@@ -393,6 +662,7 @@ namespace QDirStat
 
 
 	CacheReader * _reader;
+	bool	      _finalizing;
 
     };	// class CacheReadJob
 
@@ -402,6 +672,23 @@ namespace QDirStat
      * Queue for read jobs
      *
      * Handles time-sliced reading automatically.
+     *
+     * Jobs that can read in a worker thread (see
+     * DirReadJob::canReadInThread()) are handed to a pool of up to
+     * maxThreads() worker threads that do the I/O-bound part; their results
+     * are processed one job at a time in the main thread so all changes to
+     * the tree still happen there. All other jobs are read time-sliced in
+     * the main thread, one at a time, from the head of the queue. Jobs
+     * that are killed while a worker is still reading them are canceled
+     * and deleted when that worker is done, so the main thread never
+     * waits for a worker.
+     *
+     * Jobs for worker threads are grouped by the device (st_dev) of their
+     * directory, and each device gets its own limit of concurrent workers:
+     * A rotational disk only gets ROTATIONAL_DEVICE_THREADS, all others can
+     * use all of them. Idle workers are handed out round robin among the
+     * devices, so a slow USB disk can't starve the scan of a fast root
+     * filesystem when crossing filesystems.
      **/
     class DirReadJobQueue: public QObject
     {
@@ -433,7 +720,7 @@ namespace QDirStat
 	/**
 	 * Get the head of the queue (the next job that is due for processing).
 	 **/
-	DirReadJob * head() const { return _queue.first();}
+	DirReadJob * head() const { return _queue.first(); }
 
 	/**
 	 * Count the number of pending jobs in the queue.
@@ -459,6 +746,13 @@ namespace QDirStat
 	 **/
 	void unblock( DirReadJob * job );
 
+	/**
+	 * Take a job that is in the queue out of it and add it to the blocked
+	 * jobs until unblock() is called for it, e.g. because it continues
+	 * in worker threads that are not read jobs.
+	 **/
+	void block( DirReadJob * job );
+
 	/**
 	 * Clear the queue: Remove all pending jobs from the queue and destroy
 	 * them.
@@ -475,6 +769,17 @@ namespace QDirStat
 	 **/
 	void killAll( DirInfo * subtree, DirReadJob * exceptJob = 0 );
 
+	/**
+	 * Move all pending jobs for 'subtree' to the front of the queue, and
+	 * do the same with any jobs for that subtree that are added later
+	 * while it is still being read. This is used for directories that the
+	 * user can see right now, so they are complete as soon as possible
+	 * even during a very long scan.
+	 *
+	 * Subtrees that were prioritized last are read first.
+	 **/
+	void prioritize( DirInfo * subtree );
+
 	/**
 	 * Notification that a job is finished.
 	 * This takes that job out of the queue and deletes it.
@@ -482,6 +787,32 @@ namespace QDirStat
 	 **/
 	void jobFinishedNotify( DirReadJob *job );
 
+	/**
+	 * Set the maximum number of worker threads for reading local
+	 * directories. 0 means not to use any worker threads and to read
+	 * everything time-sliced in the main thread.
+	 **/
+	void setMaxThreads( int maxThreads );
+
+	/**
+	 * Return the maximum number of worker threads.
+	 **/
+	int maxThreads() const { return _maxThreads; }
+
+	/**
+	 * Return the throttle for low-impact scans. It is disabled by default.
+	 **/
+	ScanThrottle * throttle() { return &_throttle; }
+
+	/**
+	 * Notification from a worker thread that the I/O-bound part of 'job'
+	 * is done, and it is now ready for processEntries() in the main
+	 * thread.
+	 *
+	 * Unlike everything else in this class, this is thread-safe.
+	 **/
+	void threadedReadDone( DirReadJob * job );
+
 
     signals:
 
@@ -522,12 +853,107 @@ namespace QDirStat
 	 **/
 	void timeSlicedRead();
 
+	/**
+	 * Process the result of one job that was read in a worker thread:
+	 * Call its processEntries() method in the main thread.
+	 *
+	 * Worker threads invoke this via a queued connection once for each
+	 * job they are done with.
+	 **/
+	void processThreadedResult();
+
+	/**
+	 * Continue reading after the throttle made the queue pause.
+	 **/
+	void resumeThrottled();
+
 
     protected:
 
-	QList<DirReadJob *>  _queue;
+	/**
+	 * Hand pending jobs to worker threads as long as there are idle ones.
+	 **/
+	void startThreadedJobs();
+
+	/**
+	 * Hand one job to a worker thread.
+	 **/
+	void startThreadedJob( DirReadJob * job, dev_t device );
+
+	/**
+	 * Return the device (st_dev) of the directory of 'job' or 0 if there
+	 * is none.
+	 **/
+	static dev_t jobDevice( DirReadJob * job );
+
+	/**
+	 * Find out how many worker threads may read from the device of 'job'
+	 * at the same time.
+	 **/
+	int maxThreadsForDevice( DirReadJob * job ) const;
+
+	/**
+	 * Delete a job that was already taken out of the queue. If a worker
+	 * thread might still be busy with it, cancel it instead and delete it
+	 * only when the worker is done, so the main thread never has to wait
+	 * for any worker.
+	 **/
+	void deleteJob( DirReadJob * job );
+
+	/**
+	 * Return 'true' if 'job' is in one of the prioritized subtrees that is
+	 * still being read.
+	 **/
+	bool isBoosted( DirReadJob * job );
+
+	/**
+	 * Move 'job' to the front of the queue and of its device queue.
+	 **/
+	void moveToFront( DirReadJob * job );
+
+	/**
+	 * Take 'job' out of the queue (but not out of its device queue).
+	 **/
+	void removeFromQueue( DirReadJob * job );
+
+	/**
+	 * Take 'job' out of its device queue if it is still waiting there.
+	 **/
+	void removeFromDeviceQueue( DirReadJob * job );
+
+	/**
+	 * Ask the throttle if reading another directory may start now. If
+	 * not, this schedules resumeThrottled() for when it most likely may.
+	 **/
+	bool mayStartJob();
+
+
+	// Jobs by their queue position: Appended jobs get increasing positive
+	// positions, prepended ones decreasing negative positions, so moving a
+	// job to the front doesn't need to shift the whole queue.
+
+	typedef QMap<qint64, DirReadJob *> JobMap;
+
+	JobMap		     _queue;
+	QHash<DirInfo *, DirReadJob *> _jobsByDir;	// Jobs in _queue
+	qint64		     _nextPos;
+	qint64		     _nextBoostedPos;
 	QList<DirReadJob *>  _blocked;
+	QList<DirInfo *>     _prioritySubtrees;	// Most recent first
 	QTimer		     _timer;
+	ScanThrottle	     _throttle;
+	QTimer		     _throttleTimer;
+
+	int				    _maxThreads;
+	QThreadPool			    _threadPool;
+	QMap<dev_t, JobMap>		    _deviceQueues;	// Waiting for a worker
+	QHash<dev_t, int>		    _deviceBusyThreads;
+	QHash<dev_t, int>		    _deviceMaxThreads;
+	dev_t				    _nextDevice;	// Round robin cursor
+	QHash<DirReadJob *, dev_t>	    _threadedJobs;	// Handed to a worker, not processed yet
+	QList<DirReadJob *>		    _threadedResults;	// Done in the worker, protected by:
+	QMutex				    _threadedResultsMutex;
+	QSet<DirReadJob *>		    _orphans;		// Canceled, still in a worker
     };
 
 
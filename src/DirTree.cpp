@@ -7,14 +7,24 @@
  */
 
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
 #include <QDir>
 #include <QFileInfo>
+#include <QRunnable>
 
 #include "DirTree.h"
 #include "DirTreeCache.h"
+#include "BinaryCache.h"
 #include "DirTreeFilter.h"
 #include "DotEntry.h"
 #include "Attic.h"
+#include "FileAggregate.h"
+#include "SlabPool.h"
 #include "FileInfoIterator.h"
 #include "FileInfoSet.h"
 #include "ExcludeRules.h"
@@ -27,8 +37,51 @@
 using namespace QDirStat;
 
 
+namespace QDirStat
+{
+    /**
+     * Runnable for QThreadPool that formats the snapshot of a cache writer
+     * and writes it to its file. This does not access the tree at all.
+     **/
+    class CacheWriterTask: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor. This takes over ownership of 'writer'.
+	 **/
+	CacheWriterTask( DirTree *     tree,
+			 CacheWriter * writer ):
+	    _tree( tree ),
+	    _writer( writer )
+	    {}
+
+	virtual ~CacheWriterTask()
+	{
+	    delete _writer;
+	}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    bool ok = _writer->write();
+	    _tree->cacheWriterDone( _writer->fileName(), ok, _writer->errorMsg() );
+	}
+
+    protected:
+
+	DirTree *	_tree;
+	CacheWriter *	_writer;
+    };
+}
+
+
 DirTree::DirTree():
     QObject(),
+    _fileInfoPool( sizeof( FileInfo ), "FileInfo" ),
+    _dirInfoPool( sizeof( DirInfo ), "DirInfo" ),
+    _dotEntryPool( sizeof( DotEntry ), "DotEntry" ),
+    _atticPool( sizeof( Attic ), "Attic" ),
+    _aggregatePool( sizeof( FileAggregate ), "FileAggregate" ),
     _excludeRules( 0 ),
     _beingDestroyed( false ),
     _haveClusterSize( false ),
@@ -36,9 +89,19 @@ DirTree::DirTree():
 {
     _isBusy	      = false;
     _crossFilesystems = false;
-    _root = new DirInfo( this );
+    _structureOnly    = false;
+    _readCacheFiles   = true;
+    _lazyCacheLevels  = DEFAULT_LAZY_CACHE_LEVELS;
+    _memoryBudget     = 0;
+    _foldFilesBelow   = DEFAULT_FOLD_FILES_BELOW;
+
+    // Not from the pools of this tree: The root survives clear()
+    _root = new ( (DirTree *) 0 ) DirInfo( this );
     CHECK_NEW( _root );
 
+    // One cache file at a time
+    _cacheWriterPool.setMaxThreadCount( 1 );
+
     connect( & _jobQueue, SIGNAL( finished()	 ),
 	     this,	  SLOT	( slotFinished() ) );
 
@@ -49,11 +112,21 @@ DirTree::DirTree():
 
 DirTree::~DirTree()
 {
+    waitForCacheWriter();
     _beingDestroyed = true;
 
+    // No read job or cache reader may outlive the nodes
+    _jobQueue.clear();
+    releaseNodes();
+
     if ( _root )
 	delete _root;
 
+    clearPendingSubtrees();
+
+    // The cache writers are done
+    qDeleteAll( _retiredCacheFiles );
+
     if ( _excludeRules )
 	delete _excludeRules;
 
@@ -63,6 +136,8 @@ DirTree::~DirTree()
 
 void DirTree::setRoot( DirInfo *newRoot )
 {
+    dropFileColumns();
+
     if ( _root )
     {
 	emit deletingChild( _root );
@@ -98,13 +173,20 @@ QString DirTree::url() const
 void DirTree::clear()
 {
     _jobQueue.clear();
+    dropFileColumns();
 
     if ( _root )
     {
 	emit clearing();
-	_root->clear();
+	releaseNodes();
+	_root->recalc();
     }
 
+    clearPendingSubtrees();
+
+    // The root item has an empty name which is not in the pool
+    _namePool.clear();
+
     _isBusy	      = false;
     _haveClusterSize  = false;
     _blocksPerCluster = 0;
@@ -246,13 +328,12 @@ void DirTree::abortReading()
 
 void DirTree::finalizeTree()
 {
+    dropFileColumns();
+
     if ( _root && hasFilters() )
     {
-	recalc( _root );
 	ignoreEmptyDirs( _root );
-	recalc( _root );
 	moveIgnoredToAttic( _root );
-	recalc( _root );
     }
 }
 
@@ -267,6 +348,8 @@ void DirTree::slotFinished()
 
 void DirTree::childAddedNotify( FileInfo * newChild )
 {
+    dropFileColumns();
+
     if ( ! _haveClusterSize )
         detectClusterSize( newChild );
 
@@ -280,6 +363,7 @@ void DirTree::childAddedNotify( FileInfo * newChild )
 void DirTree::deletingChildNotify( FileInfo * deletedChild )
 {
     logDebug() << "Deleting child " << deletedChild << endl;
+    dropFileColumns();
     emit deletingChild( deletedChild );
 
     if ( deletedChild == _root )
@@ -297,6 +381,7 @@ void DirTree::deleteSubtree( FileInfo *subtree )
 {
     // logDebug() << "Deleting subtree " << subtree << endl;
     DirInfo * parent = subtree->parent();
+    dropFileColumns();
 
     // Send notification to anybody interested (e.g., to attached views)
     deletingChildNotify( subtree );
@@ -343,6 +428,7 @@ void DirTree::deleteSubtree( FileInfo *subtree )
 	parent->deletingChild( subtree );
     }
 
+    _namePool.release( subtree->rawName() );
     delete subtree;
 
     if ( subtree == _root )
@@ -359,6 +445,7 @@ void DirTree::clearSubtree( DirInfo * subtree )
     if ( subtree->hasChildren() )
     {
 	emit clearingSubtree( subtree );
+	dropFileColumns();
 	subtree->clear();
 	emit subtreeCleared( subtree );
     }
@@ -413,11 +500,12 @@ void DirTree::sendStartingReading( DirInfo * dir )
 void DirTree::sendReadJobFinished( DirInfo * dir )
 {
     // logDebug() << dir << endl;
+    dropFileColumns();	// finalizing the dir might have moved children
     emit readJobFinished( dir );
 }
 
 
-FileInfo * DirTree::locate( QString url, bool findPseudoDirs )
+FileInfo * DirTree::locate( const QString & url, bool findPseudoDirs )
 {
     if ( ! _root )
 	return 0;
@@ -435,15 +523,96 @@ FileInfo * DirTree::locate( QString url, bool findPseudoDirs )
 }
 
 
-bool DirTree::writeCache( const QString & cacheFileName )
+bool DirTree::writeCache( const QString & cacheFileName, bool longFormat )
 {
-    CacheWriter writer( cacheFileName.toUtf8(), this );
+    waitForCacheWriter( cacheFileName );
+    CacheWriter writer( cacheFileName.toUtf8(), this, longFormat );
     return writer.ok();
 }
 
 
+void DirTree::startWritingCache( const QString & cacheFileName, bool longFormat )
+{
+    // Two writers must not write the same file at the same time
+    waitForCacheWriter( cacheFileName );
+
+    // Only the snapshot accesses the tree, so this happens here in the
+    // main thread; the worker does everything else.
+
+    CacheWriter * writer = new CacheWriter( cacheFileName, longFormat );
+    CHECK_NEW( writer );
+
+    writer->snapshot( this );
+
+    // The snapshot uses the names in the pool and the cache files of
+    // pending subtrees; they have to stay until slotCacheWritten().
+
+    _namePool.pin();
+    _cacheWriterFiles << QFileInfo( cacheFileName ).absoluteFilePath();
+
+    CacheWriterTask * task = new CacheWriterTask( this, writer );
+    CHECK_NEW( task );
+
+    _cacheWriterPool.start( task );
+}
+
+
+void DirTree::waitForCacheWriter( const QString & cacheFileName )
+{
+    if ( _cacheWriterFiles.isEmpty() )
+	return;
+
+    if ( ! cacheFileName.isEmpty() &&
+	 ! _cacheWriterFiles.contains( QFileInfo( cacheFileName ).absoluteFilePath() ) )
+    {
+	return;
+    }
+
+    // cacheWritten() is still sent from the event loop
+
+    logInfo() << "Waiting for the cache writer" << endl;
+    _cacheWriterPool.waitForDone();
+}
+
+
+void DirTree::cacheWriterDone( const QString & cacheFileName,
+			       bool		  ok,
+			       const QString & errorMsg )
+{
+    // This is called in the worker thread: No logging here
+
+    QMetaObject::invokeMethod( this, "slotCacheWritten", Qt::QueuedConnection,
+			       Q_ARG( QString, cacheFileName ),
+			       Q_ARG( bool,    ok	     ),
+			       Q_ARG( QString, errorMsg      ) );
+}
+
+
+void DirTree::slotCacheWritten( const QString & cacheFileName,
+				bool		  ok,
+				const QString & errorMsg )
+{
+    _namePool.unpin();
+    _cacheWriterFiles.removeOne( QFileInfo( cacheFileName ).absoluteFilePath() );
+
+    if ( _cacheWriterFiles.isEmpty() )
+    {
+	qDeleteAll( _retiredCacheFiles );
+	_retiredCacheFiles.clear();
+    }
+
+    if ( ok )
+	logInfo() << "Wrote cache file " << cacheFileName << endl;
+    else
+	logError() << errorMsg << endl;
+
+    emit cacheWritten( cacheFileName, ok );
+}
+
+
 void DirTree::readCache( const QString & cacheFileName )
 {
+    waitForCacheWriter( cacheFileName );	// Not half written
     _isBusy = true;
     emit startingReading();
     addJob( new CacheReadJob( this, 0, cacheFileName ) );
@@ -551,6 +720,9 @@ void DirTree::moveIgnoredToAttic( DirInfo * dir )
     }
 
 
+    if ( ! ignoredChildren.isEmpty() )
+	dropFileColumns();
+
     foreach ( FileInfo * child, ignoredChildren )
     {
 	// logDebug() << "Moving ignored " << child << " to attic" << endl;
@@ -559,14 +731,6 @@ void DirTree::moveIgnoredToAttic( DirInfo * dir )
 	if ( child->isDirInfo() )
 	    unatticAll( child->toDirInfo() );
     }
-
-    if ( ! ignoredChildren.isEmpty() )
-    {
-	dir->recalc();
-
-	if ( dir->attic() )
-	    dir->attic()->recalc();
-    }
 }
 
 
@@ -607,9 +771,9 @@ void DirTree::unatticAll( DirInfo * dir )
     if ( dir->attic() )
     {
 	// logDebug() << "Moving all attic children to the normal children list for " << dir << endl;
+	dropFileColumns();
 	dir->takeAllChildren( dir->attic() );
 	dir->deleteEmptyAttic();
-	dir->recalc();
     }
 
     FileInfoIterator it( dir );
@@ -648,6 +812,285 @@ void DirTree::recalc( DirInfo * dir )
 }
 
 
+void DirTree::fillSizes( DirInfo * dir )
+{
+    if ( dir && dir->isPseudoDir() )
+	dir = dir->parent();
+
+    if ( ! dir || ! dir->sizesPending() || dir->readError() )
+	return;
+
+    QString path = dir->url();
+    int dirFd = ::open( path.toUtf8(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+    if ( dirFd < 0 )
+    {
+	// The sizes stay pending: Don't let them pass for real ones
+
+	int errorNo = errno;
+	logWarning() << "Can't open " << path << ": " << formatErrno() << endl;
+	dir->setReadError( errorNo == EACCES ? DirPermissionDenied : DirError );
+	return;
+    }
+
+    dir->setSizesPending( false );
+    dropFileColumns();
+
+    int count = fillSizes( dirFd, dir );
+
+    if ( dir->dotEntry() )
+	count += fillSizes( dirFd, dir->dotEntry() );
+
+    if ( dir->attic() )
+    {
+	count += fillSizes( dirFd, dir->attic() );
+
+	if ( dir->attic()->dotEntry() )
+	    count += fillSizes( dirFd, dir->attic()->dotEntry() );
+    }
+
+    ::close( dirFd );
+
+    logDebug() << "Filled in sizes of " << count << " items in " << dir << endl;
+}
+
+
+int DirTree::fillSizes( int dirFd, DirInfo * dir )
+{
+    int flags = AT_SYMLINK_NOFOLLOW;
+
+#ifdef AT_NO_AUTOMOUNT
+    flags |= AT_NO_AUTOMOUNT;
+#endif
+
+    int count = 0;
+    FileInfo * child = dir->firstChild();
+
+    while ( child )
+    {
+	if ( ! child->isDirInfo() )
+	{
+	    struct stat statInfo;
+
+	    if ( fstatat( dirFd, child->rawName(), &statInfo, flags ) == 0 )
+	    {
+		SummaryDelta oldValues;
+		oldValues.add( child );
+		child->setStatInfo( &statInfo );
+
+		SummaryDelta newValues;
+		newValues.add( child );
+		dir->addToSummary( oldValues, -1 );
+		dir->addToSummary( newValues,  1 );
+		++count;
+	    }
+	    else
+	    {
+		logWarning() << "lstat(" << child << ") failed: " << formatErrno() << endl;
+	    }
+	}
+
+	child = child->next();
+    }
+
+    return count;
+}
+
+
+qint64 DirTree::nodeMemory() const
+{
+    qint64 slabs =
+	_fileInfoPool.slabCount() +
+	_dirInfoPool.slabCount()  +
+	_dotEntryPool.slabCount() +
+	_atticPool.slabCount()	  +
+	_aggregatePool.slabCount();
+
+    return slabs * SLAB_SIZE + _namePool.allocatedBytes();
+}
+
+
+void DirTree::releaseNodes()
+{
+    QSet<DirInfo *> heapOwners;
+    heapOwners.swap( _heapOwners );
+
+    // First make all of them forget their children: Those are released
+    // with the slabs, and deleting one of the owners below must not delete
+    // any of them.
+
+    foreach ( DirInfo * dir, heapOwners )
+	dir->abandonChildren();
+
+    if ( _root )
+	_root->abandonChildren();
+
+    foreach ( DirInfo * dir, heapOwners )
+    {
+	if ( dir != _root && ! ownsNode( dir ) )
+	    delete dir;		// Not from the pools, e.g. a PkgInfo
+    }
+
+    _fileInfoPool.releaseAll();
+    _dirInfoPool.releaseAll();
+    _dotEntryPool.releaseAll();
+    _atticPool.releaseAll();
+    _aggregatePool.releaseAll();
+}
+
+
+bool DirTree::ownsNode( const DirInfo * dir ) const
+{
+    return
+	_dirInfoPool.owns( dir )  ||
+	_dotEntryPool.owns( dir ) ||
+	_atticPool.owns( dir );
+}
+
+
+bool DirTree::foldSmallFiles( DirInfo * dir )
+{
+    DotEntry * dotEntry = dir ? dir->dotEntry() : 0;
+
+    if ( ! dotEntry || dir->sizesPending() )
+	return false;
+
+    int count = 0;
+
+    for ( FileInfo * child = dotEntry->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isFile()	  ||
+	     child->isIgnored()	  ||
+	     child->links() > 1	  ||
+	     child->size() >= _foldFilesBelow )
+	{
+	    return false;
+	}
+
+	++count;
+    }
+
+    if ( count < MIN_FOLDED_FILES )
+	return false;
+
+    dropFileColumns();
+
+    FileAggregate * aggregate = new ( this ) FileAggregate( this, dotEntry, dotEntry->firstChild() );
+    CHECK_NEW( aggregate );
+
+    FileInfo * child = dotEntry->replaceAllChildren( aggregate );
+
+    while ( child )
+    {
+	FileInfo * next = child->next();
+	_namePool.release( child->rawName() );
+	delete child;
+	child = next;
+    }
+
+    // logDebug() << "Folded " << count << " files in " << dir << endl;
+
+    return true;
+}
+
+
+void DirTree::addPendingSubtree( DirInfo *	    dir,
+				 BinaryCacheFile *    cacheFile,
+				 quint32	      dirNo,
+				 const SummaryDelta & contents )
+{
+    PendingSubtree pending;
+
+    pending.cacheFile = cacheFile;
+    pending.dirNo     = dirNo;
+    pending.contents  = contents;
+
+    _pendingSubtrees.insert( dir, pending );
+
+    if ( ! _cacheFiles.contains( cacheFile ) )
+	_cacheFiles << cacheFile;
+
+    dir->setSubtreePending();
+    dir->addToSummary( contents, 1 );
+}
+
+
+void DirTree::loadSubtree( DirInfo * dir )
+{
+    if ( ! dir || ! dir->subtreePending() )
+	return;
+
+    PendingSubtree pending = _pendingSubtrees.take( dir );
+    logDebug() << "Loading " << dir << " from the cache" << endl;
+
+    // The reader adds the subtree item by item again
+
+    dir->setSubtreePending( false );
+    dir->addToSummary( pending.contents, -1 );
+    dir->ensureDotEntry();
+    dir->setReadState( DirReading );
+    dropFileColumns();
+
+    if ( ! pending.cacheFile )
+	return;
+
+    // The reader finalizes the subtree and sends readJobFinished() for
+    // 'dir' when it is destroyed.
+
+    CacheReader reader( pending.cacheFile, pending.dirNo, this, dir );
+
+    while ( reader.read() )
+	;
+}
+
+
+void DirTree::loadPendingSubtrees( DirInfo * subtree )
+{
+    // Loading a subtree may add new pending subtrees below it
+
+    while ( true )
+    {
+	QList<DirInfo *> dirs;
+
+	foreach ( DirInfo * dir, _pendingSubtrees.keys() )
+	{
+	    if ( ! subtree || dir->isInSubtree( subtree ) )
+		dirs << dir;
+	}
+
+	if ( dirs.isEmpty() )
+	    return;
+
+	foreach ( DirInfo * dir, dirs )
+	    loadSubtree( dir );
+    }
+}
+
+
+void DirTree::clearPendingSubtrees()
+{
+    _pendingSubtrees.clear();
+
+    // A cache writer might still read pending subtrees from these files
+
+    if ( ! _cacheWriterFiles.isEmpty() )
+	_retiredCacheFiles += _cacheFiles;
+    else
+	qDeleteAll( _cacheFiles );
+
+    _cacheFiles.clear();
+}
+
+
+FileColumns * DirTree::fileColumns()
+{
+    if ( ! _fileColumns.isValid() )
+	_fileColumns.build( _root );
+
+    return &_fileColumns;
+}
+
+
 void DirTree::detectClusterSize( FileInfo * item )
 {
     if ( item &&
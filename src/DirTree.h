@@ -17,11 +17,30 @@
 #include <stdlib.h>
 
 #include <QList>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
 
 #include "Logger.h"
 #include "DirInfo.h"
 #include "DirReadJob.h"
 #include "PkgFilter.h"
+#include "NamePool.h"
+#include "SlabPool.h"
+#include "FileColumns.h"
+
+
+// Default size limit for files to be folded into a FileAggregate when the
+// memory budget is exceeded
+#define DEFAULT_FOLD_FILES_BELOW	( 64 * 1024 )
+
+// Minimum number of files in a directory to fold them
+#define MIN_FOLDED_FILES		16
+
+// Default number of directory levels of a large binary cache file that are
+// read right away; see DirTree::setLazyCacheLevels()
+#define DEFAULT_LAZY_CACHE_LEVELS	3
 
 
 namespace QDirStat
@@ -30,6 +49,19 @@ namespace QDirStat
     class FileInfoSet;
     class ExcludeRules;
     class DirTreeFilter;
+    class BinaryCacheFile;
+
+
+    /**
+     * A subtree of a directory that is still in a binary cache file: See
+     * DirTree::loadSubtree().
+     **/
+    struct PendingSubtree
+    {
+	BinaryCacheFile *   cacheFile;
+	quint32		    dirNo;
+	SummaryDelta	    contents;
+    };
 
 
     /**
@@ -131,6 +163,51 @@ namespace QDirStat
 	 **/
 	DirInfo * root() const { return _root; }
 
+	/**
+	 * Return the pool that stores the names of the items of this tree.
+	 **/
+	NamePool * namePool() { return &_namePool; }
+
+	/**
+	 * Return the SlabPools for the nodes of this tree. See
+	 * FileInfo::operator new().
+	 **/
+	SlabPool * fileInfoPool()  { return &_fileInfoPool;  }
+	SlabPool * dirInfoPool()   { return &_dirInfoPool;   }
+	SlabPool * dotEntryPool()  { return &_dotEntryPool;  }
+	SlabPool * atticPool()	   { return &_atticPool;     }
+	SlabPool * aggregatePool() { return &_aggregatePool; }
+
+	/**
+	 * Notification that 'dir' owns memory outside of the SlabPools of
+	 * this tree (sort caches, a child name index) or is not allocated from
+	 * them at all, so clear() has to take care of it separately.
+	 **/
+	void addHeapOwner( DirInfo * dir ) { _heapOwners.insert( dir ); }
+
+	/**
+	 * Notification that 'dir' is deleted.
+	 **/
+	void removeHeapOwner( DirInfo * dir ) { _heapOwners.remove( dir ); }
+
+	/**
+	 * Return the columnar mirror of the files of this tree for fast
+	 * passes over all files of a subtree (statistics etc.). This is built
+	 * on demand if the tree changed since the last call.
+	 **/
+	FileColumns * fileColumns();
+
+	/**
+	 * Drop the columnar mirror because the tree changed.
+	 **/
+	void dropFileColumns() { _fileColumns.clear(); }
+
+	/**
+	 * Return the approximate number of bytes used by the columnar mirror
+	 * without building it.
+	 **/
+	qint64 fileColumnsMemory() const { return _fileColumns.memoryUsage(); }
+
 	/**
 	 * Sets the root item of this tree.
 	 **/
@@ -155,6 +232,9 @@ namespace QDirStat
 
 	/**
 	 * Clear all items of this tree.
+	 *
+	 * This does not delete the items one by one: All their slabs are
+	 * released at once (see releaseNodes()).
 	 **/
 	void clear();
 
@@ -167,13 +247,13 @@ namespace QDirStat
 	 * Locate a child somewhere in the tree whose URL (i.e. complete path)
 	 * matches the URL passed. Returns 0 if there is no such child.
 	 *
-	 * Notice: This is a very expensive operation since the entire tree is
-	 * searched recursively.
+	 * This follows the path one component at a time; see
+	 * FileInfo::locate().
 	 *
 	 * 'findPseudoDirs' specifies if locating pseudo directories like "dot
 	 * entries" (".../<Files>") or "attics" (".../<Ignored>") is desired.
 	 **/
-	FileInfo * locate( QString url, bool findPseudoDirs = false );
+	FileInfo * locate( const QString & url, bool findPseudoDirs = false );
 
 	/**
 	 * Add a new directory read job to the queue.
@@ -193,6 +273,13 @@ namespace QDirStat
 	 **/
 	void unblock( DirReadJob * job );
 
+	/**
+	 * Read the pending directories of 'subtree' before anything else,
+	 * typically because the user is looking at it right now.
+	 * See also DirReadJobQueue::prioritize().
+	 **/
+	void prioritize( DirInfo * subtree ) { _jobQueue.prioritize( subtree ); }
+
 	/**
 	 * Should directory scans cross filesystems?
 	 *
@@ -208,6 +295,180 @@ namespace QDirStat
 	void setCrossFilesystems( bool doCross )
 	    { _crossFilesystems = doCross; }
 
+	/**
+	 * Return 'true' if local directories are scanned for their structure
+	 * and item counts only: Entries that are not directories are not
+	 * lstat()ed if the filesystem reports their type when reading the
+	 * directory, so they don't get any size, owner or mtime. Their
+	 * directory can get those later with fillSizes().
+	 **/
+	bool structureOnly() const { return _structureOnly; }
+
+	/**
+	 * Set or unset the "structure only" scan mode. This takes effect for
+	 * read jobs that are created after this call.
+	 **/
+	void setStructureOnly( bool structureOnly )
+	    { _structureOnly = structureOnly; }
+
+	/**
+	 * Return 'true' if cache files (DEFAULT_CACHE_NAME) that are found
+	 * while reading local directories are used instead of reading the
+	 * directory they belong to. This is the default.
+	 **/
+	bool readCacheFiles() const { return _readCacheFiles; }
+
+	/**
+	 * Set or unset using cache files found while reading local
+	 * directories. A program that writes cache files will want to unset
+	 * this so it does not simply copy an old cache file.
+	 **/
+	void setReadCacheFiles( bool readCacheFiles )
+	    { _readCacheFiles = readCacheFiles; }
+
+	/**
+	 * lstat() the non-directory children of 'dir' that were created in a
+	 * structure-only scan and set their real sizes etc. The difference
+	 * between the old and the new values of each child is added to the
+	 * summaries of 'dir' and its ancestors right away, so nothing needs
+	 * to be recalculated. If 'dir' is a dot entry, this is done for its
+	 * parent. This does nothing if the sizes
+	 * of 'dir' are not pending.
+	 *
+	 * If 'dir' cannot be opened any more, its sizes stay pending, and it
+	 * gets a read error (see DirInfo::setReadError()).
+	 *
+	 * The caller is responsible for notifying any views.
+	 **/
+	void fillSizes( DirInfo * dir );
+
+	/**
+	 * Return the number of directory levels of a large binary cache file
+	 * that are read right away. The subtrees below that level are only
+	 * read when somebody wants to see them; see loadSubtree(). 0 means
+	 * everything is read right away.
+	 **/
+	int lazyCacheLevels() const { return _lazyCacheLevels; }
+
+	/**
+	 * Set the number of directory levels of a large binary cache file
+	 * that are read right away. This takes effect for the next cache file
+	 * that is read.
+	 **/
+	void setLazyCacheLevels( int levels ) { _lazyCacheLevels = levels; }
+
+	/**
+	 * Remember that the subtree of 'dir' is directory no. 'dirNo' of
+	 * 'cacheFile' and was not read yet. 'contents' is what that subtree
+	 * adds to the summary of 'dir'; it is added right away, so 'dir' and
+	 * its ancestors show the correct totals.
+	 *
+	 * The tree takes over ownership of 'cacheFile'; it is deleted when
+	 * the tree is cleared.
+	 **/
+	void addPendingSubtree( DirInfo *	     dir,
+				BinaryCacheFile *    cacheFile,
+				quint32		     dirNo,
+				const SummaryDelta & contents );
+
+	/**
+	 * Forget the pending subtree of 'dir' because 'dir' is cleared or
+	 * deleted.
+	 **/
+	void dropPendingSubtree( DirInfo * dir ) { _pendingSubtrees.remove( dir ); }
+
+	/**
+	 * Return the pending subtree of 'dir'. Use this only if
+	 * dir->subtreePending() returns 'true'.
+	 **/
+	PendingSubtree pendingSubtree( DirInfo * dir ) const
+	    { return _pendingSubtrees.value( dir ); }
+
+	/**
+	 * Read the subtree of 'dir' from its cache file if it was not read
+	 * yet. This does nothing if the subtree of 'dir' is not pending.
+	 *
+	 * This sends a readJobFinished() signal for 'dir' when it is done.
+	 * Subdirectories of 'dir' may again have pending subtrees.
+	 **/
+	void loadSubtree( DirInfo * dir );
+
+	/**
+	 * Read all pending subtrees in 'subtree' (in the complete tree if
+	 * 'subtree' is 0), e.g. for something that needs to see each item.
+	 **/
+	void loadPendingSubtrees( DirInfo * subtree = 0 );
+
+	/**
+	 * Return the memory budget for the tree nodes in bytes; 0 means
+	 * unlimited.
+	 **/
+	qint64 memoryBudget() const { return _memoryBudget; }
+
+	/**
+	 * Set the memory budget for the tree nodes in bytes. When the nodes
+	 * need more than that during a scan, directories that only contain
+	 * small files get them folded into one FileAggregate; see
+	 * foldSmallFiles(). 0 means unlimited.
+	 **/
+	void setMemoryBudget( qint64 bytes ) { _memoryBudget = bytes; }
+
+	/**
+	 * Return the size limit for files to be folded. See foldSmallFiles().
+	 **/
+	FileSize foldFilesBelow() const { return _foldFilesBelow; }
+
+	/**
+	 * Set the size limit for files to be folded.
+	 **/
+	void setFoldFilesBelow( FileSize size ) { _foldFilesBelow = size; }
+
+	/**
+	 * Return the memory used by the tree nodes and their names.
+	 **/
+	qint64 nodeMemory() const;
+
+	/**
+	 * Return 'true' if there is a memory budget and the tree nodes need
+	 * more than that.
+	 **/
+	bool memoryBudgetExceeded() const
+	    { return _memoryBudget > 0 && nodeMemory() > _memoryBudget; }
+
+	/**
+	 * Replace the files in the dot entry of 'dir' with one FileAggregate
+	 * if they are all regular files smaller than foldFilesBelow() without
+	 * hard links, and if there are at least MIN_FOLDED_FILES of them.
+	 * Return 'true' if anything was folded.
+	 *
+	 * All summary values of 'dir' and its ancestors stay exactly the
+	 * same. This is meant for directories that were just read and that
+	 * are not known to any views yet.
+	 **/
+	bool foldSmallFiles( DirInfo * dir );
+
+	/**
+	 * Return the number of worker threads used for reading local
+	 * directories. 0 means everything is read in the main thread.
+	 **/
+	int readerThreads() const { return _jobQueue.maxThreads(); }
+
+	/**
+	 * Set the number of worker threads used for reading local
+	 * directories. This takes effect for the next read job that is
+	 * started.
+	 **/
+	void setReaderThreads( int threads )
+	    { _jobQueue.setMaxThreads( threads ); }
+
+	/**
+	 * Return the throttle for low-impact scans ("production server
+	 * mode"): Idle I/O priority for the reader threads, limited
+	 * directories and lstat() calls per second, and backing off when the
+	 * system is busy. It is disabled by default.
+	 **/
+	ScanThrottle * scanThrottle() { return _jobQueue.throttle(); }
+
 	/**
 	 * Notification that a child has been added.
 	 *
@@ -265,11 +526,44 @@ namespace QDirStat
 	bool isBusy() { return _isBusy; }
 
 	/**
-	 * Write the complete tree to a cache file.
+	 * Write the complete tree to a cache file. If 'longFormat' is true,
+	 * files are written with their full path (see CacheWriter).
 	 *
 	 * Returns true if OK, false upon error.
 	 **/
-	bool writeCache( const QString & cacheFileName );
+	bool writeCache( const QString & cacheFileName, bool longFormat = false );
+
+	/**
+	 * Write the complete tree to a cache file in a worker thread, so the
+	 * views can still show the tree in the meantime. This emits
+	 * cacheWritten() when it is done.
+	 *
+	 * Only a compact snapshot of the tree is taken right away (see
+	 * CacheSnapshot); the worker formats, compresses and writes it, so
+	 * it never accesses the tree. Pending subtrees (see loadSubtree())
+	 * are not loaded: The worker reads them from their cache files. The
+	 * snapshot does not copy the names, so the name pool stays pinned and
+	 * those cache files stay open until the worker is done. Since the
+	 * worker has everything it needs, the tree can be cleared, read,
+	 * refreshed and changed in the meantime. Only writing or reading the
+	 * same cache file waits for the writer (see waitForCacheWriter()).
+	 **/
+	void startWritingCache( const QString & cacheFileName, bool longFormat = false );
+
+	/**
+	 * Wait until the cache writers started with startWritingCache() are
+	 * done if one of them writes 'cacheFileName' or, if that is empty, if
+	 * there is any.
+	 **/
+	void waitForCacheWriter( const QString & cacheFileName = QString() );
+
+	/**
+	 * Notification that a cache writer is done. 'errorMsg' is what went
+	 * wrong if 'ok' is false. This is called in the worker thread.
+	 **/
+	void cacheWriterDone( const QString & cacheFileName,
+			      bool		ok,
+			      const QString & errorMsg );
 
 	/**
 	 * Read a cache file.
@@ -432,6 +726,13 @@ namespace QDirStat
 	 **/
 	void progressInfo( const QString & infoLine );
 
+	/**
+	 * Emitted when writing a cache file that was started with
+	 * startWritingCache() is finished. 'ok' is false if there was an
+	 * error.
+	 **/
+	void cacheWritten( const QString & cacheFileName, bool ok );
+
 
     protected slots:
 
@@ -441,6 +742,14 @@ namespace QDirStat
 	 **/
 	void slotFinished();
 
+	/**
+	 * Log the result of a cache writer, release what it needed from the
+	 * tree and emit cacheWritten() in the main thread.
+	 **/
+	void slotCacheWritten( const QString & cacheFileName,
+			       bool		 ok,
+			       const QString & errorMsg );
+
 
     protected:
 
@@ -468,18 +777,58 @@ namespace QDirStat
 	 **/
 	void recalc( DirInfo * dir );
 
+	/**
+	 * lstat() all non-directory children of 'dir' relative to the open
+	 * directory 'dirFd' and set their values from that. Return the number
+	 * of children that were updated.
+	 **/
+	int fillSizes( int dirFd, DirInfo * dir );
+
         /**
          * Try to derive the cluster size from 'item'.
          **/
         void detectClusterSize( FileInfo * item );
 
+	/**
+	 * Delete the cache files of the pending subtrees.
+	 **/
+	void clearPendingSubtrees();
+
+	/**
+	 * Release all items below the root at once: Only the heap owners (see
+	 * addHeapOwner()) are cleaned up individually; all other items are
+	 * trivially destructible apart from their memory, so they are simply
+	 * dropped together with the slabs of the pools and the names in the
+	 * name pool. This takes time proportional to the number of slabs, not
+	 * to the number of items.
+	 **/
+	void releaseNodes();
+
+	/**
+	 * Return 'true' if 'dir' is allocated from the SlabPools of this tree.
+	 **/
+	bool ownsNode( const DirInfo * dir ) const;
+
 
 
 	// Data members
 
+	SlabPool		_fileInfoPool;
+	SlabPool		_dirInfoPool;
+	SlabPool		_dotEntryPool;
+	SlabPool		_atticPool;
+	SlabPool		_aggregatePool;
+	QSet<DirInfo *>		_heapOwners;
 	DirInfo *		_root;
+	NamePool		_namePool;
+	FileColumns		_fileColumns;
 	DirReadJobQueue		_jobQueue;
 	bool			_crossFilesystems;
+	bool			_structureOnly;
+	bool			_readCacheFiles;
+	int			_lazyCacheLevels;
+	qint64			_memoryBudget;
+	FileSize		_foldFilesBelow;
 	bool			_isBusy;
 	QString			_device;
 	QString			_url;
@@ -489,6 +838,13 @@ namespace QDirStat
         bool                    _haveClusterSize;
         int                     _blocksPerCluster;
 
+	QHash<DirInfo *, PendingSubtree> _pendingSubtrees;
+	QList<BinaryCacheFile *>	 _cacheFiles;
+	QList<BinaryCacheFile *>	 _retiredCacheFiles; // Still used by a cache writer
+
+	QThreadPool		_cacheWriterPool;
+	QStringList		_cacheWriterFiles;	// One for each running writer
+
     };	// class DirTree
 
 }	// namespace QDirStat
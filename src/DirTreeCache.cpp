@@ -8,12 +8,19 @@
 
 
 #include <ctype.h>
+#include <sys/stat.h>	// S_ISREG() etc.
+#include <string.h>	// strchr(), strlen()
 #include <QUrl>
 
 #include "DirTreeCache.h"
+#include "BinaryCache.h"
+#include "CacheBlocks.h"
+#include "CacheSnapshot.h"
 #include "DirTree.h"
 #include "DotEntry.h"
+#include "FileAggregate.h"
 #include "ExcludeRules.h"
+#include "TreeFinalizer.h"
 #include "Logger.h"
 #include "Exception.h"
 
@@ -32,168 +39,398 @@
 using namespace QDirStat;
 
 
-CacheWriter::CacheWriter( const QString & fileName, DirTree *tree )
+CacheWriter::CacheWriter( const QString & fileName,
+			  DirTree *	  tree,
+			  bool		  longFormat ):
+    _fileName( fileName ),
+    _ok( true ),
+    _longFormat( longFormat ),
+    _binaryWriter( 0 ),
+    _snapshot( 0 ),
+    _blockWriter( 0 )
+{
+    if ( isBinaryCacheName( fileName ) )
+    {
+	_binaryWriter = new BinaryCacheWriter( fileName );
+	CHECK_NEW( _binaryWriter );
+    }
+
+    snapshot( tree );
+
+    if ( write() )
+	logInfo() << "Wrote cache file " << fileName << endl;
+    else
+	logError() << _errorMsg << endl;
+}
+
+
+CacheWriter::CacheWriter( const QString & fileName,
+			  bool		  longFormat ):
+    _fileName( fileName ),
+    _ok( true ),
+    _longFormat( longFormat ),
+    _binaryWriter( 0 ),
+    _snapshot( 0 ),
+    _blockWriter( 0 )
 {
-    _ok = writeCache( fileName, tree );
+    if ( isBinaryCacheName( fileName ) )
+    {
+	_binaryWriter = new BinaryCacheWriter( fileName );
+	CHECK_NEW( _binaryWriter );
+    }
 }
 
 
 CacheWriter::~CacheWriter()
 {
-    // NOP
+    if ( _binaryWriter )
+	delete _binaryWriter;
+
+    if ( _snapshot )
+	delete _snapshot;
+}
+
+
+void CacheWriter::snapshot( DirTree * tree )
+{
+    if ( _snapshot )
+	delete _snapshot;
+
+    _snapshot = new CacheSnapshot( tree );
+    CHECK_NEW( _snapshot );
+
+    if ( ! _snapshot->ok() )
+    {
+	_errorMsg = _snapshot->errorMsg();
+	_ok = false;
+    }
 }
 
 
-bool CacheWriter::writeCache( const QString & fileName, DirTree *tree )
+bool CacheWriter::write()
 {
-    if ( ! tree || ! tree->root() )
+    if ( _ok && ! _snapshot )
+    {
+	_errorMsg = "No snapshot";
+	_ok = false;
+    }
+
+    if ( _ok )
+    {
+	if ( _binaryWriter )
+	{
+	    _ok	      = _binaryWriter->write( _snapshot );
+	    _errorMsg = _binaryWriter->errorMsg();
+	}
+	else
+	{
+	    _ok = writeBlocks();
+	}
+    }
+
+    // Whatever is left of the snapshot is not needed any more
+
+    if ( _snapshot )
+    {
+	delete _snapshot;
+	_snapshot = 0;
+    }
+
+    return _ok;
+}
+
+
+bool CacheWriter::writeBlocks()
+{
+    CacheBlockWriter blockWriter( _fileName );
+
+    if ( ! blockWriter.ok() )
+    {
+	_errorMsg = blockWriter.errorMsg();
 	return false;
+    }
+
+    // The block writer compresses the blocks in other threads, but it
+    // keeps only a few of them in memory: writeBlock() waits when this
+    // gets too far ahead.
+
+    _blockWriter = &blockWriter;
+    _block.clear();
+    _block.reserve( CACHE_BLOCK_SIZE + MAX_CACHE_LINE_LEN );
+    _path.clear();
+    _pathLens.clear();
 
-    gzFile cache = gzopen( (const char *) fileName.toUtf8(), "w" );
+    _block += "[qdirstat " CACHE_FORMAT_VERSION " cache file]\n";
+    _block +=
+	"# Do not edit!\n"
+	"#\n"
+	"# Type\tpath\t\tsize\tmtime\t\t<optional fields>\n"
+	"\n";
 
-    if ( cache == 0 )
+    CacheSnapshotEntry entry;
+
+    while ( _snapshot->next( entry ) )
+	writeEntry( entry );
+
+    flushBlock();
+
+    _blockWriter = 0;
+    _block = QByteArray();
+    _path.clear();
+
+    bool ok = blockWriter.close();
+
+    if ( ! _snapshot->ok() )
     {
-	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	_errorMsg = QString( "Error writing %1: %2" )
+	    .arg( _fileName ).arg( _snapshot->errorMsg() );
+
 	return false;
     }
 
-    gzprintf( cache, "[qdirstat %s cache file]\n", CACHE_FORMAT_VERSION );
-    gzprintf( cache,
-	     "# Do not edit!\n"
-	     "#\n"
-	     "# Type\tpath\t\tsize\tmtime\t\t<optional fields>\n"
-	     "\n" );
+    if ( ! ok )
+    {
+	_errorMsg = QString( "Error writing %1: %2" )
+	    .arg( _fileName ).arg( blockWriter.errorMsg() );
 
-    writeTree( cache, tree->root()->firstChild() );
-    gzclose( cache );
+	return false;
+    }
 
     return true;
 }
 
 
-void CacheWriter::writeTree( gzFile cache, FileInfo * item )
+void CacheWriter::flushBlock()
 {
-    if ( ! item )
+    if ( _block.isEmpty() )
 	return;
 
-    //
-    // Write entry for this item
-    //
-
-    if ( ! item->isDotEntry() )
-	writeItem( cache, item );
+    // The block writer keeps this block until it is compressed, so this
+    // needs a new buffer.
 
-    //
-    // Write file children
-    //
+    _blockWriter->writeBlock( _block );
+    _block = QByteArray();
+    _block.reserve( CACHE_BLOCK_SIZE + MAX_CACHE_LINE_LEN );
+}
 
-    if ( item->dotEntry() )
-	writeTree( cache, item->dotEntry() );
 
-    //
-    // Recurse through subdirectories
-    //
+void CacheWriter::writeEntry( const CacheSnapshotEntry & entry )
+{
+    // Back to the path of the parent directory
 
-    FileInfo * child = item->firstChild();
+    if ( entry.depth > 0 && entry.depth <= _pathLens.size() )
+	_path.resize( _pathLens[ entry.depth - 1 ] );
 
-    while ( child )
+    if ( entry.isDirInfo )
     {
-	writeTree( cache, child );
-	child = child->next();
+	// Build the path of a directory from the path of its parent instead
+	// of the complete path for each directory
+
+	if ( entry.depth == 0 )
+	{
+	    _path.clear();
+	    appendEncoded( _path, entry.name, entry.nameLen );
+	}
+	else
+	{
+	    if ( ! _path.endsWith( '/' ) )
+		_path += '/';
+
+	    appendEncoded( _path, entry.name, entry.nameLen );
+	}
+
+	_pathLens.resize( entry.depth + 1 );
+	_pathLens[ entry.depth ] = _path.size();
+
+	// Start a new block with a directory so the blocks can be read
+	// independently of each other
+
+	if ( _block.size() >= CACHE_BLOCK_SIZE )
+	    flushBlock();
     }
+
+    writeItem( entry );
 }
 
 
-void CacheWriter::writeItem( gzFile cache, FileInfo * item )
+void CacheWriter::writeItem( const CacheSnapshotEntry & entry )
 {
-    if ( ! item )
-	return;
-
     // Write file type
 
     const char * file_type = "";
-    if	    ( item->isFile()		)	file_type = "F";
-    else if ( item->isDir()		)	file_type = "D";
-    else if ( item->isSymLink()		)	file_type = "L";
-    else if ( item->isBlockDevice()	)	file_type = "BlockDev";
-    else if ( item->isCharDevice()	)	file_type = "CharDev";
-    else if ( item->isFifo()		)	file_type = "FIFO";
-    else if ( item->isSocket()		)	file_type = "Socket";
+    if	    ( S_ISREG ( entry.mode ) )	file_type = "F";
+    else if ( S_ISDIR ( entry.mode ) )	file_type = "D";
+    else if ( S_ISLNK ( entry.mode ) )	file_type = "L";
+    else if ( S_ISBLK ( entry.mode ) )	file_type = "BlockDev";
+    else if ( S_ISCHR ( entry.mode ) )	file_type = "CharDev";
+    else if ( S_ISFIFO( entry.mode ) )	file_type = "FIFO";
+    else if ( S_ISSOCK( entry.mode ) )	file_type = "Socket";
 
-    gzprintf( cache, "%s", file_type );
+    _block += file_type;
 
     // Write name
 
-    if ( item->isDirInfo() && ! item->isDotEntry() )
+    if ( entry.isDirInfo )
     {
 	// Use absolute path
 
-	gzprintf( cache, " %s", urlEncoded( item->url() ).data() );
+	_block += ' ';
+	_block += _path;
+    }
+    else if ( _longFormat )
+    {
+	_block += ' ';
+	_block += _path;
+
+	if ( ! _path.endsWith( '/' ) )
+	    _block += '/';
+
+	appendEncoded( _block, entry.name, entry.nameLen );
     }
     else
     {
 	// Use relative path
 
-	gzprintf( cache, "\t%s", urlEncoded( item->name() ).data() );
+	_block += '\t';
+	appendEncoded( _block, entry.name, entry.nameLen );
     }
 
 
     // Write size
 
-    gzprintf( cache, "\t%s", formatSize( item->rawByteSize() ).toUtf8().data() );
+    _block += '\t';
+    appendSize( _block, entry.size );
 
 
     // Write mtime
 
-    gzprintf( cache, "\t0x%lx", (unsigned long) item->mtime() );
+    _block += "\t0x";
+    appendNumber( _block, (quint64) (unsigned long) entry.mtime, 16 );
 
     // Optional fields
 
-    if ( item->isSparseFile() )
-	gzprintf( cache, "\tblocks: %lld", item->blocks() );
+    if ( entry.blocks >= 0 && entry.files == 0 )
+    {
+	// A sparse file
+
+	_block += "\tblocks: ";
+	appendNumber( _block, entry.blocks );
+    }
+
+    if ( S_ISREG( entry.mode ) && entry.links > 1 )
+    {
+	_block += "\tlinks: ";
+	appendNumber( _block, entry.links );
+    }
+
+    if ( entry.files > 0 )
+    {
+	// A FileAggregate: Older readers see this as one file with the
+	// total size
+
+	_block += "\tblocks: ";
+	appendNumber( _block, entry.blocks );
+
+	_block += "\tfiles: ";
+	appendNumber( _block, entry.files );
 
-    if ( item->isFile() && item->links() > 1 )
-	gzprintf( cache, "\tlinks: %u", (unsigned) item->links() );
+	// Signed decimal: Unlike the mtime of the item itself, this is read
+	// only by the readers that know about aggregates
 
-    gzputc( cache, '\n' );
+	qint64 oldest = entry.oldestMtime;
+	_block += "\toldest: ";
+
+	if ( oldest < 0 )
+	{
+	    _block += '-';
+	    oldest = -oldest;
+	}
+
+	appendNumber( _block, (quint64) oldest );
+    }
+
+    _block += '\n';
 }
 
 
-QByteArray CacheWriter::urlEncoded( const QString & path )
+void CacheWriter::appendEncoded( QByteArray & dest, const char * name, int len )
 {
-    // Using a protocol ("scheme") part to avoid directory names with a colon
-    // ":" being cut off because it looks like a URL protocol.
-    QUrl url;
-    url.setScheme( "foo" );
-    url.setPath( path );
+    // The same characters that QUrl escapes in a path, plus whitespace and
+    // anything that is not 7 bit ASCII. CacheReader::unescapedPath() uses
+    // QUrl to decode all of them again.
 
-    QByteArray encoded = url.toEncoded( QUrl::RemoveScheme );
+    static const char hexDigits[] = "0123456789ABCDEF";
 
-    if ( encoded.isEmpty() )
+    for ( int i=0; i < len; ++i )
     {
-        logError() << "Invalid file/dir name: " << path << endl;
-    }
-
-    return encoded;
+	unsigned char c = name[i];
 
+	if ( c <= ' ' || c >= 0x7F || strchr( "\"#%<>?[\\]^`{|}", c ) )
+	{
+	    dest += '%';
+	    dest += hexDigits[ c >> 4 ];
+	    dest += hexDigits[ c & 0x0F ];
+	}
+	else
+	{
+	    dest += (char) c;
+	}
+    }
 }
 
 
-QString CacheWriter::formatSize( FileSize size )
+void CacheWriter::appendNumber( QByteArray & dest, quint64 value, int base )
 {
-    if ( size >= TB && size % TB == 0 )
-        return QString( "%1T" ).arg( size / TB );
+    static const char digits[] = "0123456789abcdef";
+
+    // Fill a local buffer from the end
+
+    char buffer[ 24 ];
+    char * start = buffer + sizeof( buffer );
+
+    do
+    {
+	*--start = digits[ value % base ];
+	value /= base;
+    }
+    while ( value > 0 );
 
-    if ( size >= GB && size % GB == 0 )
-        return QString( "%1G" ).arg( size / GB );
+    dest.append( start, buffer + sizeof( buffer ) - start );
+}
 
-    if ( size >= MB && size % MB == 0 )
-        return QString( "%1M" ).arg( size / MB );
 
-    if ( size >= KB && size % KB == 0 )
-        return QString( "%1K" ).arg( size / KB );
+bool CacheWriter::isBinaryCacheName( const QString & fileName )
+{
+    return fileName.endsWith( BINARY_CACHE_SUFFIX );
+}
 
-    return QString( "%1" ).arg( size );
+
+void CacheWriter::appendSize( QByteArray & dest, FileSize size )
+{
+    if ( size >= TB && size % TB == 0 )
+    {
+	appendNumber( dest, size / TB );
+	dest += 'T';
+    }
+    else if ( size >= GB && size % GB == 0 )
+    {
+	appendNumber( dest, size / GB );
+	dest += 'G';
+    }
+    else if ( size >= MB && size % MB == 0 )
+    {
+	appendNumber( dest, size / MB );
+	dest += 'M';
+    }
+    else if ( size >= KB && size % KB == 0 )
+    {
+	appendNumber( dest, size / KB );
+	dest += 'K';
+    }
+    else
+    {
+	appendNumber( dest, size );
+    }
 }
 
 
@@ -208,7 +445,81 @@ CacheReader::CacheReader( const QString & fileName,
     QObject(),
     _multiSlash( "//+" ) // cache regexp for multiple use
 {
-    _fileName		= fileName;
+    init( tree, parent );
+    _fileName = fileName;
+
+    if ( BinaryCacheFile::isBinaryCache( fileName ) )
+    {
+	_binaryCache	 = new BinaryCacheFile( fileName );
+	_ownsBinaryCache = true;
+	CHECK_NEW( _binaryCache );
+
+	if ( ! _binaryCache->ok() )
+	{
+	    _ok = false;
+	    emit error();
+	    return;
+	}
+
+	_endRecord = _binaryCache->header().recordCount;
+	_endDir	   = _binaryCache->header().dirCount;
+
+	// Only large files are worth reading lazily; they need the
+	// directory index for that.
+
+	if ( _binaryCache->hasDirIndex() && _endRecord >= LAZY_CACHE_MIN_ITEMS )
+	    _lazyLevels = tree->lazyCacheLevels();
+
+	return;
+    }
+
+    _cache = gzopen( fileName.toUtf8(), "r" );
+
+    if ( _cache == 0 )
+    {
+	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	_ok = false;
+	emit error();
+	return;
+    }
+
+    // logDebug() << "Opening " << fileName << " OK" << endl;
+    checkHeader();
+}
+
+
+CacheReader::CacheReader( BinaryCacheFile * cacheFile,
+			  quint32	    dirNo,
+			  DirTree *	    tree,
+			  DirInfo *	    dir ):
+    QObject(),
+    _multiSlash( "//+" )
+{
+    init( tree, dir );
+    _fileName	 = cacheFile->fileName();
+    _binaryCache = cacheFile;
+
+    // The subtree was already checked by the reader that skipped it
+
+    const BinaryCacheDir & info = cacheFile->dirInfo( dirNo );
+
+    _nextRecord = info.record + 1;
+    _endRecord	= cacheFile->subtreeEnd( dirNo );
+    _dirBase	= dirNo;
+    _dirNo	= dirNo + 1;
+    _endDir	= info.endDir;
+    _lazyBase	= dir;
+
+    if ( _endRecord - _nextRecord >= LAZY_CACHE_MIN_ITEMS )
+	_lazyLevels = tree->lazyCacheLevels();
+
+    _binaryDirs.fill( 0, _endDir - _dirBase );
+    _binaryDirs[0] = dir;
+}
+
+
+void CacheReader::init( DirTree * tree, DirInfo * parent )
+{
     _buffer[0]		= 0;
     _line		= _buffer;
     _lineNo		= 0;
@@ -218,294 +529,905 @@ CacheReader::CacheReader( const QString & fileName,
     _toplevel		= parent;
     _lastDir		= 0;
     _lastExcludedDir	= 0;
+    _cache		= 0;
+    _binaryCache	= 0;
+    _ownsBinaryCache	= false;
+    _blockNo		= 0;
+    _nextRecord		= 0;
+    _endRecord		= 0;
+    _blockData		= 0;
+    _dirNo		= 0;
+    _dirBase		= 0;
+    _endDir		= 0;
+    _lazyLevels		= 0;
+    _lazyBase		= 0;
+    _blockFile		= 0;
+    _blockFileChecked	= false;
+    _parsedBlock	= 0;
+    _itemNo		= 0;
+    _finalizer		= 0;
+}
 
-    _cache = gzopen( fileName.toUtf8(), "r" );
 
-    if ( _cache == 0 )
+CacheReader::~CacheReader()
+{
+    if ( _cache )
+	gzclose( _cache );
+
+    if ( _binaryCache && _ownsBinaryCache )
+	delete _binaryCache;
+
+    if ( _parsedBlock )
+	delete _parsedBlock;
+
+    if ( _blockFile )
+	delete _blockFile;
+
+    logDebug() << "Cache reading finished" << endl;
+
+    if ( _finalizer )
+	_finalizer->wait();
+
+    if ( _toplevel && ! _tree->beingDestroyed() )
     {
-	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
-	_ok = false;
-	emit error();
+	// Finalize everything first (in parallel for large trees) and tell
+	// the views only once when it is done: newChildrenNotify() in the
+	// model recurses into all finished subdirectories anyway.
+
+	if ( ! _finalizer )
+	{
+	    setReadStateRecursive( _toplevel );
+	    TreeFinalizer::finalize( _toplevel );
+	}
+
+	_tree->sendReadJobFinished( _toplevel );
+    }
+
+    emit finished();
+}
+
+
+bool CacheReader::startFinalizing()
+{
+    if ( ! _toplevel || _finalizer )
+	return false;
+
+    setReadStateRecursive( _toplevel );
+
+    _finalizer = new TreeFinalizer( _toplevel, this );
+    CHECK_NEW( _finalizer );
+
+    connect( _finalizer, SIGNAL( finished ( DirInfo * ) ),
+	     this,	 SIGNAL( finalized()		) );
+
+    _finalizer->start();
+
+    return true;
+}
+
+
+void CacheReader::rewind()
+{
+    if ( _binaryCache )
+    {
+	_blockNo    = 0;
+	_nextRecord = 0;
+	_blockData  = 0;
+	_dirNo	    = 0;
+	_lazyBase   = 0;
+	_binaryDirs.clear();
+    }
+
+    if ( _blockFile )
+    {
+	delete _parsedBlock;
+	delete _blockFile;
+
+	_parsedBlock = 0;
+	_blockFile   = 0;
+	_blockNo     = 0;
+	_dirPaths.clear();
+	_dirStack.clear();
+    }
+
+    _blockFileChecked = false;
+
+    if ( _cache )
+    {
+	gzrewind( _cache );
+	checkHeader();		// skip cache header
+    }
+}
+
+
+bool CacheReader::read( int maxLines )
+{
+    if ( _binaryCache )
+	return readBinary( maxLines );
+
+    if ( ! _blockFileChecked && _ok )
+    {
+	// Files with blocks are parsed in worker threads; anything else is
+	// read as one gzip stream line by line.
+
+	_blockFileChecked = true;
+	_blockFile = new CacheBlockFile( _fileName );
+	CHECK_NEW( _blockFile );
+
+	if ( ! _blockFile->ok() )
+	{
+	    delete _blockFile;
+	    _blockFile = 0;
+	}
+    }
+
+    if ( _blockFile )
+	return readBlocks( maxLines );
+
+    while ( ! gzeof( _cache )
+	    && _ok
+	    && ( maxLines == 0 || --maxLines > 0 ) )
+    {
+	if ( readLine() )
+	{
+	    splitLine();
+	    addItem();
+	}
+    }
+
+    return _ok && ! gzeof( _cache );
+}
+
+
+bool CacheReader::parseItem( char ** fields, int fieldsCount, CacheItem & item )
+{
+    if ( fieldsCount < 4 )
+	return false;
+
+    int n = 0;
+    char * type		= fields[ n++ ];
+    item.rawPath	= fields[ n++ ];
+    char * size_str	= fields[ n++ ];
+    char * mtime_str	= fields[ n++ ];
+    char * blocks_str	= 0;
+    char * links_str	= 0;
+    char * files_str	= 0;
+    char * oldest_str	= 0;
+
+    while ( fieldsCount > n+1 )
+    {
+	char * keyword	= fields[ n++ ];
+	char * val_str	= fields[ n++ ];
+
+	if ( strcasecmp( keyword, "blocks:" ) == 0 ) blocks_str = val_str;
+	if ( strcasecmp( keyword, "links:"  ) == 0 ) links_str	= val_str;
+	if ( strcasecmp( keyword, "files:"  ) == 0 ) files_str	= val_str;
+	if ( strcasecmp( keyword, "oldest:" ) == 0 ) oldest_str = val_str;
+    }
+
+
+    // Type
+
+    item.mode = S_IFREG;
+
+    if	    ( strcasecmp( type, "F"	   ) == 0 )	item.mode = S_IFREG;
+    else if ( strcasecmp( type, "D"	   ) == 0 )	item.mode = S_IFDIR;
+    else if ( strcasecmp( type, "L"	   ) == 0 )	item.mode = S_IFLNK;
+    else if ( strcasecmp( type, "BlockDev" ) == 0 )	item.mode = S_IFBLK;
+    else if ( strcasecmp( type, "CharDev"  ) == 0 )	item.mode = S_IFCHR;
+    else if ( strcasecmp( type, "FIFO"	   ) == 0 )	item.mode = S_IFIFO;
+    else if ( strcasecmp( type, "Socket"   ) == 0 )	item.mode = S_IFSOCK;
+
+
+    // Size
+
+    char * end = 0;
+    item.size = strtoll( size_str, &end, 10 );
+
+    if ( end )
+    {
+	switch ( *end )
+	{
+	    case 'K':	item.size *= KB; break;
+	    case 'M':	item.size *= MB; break;
+	    case 'G':	item.size *= GB; break;
+	    case 'T':	item.size *= TB; break;
+	    default: break;
+	}
+    }
+
+
+    // MTime
+
+    item.mtime = strtol( mtime_str, 0, 0 );
+
+
+    // Blocks
+
+    item.blocks = blocks_str ? strtoll( blocks_str, 0, 10 ) : -1;
+
+
+    // Links
+
+    item.links = links_str ? atoi( links_str ) : 1;
+
+
+    // Files of a FileAggregate
+
+    item.files	     = files_str  ? atoi( files_str )	     : 0;
+    item.oldestMtime = oldest_str ? strtoll( oldest_str, 0, 0 ) : 0;
+
+    return true;
+}
+
+
+void CacheReader::addItem()
+{
+    CacheItem parsed;
+
+    if ( ! parseItem( _fields, _fieldsCount, parsed ) )
+    {
+	logError() << "Syntax error in " << _fileName << ":" << _lineNo
+		   << ": Expected at least 4 fields, saw only " << fieldsCount()
+		   << endl;
+
+	setReadError( _lastDir );
+
+	if ( ++_errorCount > MAX_ERROR_COUNT )
+	{
+	    logError() << "Too many syntax errors. Giving up." << endl;
+	    _ok = false;
+	    emit error();
+	}
+
+	return;
+    }
+
+    if ( *parsed.rawPath == '/' )
+	_lastDir = 0;
+
+
+    //
+    // Create a new item
+    //
+
+    if ( _lastDir && parsed.mode != S_IFDIR && isPlainName( parsed.rawPath ) )
+    {
+	// Fast path for the most common case: A file in the current directory
+	// with a name that does not need any unescaping. Store the name in
+	// the tree's name pool right away without any QString or QUrl
+	// roundtrips.
+
+	addFile( _lastDir, parsed.rawPath, strlen( parsed.rawPath ),
+		 parsed.mode, parsed.size, parsed.mtime,
+		 parsed.blocks, parsed.links,
+		 parsed.files, parsed.oldestMtime );
+
 	return;
     }
 
-    // logDebug() << "Opening " << fileName << " OK" << endl;
-    checkHeader();
+    QString fullPath = unescapedPath( parsed.rawPath );
+    QString path;
+    QString name;
+    splitPath( fullPath, path, name );
+
+    if ( _lastExcludedDir )
+    {
+	if ( path.startsWith( _lastExcludedDirUrl ) )
+	{
+	    // logDebug() << "Excluding " << path << "/" << name << endl;
+	    return;
+	}
+    }
+
+    // Find parent in tree
+
+    DirInfo * parent = _lastDir;
+
+    if ( ! parent && _tree->root() )
+    {
+	parent = locateParent( path, name );
+
+	if ( ! parent )
+	    return;	// Ignore this cache line completely
+    }
+
+    if ( S_ISDIR( parsed.mode ) )
+    {
+	QString url = ( parent == _tree->root() ) ? buildPath( path, name ) : name;
+#if VERBOSE_CACHE_DIRS
+	logDebug() << "Creating DirInfo for " << url << " with parent " << parent << endl;
+#endif
+	DirInfo * dir = new ( _tree ) DirInfo( _tree, parent, url,
+				     parsed.mode, parsed.size, parsed.mtime );
+	dir->setReadState( DirReading );
+	_lastDir = dir;
+
+	if ( parent )
+	    parent->insertChild( dir );
+
+	if ( ! _tree->root() )
+	{
+	    _tree->setRoot( dir );
+	    _toplevel = dir;
+	}
+
+	if ( ! _toplevel )
+	    _toplevel = dir;
+
+	_tree->childAddedNotify( dir );
+
+	if ( excludeDir( dir ) )
+	{
+	    _lastExcludedDir	= dir;
+	    _lastExcludedDirUrl = _lastExcludedDir->url();
+	    _lastDir		= 0;
+	}
+    }
+    else
+    {
+	if ( parent )
+	{
+#if VERBOSE_CACHE_FILE_INFOS
+	    logDebug() << "Creating FileInfo for "
+		       << buildPath( parent->debugUrl(), name ) << endl;
+#endif
+
+	    QByteArray rawName = name.toUtf8();
+
+	    addFile( parent, rawName.constData(), rawName.size(),
+		     parsed.mode, parsed.size, parsed.mtime,
+		     parsed.blocks, parsed.links,
+		     parsed.files, parsed.oldestMtime );
+	}
+	else
+	{
+	    logError() << _fileName << ":" << _lineNo << ": "
+		       << "No parent for item " << name << endl;
+	}
+    }
+}
+
+
+DirInfo * CacheReader::locateParent( const QString & path, const QString & name )
+{
+    DirInfo * parent = 0;
+
+    if ( ! _tree->root()->hasChildren() )
+	parent = _tree->root();
+
+    // Try the easy way first - the starting point of this cache
+
+    if ( ! parent && _toplevel )
+	parent = dynamic_cast<DirInfo *> ( _toplevel->locate( path ) );
+
+#if DEBUG_LOCATE_PARENT
+    if ( parent )
+	logDebug() << "Using cache starting point as parent for " << name << endl;
+#endif
+
+
+    // Fallback: Search the entire tree
+
+    if ( ! parent )
+    {
+	parent = dynamic_cast<DirInfo *> ( _tree->locate( path ) );
+
+#if DEBUG_LOCATE_PARENT
+	if ( parent )
+	    logDebug() << "Located parent " << path << " in tree" << endl;
+#endif
+    }
+
+    if ( ! parent ) // Still nothing?
+    {
+	logError() << _fileName << ":" << _lineNo << ": "
+		   << "Could not locate parent \"" << path << "\" for "
+		   << name << endl;
+
+	if ( ++_errorCount > MAX_ERROR_COUNT )
+	{
+	    logError() << "Too many consistency errors. Giving up." << endl;
+	    _ok = false;
+	    emit error();
+	}
+
+#if DEBUG_LOCATE_PARENT
+	THROW( Exception( "Could not locate cache item parent" ) );
+#endif
+    }
+
+    return parent;
+}
+
+
+bool CacheReader::excludeDir( DirInfo * dir )
+{
+    if ( dir == _toplevel || ! ExcludeRules::instance()->match( dir->url(), dir->name() ) )
+	return false;
+
+    logDebug() << "Excluding " << dir->name() << endl;
+    dir->setExcluded();
+    dir->setReadState( DirOnRequestOnly );
+    dir->finalizeLocal();
+    _tree->sendReadJobFinished( dir );
+
+    return true;
 }
 
 
-CacheReader::~CacheReader()
+DirInfo * CacheReader::addDir( DirInfo *    parent,
+			       const char * name,
+			       int	    len,
+			       mode_t	    mode,
+			       FileSize	    size,
+			       time_t	    mtime )
 {
-    if ( _cache )
-	gzclose( _cache );
+    DirInfo * dir = new ( _tree ) DirInfo( _tree, parent, QString(), mode, size, mtime );
+    CHECK_NEW( dir );
 
-    logDebug() << "Cache reading finished" << endl;
+    dir->setName( name, len );
+    dir->setReadState( DirReading );
+
+    if ( parent )
+	parent->insertChild( dir );
 
-    if ( _toplevel )
+    if ( ! _tree->root() )
     {
-	// logDebug() << "Finalizing recursive for " << _toplevel << endl;
-	finalizeRecursive( _toplevel );
-	_toplevel->finalizeAll();
+	_tree->setRoot( dir );
+	_toplevel = dir;
     }
 
-    emit finished();
+    if ( ! _toplevel )
+	_toplevel = dir;
+
+    _tree->childAddedNotify( dir );
+
+    return dir;
 }
 
 
-void CacheReader::rewind()
+void CacheReader::addFile( DirInfo *	parent,
+			   const char * name,
+			   int		len,
+			   mode_t	mode,
+			   FileSize	size,
+			   time_t	mtime,
+			   FileSize	blocks,
+			   nlink_t	links,
+			   int		files,
+			   time_t	oldestMtime )
 {
-    if ( _cache )
+    FileInfo * item = 0;
+
+    if ( files > 0 )
     {
-	gzrewind( _cache );
-	checkHeader();		// skip cache header
+	// The name of an aggregate is made up from the number of files
+
+	item = new ( _tree ) FileAggregate( _tree, parent, files,
+					    size, blocks, mtime, oldestMtime );
+	CHECK_NEW( item );
+    }
+    else
+    {
+	item = new ( _tree ) FileInfo( _tree, parent, QString(),
+				       mode, size, mtime,
+				       blocks, links );
+	CHECK_NEW( item );
+
+	item->setName( name, len );
     }
+
+    parent->insertChild( item );
+    _tree->childAddedNotify( item );
 }
 
 
-bool CacheReader::read( int maxLines )
+bool CacheReader::readBlocks( int maxItems )
 {
-    while ( ! gzeof( _cache )
-	    && _ok
-	    && ( maxLines == 0 || --maxLines > 0 ) )
+    while ( _ok && ( _parsedBlock || _blockNo < _blockFile->blockCount() ) )
     {
-	if ( readLine() )
+	if ( ! _parsedBlock )
 	{
-	    splitLine();
-	    addItem();
+	    _parsedBlock = _blockFile->takeBlock( _blockNo );
+	    _itemNo	 = 0;
+
+	    if ( ! _parsedBlock->ok )
+	    {
+		logError() << _fileName << ": " << _parsedBlock->errorMsg << endl;
+		_ok = false;
+		emit error();
+		break;
+	    }
+
+	    if ( _parsedBlock->syntaxErrors > 0 )
+	    {
+		logError() << "Syntax errors in " << _fileName << " block " << _blockNo
+			   << ": " << _parsedBlock->syntaxErrors << endl;
+
+		_errorCount += _parsedBlock->syntaxErrors;
+
+		if ( _errorCount > MAX_ERROR_COUNT )
+		{
+		    logError() << "Too many syntax errors. Giving up." << endl;
+		    _ok = false;
+		    emit error();
+		    break;
+		}
+	    }
+	}
+
+	const char * names = _parsedBlock->names.constData();
+
+	while ( _ok && _itemNo < _parsedBlock->items.size() )
+	{
+	    addParsedItem( _parsedBlock->items[ _itemNo++ ], names );
+
+	    if ( maxItems > 0 && --maxItems == 0 )
+		return _ok && ! eof();
 	}
+
+	delete _parsedBlock;
+	_parsedBlock = 0;
+	++_blockNo;
     }
 
-    return _ok && ! gzeof( _cache );
+    return _ok && ! eof();
 }
 
 
-void CacheReader::addItem()
+void CacheReader::addParsedItem( const ParsedCacheItem & item, const char * names )
 {
-    if ( fieldsCount() < 4 )
+    const char * name = names + item.nameOffset;
+    bool isDir = S_ISDIR( item.mode );
+
+    if ( ! item.absolute )
     {
-	logError() << "Syntax error in " << _fileName << ":" << _lineNo
-		   << ": Expected at least 4 fields, saw only " << fieldsCount()
-		   << endl;
+	// Relative to the last directory; if there is none, that directory
+	// was excluded or could not be located.
 
-	setReadError( _lastDir );
+	if ( ! _lastDir )
+	    return;
 
-	if ( ++_errorCount > MAX_ERROR_COUNT )
+	if ( isDir )
 	{
-	    logError() << "Too many syntax errors. Giving up." << endl;
-	    _ok = false;
-	    emit error();
+	    DirInfo * dir = addDir( _lastDir, name, item.nameLen,
+				    item.mode, item.size, item.mtime );
+	    _lastDir = excludeDir( dir ) ? 0 : dir;
+	}
+	else
+	{
+	    addFile( _lastDir, name, item.nameLen,
+		     item.mode, item.size, item.mtime,
+		     item.blocks, item.links,
+		     item.files, item.oldestMtime );
 	}
 
 	return;
     }
 
-    int n = 0;
-    char * type		= field( n++ );
-    char * raw_path	= field( n++ );
-    char * size_str	= field( n++ );
-    char * mtime_str	= field( n++ );
-    char * blocks_str	= 0;
-    char * links_str	= 0;
+    DirInfo * parent = 0;
 
-    while ( fieldsCount() > n+1 )
+    if ( _tree->root() )
     {
-	char * keyword	= field( n++ );
-	char * val_str	= field( n++ );
-
-	if ( strcasecmp( keyword, "blocks:" ) == 0 ) blocks_str = val_str;
-	if ( strcasecmp( keyword, "links:"  ) == 0 ) links_str	= val_str;
-    }
+	parent = findParent( name, item.nameLen );
 
+	if ( ! parent )
+	{
+	    _lastDir = 0;
 
-    // Type
+	    if ( isDir )
+	    {
+		// Skip everything below this directory, too
 
-    mode_t mode = S_IFREG;
+		_dirPaths << QByteArray( name, item.nameLen );
+		_dirStack << 0;
+	    }
 
-    if	    ( strcasecmp( type, "F"	   ) == 0 )	mode = S_IFREG;
-    else if ( strcasecmp( type, "D"	   ) == 0 )	mode = S_IFDIR;
-    else if ( strcasecmp( type, "L"	   ) == 0 )	mode = S_IFLNK;
-    else if ( strcasecmp( type, "BlockDev" ) == 0 )	mode = S_IFBLK;
-    else if ( strcasecmp( type, "CharDev"  ) == 0 )	mode = S_IFCHR;
-    else if ( strcasecmp( type, "FIFO"	   ) == 0 )	mode = S_IFIFO;
-    else if ( strcasecmp( type, "Socket"   ) == 0 )	mode = S_IFSOCK;
+	    return;
+	}
+    }
 
+    if ( ! parent && ! isDir )
+    {
+	logError() << _fileName << ": No parent for item " << name << endl;
+	return;
+    }
 
-    // Path
+    // Directly below the root the name is the complete path
 
-    if ( *raw_path == '/' )
-	_lastDir = 0;
+    const char * baseName = name;
+    int		 baseLen  = item.nameLen;
 
+    if ( parent && parent != _tree->root() )
+    {
+	baseName = strrchr( name, '/' ) + 1;
+	baseLen	 = item.nameLen - ( baseName - name );
+    }
 
-    // Size
+    if ( isDir )
+    {
+	DirInfo * dir = addDir( parent, baseName, baseLen,
+				item.mode, item.size, item.mtime );
 
-    char * end = 0;
-    FileSize size = strtoll( size_str, &end, 10 );
+	if ( excludeDir( dir ) )
+	    dir = 0;
 
-    if ( end )
+	_dirPaths << QByteArray( name, item.nameLen );
+	_dirStack << dir;
+	_lastDir = dir;
+    }
+    else
     {
-	switch ( *end )
-	{
-	    case 'K':	size *= KB; break;
-	    case 'M':	size *= MB; break;
-	    case 'G':	size *= GB; break;
-	    case 'T':	size *= TB; break;
-	    default: break;
-	}
+	addFile( parent, baseName, baseLen,
+		 item.mode, item.size, item.mtime,
+		 item.blocks, item.links,
+		 item.files, item.oldestMtime );
+	_lastDir = 0;
     }
+}
 
 
-    // MTime
+/**
+ * Return 'true' if 'path' with 'len' bytes is somewhere below directory
+ * 'dir'.
+ **/
+static bool isInside( const char * path, int len, const QByteArray & dir )
+{
+    if ( len <= dir.size() || memcmp( path, dir.constData(), dir.size() ) != 0 )
+	return false;
 
-    time_t mtime = strtol( mtime_str, 0, 0 );
+    return dir.endsWith( '/' ) || path[ dir.size() ] == '/';
+}
 
 
-    // Blocks
+DirInfo * CacheReader::findParent( const char * path, int len )
+{
+    // The directories are in depth-first order, so the parent of a new
+    // directory is usually the last one that contains it.
 
-    FileSize blocks = blocks_str ? strtoll( blocks_str, 0, 10 ) : -1;
+    while ( ! _dirPaths.isEmpty() && ! isInside( path, len, _dirPaths.last() ) )
+    {
+	_dirPaths.removeLast();
+	_dirStack.removeLast();
+    }
 
+    if ( ! _dirPaths.isEmpty() )
+    {
+	const QByteArray & dirPath = _dirPaths.last();
 
-    // Links
+	if ( ! _dirStack.last() )
+	    return 0;	// Excluded or skipped subtree
 
-    int links = links_str ? atoi( links_str ) : 1;
+	int start = dirPath.endsWith( '/' ) ? dirPath.size() : dirPath.size() + 1;
 
+	if ( ! memchr( path + start, '/', len - start ) )
+	    return _dirStack.last();
+    }
 
-    //
-    // Create a new item
-    //
+    // The toplevel directory of the cache or an unusual order: Search the
+    // tree
 
-    QString fullPath = unescapedPath( raw_path );
-    QString path;
+    QString parentPath;
     QString name;
-    splitPath( fullPath, path, name );
+    splitPath( QString::fromUtf8( path, len ), parentPath, name );
 
-    if ( _lastExcludedDir )
+    return locateParent( parentPath, name );
+}
+
+
+bool CacheReader::readBinary( int maxItems )
+{
+    if ( _binaryDirs.isEmpty() && _ok )
+	_binaryDirs.fill( 0, _endDir - _dirBase );
+
+    // All blocks but the last one have the same number of records, so the
+    // block of each record is known without looking at the others. That
+    // is what makes skipping subtrees possible.
+
+    while ( _ok && _nextRecord < _endRecord )
     {
-	if ( path.startsWith( _lastExcludedDirUrl ) )
+	int blockNo = _nextRecord / BINARY_CACHE_BLOCK_RECORDS;
+
+	if ( ! _blockData || blockNo != _blockNo )
 	{
-	    // logDebug() << "Excluding " << path << "/" << name << endl;
-	    return;
+	    _blockNo   = blockNo;
+	    _blockData = _binaryCache->block( _blockNo, _blockBuffer );
+
+	    if ( ! _blockData )
+	    {
+		_ok = false;
+		emit error();
+		break;
+	    }
 	}
+
+	const BinaryCacheBlock & info = _binaryCache->blockInfo( _blockNo );
+	const BinaryCacheRecord * records = (const BinaryCacheRecord *) _blockData;
+	const char * names = _blockData + info.namesOffset;
+	quint32 recordNo   = _nextRecord++ % BINARY_CACHE_BLOCK_RECORDS;
+
+	addBinaryRecord( records[ recordNo ], names, info.rawSize - info.namesOffset );
+
+	if ( maxItems > 0 && --maxItems == 0 )
+	    break;
     }
 
-    // Find parent in tree
+    return _ok && ! eof();
+}
 
-    DirInfo * parent = _lastDir;
 
-    if ( ! parent && _tree->root() )
+void CacheReader::addBinaryRecord( const BinaryCacheRecord & record,
+				   const char		   * names,
+				   quint32		     namesSize )
+{
+    bool isDir = S_ISDIR( record.mode );
+
+    if ( record.nameOffset + (quint64) record.nameLen >= namesSize ||
+	 ( isDir && _dirNo >= _endDir ) ||
+	 ( record.parent == BINARY_CACHE_NO_PARENT && ( ! isDir || _lazyBase ) ) ||
+	 ( record.parent != BINARY_CACHE_NO_PARENT &&
+	   ( record.parent < _dirBase || record.parent >= _dirNo ) ) )
     {
-	if ( ! _tree->root()->hasChildren() )
-	    parent = _tree->root();
+	logError() << _fileName << ": Corrupt record in block " << _blockNo << endl;
+	_ok = false;
+	emit error();
 
-	// Try the easy way first - the starting point of this cache
+	return;
+    }
 
-	if ( ! parent && _toplevel )
-	    parent = dynamic_cast<DirInfo *> ( _toplevel->locate( path ) );
+    const char * name = names + record.nameOffset;
+    DirInfo * parent  = 0;
 
-#if DEBUG_LOCATE_PARENT
-	if ( parent )
-	    logDebug() << "Using cache starting point as parent for " << fullPath << endl;
-#endif
+    if ( record.parent == BINARY_CACHE_NO_PARENT )
+    {
+	// The toplevel directory of this cache: Find its parent by its path
 
+	QString path;
+	QString dirName;
+	splitPath( QString::fromUtf8( name, record.nameLen ), path, dirName );
 
-	// Fallback: Search the entire tree
+	if ( _tree->root() )
+	    parent = locateParent( path, dirName );
 
-	if ( ! parent )
+	if ( ! parent && _tree->root() )
 	{
-	    parent = dynamic_cast<DirInfo *> ( _tree->locate( path ) );
+	    quint32 dirNo = _dirNo++;	// Skip this subtree
 
-#if DEBUG_LOCATE_PARENT
-	    if ( parent )
-		logDebug() << "Located parent " << path << " in tree" << endl;
-#endif
+	    if ( _binaryCache->hasDirIndex() )
+		skipSubtree( dirNo );
+
+	    return;
 	}
 
-	if ( ! parent ) // Still nothing?
-	{
-	    logError() << _fileName << ":" << _lineNo << ": "
-		       << "Could not locate parent \"" << path << "\" for "
-		       << name << endl;
+	QByteArray url = ( parent == _tree->root() ? buildPath( path, dirName ) : dirName ).toUtf8();
+	DirInfo * dir = addDir( parent, url.constData(), url.size(),
+				record.mode, record.size, record.mtime );
+	_lazyBase = dir;
+	addBinaryDir( dir, _dirNo++ );
+
+	return;
+    }
 
-            if ( ++_errorCount > MAX_ERROR_COUNT )
-            {
-                logError() << "Too many consistency errors. Giving up." << endl;
-                _ok = false;
-                emit error();
-            }
+    parent = _binaryDirs[ record.parent - _dirBase ];
 
-#if DEBUG_LOCATE_PARENT
-	    THROW( Exception( "Could not locate cache item parent" ) );
-#endif
-	    return;	// Ignore this cache line completely
-	}
+    if ( ! parent )
+    {
+	// In an excluded or skipped subtree
+
+	if ( isDir )
+	    _binaryDirs[ _dirNo++ - _dirBase ] = 0;
+
+	return;
     }
 
-    if ( strcasecmp( type, "D" ) == 0 )
+    if ( isDir )
     {
-	QString url = ( parent == _tree->root() ) ? buildPath( path, name ) : name;
-#if VERBOSE_CACHE_DIRS
-	logDebug() << "Creating DirInfo for " << url << " with parent " << parent << endl;
-#endif
-	DirInfo * dir = new DirInfo( _tree, parent, url,
-				     mode, size, mtime );
-	dir->setReadState( DirReading );
-	_lastDir = dir;
+	DirInfo * dir = addDir( parent, name, record.nameLen,
+				record.mode, record.size, record.mtime );
 
-	if ( parent )
-	    parent->insertChild( dir );
+	addBinaryDir( dir, _dirNo++ );
+    }
+    else
+    {
+	addFile( parent, name, record.nameLen,
+		 record.mode, record.size, record.mtime,
+		 record.blocks, record.links,
+		 record.files, record.oldestMtime );
+    }
+}
 
-	if ( ! _tree->root() )
-	{
-	    _tree->setRoot( dir );
-	    _toplevel = dir;
-	}
 
-	if ( ! _toplevel )
-	    _toplevel = dir;
+void CacheReader::addBinaryDir( DirInfo * dir, quint32 dirNo )
+{
+    if ( excludeDir( dir ) )
+    {
+	_binaryDirs[ dirNo - _dirBase ] = 0;
 
-	_tree->childAddedNotify( dir );
+	// No need to look at the records of an excluded subtree at all
 
-	if ( dir != _toplevel )
-	{
-	    if ( ExcludeRules::instance()->match( dir->url(), dir->name() ) )
-	    {
-		logDebug() << "Excluding " << name << endl;
-		dir->setExcluded();
-		dir->setReadState( DirOnRequestOnly );
-		dir->finalizeLocal();
-		_tree->sendReadJobFinished( dir );
-
-		_lastExcludedDir    = dir;
-		_lastExcludedDirUrl = _lastExcludedDir->url();
-		_lastDir	    = 0;
-	    }
-	}
+	if ( _binaryCache->hasDirIndex() )
+	    skipSubtree( dirNo );
+
+	return;
     }
-    else
+
+    _binaryDirs[ dirNo - _dirBase ] = dir;
+
+    if ( _lazyLevels <= 0 || ! _binaryCache->hasDirIndex() )
+	return;
+
+    int level = 0;
+
+    for ( DirInfo * ancestor = dir; ancestor && ancestor != _lazyBase; ancestor = ancestor->parent() )
+	++level;
+
+    const BinaryCacheDir & info = _binaryCache->dirInfo( dirNo );
+
+    if ( level < _lazyLevels || _binaryCache->subtreeEnd( dirNo ) <= info.record + 1 )
+	return;
+
+    // Leave the subtree in the file until somebody wants to see it, but
+    // count it right away. The cache file does not know about ignored
+    // items or read errors, and everything but a directory counts as an
+    // unignored item (this includes the dot entries).
+
+    if ( ! skipSubtree( dirNo ) )
+	return;
+
+    SummaryDelta contents;
+
+    contents.size	     = info.totalSize;
+    contents.allocatedSize   = info.totalAllocatedSize;
+    contents.blocks	     = info.totalBlocks;
+    contents.items	     = info.totalItems;
+    contents.subDirs	     = info.totalSubDirs;
+    contents.files	     = info.totalFiles;
+    contents.unignoredItems  = info.totalItems - info.totalSubDirs;
+    contents.latestMtime     = info.latestMtime;
+    contents.oldestFileMtime = info.oldestFileMtime;
+
+    _tree->addPendingSubtree( dir, _binaryCache, dirNo, contents );
+    _ownsBinaryCache = false;	// The tree deletes it now
+}
+
+
+bool CacheReader::skipSubtree( quint32 dirNo )
+{
+    const BinaryCacheDir & info = _binaryCache->dirInfo( dirNo );
+    quint64 end = _binaryCache->subtreeEnd( dirNo );
+
+    // This has to be the directory that was just read, and the subtree
+    // has to be within what this reader reads.
+
+    if ( info.record + 1 != _nextRecord ||
+	 info.endDir <= dirNo		||
+	 info.endDir > _endDir		||
+	 end < _nextRecord		||
+	 end > _endRecord )
     {
-	if ( parent )
-	{
-#if VERBOSE_CACHE_FILE_INFOS
-	    logDebug() << "Creating FileInfo for "
-		       << buildPath( parent->debugUrl(), name ) << endl;
-#endif
+	logError() << _fileName << ": Corrupt directory index entry " << dirNo << endl;
+	_ok = false;
+	emit error();
 
-	    FileInfo * item = new FileInfo( _tree, parent, name,
-					    mode, size, mtime,
-					    blocks, links );
-	    parent->insertChild( item );
-	    _tree->childAddedNotify( item );
-	}
-	else
-	{
-	    logError() << _fileName << ":" << _lineNo << ": "
-		       << "No parent for item " << name << endl;
-	}
+	return false;
     }
+
+    _nextRecord = end;
+    _dirNo	= info.endDir;
+
+    return true;
 }
 
 
 bool CacheReader::eof()
 {
+    if ( _binaryCache )
+	return ! _ok || _nextRecord >= _endRecord;
+
+    if ( _blockFile )
+	return ! _ok || ( ! _parsedBlock && _blockNo >= _blockFile->blockCount() );
+
     if ( ! _ok || ! _cache )
 	return true;
 
@@ -515,6 +1437,26 @@ bool CacheReader::eof()
 
 QString CacheReader::firstDir()
 {
+    if ( _binaryCache )
+    {
+	if ( ! _ok || _binaryCache->blockCount() == 0 )
+	    return "";
+
+	QByteArray buffer;
+	const char * data = _binaryCache->block( 0, buffer );
+	const BinaryCacheBlock & info = _binaryCache->blockInfo( 0 );
+
+	if ( ! data || info.recordCount == 0 )
+	    return "";
+
+	const BinaryCacheRecord & record = *( (const BinaryCacheRecord *) data );
+
+	if ( record.nameOffset + (quint64) record.nameLen >= info.rawSize - info.namesOffset )
+	    return "";
+
+	return QString::fromUtf8( data + info.namesOffset + record.nameOffset, record.nameLen );
+    }
+
     while ( ! gzeof( _cache ) && _ok )
     {
 	if ( ! readLine() )
@@ -701,6 +1643,21 @@ void CacheReader::killTrailingWhiteSpace( char * cptr )
 }
 
 
+bool CacheReader::isPlainName( const char * rawPath )
+{
+    if ( ! *rawPath )
+	return false;
+
+    for ( const char * pos = rawPath; *pos; ++pos )
+    {
+	if ( ! isalnum( (unsigned char) *pos ) && ! strchr( "-._~+,=@", *pos ) )
+	    return false;
+    }
+
+    return true;
+}
+
+
 void CacheReader::splitPath( const QString & fileNameWithPath,
 			     QString	   & path_ret,
 			     QString	   & name_ret ) const
@@ -754,23 +1711,17 @@ QString CacheReader::cleanPath( const QString & rawPath ) const
 }
 
 
-void CacheReader::finalizeRecursive( DirInfo * dir )
+void CacheReader::setReadStateRecursive( DirInfo * dir )
 {
-    if ( dir->readState() != DirOnRequestOnly )
-    {
-	if ( ! dir->readError() )
-	    dir->setReadState( DirCached );
-
-	dir->finalizeLocal();
-	_tree->sendReadJobFinished( dir );
-    }
+    if ( dir->readState() != DirOnRequestOnly && ! dir->readError() )
+	dir->setReadState( DirCached );
 
     FileInfo * child = dir->firstChild();
 
     while ( child )
     {
 	if ( child->isDirInfo() )
-	    finalizeRecursive( child->toDirInfo() );
+	    setReadStateRecursive( child->toDirInfo() );
 
 	child = child->next();
     }
@@ -13,76 +13,188 @@
 
 #include <stdio.h>
 #include <zlib.h>
+#include <QVector>
+#include <QList>
 #include "DirTree.h"
 
 #define DEFAULT_CACHE_NAME	".qdirstat.cache.gz"
+#define DEFAULT_BINARY_CACHE_NAME ".qdirstat.cache.bin"
+#define BINARY_CACHE_SUFFIX	".bin"
 #define CACHE_FORMAT_VERSION	"1.0"
 #define MAX_CACHE_LINE_LEN	1024
 #define MAX_FIELDS_PER_LINE	32
 
+// Minimum number of items of a binary cache file to read its deeper
+// subtrees only on demand; see DirTree::lazyCacheLevels()
+#define LAZY_CACHE_MIN_ITEMS	1000000
+
 
 namespace QDirStat
 {
+    class BinaryCacheFile;
+    class BinaryCacheWriter;
+    class CacheBlockFile;
+    class CacheBlockWriter;
+    class CacheSnapshot;
+    class TreeFinalizer;
+    struct BinaryCacheRecord;
+    struct CacheSnapshotEntry;
+    struct ParsedCacheItem;
+    struct ParsedCacheBlock;
+
+
+    /**
+     * The fields of one line of a text cache file.
+     **/
+    struct CacheItem
+    {
+	char *		rawPath;	// Still URL-encoded
+	mode_t		mode;
+	FileSize	size;
+	time_t		mtime;
+	FileSize	blocks;		// -1 if not sparse
+	nlink_t		links;
+	int		files;		// Files of a FileAggregate, otherwise 0
+	time_t		oldestMtime;	// Oldest mtime of a FileAggregate
+    };
+
+
     class CacheWriter
     {
     public:
 
 	/**
-	 * Write 'tree' to file 'fileName' in gzip format (using zlib).
+	 * Write 'tree' to file 'fileName' in gzip format (using zlib), or in
+	 * the binary format if 'fileName' ends with BINARY_CACHE_SUFFIX (see
+	 * BinaryCacheWriter).
+	 *
+	 * If 'longFormat' is true, files are written with their full path,
+	 * too, not only directories. This makes the cache file larger, but
+	 * usable with "zgrep" like a "locate" database. The binary format
+	 * does not have a long format.
 	 *
 	 * Check CacheWriter::ok() to see if writing the cache file went OK.
+	 * This logs any error.
 	 **/
-	CacheWriter( const QString & fileName, DirTree *tree );
+	CacheWriter( const QString & fileName,
+		     DirTree *	     tree,
+		     bool	     longFormat = false );
+
+	/**
+	 * Constructor for writing a tree in two steps: First take a
+	 * snapshot() of the tree, then write() it to file 'fileName'. Only
+	 * snapshot() accesses the tree, so write() can run in a worker thread
+	 * while the tree is used and changed; see
+	 * DirTree::startWritingCache() for what the tree has to keep until
+	 * then.
+	 **/
+	CacheWriter( const QString & fileName,
+		     bool	     longFormat = false );
 
 	/**
 	 * Destructor
 	 **/
 	virtual ~CacheWriter();
 
+	/**
+	 * Take a CacheSnapshot of 'tree', but don't format or write anything
+	 * yet.
+	 **/
+	void snapshot( DirTree * tree );
+
+	/**
+	 * Format, compress and write the snapshot to the cache file block by
+	 * block and free the snapshot. This does not log anything, so it can
+	 * run in any thread; see errorMsg().
+	 *
+	 * Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool write();
+
 	/**
 	 * Returns true if writing the cache file went OK.
 	 **/
 	bool ok() const { return _ok; }
 
 	/**
-	 * Format a file size as string - with trailing "G", "M", "K" for
+	 * Return what went wrong if ok() returns 'false'.
+	 **/
+	const QString & errorMsg() const { return _errorMsg; }
+
+	/**
+	 * Return the name of the cache file.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Append a file size to 'dest' - with trailing "G", "M", "K" for
 	 * "Gigabytes", "Megabytes, "Kilobytes", respectively (provided there
 	 * is no fractional part - 27M is OK, 27.2M is not).
+	 *
+	 * This does not allocate anything if 'dest' has enough capacity.
 	 **/
-	QString formatSize( FileSize size );
+	static void appendSize( QByteArray & dest, FileSize size );
+
+	/**
+	 * Append 'value' to 'dest' as a decimal or hex number without
+	 * allocating anything if 'dest' has enough capacity.
+	 **/
+	static void appendNumber( QByteArray & dest, quint64 value, int base = 10 );
+
+	/**
+	 * Append the 'len' bytes of 'name' to 'dest' URL-encoded, i.e. with
+	 * whitespace and other special characters escaped in percent
+	 * notation (" " -> "%20"). Slashes are left alone.
+	 **/
+	static void appendEncoded( QByteArray & dest, const char * name, int len );
+
+	/**
+	 * Return 'true' if a cache file 'fileName' is written in the binary
+	 * format.
+	 **/
+	static bool isBinaryCacheName( const QString & fileName );
 
 
     protected:
 
 	/**
-	 * Write cache file in gzip format.
+	 * Write the snapshot in gzip format: Independently compressed blocks
+	 * that each start with a directory (see CacheBlockWriter).
+	 *
 	 * Returns 'true' if OK, 'false' upon error.
 	 **/
-	bool writeCache( const QString & fileName, DirTree *tree );
+	bool writeBlocks();
 
 	/**
-	 * Write 'item' recursively to cache file 'cache'.
-	 * Uses zlib to write gzip-compressed files.
+	 * Write 'entry' of the snapshot to the current block.
 	 **/
-	void writeTree( gzFile cache, FileInfo * item );
+	void writeEntry( const CacheSnapshotEntry & entry );
 
 	/**
-	 * Write 'item' to cache file 'cache' without recursion.
-	 * Uses zlib to write gzip-compressed files.
+	 * Write the fields of 'entry' to the current block.
 	 **/
-	void writeItem( gzFile cache, FileInfo * item );
+	void writeItem( const CacheSnapshotEntry & entry );
 
-        /**
-         * Return the 'path' in an URL-encoded form, i.e. with some special
-         * characters escaped in percent notation (" " -> "%20").
-         **/
-        QByteArray urlEncoded( const QString & path );
+	/**
+	 * Hand the current block over to the block writer if it is not empty,
+	 * and start a new one.
+	 **/
+	void flushBlock();
 
 	//
 	// Data members
 	//
 
-	bool _ok;
+	QString			_fileName;
+	bool			_ok;
+	QString			_errorMsg;
+	bool			_longFormat;
+	BinaryCacheWriter *	_binaryWriter;
+	CacheSnapshot *		_snapshot;
+	CacheBlockWriter *	_blockWriter;
+	QByteArray		_block;
+	QByteArray		_path;		// URL-encoded path of the current dir
+	QVector<int>		_pathLens;	// Path length of each dir level
     };
 
 
@@ -96,11 +208,27 @@ namespace QDirStat
 	/**
 	 * Begin reading cache file 'fileName'. The cache file remains open
 	 * until this object is destroyed.
+	 *
+	 * This reads both the text format and the binary format; the binary
+	 * format is recognized by its magic number, not by the file name.
 	 **/
 	CacheReader( const QString & fileName,
 		     DirTree	   * tree,
 		     DirInfo	   * parent = 0 );
 
+	/**
+	 * Begin reading the subtree of directory no. 'dirNo' of the binary
+	 * cache file 'cacheFile' into 'dir' that was created for that
+	 * directory before. See DirTree::loadSubtree().
+	 *
+	 * 'cacheFile' remains owned by the caller. Don't use rewind() or
+	 * firstDir() with this: They are only meant for complete files.
+	 **/
+	CacheReader( BinaryCacheFile * cacheFile,
+		     quint32	       dirNo,
+		     DirTree	     * tree,
+		     DirInfo	     * dir );
+
 	/**
 	 * Destructor
 	 **/
@@ -131,6 +259,15 @@ namespace QDirStat
 	 **/
 	void rewind();
 
+	/**
+	 * Start finalizing the tree that was read (see TreeFinalizer)
+	 * without waiting for it; finalized() is emitted when that is done.
+	 * Otherwise the destructor does it (and waits for it).
+	 *
+	 * Returns false if there is nothing to finalize.
+	 **/
+	bool startFinalizing();
+
 	/**
 	 * Returns the absolute path of the first directory in this cache file
 	 * or an empty string if there is none.
@@ -172,6 +309,18 @@ namespace QDirStat
 	 **/
 	static void killTrailingWhiteSpace( char * cptr );
 
+	/**
+	 * Parse the split line 'fields' of a text cache file into 'item'.
+	 * Returns false if there are not enough fields.
+	 **/
+	static bool parseItem( char ** fields, int fieldsCount, CacheItem & item );
+
+	/**
+	 * Return 'true' if 'rawPath' is a plain file name without a path that
+	 * needs no unescaping, i.e. if it can be used as a file name as it is.
+	 **/
+	static bool isPlainName( const char * rawPath );
+
 
     signals:
 
@@ -190,9 +339,19 @@ namespace QDirStat
 	 **/
 	void error();
 
+	/**
+	 * Emitted when the tree is finalized after startFinalizing().
+	 **/
+	void finalized();
+
 
     protected:
 
+	/**
+	 * Initialize the data members common to all constructors.
+	 **/
+	void init( DirTree * tree, DirInfo * parent );
+
 	/**
 	 * Check this cache's header (see if it is a QDirStat cache at all)
 	 **/
@@ -203,6 +362,98 @@ namespace QDirStat
 	 **/
 	void addItem();
 
+	/**
+	 * Read at most 'maxItems' items from a text cache file that consists
+	 * of blocks that are parsed in worker threads (all if 'maxItems' is
+	 * 0).
+	 *
+	 * Returns true if OK and there is more to read, false otherwise.
+	 **/
+	bool readBlocks( int maxItems );
+
+	/**
+	 * Add the item for 'item' from a parsed block with names 'names' to
+	 * _tree.
+	 **/
+	void addParsedItem( const ParsedCacheItem & item, const char * names );
+
+	/**
+	 * Find the parent directory of absolute path 'path' with 'len' bytes
+	 * in the stack of the directories of the current branch or, if it is
+	 * not there, in the tree. Return 0 if it is in an excluded subtree or
+	 * if there is none.
+	 **/
+	DirInfo * findParent( const char * path, int len );
+
+	/**
+	 * Create a directory 'name' with 'len' bytes in 'parent' and make it
+	 * the root of the tree if there is none yet.
+	 **/
+	DirInfo * addDir( DirInfo *    parent,
+			  const char * name,
+			  int	       len,
+			  mode_t       mode,
+			  FileSize     size,
+			  time_t       mtime );
+
+	/**
+	 * Create a non-directory item 'name' with 'len' bytes in 'parent'.
+	 * If 'files' is more than 0, this is a FileAggregate of that many
+	 * files instead, and 'name' is ignored.
+	 **/
+	void addFile( DirInfo *	   parent,
+		      const char * name,
+		      int	   len,
+		      mode_t	   mode,
+		      FileSize	   size,
+		      time_t	   mtime,
+		      FileSize	   blocks,
+		      nlink_t	   links,
+		      int	   files       = 0,
+		      time_t	   oldestMtime = 0 );
+
+	/**
+	 * Read at most 'maxItems' records from a binary cache file (all if
+	 * 'maxItems' is 0).
+	 *
+	 * Returns true if OK and there is more to read, false otherwise.
+	 **/
+	bool readBinary( int maxItems );
+
+	/**
+	 * Add the item for 'record' of a binary cache file to _tree. 'names'
+	 * are the 'namesSize' bytes of names of the block of 'record'.
+	 **/
+	void addBinaryRecord( const BinaryCacheRecord & record,
+			      const char	      * names,
+			      quint32			namesSize );
+
+	/**
+	 * Add directory 'dir' with number 'dirNo' of a binary cache file to
+	 * _binaryDirs, or skip its subtree if it is excluded or if it is deep
+	 * enough to be read only on demand.
+	 **/
+	void addBinaryDir( DirInfo * dir, quint32 dirNo );
+
+	/**
+	 * Continue reading a binary cache file after the subtree of directory
+	 * no. 'dirNo', using its directory index. Return 'false' if the index
+	 * does not make sense.
+	 **/
+	bool skipSubtree( quint32 dirNo );
+
+	/**
+	 * Find the parent directory 'path' of the toplevel item 'name' of
+	 * this cache in the tree. Return 0 if there is none.
+	 **/
+	DirInfo * locateParent( const QString & path, const QString & name );
+
+	/**
+	 * Check if 'dir' is excluded by the exclude rules. If it is, mark it
+	 * as excluded and finished and return 'true'.
+	 **/
+	bool excludeDir( DirInfo * dir );
+
 	/**
 	 * Read the next line that is not empty or a comment and store it in
 	 * _line.
@@ -257,11 +508,10 @@ namespace QDirStat
 	int fieldsCount() const { return _fieldsCount; }
 
 	/**
-	 * Recursively set the read status of all dirs from 'dir' on, send tree
-	 * signals and finalize local (i.e. clean up empty or unneded dot
-	 * entries).
+	 * Recursively set the read status of all dirs from 'dir' on to
+	 * "cached" unless they had a read error or they were excluded.
 	 **/
-	void finalizeRecursive( DirInfo * dir );
+	void setReadStateRecursive( DirInfo * dir );
 
         /**
          * Cascade a read error up to the toplevel directory node read by this
@@ -289,6 +539,29 @@ namespace QDirStat
 	DirInfo *	_lastExcludedDir;
 	QString		_lastExcludedDirUrl;
         QRegExp         _multiSlash;
+
+	// Binary format and text format with blocks
+
+	int		    _blockNo;
+	BinaryCacheFile *   _binaryCache;
+	bool		    _ownsBinaryCache;
+	quint64		    _nextRecord;
+	quint64		    _endRecord;
+	const char *	    _blockData;
+	QByteArray	    _blockBuffer;
+	QVector<DirInfo *>  _binaryDirs;	// By dir number - _dirBase; 0 if skipped
+	quint32		    _dirNo;
+	quint32		    _dirBase;
+	quint32		    _endDir;
+	int		    _lazyLevels;	// 0 if everything is read
+	DirInfo *	    _lazyBase;		// Where the levels are counted from
+	CacheBlockFile *    _blockFile;
+	bool		    _blockFileChecked;
+	ParsedCacheBlock *  _parsedBlock;
+	int		    _itemNo;
+	QVector<QByteArray> _dirPaths;		// The current branch
+	QVector<DirInfo *>  _dirStack;		// 0 if excluded or skipped
+	TreeFinalizer *	    _finalizer;
     };
 
 }	// namespace QDirStat
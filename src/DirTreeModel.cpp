@@ -21,6 +21,7 @@
 #include "Logger.h"
 #include "Exception.h"
 #include "DebugHelpers.h"
+#include "NodeFile.h"
 
 // Number of clusters up to which a file will be considered small and will also
 // display the allocated size like (4k).
@@ -30,6 +31,9 @@
 // like (4k)
 #define SMALL_FILE_SHOW_ALLOC_THRESHOLD         75
 
+// Max. number of decoded names to keep for the views: Some screens full
+#define NAME_CACHE_MAX_ENTRIES	4096
+
 using namespace QDirStat;
 
 
@@ -43,7 +47,8 @@ DirTreeModel::DirTreeModel( QObject * parent ):
     _slowUpdate( false ),
     _sortCol( NameCol ),
     _sortOrder( Qt::AscendingOrder ),
-    _removingRows( false )
+    _removingRows( false ),
+    _nameCacheReleaseCount( 0 )
 {
     createTree();
     readSettings();
@@ -70,7 +75,22 @@ void DirTreeModel::readSettings()
     settings.beginGroup( "DirectoryTree" );
 
     _tree->setCrossFilesystems	( settings.value( "CrossFilesystems", false ).toBool() );
+    _tree->setStructureOnly	( settings.value( "StructureOnlyScan", false ).toBool() );
+    _tree->setReaderThreads	( settings.value( "ReaderThreads", DEFAULT_READER_THREADS ).toInt() );
     FileInfo::setIgnoreHardLinks( settings.value( "IgnoreHardLinks",  false ).toBool() );
+    LocalDirReadJob::setUseIoUring( settings.value( "UseIoUring",	 true  ).toBool() );
+    NodeFile::instance()->setDirectory( settings.value( "NodeFileDir", "" ).toString() );
+    _tree->setMemoryBudget	( settings.value( "MemoryBudgetMB", 0 ).toLongLong() * 1024 * 1024 );
+    _tree->setFoldFilesBelow	( settings.value( "FoldFilesBelow", DEFAULT_FOLD_FILES_BELOW ).toLongLong() );
+    _tree->setLazyCacheLevels	( settings.value( "LazyCacheLevels", DEFAULT_LAZY_CACHE_LEVELS ).toInt() );
+
+    ScanThrottle * throttle = _tree->scanThrottle();
+    throttle->setMaxStatsPerSec( settings.value( "LowImpactMaxStatsPerSec", DEFAULT_MAX_STATS_PER_SEC ).toInt()	  );
+    throttle->setMaxDirsPerSec ( settings.value( "LowImpactMaxDirsPerSec",  DEFAULT_MAX_DIRS_PER_SEC  ).toInt()	  );
+    throttle->setMaxLoadPerCpu ( settings.value( "LowImpactMaxLoadPerCpu",  DEFAULT_MAX_LOAD_PER_CPU  ).toDouble() );
+    throttle->setMaxIoPressure ( settings.value( "LowImpactMaxIoPressure",  DEFAULT_MAX_IO_PRESSURE   ).toDouble() );
+    throttle->setEnabled       ( settings.value( "LowImpactScan",	     false			).toBool()   );
+
     _treeIconDir	 = settings.value( "TreeIconDir" , ":/icons/tree-medium/" ).toString();
     _updateTimerMillisec = settings.value( "UpdateTimerMillisec", 333 ).toInt();
     _slowUpdateMillisec	 = settings.value( "SlowUpdateMillisec", 3000 ).toInt();
@@ -106,7 +126,28 @@ void DirTreeModel::writeSettings()
     settings.setValue( "SlowUpdateMillisec", _slowUpdateMillisec  );
 
     settings.setDefaultValue( "CrossFilesystems",    _tree ? _tree->crossFilesystems() : false );
+    settings.setDefaultValue( "StructureOnlyScan",   false );
+    settings.setDefaultValue( "ReaderThreads",	     _tree ? _tree->readerThreads() : DEFAULT_READER_THREADS );
     settings.setDefaultValue( "IgnoreHardLinks",     FileInfo::ignoreHardLinks() );
+    settings.setDefaultValue( "UseIoUring",	     LocalDirReadJob::useIoUring() );
+    settings.setDefaultValue( "NodeFileDir",	     NodeFile::instance()->directory() );
+    settings.setDefaultValue( "MemoryBudgetMB",	     _tree ? _tree->memoryBudget() / ( 1024 * 1024 ) : 0 );
+    settings.setDefaultValue( "FoldFilesBelow",	     _tree ? _tree->foldFilesBelow() : DEFAULT_FOLD_FILES_BELOW );
+    settings.setDefaultValue( "LazyCacheLevels",     _tree ? _tree->lazyCacheLevels() : DEFAULT_LAZY_CACHE_LEVELS );
+
+    if ( _tree )
+    {
+	ScanThrottle * throttle = _tree->scanThrottle();
+
+	// Not writing back "LowImpactScan": It might have been switched on
+	// with the --low-impact command line option just for this session.
+	settings.setDefaultValue( "LowImpactScan",	     false			);
+	settings.setDefaultValue( "LowImpactMaxStatsPerSec", throttle->maxStatsPerSec() );
+	settings.setDefaultValue( "LowImpactMaxDirsPerSec",  throttle->maxDirsPerSec()	);
+	settings.setDefaultValue( "LowImpactMaxLoadPerCpu",  throttle->maxLoadPerCpu()	);
+	settings.setDefaultValue( "LowImpactMaxIoPressure",  throttle->maxIoPressure()	);
+    }
+
     settings.setDefaultValue( "TreeIconDir",	     _treeIconDir		 );
     settings.setDefaultValue( "UpdateTimerMillisec", _updateTimerMillisec	 );
 
@@ -130,6 +171,23 @@ bool DirTreeModel::usingDarkTheme()
 }
 
 
+void DirTreeModel::fillSizes( DirInfo * dir )
+{
+    if ( dir && dir->isPseudoDir() )
+	dir = dir->parent();
+
+    if ( ! dir || ! dir->sizesPending() || dir->readError() )
+	return;
+
+    // The sort order might change with the new sizes
+
+    emit layoutAboutToBeChanged();
+    _tree->fillSizes( dir );
+    updatePersistentIndexes();
+    emit layoutChanged();
+}
+
+
 void DirTreeModel::setSlowUpdate( bool slow )
 {
     _slowUpdate = slow;
@@ -168,6 +226,9 @@ void DirTreeModel::createTree()
 
     connect( _tree, SIGNAL( childDeleted() ),
 	     this,  SLOT  ( childDeleted() ) );
+
+    connect( _tree, SIGNAL( clearing()	   ),
+	     this,  SLOT  ( dropNameCache() ) );
 }
 
 
@@ -278,11 +339,8 @@ int DirTreeModel::rowNumber( FileInfo * child ) const
     if ( ! child->parent() )
 	return 0;
 
-    const FileInfoList & childrenList =
-	child->parent()->sortedChildren( _sortCol, _sortOrder,
-					 true ); // includeAttic
-
-    int row = childrenList.indexOf( child );
+    int row = child->parent()->sortedRow( child, _sortCol, _sortOrder,
+					  true ); // includeAttic
 
     if ( row < 0 )
     {
@@ -421,8 +479,19 @@ QVariant DirTreeModel::data( const QModelIndex & index, int role ) const
 
 		if ( item && item->isDirInfo() )
 		{
-		    // logDebug() << "Touching " << col << "\tof " << item << endl;
-		    item->toDirInfo()->touch();
+		    DirInfo * dir = item->toDirInfo();
+
+		    if ( ! dir->isTouched() )
+		    {
+			// logDebug() << "Touching " << col << "\tof " << item << endl;
+			dir->touch();
+
+			// The user can see this directory now, so read it and
+			// anything below it first.
+
+			if ( dir->isBusy() && dir != _tree->firstToplevel() )
+			    _tree->prioritize( dir );
+		    }
 		}
 
 		return result;
@@ -488,7 +557,7 @@ QVariant DirTreeModel::data( const QModelIndex & index, int role ) const
 	    {
 		switch ( col )
 		{
-		    case NameCol:	      return item->name();
+		    case NameCol:	      return itemName( item );
 		    case PercentBarCol:
 			{
 			    if ( ( item->parent() && item->parent()->isBusy() ) ||
@@ -655,6 +724,42 @@ QModelIndex DirTreeModel::parent( const QModelIndex & index ) const
 }
 
 
+bool DirTreeModel::hasChildren( const QModelIndex & parentIndex ) const
+{
+    if ( canFetchMore( parentIndex ) )
+	return true;
+
+    return QAbstractItemModel::hasChildren( parentIndex );
+}
+
+
+bool DirTreeModel::canFetchMore( const QModelIndex & parentIndex ) const
+{
+    if ( ! parentIndex.isValid() )
+	return false;
+
+    FileInfo * item = static_cast<FileInfo *>( parentIndex.internalPointer() );
+    CHECK_MAGIC( item );
+
+    return item->isDirInfo() && item->toDirInfo()->subtreePending();
+}
+
+
+void DirTreeModel::fetchMore( const QModelIndex & parentIndex )
+{
+    if ( ! canFetchMore( parentIndex ) )
+	return;
+
+    DirInfo * dir = static_cast<FileInfo *>( parentIndex.internalPointer() )->toDirInfo();
+
+    // Only touched directories get their new children announced to the
+    // views in readJobFinished()
+
+    dir->touch();
+    _tree->loadSubtree( dir );
+}
+
+
 void DirTreeModel::sort( int column, Qt::SortOrder order )
 {
     logDebug() << "Sorting by " << static_cast<DataColumn>( column )
@@ -743,7 +848,7 @@ QVariant DirTreeModel::columnText( FileInfo * item, int col ) const
 
     switch ( col )
     {
-	case NameCol:		  return item->name();
+	case NameCol:		  return itemName( item );
 	case PercentBarCol:	  return item->isExcluded() ? tr( "[Excluded]" ) : QVariant();
 	case PercentNumCol:	  return item == _tree->firstToplevel() ? QVariant() : formatPercent( item->subtreeAllocatedPercent() );
 	case SizeCol:		  return sizeColText( item );
@@ -930,6 +1035,41 @@ QVariant DirTreeModel::sizeColText( FileInfo * item ) const
 }
 
 
+QString DirTreeModel::itemName( FileInfo * item ) const
+{
+    // A released name may be reused for another item with a different
+    // name of the same length
+
+    qint64 releaseCount = _tree->namePool()->releaseCount();
+
+    if ( releaseCount != _nameCacheReleaseCount )
+    {
+	_nameCache.clear();
+	_nameCacheReleaseCount = releaseCount;
+    }
+
+    const char * rawName = item->rawName();
+    QHash<const char *, QString>::const_iterator it = _nameCache.constFind( rawName );
+
+    if ( it != _nameCache.constEnd() )
+	return it.value();
+
+    if ( _nameCache.size() >= NAME_CACHE_MAX_ENTRIES )
+	_nameCache.clear();
+
+    QString name = item->name();
+    _nameCache.insert( rawName, name );
+
+    return name;
+}
+
+
+void DirTreeModel::dropNameCache()
+{
+    _nameCache.clear();
+}
+
+
 QVariant DirTreeModel::columnIcon( FileInfo * item, int col ) const
 {
     if ( col != NameCol )
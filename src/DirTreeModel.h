@@ -12,6 +12,7 @@
 
 #include <QAbstractItemModel>
 #include <QColor>
+#include <QHash>
 #include <QIcon>
 #include <QSet>
 #include <QTimer>
@@ -194,6 +195,12 @@ namespace QDirStat
 	 **/
 	void refreshSelected();
 
+	/**
+	 * Fill in the sizes of the files in 'dir' if it was read in a
+	 * structure-only scan (see DirTree::fillSizes()) and notify the views.
+	 **/
+	void fillSizes( DirInfo * dir );
+
 	/**
 	 * Set the update speed to slow (3 sec instead of 333 millisec).
 	 **/
@@ -295,6 +302,25 @@ namespace QDirStat
 	 **/
 	virtual QModelIndex parent( const QModelIndex & index ) const Q_DECL_OVERRIDE;
 
+	/**
+	 * Return 'true' if the item for 'parent' has any children. A
+	 * directory with a subtree that is still in a cache file has some,
+	 * even if rowCount() does not know them yet.
+	 **/
+	virtual bool hasChildren( const QModelIndex & parent = QModelIndex() ) const Q_DECL_OVERRIDE;
+
+	/**
+	 * Return 'true' if the subtree of the item for 'parent' is still in a
+	 * cache file. See DirTree::loadSubtree().
+	 **/
+	virtual bool canFetchMore( const QModelIndex & parent ) const Q_DECL_OVERRIDE;
+
+	/**
+	 * Read the subtree of the item for 'parent' from its cache file and
+	 * notify the views. The views call this when the item is expanded.
+	 **/
+	virtual void fetchMore( const QModelIndex & parent ) Q_DECL_OVERRIDE;
+
 	/**
 	 * Sort the model.
 	 **/
@@ -397,6 +423,12 @@ namespace QDirStat
 	void invalidatePersistent( FileInfo * subtree,
 				   bool	      includeParent );
 
+	/**
+	 * Forget the decoded names of itemName() because the tree is about
+	 * to be cleared.
+	 **/
+	void dropNameCache();
+
 
     protected:
 	/**
@@ -438,6 +470,13 @@ namespace QDirStat
 	 **/
 	QVariant columnText( FileInfo * item, int col ) const;
 
+	/**
+	 * Return the name of 'item' as a QString. The views ask for the same
+	 * few names again and again whenever they paint, so this keeps the
+	 * recently decoded ones rather than decoding the UTF-8 name each time.
+	 **/
+	QString itemName( FileInfo * item ) const;
+
 	/**
 	 * Return the icon for (model) column 'col' for 'item'.
 	 **/
@@ -496,6 +535,12 @@ namespace QDirStat
 	Qt::SortOrder	 _sortOrder;
 	bool		 _removingRows;
 
+	// Decoded names by FileInfo::rawName(): Those stay valid until the
+	// tree is cleared or the name pool releases any name
+
+	mutable QHash<const char *, QString> _nameCache;
+	mutable qint64			     _nameCacheReleaseCount;
+
 	// Colors
 
 	QColor _dirReadErrColor;
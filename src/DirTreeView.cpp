@@ -48,6 +48,9 @@ DirTreeView::DirTreeView( QWidget * parent ):
 
     connect( this , SIGNAL( customContextMenuRequested( const QPoint & ) ),
 	     this,  SLOT  ( contextMenu		      ( const QPoint & ) ) );
+
+    connect( this , SIGNAL( expanded    ( const QModelIndex & ) ),
+	     this,  SLOT  ( itemExpanded( const QModelIndex & ) ) );
 }
 
 
@@ -67,6 +70,16 @@ void DirTreeView::currentChanged( const QModelIndex & current,
 }
 
 
+void DirTreeView::itemExpanded( const QModelIndex & index )
+{
+    DirTreeModel * dirTreeModel = qobject_cast<DirTreeModel *>( model() );
+    FileInfo * item = static_cast<FileInfo *>( index.internalPointer() );
+
+    if ( dirTreeModel && item && item->isDirInfo() )
+	dirTreeModel->fillSizes( item->toDirInfo() );
+}
+
+
 void DirTreeView::contextMenu( const QPoint & pos )
 {
     QModelIndex index = indexAt( pos );
@@ -105,6 +105,12 @@ namespace QDirStat
 	 **/
 	void contextMenu( const QPoint & pos );
 
+	/**
+	 * Notification that the branch at 'index' was expanded: Fill in the
+	 * file sizes if it was read in a structure-only scan.
+	 **/
+	void itemExpanded( const QModelIndex & index );
+
 
     protected:
 
@@ -9,7 +9,9 @@
 
 #include "DotEntry.h"
 #include "DirTree.h"
+#include "ChildNameIndex.h"
 #include "Exception.h"
+#include "SlabPool.h"
 #include "Logger.h"
 
 
@@ -20,16 +22,14 @@ DotEntry::DotEntry( DirTree * tree,
 		    DirInfo * parent )
     : DirInfo( tree, parent )
 {
-    _name	= dotEntryName();
+    setName( dotEntryName() );
     _dotEntry	= 0;
     _mtime	= 0;
 
     if ( parent )
     {
-	_device = parent->device();
+	setAttributes( parent->device(), 0, parent->uid(), parent->gid() );
 	_mode	= parent->mode();
-	_uid	= parent->uid();
-	_gid	= parent->gid();
     }
 }
 
@@ -40,6 +40,29 @@ DotEntry::~DotEntry()
 }
 
 
+void * DotEntry::operator new( size_t size, DirTree * tree )
+{
+    return slabPool( tree )->alloc( size );
+}
+
+
+void DotEntry::operator delete( void * ptr, size_t size )
+{
+    if ( size == sizeof( DotEntry ) )
+	SlabPool::releaseObject( ptr );
+    else
+	::operator delete( ptr );	// See FileInfo::operator delete()
+}
+
+
+SlabPool * DotEntry::slabPool( DirTree * tree )
+{
+    static SlabPool pool( sizeof( DotEntry ), "DotEntry" );
+
+    return tree ? tree->dotEntryPool() : &pool;
+}
+
+
 void DotEntry::reset()
 {
     // NOP
@@ -57,6 +80,9 @@ void DotEntry::insertChild( FileInfo * newChild )
     _firstChild = newChild;
     newChild->setParent( this );	// make sure the parent pointer is correct
 
+    if ( _childNameIndex )
+	_childNameIndex->add( newChild );
+
     childAdded( newChild );		// update summaries
 }
 
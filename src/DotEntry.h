@@ -40,6 +40,18 @@ namespace QDirStat
 	 **/
 	virtual ~DotEntry();
 
+	/**
+	 * Allocate from the DotEntry SlabPool of 'tree'. See
+	 * FileInfo::operator new().
+	 **/
+	static void * operator new( size_t size, DirTree * tree );
+	static void operator delete( void * ptr, size_t size );
+
+	/**
+	 * Return the SlabPool for DotEntry objects of 'tree'.
+	 **/
+	static SlabPool * slabPool( DirTree * tree );
+
 	/**
 	 * Get the "Dot Entry" for this node if there is one (or 0 otherwise).
 	 * Since this is a dot entry, this always returns 0: A dot entry does
@@ -0,0 +1,101 @@
+/*
+ *   File name: FileAggregate.cpp
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QObject>
+
+#include "FileAggregate.h"
+#include "DirTree.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+FileAggregate::FileAggregate( DirTree  * tree,
+			      DirInfo  * parent,
+			      FileInfo * files )
+    : FileInfo( tree, parent )
+    , _count( 0 )
+    , _blocks( 0 )
+    , _oldestMtime( 0 )
+{
+    CHECK_PTR( files );
+
+    setAttributes( files->device(), 1, files->uid(), files->gid() );
+    _mode	 = files->mode();
+    _mtime	 = files->mtime();
+
+    for ( FileInfo * file = files; file; file = file->next() )
+    {
+	_count++;
+	_size		+= file->size();
+	_allocatedSize	+= file->allocatedSize();
+	_blocks		+= file->blocks();
+
+	if ( file->mtime() > _mtime )
+	    _mtime = file->mtime();
+
+	// Just like DirInfo::recalc(): 0 means "no mtime"
+
+	if ( file->mtime() > 0 && ( _oldestMtime == 0 || file->mtime() < _oldestMtime ) )
+	    _oldestMtime = file->mtime();
+    }
+
+    setName( aggregateName( _count ) );
+}
+
+
+FileAggregate::FileAggregate( DirTree  * tree,
+			      DirInfo  * parent,
+			      int	 count,
+			      FileSize	 size,
+			      FileSize	 blocks,
+			      time_t	 mtime,
+			      time_t	 oldestMtime )
+    : FileInfo( tree, parent )
+    , _count( count )
+    , _blocks( blocks )
+    , _oldestMtime( oldestMtime )
+{
+    setAttributes( 0, 1, 0, 0 );
+    _mode	   = S_IFREG;
+    _mtime	   = mtime;
+    _size	   = size;
+    _allocatedSize = blocks * STD_BLOCK_SIZE;
+
+    setName( aggregateName( _count ) );
+}
+
+
+void * FileAggregate::operator new( size_t size, DirTree * tree )
+{
+    return slabPool( tree )->alloc( size );
+}
+
+
+void FileAggregate::operator delete( void * ptr, size_t size )
+{
+    if ( size == sizeof( FileAggregate ) )
+	SlabPool::releaseObject( ptr );
+    else
+	::operator delete( ptr );
+}
+
+
+SlabPool * FileAggregate::slabPool( DirTree * tree )
+{
+    static SlabPool pool( sizeof( FileAggregate ), "FileAggregate" );
+
+    return tree ? tree->aggregatePool() : &pool;
+}
+
+
+QString FileAggregate::aggregateName( int count )
+{
+    return QObject::tr( "<%1 files>" ).arg( count );
+}
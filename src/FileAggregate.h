@@ -0,0 +1,119 @@
+/*
+ *   File name: FileAggregate.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef FileAggregate_h
+#define FileAggregate_h
+
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    /**
+     * One item that stands for many small files of a directory: When a
+     * DirTree exceeds its memory budget, the files of directories that only
+     * have small files are replaced by one of these in the dot entry (see
+     * DirTree::foldSmallFiles()).
+     *
+     * It keeps the number of files, their total size, allocated size and
+     * blocks and their latest and oldest mtime, so all the summary fields
+     * of its ancestors stay exactly the same: For recalc() it counts as
+     * one file itself plus totalItems() more.
+     **/
+    class FileAggregate: public FileInfo
+    {
+    public:
+
+	/**
+	 * Constructor. 'files' is a list of regular files linked with
+	 * next() that this stands for. The caller still owns them.
+	 **/
+	FileAggregate( DirTree	* tree,
+		       DirInfo	* parent,
+		       FileInfo * files );
+
+	/**
+	 * Constructor for an aggregate from a cache file: 'count' files with
+	 * a total of 'size' bytes and 'blocks' blocks, the latest mtime
+	 * 'mtime' and the oldest 'oldestMtime'.
+	 **/
+	FileAggregate( DirTree	* tree,
+		       DirInfo	* parent,
+		       int	  count,
+		       FileSize	  size,
+		       FileSize	  blocks,
+		       time_t	  mtime,
+		       time_t	  oldestMtime );
+
+	/**
+	 * Allocate from the FileAggregate SlabPool of 'tree'. See
+	 * FileInfo::operator new().
+	 **/
+	static void * operator new( size_t size, DirTree * tree );
+	static void operator delete( void * ptr, size_t size );
+
+	/**
+	 * Return the SlabPool for FileAggregate objects of 'tree'.
+	 **/
+	static SlabPool * slabPool( DirTree * tree );
+
+	/**
+	 * Return the number of files this stands for.
+	 **/
+	int count() const { return _count; }
+
+	/**
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual bool isAggregate() const Q_DECL_OVERRIDE { return true; }
+
+	/**
+	 * The files other than the first one are counted like children.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual int totalItems()	  Q_DECL_OVERRIDE { return _count - 1; }
+	virtual int totalFiles()	  Q_DECL_OVERRIDE { return _count - 1; }
+	virtual int totalNonDirItems()	  Q_DECL_OVERRIDE { return _count - 1; }
+	virtual int totalUnignoredItems() Q_DECL_OVERRIDE { return _count - 1; }
+
+	/**
+	 * The sum of the blocks of all the files. This may be a little more
+	 * than blocks() if their allocated sizes are no multiples of 512.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual FileSize totalBlocks() Q_DECL_OVERRIDE { return _blocks; }
+
+	/**
+	 * The oldest mtime of all the files; mtime() is the latest.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual time_t oldestFileMtime() Q_DECL_OVERRIDE { return _oldestMtime; }
+
+	/**
+	 * (Translated) user-visible name for 'count' files ("<42 files>").
+	 **/
+	static QString aggregateName( int count );
+
+
+    protected:
+
+	int	 _count;
+	FileSize _blocks;
+	time_t	 _oldestMtime;
+
+    };	// class FileAggregate
+
+}	// namespace QDirStat
+
+
+#endif // ifndef FileAggregate_h
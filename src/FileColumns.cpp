@@ -0,0 +1,202 @@
+/*
+ *   File name: FileColumns.cpp
+ *   Summary:	Columnar mirror of the files of a DirTree for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "FileColumns.h"
+#include "FileInfoIterator.h"
+#include "DirInfo.h"
+#include "Attic.h"
+#include "DirTree.h"
+#include "Logger.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+FileColumns::FileColumns():
+    _valid( false ),
+    _ignoreHardLinks( false )
+{
+    // NOP
+}
+
+
+void FileColumns::clear()
+{
+    if ( ! _valid && _items.isEmpty() )
+	return;
+
+    _sizes.clear();
+    _allocatedSizes.clear();
+    _mtimes.clear();
+    _modes.clear();
+    _flags.clear();
+    _parents.clear();
+    _names.clear();
+    _items.clear();
+
+    _dirs.clear();
+    _dirFirst.clear();
+    _dirEnd.clear();
+    _dirIndex.clear();
+    _attics.clear();
+
+    _valid = false;
+}
+
+
+bool FileColumns::isValid() const
+{
+    // The sizes depend on the hard links policy
+
+    return _valid && _ignoreHardLinks == FileInfo::ignoreHardLinks();
+}
+
+
+void FileColumns::build( DirInfo * root )
+{
+    clear();
+
+    if ( ! root )
+	return;
+
+    int reserve = root->totalItems();
+    _sizes.reserve( reserve );
+    _allocatedSizes.reserve( reserve );
+    _mtimes.reserve( reserve );
+    _modes.reserve( reserve );
+    _flags.reserve( reserve );
+    _parents.reserve( reserve );
+    _names.reserve( reserve );
+    _items.reserve( reserve );
+
+    addSubtree( root );
+
+    // The attics come last so they are not in the range of any ancestor.
+    // Each one may add more attics further down.
+
+    while ( ! _attics.isEmpty() )
+	addSubtree( _attics.takeFirst() );
+
+    _ignoreHardLinks = FileInfo::ignoreHardLinks();
+    _valid = true;
+
+    logDebug() << "Built columns for " << _items.size() << " items in "
+	       << _dirs.size() << " directories" << endl;
+}
+
+
+void FileColumns::addSubtree( DirInfo * dir )
+{
+    quint32 dirIndex = _dirs.size();
+
+    _dirs << dir;
+    _dirFirst << _items.size();
+    _dirEnd << _items.size();
+    _dirIndex.insert( dir, dirIndex );
+
+    if ( dir->attic() )
+	_attics << dir->attic();
+
+    FileInfoIterator it( dir );
+
+    while ( *it )
+    {
+	FileInfo * item = *it;
+
+	if ( item->isDirInfo() )
+	    addSubtree( item->toDirInfo() );
+	else if ( ! item->isAggregate() )	// No real file
+	    addItem( item, dirIndex );
+
+	++it;
+    }
+
+    _dirEnd[ dirIndex ] = _items.size();
+}
+
+
+void FileColumns::addItem( FileInfo * item, quint32 parentIndex )
+{
+    quint8 flags = 0;
+
+    if ( item->isSparseFile() )
+	flags |= SparseFile;
+
+    if ( item->links() > 1 )
+	flags |= HardLinked;
+
+    _sizes	    << item->size();
+    _allocatedSizes << item->allocatedSize();
+    _mtimes	    << item->mtime();
+    _modes	    << (quint16) item->mode();
+    _flags	    << flags;
+    _parents	    << parentIndex;
+    _names	    << item->rawName();
+    _items	    << item;
+}
+
+
+qint64 FileColumns::memoryUsage() const
+{
+    qint64 bytes =
+	_sizes.capacity()	   * sizeof( FileSize	  ) +
+	_allocatedSizes.capacity() * sizeof( FileSize	  ) +
+	_mtimes.capacity()	   * sizeof( time_t	  ) +
+	_modes.capacity()	   * sizeof( quint16	  ) +
+	_flags.capacity()	   * sizeof( quint8	  ) +
+	_parents.capacity()	   * sizeof( quint32	  ) +
+	_names.capacity()	   * sizeof( const char * ) +
+	_items.capacity()	   * sizeof( FileInfo *	  ) +
+	_dirs.capacity()	   * sizeof( DirInfo *	  ) +
+	_dirFirst.capacity()	   * sizeof( int	  ) +
+	_dirEnd.capacity()	   * sizeof( int	  );
+
+    // Buckets plus one node (next pointer, hash value, key, value) per entry
+
+    bytes += _dirIndex.capacity() * sizeof( void * );
+    bytes += _dirIndex.size() * ( 2 * sizeof( void * ) + sizeof( uint ) + sizeof( int ) );
+
+    return bytes;
+}
+
+
+bool FileColumns::range( const FileInfo * subtree, int & first, int & end ) const
+{
+    QHash<const FileInfo *, int>::const_iterator it = _dirIndex.constFind( subtree );
+
+    if ( it == _dirIndex.constEnd() )
+	return false;
+
+    first = _dirFirst[ it.value() ];
+    end	  = _dirEnd  [ it.value() ];
+
+    return true;
+}
+
+
+const FileColumns * FileColumns::forSubtree( FileInfo * subtree,
+					     int      & first,
+					     int      & end )
+{
+    if ( ! subtree || ! subtree->isDirInfo() || ! subtree->tree() )
+	return 0;
+
+    // Statistics need all items of the subtree
+
+    subtree->tree()->loadPendingSubtrees( subtree->toDirInfo() );
+    const FileColumns * columns = subtree->tree()->fileColumns();
+
+    if ( ! columns->range( subtree, first, end ) )
+    {
+	logError() << "No columns for " << subtree << endl;
+	return 0;
+    }
+
+    return columns;
+}
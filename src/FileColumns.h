@@ -0,0 +1,174 @@
+/*
+ *   File name: FileColumns.h
+ *   Summary:	Columnar mirror of the files of a DirTree for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef FileColumns_h
+#define FileColumns_h
+
+
+#include <sys/stat.h>
+
+#include <QVector>
+#include <QHash>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    class DirInfo;
+
+    /**
+     * Columnar ("struct of arrays") mirror of all the non-directory items
+     * of a tree: One contiguous array for each of size, allocated size,
+     * mtime, mode etc. with one entry per item.
+     *
+     * This is for statistics and other passes over all files of a subtree:
+     * They become simple loops over packed arrays instead of chasing the
+     * _firstChild / _next pointers of the tree and calling virtual methods
+     * for each item.
+     *
+     * The items are stored in tree order (depth-first, the direct children
+     * of a directory before its dot entry), so the files of any subtree are
+     * one contiguous range of indices; see range(). The contents of attics
+     * are stored at the end, so they are not part of the range of their
+     * ancestors, just like FileInfoIterator does not include attics.
+     *
+     * This is only a snapshot: DirTree drops it whenever the tree changes
+     * and builds a new one on demand; see DirTree::fileColumns().
+     **/
+    class FileColumns
+    {
+    public:
+
+	/**
+	 * Flags for each item.
+	 **/
+	enum ItemFlags
+	{
+	    SparseFile	   = 0x01,
+	    HardLinked	   = 0x02
+	};
+
+	/**
+	 * Constructor. This creates an empty, invalid mirror.
+	 **/
+	FileColumns();
+
+	/**
+	 * Build the mirror for the complete tree below 'root'.
+	 **/
+	void build( DirInfo * root );
+
+	/**
+	 * Clear all data. This makes the mirror invalid.
+	 **/
+	void clear();
+
+	/**
+	 * Return 'true' if this was built and is still up to date.
+	 **/
+	bool isValid() const;
+
+	/**
+	 * Return the number of items.
+	 **/
+	int count() const { return _items.size(); }
+
+	/**
+	 * Return the approximate number of bytes used by this mirror.
+	 **/
+	qint64 memoryUsage() const;
+
+	/**
+	 * Find the range of indices [first, end) of the items in 'subtree'.
+	 * Return 'false' if 'subtree' is not a directory in the mirror.
+	 **/
+	bool range( const FileInfo * subtree, int & first, int & end ) const;
+
+	/**
+	 * The columns. Use these with indices from range().
+	 *
+	 * sizes() are the sizes as returned by FileInfo::size(), i.e. with
+	 * hard links and sparse files already taken into account.
+	 **/
+	const FileSize *     sizes()	      const { return _sizes.constData();	  }
+	const FileSize *     allocatedSizes() const { return _allocatedSizes.constData(); }
+	const time_t *	     mtimes()	      const { return _mtimes.constData();	  }
+	const quint16 *	     modes()	      const { return _modes.constData();	  }
+	const quint8 *	     flags()	      const { return _flags.constData();	  }
+	const quint32 *	     parents()	      const { return _parents.constData();	  }
+	const char * const * names()	      const { return _names.constData();	  }
+
+	/**
+	 * Return 'true' if item no. 'index' is a regular file.
+	 **/
+	bool isFile( int index ) const { return S_ISREG( _modes[ index ] ); }
+
+	/**
+	 * Return the columnar mirror of the tree of 'subtree' and the range
+	 * of the items in 'subtree' in 'first' and 'end', or 0 if 'subtree'
+	 * is not a directory in a tree.
+	 **/
+	static const FileColumns * forSubtree( FileInfo * subtree,
+					       int	& first,
+					       int	& end );
+
+	/**
+	 * Return the tree item for index 'index'.
+	 **/
+	FileInfo * item( int index ) const { return _items[ index ]; }
+
+	/**
+	 * Return the directory for 'parentIndex' as stored in parents().
+	 **/
+	DirInfo * dir( quint32 parentIndex ) const { return _dirs[ parentIndex ]; }
+
+
+    protected:
+
+	/**
+	 * Add the items of 'dir' and all its subdirectories. Attics are only
+	 * collected in _attics.
+	 **/
+	void addSubtree( DirInfo * dir );
+
+	/**
+	 * Add one non-directory item.
+	 **/
+	void addItem( FileInfo * item, quint32 parentIndex );
+
+
+	//
+	// Data members
+	//
+
+	QVector<FileSize>	_sizes;
+	QVector<FileSize>	_allocatedSizes;
+	QVector<time_t>		_mtimes;
+	QVector<quint16>	_modes;
+	QVector<quint8>		_flags;
+	QVector<quint32>	_parents;
+	QVector<const char *>	_names;
+	QVector<FileInfo *>	_items;
+
+	QVector<DirInfo *>	_dirs;
+	QVector<int>		_dirFirst;
+	QVector<int>		_dirEnd;
+	QHash<const FileInfo *, int> _dirIndex;
+	QList<DirInfo *>	_attics;
+
+	bool			_valid;
+	bool			_ignoreHardLinks;	// Policy at the time of build()
+
+    };	// class FileColumns
+
+}	// namespace QDirStat
+
+
+#endif // ifndef FileColumns_h
@@ -12,10 +12,12 @@
 #include <pwd.h>	// getpwuid()
 #include <grp.h>	// getgrgid()
 #include <unistd.h>
+#include <string.h>	// strlen()
 
 #include <QDateTime>
 
 #include "FileInfo.h"
+#include "ChildNameIndex.h"
 #include "DirInfo.h"
 #include "DotEntry.h"
 #include "Attic.h"
@@ -24,6 +26,8 @@
 #include "SysUtil.h"
 #include "Logger.h"
 #include "Exception.h"
+#include "SlabPool.h"
+#include "NamePool.h"
 
 // Some filesystems (NTFS seems to be among them) may handle block fragments
 // well. Don't report files as "sparse" files if the block size is only a few
@@ -35,27 +39,49 @@
 using namespace QDirStat;
 
 
+/**
+ * Return the name pool for items of 'tree'.
+ **/
+static NamePool * namePool( DirTree * tree )
+{
+    return tree ? tree->namePool() : NamePool::globalPool();
+}
+
+
+/**
+ * Return the last character of 'str' or 0 if it is empty.
+ **/
+static char lastChar( const char * str )
+{
+    size_t len = strlen( str );
+
+    return len > 0 ? str[ len-1 ] : '\0';
+}
+
+
 bool FileInfo::_ignoreHardLinks = false;
 
 
+// This is what all the memory tuning of FileInfo is about: Make sure it
+// stays within one cache line on 64 bit platforms.
+
+Q_STATIC_ASSERT_X( sizeof( void * ) != 8 || sizeof( FileInfo ) <= 64,
+		   "FileInfo exceeds its size budget of 64 bytes" );
+
+
 FileInfo::FileInfo( DirTree    * tree,
 		    DirInfo    * parent,
 		    const char * name )
     : _parent( parent )
     , _next( 0 )
-    , _tree( tree )
 {
     _isLocalFile   = true;
     _isSparseFile  = false;
     _isIgnored	   = false;
-    _name	   = name ? name : "";
-    _device	   = 0;
+    _name	   = namePool( tree )->intern( name );
+    _attrIndex	   = 0;
     _mode	   = 0;
-    _links	   = 0;
-    _uid	   = 0;
-    _gid	   = 0;
     _size	   = 0;
-    _blocks	   = 0;
     _mtime	   = 0;
     _allocatedSize = 0;
     _magic	   = FileInfoMagic;
@@ -68,35 +94,58 @@ FileInfo::FileInfo( const QString & filenameWithoutPath,
 		    DirInfo	  * parent )
     : _parent( parent )
     , _next( 0 )
-    , _tree( tree )
 {
     CHECK_PTR( statInfo );
 
     _isLocalFile   = true;
     _isIgnored	   = false;
-    _name	   = filenameWithoutPath;
+    _name	   = namePool( tree )->intern( filenameWithoutPath );
+    _magic	   = FileInfoMagic;
 
-    _device	   = statInfo->st_dev;
+    setStatInfo( statInfo );
+}
+
+
+FileInfo::FileInfo( const char	* utf8Name,
+		    int		  len,
+		    struct stat * statInfo,
+		    DirTree	* tree,
+		    DirInfo	* parent )
+    : _parent( parent )
+    , _next( 0 )
+{
+    CHECK_PTR( statInfo );
+
+    _isLocalFile   = true;
+    _isIgnored	   = false;
+    _name	   = namePool( tree )->intern( utf8Name, len );
+    _magic	   = FileInfoMagic;
+
+    setStatInfo( statInfo );
+}
+
+
+void FileInfo::setStatInfo( struct stat * statInfo )
+{
+    CHECK_PTR( statInfo );
+
+    setAttributes( statInfo->st_dev, statInfo->st_nlink,
+		   statInfo->st_uid, statInfo->st_gid );
     _mode	   = statInfo->st_mode;
-    _links	   = statInfo->st_nlink;
-    _uid	   = statInfo->st_uid;
-    _gid	   = statInfo->st_gid;
     _mtime	   = statInfo->st_mtime;
-    _magic	   = FileInfoMagic;
     _allocatedSize = 0;
 
     if ( isSpecial() )
     {
 	_size		= 0;
-	_blocks		= 0;
 	_isSparseFile	= false;
     }
     else
     {
 	_size		= statInfo->st_size;
-	_blocks		= statInfo->st_blocks;
+	FileSize blocks = statInfo->st_blocks;
 
-	if ( _blocks == 0 && _size > 0 )
+	if ( blocks == 0 && _size > 0 )
 	{
 	    if ( ! filesystemCanReportBlocks() )
 	    {
@@ -111,11 +160,11 @@ FileInfo::FileInfo( const QString & filenameWithoutPath,
 	}
 	else
 	{
-	    _allocatedSize = _blocks * STD_BLOCK_SIZE;
+	    _allocatedSize = blocks * STD_BLOCK_SIZE;
 	}
 
 	_isSparseFile	= isFile()
-	    && _blocks >= 0
+	    && blocks >= 0
 	    && _allocatedSize + FRAGMENT_SIZE < _size; // allow for intelligent fragment handling
 
 	if ( _isSparseFile )
@@ -123,14 +172,14 @@ FileInfo::FileInfo( const QString & filenameWithoutPath,
 	    logDebug() << "Found sparse file: " << this
 		       << "    Byte size: " << formatSize( _size )
 		       << "  Allocated: " << formatSize( _allocatedSize )
-		       << " (" << (int) _blocks << " blocks)"
+		       << " (" << (int) blocks << " blocks)"
 		       << endl;
 	}
 
 #if 0
-	if ( isFile() && _links > 1 )
+	if ( isFile() && links() > 1 )
 	{
-	    logDebug() << _links << " hard links: " << this << endl;
+	    logDebug() << links() << " hard links: " << this << endl;
 	}
 #endif
     }
@@ -148,42 +197,30 @@ FileInfo::FileInfo( DirTree *	    tree,
 		    nlink_t	    links )
     : _parent( parent )
     , _next( 0 )
-    , _tree( tree )
 {
-    _name	   = filenameWithoutPath;
+    _name	   = namePool( tree )->intern( filenameWithoutPath );
     _isLocalFile   = true;
     _isIgnored	   = false;
-    _device	   = 0;
     _mode	   = mode;
     _size	   = size;
     _mtime	   = mtime;
-    _allocatedSize = 0;
-    _links	   = links;
-    _uid	   = 0;
-    _gid	   = 0;
     _magic	   = FileInfoMagic;
+    setAttributes( 0, links, 0, 0 );
 
     if ( blocks < 0 )
     {
-	_isSparseFile	= false;
-	_blocks		= _size / STD_BLOCK_SIZE;
-
-	if ( ( _size % STD_BLOCK_SIZE ) > 0 )
-	    _blocks++;
-
 	// Don't make any assumptions about the file's tail. We might use
-	//
-	//   _allocatedSize = _blocks * STD_BLOCK_SIZE;
-	//
-	// but that might be wrong if the filesystem has intelligent fragment
-	// handling. Simply use the byte size instead.
+	// the size rounded up to full blocks, but that might be wrong if the
+	// filesystem has intelligent fragment handling. Simply use the byte
+	// size instead; blocks() still rounds that up to full blocks.
 
-	_allocatedSize = _size;
+	_isSparseFile	= false;
+	_allocatedSize	= _size;
     }
     else
     {
 	_isSparseFile	= true;
-	_blocks		= blocks;
+	_allocatedSize	= blocks * STD_BLOCK_SIZE;
     }
 
     // logDebug() << "Created FileInfo " << this << endl;
@@ -207,6 +244,32 @@ FileInfo::~FileInfo()
 }
 
 
+void * FileInfo::operator new( size_t size, DirTree * tree )
+{
+    return slabPool( tree )->alloc( size );
+}
+
+
+void FileInfo::operator delete( void * ptr, size_t size )
+{
+    // Derived classes without their own pool are too large for this one:
+    // SlabPool::alloc() took them from the heap.
+
+    if ( size == sizeof( FileInfo ) )
+	SlabPool::releaseObject( ptr );
+    else
+	::operator delete( ptr );
+}
+
+
+SlabPool * FileInfo::slabPool( DirTree * tree )
+{
+    static SlabPool pool( sizeof( FileInfo ), "FileInfo" );
+
+    return tree ? tree->fileInfoPool() : &pool;
+}
+
+
 bool FileInfo::checkMagicNumber() const
 {
     return _magic == FileInfoMagic;
@@ -217,8 +280,10 @@ FileSize FileInfo::size() const
 {
     FileSize sz = _isSparseFile ? _allocatedSize : _size;
 
-    if ( _links > 1 && ! _ignoreHardLinks && isFile() )
-	sz /= _links;
+    nlink_t links = this->links();
+
+    if ( links > 1 && ! _ignoreHardLinks && isFile() )
+	sz /= links;
 
     return sz;
 }
@@ -227,9 +292,10 @@ FileSize FileInfo::size() const
 FileSize FileInfo::allocatedSize() const
 {
     FileSize sz = _allocatedSize;
+    nlink_t links = this->links();
 
-    if ( _links > 1 && ! _ignoreHardLinks && isFile() )
-	sz /= _links;
+    if ( links > 1 && ! _ignoreHardLinks && isFile() )
+	sz /= links;
 
     return sz;
 }
@@ -257,13 +323,13 @@ QString FileInfo::url() const
 	if ( isPseudoDir() ) // don't append "/." for dot entries and attics
 	    return parentUrl;
 
-	if ( ! parentUrl.endsWith( "/" ) && ! _name.startsWith( "/" ) )
+	if ( ! parentUrl.endsWith( "/" ) && _name[0] != '/' )
 	    parentUrl += "/";
 
-	return parentUrl + _name;
+	return parentUrl + name();
     }
     else
-	return _name;
+	return name();
 }
 
 
@@ -279,19 +345,27 @@ QString FileInfo::path() const
 	if ( isPseudoDir() )
 	    return parentPath;
 
-	if ( ! parentPath.endsWith( "/" ) && ! _name.startsWith( "/" ) )
+	if ( ! parentPath.endsWith( "/" ) && _name[0] != '/' )
 	    parentPath += "/";
 
-	return parentPath + _name;
+	return parentPath + name();
     }
     else
-	return _name;
+	return name();
+}
+
+
+DirTree * FileInfo::tree() const
+{
+    return _parent ? _parent->tree() : 0;
 }
 
 
 QString FileInfo::debugUrl() const
 {
-    if ( _tree && this == _tree->root() )
+    DirTree * tree = this->tree();
+
+    if ( tree && this == tree->root() )
 	return "<root>";
 
     if ( isDotEntry() )
@@ -301,7 +375,7 @@ QString FileInfo::debugUrl() const
     {
 	if ( _parent )
 	{
-	    if ( _tree && _parent != _tree->root() )
+	    if ( tree && _parent != tree->root() )
 		return _parent->debugUrl() + "/" + atticName();
 	}
 
@@ -349,102 +423,151 @@ bool FileInfo::isInSubtree( const FileInfo *subtree ) const
 }
 
 
-FileInfo * FileInfo::locate( QString url, bool findPseudoDirs )
+FileInfo * FileInfo::locate( const QString & url, bool findPseudoDirs )
 {
-    if ( ! _tree )
-	return 0;
+    return locate( url, 0, findPseudoDirs );
+}
+
 
-    FileInfo * result = 0;
+FileInfo * FileInfo::locate( const QString & url, int pos, bool findPseudoDirs )
+{
+    DirTree * tree = this->tree();
 
-    if ( ! url.startsWith( _name ) && this != _tree->root() )
+    if ( ! tree )
 	return 0;
-    else					// URL starts with this node's name
+
+    if ( this != tree->root() )			// The root item is invisible
     {
-	if ( this != _tree->root() )		// The root item is invisible
-	{
-	    url.remove( 0, _name.length() );	// Remove leading name of this node
+	int nameLen = ChildNameIndex::matchPrefix( _name, url, pos );
+
+	if ( nameLen < 0 )			// URL doesn't continue with this node's name
+	    return 0;
 
-	    if ( url.length() == 0 )		// Nothing left?
-		return this;			// Hey! That's us!
+	pos += nameLen;				// Skip the name of this node
 
-	    if ( url.startsWith( "/" ) )	// If the next thing is a path delimiter,
-		url.remove( 0, 1 );		// remove that leading delimiter.
-	    else				// No path delimiter at the beginning
+	if ( pos == url.length() )		// Nothing left?
+	    return this;			// Hey! That's us!
+
+	if ( url.at( pos ) == '/' )		// If the next thing is a path delimiter,
+	    pos++;				// skip that delimiter.
+	else					// No path delimiter at that position
+	{
+	    if ( lastChar( _name ) != '/' &&	// and this is not the root directory
+		 ! isDotEntry() )		// or a dot entry:
 	    {
-		if ( _name.right(1) != "/" &&	// and this is not the root directory
-		     ! isDotEntry() )		// or a dot entry:
-		{
-		    return 0;			// This can't be any of our children.
-		}
+		return 0;			// This can't be any of our children.
 	    }
 	}
+    }
+
+    // The subtree of a directory from a cache file might not be read yet
+
+    if ( isDirInfo() && toDirInfo()->subtreePending() )
+	tree->loadSubtree( toDirInfo() );
+
+    // The next path component
 
+    int end = url.indexOf( '/', pos );
 
-	// Search all children
+    if ( end < 0 )
+	end = url.length();
 
+
+    // Search all children: Use the index of the children names if this is
+    // a large directory, otherwise try each child.
+
+    const ChildNameIndex * index = isDirInfo() ? toDirInfo()->childNameIndex() : 0;
+
+    if ( index )
+    {
+	FileInfo * child = index->find( url, pos, end - pos );
+
+	if ( child )
+	{
+	    FileInfo * foundChild = child->locate( url, pos, findPseudoDirs );
+
+	    if ( foundChild )
+		return foundChild;
+	}
+    }
+    else
+    {
 	FileInfo * child = firstChild();
 
 	while ( child )
 	{
-	    FileInfo * foundChild = child->locate( url, findPseudoDirs );
+	    FileInfo * foundChild = child->locate( url, pos, findPseudoDirs );
 
 	    if ( foundChild )
 		return foundChild;
 	    else
 		child = child->next();
 	}
+    }
 
 
-	// Special case: One of the pseudo directories is requested.
+    // Special case: One of the pseudo directories is requested.
 
-	if ( findPseudoDirs )
-	{
-	    if ( dotEntry() && url == dotEntryName() )
-		return dotEntry();
+    if ( findPseudoDirs )
+    {
+	QStringRef rest = url.midRef( pos );
 
-	    if ( attic() && url == atticName() )
-		return attic();
+	if ( dotEntry() && rest == dotEntryName() )
+	    return dotEntry();
 
-	    if ( url == dotEntryName() + "/" + atticName() &&
-		 dotEntry() && dotEntry()->attic() )
-	    {
-		return dotEntry()->attic();
-	    }
+	if ( attic() && rest == atticName() )
+	    return attic();
+
+	if ( rest == dotEntryName() + "/" + atticName() &&
+	     dotEntry() && dotEntry()->attic() )
+	{
+	    return dotEntry()->attic();
 	}
+    }
 
-	// Search the dot entry if there is one - but only if there is no more
-	// path delimiter left in the URL. The dot entry contains files only,
-	// and their names may not contain the path delimiter, nor can they
-	// have children. This check is not strictly necessary, but it may
-	// speed up things a bit if we don't search the non-directory children
-	// if the rest of the URL consists of several pathname components.
+    // Search the dot entry if there is one - but only if there is no more
+    // path delimiter left in the URL. The dot entry contains files only,
+    // and their names may not contain the path delimiter, nor can they
+    // have children. This check is not strictly necessary, but it may
+    // speed up things a bit if we don't search the non-directory children
+    // if the rest of the URL consists of several pathname components.
 
-	if ( dotEntry() &&
-	     ! url.contains( "/" ) )	   // No (more) "/" in this URL
-	{
-            // logDebug() << "Searching DotEntry for " << url << " in " << this << endl;
+    if ( dotEntry() && end == url.length() )	// No (more) "/" in this URL
+    {
+	// logDebug() << "Searching DotEntry for " << url << " in " << this << endl;
+
+	index = dotEntry()->childNameIndex();
 
-            child = dotEntry()->firstChild();
+	if ( index )
+	{
+	    FileInfo * child = index->find( url, pos, end - pos );
 
-            while ( child )
-            {
-                if ( child->name() == url )
-                {
-                    // logDebug() << "Found " << url << " in " << dotEntry() << endl;
-                    return child;
-                }
+	    if ( child )
+		return child;
+	}
+	else
+	{
+	    FileInfo * child = dotEntry()->firstChild();
 
-                child = child->next();
-            }
+	    while ( child )
+	    {
+		if ( ChildNameIndex::matchPrefix( child->rawName(), url, pos ) == end - pos )
+		{
+		    // logDebug() << "Found " << url << " in " << dotEntry() << endl;
+		    return child;
+		}
 
-            // logDebug() << "Cant find " << url << " in DotEntry" << endl;
+		child = child->next();
+	    }
 	}
 
-	if ( ! result && attic() )
-	    result = attic()->locate( url, findPseudoDirs );
+	// logDebug() << "Cant find " << url << " in DotEntry" << endl;
     }
 
-    return result;
+    if ( attic() )
+	return attic()->locate( url, pos, findPseudoDirs );
+
+    return 0;
 }
 
 
@@ -550,9 +673,46 @@ QString FileInfo::octalPermissions() const
 }
 
 
+void FileInfo::setIgnored( bool ignored )
+{
+    // Ignored items are sorted last by name
+
+    if ( ignored != _isIgnored && _parent )
+	_parent->dropSortCache();
+
+    _isIgnored = ignored;
+}
+
+
+void FileInfo::setName( const QString & newName )
+{
+    NamePool *	 pool	 = namePool( tree() );
+    const char * oldName = _name;
+    _name = pool->intern( newName );
+
+    if ( _parent )
+	_parent->childRenamed( this, oldName );
+
+    pool->release( oldName );
+}
+
+
+void FileInfo::setName( const char * utf8Name, int len )
+{
+    NamePool *	 pool	 = namePool( tree() );
+    const char * oldName = _name;
+    _name = pool->intern( utf8Name, len );
+
+    if ( _parent )
+	_parent->childRenamed( this, oldName );
+
+    pool->release( oldName );
+}
+
+
 QString FileInfo::baseName() const
 {
-    return QDirStat::baseName( _name );
+    return QDirStat::baseName( name() );
 }
 
 
@@ -19,6 +19,7 @@
 #include <QList>
 
 #include "Logger.h"
+#include "NodeAttrTable.h"
 
 // The size of a standard disk block.
 //
@@ -36,7 +37,7 @@ namespace QDirStat
 #define FileSizeMax   LLONG_MAX
 // 0x7FFFFFFFFFFFFFFFLL == 9223372036854775807LL
 
-#define FileInfoMagic 4242
+#define FileInfoMagic 0x42
 
     // Forward declarations
     class DirInfo;
@@ -44,6 +45,8 @@ namespace QDirStat
     class Attic;
     class PkgInfo;
     class DirTree;
+    class SlabPool;
+    class NamePool;
 
 
     /**
@@ -96,6 +99,16 @@ namespace QDirStat
 		  DirTree	* tree,
 		  DirInfo	* parent = 0 );
 
+	/**
+	 * Constructor from a stat buffer with the name as it was read from
+	 * the directory: UTF-8, 'len' bytes. This does not need any QString.
+	 **/
+	FileInfo( const char	* utf8Name,
+		  int		  len,
+		  struct stat	* statInfo,
+		  DirTree	* tree,
+		  DirInfo	* parent = 0 );
+
 	/**
 	 * Constructor from the bare necessary fields
 	 * for use from a cache file reader
@@ -119,6 +132,29 @@ namespace QDirStat
 	 **/
 	virtual ~FileInfo();
 
+	/**
+	 * Allocate the memory for a FileInfo from the SlabPool of 'tree'
+	 * rather than from the general heap: Trees easily have millions of
+	 * them, so this avoids the per-object overhead of malloc() and
+	 * fragmenting the heap, and clearing a tree releases all its nodes at
+	 * once. Items that don't belong to any tree use a global pool.
+	 *
+	 * Use this as 'new ( tree ) FileInfo( tree, ... )'.
+	 *
+	 * Derived classes have their own pools.
+	 **/
+	static void * operator new( size_t size, DirTree * tree );
+
+	/**
+	 * Return the memory of a FileInfo to its SlabPool.
+	 **/
+	static void operator delete( void * ptr, size_t size );
+
+	/**
+	 * Return the SlabPool for FileInfo objects of 'tree'.
+	 **/
+	static SlabPool * slabPool( DirTree * tree );
+
 	/**
 	 * Check with the magic number if this object is valid.
 	 * Return 'true' if it is valid, 'false' if invalid.
@@ -128,6 +164,16 @@ namespace QDirStat
 	 **/
 	bool checkMagicNumber() const;
 
+	/**
+	 * Set the mode, size, owner, mtime etc. from a stat buffer. This is
+	 * used by the constructor and to fill in the real values of an item
+	 * that was created without an lstat() call in a structure-only scan.
+	 *
+	 * Notice that this does not update any summary values of the parent
+	 * directories; use DirInfo::addToSummary() for that.
+	 **/
+	void setStatInfo( struct stat * statInfo );
+
 	/**
 	 * Returns whether or not this is a local file (protocol "file:").
 	 * It might as well be a remote file ("ftp:", "smb:" etc.).
@@ -144,7 +190,25 @@ namespace QDirStat
 	 * requested for "/usr/share/man". Notice, however, that the entry for
 	 * "/usr/share/man/man1" will only return "man1" in this example.
 	 **/
-	QString name() const { return _name; }
+	QString name() const { return QString::fromUtf8( _name ); }
+
+	/**
+	 * Returns the name as the UTF-8 string that is stored in the name
+	 * pool of the tree. This is cheaper than name() since it does not
+	 * create a QString.
+	 **/
+	const char * rawName() const { return _name; }
+
+	/**
+	 * Set the name. This stores it in the name pool of the tree.
+	 **/
+	void setName( const QString & newName );
+
+	/**
+	 * Set the name from 'len' bytes of UTF-8 'utf8Name' without creating
+	 * a QString.
+	 **/
+	void setName( const char * utf8Name, int len );
 
 	/**
 	 * Returns the base name of this object, i.e. the last path component,
@@ -189,7 +253,7 @@ namespace QDirStat
 	 * Returns the major and minor device numbers of the device this file
 	 * resides on or 0 if this is a remote file.
 	 **/
-	dev_t device() const { return _device; }
+	dev_t device() const { return NodeAttrTable::at( _attrIndex ).device; }
 
 	/**
 	 * The file permissions and object type as returned by lstat().
@@ -204,7 +268,7 @@ namespace QDirStat
 	 * The number of hard links to this file. Relevant for size summaries
 	 * to avoid counting one file several times.
 	 **/
-	nlink_t links() const { return _links;	}
+	nlink_t links() const { return NodeAttrTable::at( _attrIndex ).links; }
 
 	/**
 	 * User ID of the owner.
@@ -212,7 +276,7 @@ namespace QDirStat
 	 * Notice that this might be undefined if this tree branch was read
 	 * from a cache file. Check that with hasUid().
 	 **/
-	uid_t uid() const { return _uid; }
+	uid_t uid() const { return NodeAttrTable::at( _attrIndex ).uid; }
 
 	/**
 	 * Return the user name of the owner.
@@ -236,7 +300,7 @@ namespace QDirStat
 	 * Notice that this might be undefined if this tree branch was read
 	 * from a cache file. Check that with hasGid().
 	 **/
-	gid_t gid() const { return _gid; }
+	gid_t gid() const { return NodeAttrTable::at( _attrIndex ).gid; }
 
 	/**
 	 * Return the group name of the owner.
@@ -315,9 +379,11 @@ namespace QDirStat
 	FileSize rawAllocatedSize() const { return _allocatedSize; }
 
 	/**
-	 * The file size in 512 byte blocks.
+	 * The file size in 512 byte blocks. This is derived from the
+	 * allocated size.
 	 **/
-	FileSize blocks() const { return _blocks; }
+	FileSize blocks() const
+	    { return ( _allocatedSize + STD_BLOCK_SIZE - 1 ) / STD_BLOCK_SIZE; }
 
 	/**
 	 * The modification time of the file (not the inode).
@@ -340,7 +406,7 @@ namespace QDirStat
 	 * Returns the total size in blocks of this subtree.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual FileSize totalBlocks() { return _blocks; }
+	virtual FileSize totalBlocks() { return blocks(); }
 
 	/**
 	 * Returns the total number of children in this subtree, excluding this
@@ -508,8 +574,11 @@ namespace QDirStat
 
 	/**
 	 * Returns a pointer to the DirTree this entry belongs to.
+	 *
+	 * Only directories store this; for other items, this is taken from
+	 * the parent.
 	 **/
-	DirTree * tree() const { return _tree; }
+	virtual DirTree * tree() const;
 
 	/**
 	 * Returns a pointer to this entry's parent entry or 0 if there is
@@ -566,17 +635,27 @@ namespace QDirStat
 	 * Locate a child somewhere in this subtree whose URL (i.e. complete
 	 * path) matches the URL passed. Returns 0 if there is no such child.
 	 *
-	 * Notice: This is a very expensive operation since the entire subtree
-	 * is searched recursively.
-	 *
-	 * Derived classes might or might not wish to overwrite this method;
-	 * it's only advisable to do so if a derived class comes up with a
-	 * different method than brute-force searching all children.
+	 * This follows the path one component at a time; large directories
+	 * look up each component in their index of children names (see
+	 * ChildNameIndex), so this is about O(depth).
 	 *
 	 * 'findPseudoDirs' specifies if locating pseudo directories like "dot
 	 * entries" (".../<Files>") or "attics" (".../<Ignored>") is desired.
 	 **/
-	virtual FileInfo * locate( QString url, bool findPseudoDirs = false );
+	FileInfo * locate( const QString & url, bool findPseudoDirs = false );
+
+	/**
+	 * Locate a child like above, but only match the part of 'url' that
+	 * starts at position 'pos'. This is what locate() uses recursively
+	 * to avoid copying the URL for each level.
+	 *
+	 * Derived classes might or might not wish to overwrite this method;
+	 * it's only advisable to do so if a derived class comes up with a
+	 * different method than searching the children.
+	 **/
+	virtual FileInfo * locate( const QString & url,
+				   int		   pos,
+				   bool		   findPseudoDirs );
 
 	/**
 	 * Insert a child into the children list.
@@ -733,6 +812,16 @@ namespace QDirStat
 	 **/
 	virtual bool isPkgInfo() const { return false; }
 
+	/**
+	 * Returns true if this is a FileAggregate, i.e. not a real file, but
+	 * a stand-in for many small files that are no longer in the tree.
+	 * There is no such file on disk, so no cleanup can work on it, and it
+	 * is not counted in any file statistics.
+	 *
+	 * This default implementation always returns 'false'.
+	 **/
+	virtual bool isAggregate() const { return false; }
+
 	/**
 	 * Try to convert this to a DirInfo pointer. This returns null if this
 	 * is not a DirInfo.
@@ -782,10 +871,11 @@ namespace QDirStat
 	bool isIgnored() const { return _isIgnored; }
 
 	/**
-	 * Set the "ignored" flag. Notice that this only sets the flag; it does
-	 * not reparent the FileInfo or anything like that.
+	 * Set the "ignored" flag. Notice that this only sets the flag (and
+	 * drops the sorted children lists of the parent); it does not
+	 * reparent the FileInfo or anything like that.
 	 **/
-	void setIgnored( bool ignored ) { _isIgnored = ignored; }
+	void setIgnored( bool ignored );
 
 	/**
 	 * Return the nearest PkgInfo parent or 0 if there is none.
@@ -904,29 +994,36 @@ namespace QDirStat
 
     protected:
 
+	/**
+	 * Set the device, the number of hard links and the owner.
+	 **/
+	void setAttributes( dev_t device, nlink_t links, uid_t uid, gid_t gid )
+	    { _attrIndex = NodeAttrTable::index( device, links, uid, gid ); }
+
+
 	// Data members.
 	//
 	// Keep this short in order to use as little memory as possible -
-	// there will be a _lot_ of entries of this kind!
+	// there will be a _lot_ of entries of this kind! On 64 bit platforms,
+	// this must fit into 64 bytes (one cache line) including the vtable
+	// pointer; see the static assertion in FileInfo.cpp.
+	//
+	// The attributes that are the same for most items (device, links,
+	// owner) are stored in the NodeAttrTable; the blocks are derived from
+	// the allocated size, and only directories keep a pointer to the tree.
 
-	short		_magic;			// magic number to detect if this object is valid
-	QString		_name;			// the file name (without path!)
+	const char *	_name;			// the file name (without path!), UTF-8 in the NamePool
+	DirInfo	 *	_parent;		// pointer to the parent entry
+	FileInfo *	_next;			// pointer to the next entry
+	FileSize	_size;			// size in bytes
+	FileSize	_allocatedSize;		// allocated size in bytes
+	time_t		_mtime;			// modification time
+	quint32		_attrIndex;		// device, links, owner in the NodeAttrTable
+	quint16		_mode;			// file permissions + object type
+	quint8		_magic;			// magic number to detect if this object is valid
 	bool		_isLocalFile  :1;	// flag: local or remote file?
 	bool		_isSparseFile :1;	// (cache) flag: sparse file (file with "holes")?
 	bool		_isIgnored    :1;	// flag: ignored by rule?
-	dev_t		_device;		// device this object resides on
-	mode_t		_mode;			// file permissions + object type
-	nlink_t		_links;			// number of links
-	uid_t		_uid;			// User ID of owner
-	gid_t		_gid;			// Group ID of owner
-	FileSize	_size;			// size in bytes
-	FileSize	_blocks;		// 512 bytes blocks
-	time_t		_mtime;			// modification time
-	FileSize	_allocatedSize;		// allocated size in bytes
-
-	DirInfo	 *	_parent;		// pointer to the parent entry
-	FileInfo *	_next;			// pointer to the next entry
-	DirTree	 *	_tree;			// pointer to the parent tree
 
 	static bool	_ignoreHardLinks;	// don't distribute size for multiple hard links
 
@@ -163,6 +163,18 @@ bool FileInfoSet::containsPkg() const
 }
 
 
+bool FileInfoSet::containsAggregate() const
+{
+    foreach ( FileInfo * item, *this )
+    {
+	if ( item  && item->isAggregate() )
+	    return true;
+    }
+
+    return false;
+}
+
+
 bool FileInfoSet::containsBusyItem() const
 {
     foreach ( FileInfo * item, *this )
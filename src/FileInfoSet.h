@@ -57,6 +57,11 @@ namespace QDirStat
 	 **/
 	bool containsPkg() const;
 
+	/**
+	 * Return 'true' if the set contains any FileAggregate ("<42 files>").
+	 **/
+	bool containsAggregate() const;
+
 	/**
 	 * Return 'true' if the set contains any pseudo directory, i.e. any dot
 	 * entry ("<Files>") or attic ("<Ignored>).
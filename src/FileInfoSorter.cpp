@@ -7,59 +7,86 @@
  */
 
 
-#include <algorithm>
+#include <string.h>	// strcmp()
 #include "FileInfoSorter.h"
 
 using namespace QDirStat;
 
 
+/**
+ * Compare two values: Return -1 if a < b, 0 if they are equal, 1 if a > b.
+ **/
+template<typename T> static inline int compareValues( T a, T b )
+{
+    return a < b ? -1 : ( b < a ? 1 : 0 );
+}
+
+
 bool FileInfoSorter::operator() ( FileInfo * a, FileInfo * b )
 {
     if ( !a || !b ) return false;
 
+    int result = compare( _sortCol, a, b );
+
     if ( _sortOrder == Qt::DescendingOrder )
-	std::swap( a, b ); // Now we only need to handle the a < b case
+	result = -result;
+
+    if ( result == 0 && _nameTiebreak && _sortCol != NameCol )
+	result = compare( NameCol, a, b );
 
-    switch ( _sortCol )
+    return result < 0;
+}
+
+
+int FileInfoSorter::compare( DataColumn col, FileInfo * a, FileInfo * b )
+{
+    switch ( col )
     {
 	case NameCol:
 	    {
 		// Sort ignored items last
-		if ( a->isIgnored() != b->isIgnored() ) return b->isIgnored();
+		if ( a->isIgnored() != b->isIgnored() ) return a->isIgnored() ? 1 : -1;
 
 		// The dot entry (there can only be one) should always come last
-		if ( a->isDotEntry() ) return false;
-		if ( b->isDotEntry() ) return true;
-		return a->name() < b->name();
+		if ( a->isDotEntry() ) return b->isDotEntry() ? 0 : 1;
+		if ( b->isDotEntry() ) return -1;
+
+		// Comparing the UTF-8 bytes sorts by code point. This is the
+		// same order as comparing the names as QStrings (except for
+		// characters outside the BMP), but without converting them.
+
+		return compareValues( strcmp( a->rawName(), b->rawName() ), 0 );
 	    }
 
-	case PercentBarCol:	  return a->subtreePercent()  < b->subtreePercent();
-	case PercentNumCol:	  return a->subtreePercent()  < b->subtreePercent();
-	case SizeCol:		  return a->totalSize()	      < b->totalSize();
-	case TotalItemsCol:	  return a->totalItems()      < b->totalItems();
-	case TotalFilesCol:	  return a->totalFiles()      < b->totalFiles();
-	case TotalSubDirsCol:	  return a->totalSubDirs()    < b->totalSubDirs();
-	case LatestMTimeCol:	  return a->latestMtime()     < b->latestMtime();
+	case PercentBarCol:	  return compareValues( a->subtreePercent(),  b->subtreePercent()  );
+	case PercentNumCol:	  return compareValues( a->subtreePercent(),  b->subtreePercent()  );
+	case SizeCol:		  return compareValues( a->totalSize(),	      b->totalSize()	   );
+	case TotalItemsCol:	  return compareValues( a->totalItems(),      b->totalItems()	   );
+	case TotalFilesCol:	  return compareValues( a->totalFiles(),      b->totalFiles()	   );
+	case TotalSubDirsCol:	  return compareValues( a->totalSubDirs(),    b->totalSubDirs()	   );
+	case LatestMTimeCol:	  return compareValues( a->latestMtime(),     b->latestMtime()	   );
 	case OldestFileMTimeCol:
             {
                 time_t a_time = a->oldestFileMtime();
                 time_t b_time = b->oldestFileMtime();
 
-                if ( a_time == 0 ) return false;
-                if ( b_time == 0 ) return true;
+		// Items without any files come last
+
+                if ( a_time == 0 ) return b_time == 0 ? 0 : 1;
+                if ( b_time == 0 ) return -1;
 
-                return a_time < b_time;
+                return compareValues( a_time, b_time );
             }
 
-	case UserCol:		  return a->uid()	      < b->uid();
-	case GroupCol:		  return a->gid()	      < b->gid();
-	case PermissionsCol:	  return a->mode()	      < b->mode();
-	case OctalPermissionsCol: return a->mode()	      < b->mode();
-	case ReadJobsCol:	  return a->pendingReadJobs() < b->pendingReadJobs();
-	case UndefinedCol:	  return false;
+	case UserCol:		  return compareValues( a->uid(),	      b->uid()		   );
+	case GroupCol:		  return compareValues( a->gid(),	      b->gid()		   );
+	case PermissionsCol:	  return compareValues( a->mode(),	      b->mode()		   );
+	case OctalPermissionsCol: return compareValues( a->mode(),	      b->mode()		   );
+	case ReadJobsCol:	  return compareValues( a->pendingReadJobs(), b->pendingReadJobs() );
+	case UndefinedCol:	  return 0;
 	    // Intentionally omitting the 'default' branch
 	    // so the compiler can warn about unhandled enum values
     }
 
-    return false;
+    return 0;
 }
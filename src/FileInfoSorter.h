@@ -41,10 +41,18 @@ namespace QDirStat
 	/**
 	 * Constructor. This sets the sort column and sort order that will be
 	 * used in subsequent calls.
+	 *
+	 * If 'nameTiebreak' is 'true', items that are equal in 'sortCol' are
+	 * sorted by name (always ascending), so one sorting pass is enough
+	 * instead of sorting by name first and then stable sorting by
+	 * 'sortCol'.
 	 **/
-	FileInfoSorter( DataColumn sortCol, Qt::SortOrder sortOrder ):
+	FileInfoSorter( DataColumn    sortCol,
+			Qt::SortOrder sortOrder,
+			bool	      nameTiebreak = false ):
 	    _sortCol( sortCol ),
-	    _sortOrder( sortOrder )
+	    _sortOrder( sortOrder ),
+	    _nameTiebreak( nameTiebreak )
 	    {}
 
 	/**
@@ -53,9 +61,18 @@ namespace QDirStat
 	 **/
 	bool operator() ( FileInfo * a, FileInfo * b );
 
+	/**
+	 * Compare 'a' and 'b' by column 'col' in ascending order. Return a
+	 * negative value if a < b, 0 if they are equal, a positive value if
+	 * a > b.
+	 **/
+	static int compare( DataColumn col, FileInfo * a, FileInfo * b );
+
     private:
+
 	DataColumn    _sortCol;
 	Qt::SortOrder _sortOrder;
+	bool	      _nameTiebreak;
 
     };	   // class FileInfoSorter
 
@@ -11,7 +11,7 @@
 #include <algorithm>
 
 #include "FileMTimeStats.h"
-#include "FileInfoIterator.h"
+#include "FileColumns.h"
 #include "DirTree.h"
 #include "Exception.h"
 
@@ -44,28 +44,27 @@ void FileMTimeStats::collect( FileInfo * subtree )
 {
     Q_CHECK_PTR( subtree );
 
-    if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
-
-    if ( subtree->isFile() )
+    if ( subtree->isFile() && ! subtree->isAggregate() )
         _data << subtree->mtime();
 
-    FileInfoIterator it( subtree );
+    int first = 0;
+    int end   = 0;
+    const FileColumns * columns = FileColumns::forSubtree( subtree, first, end );
 
-    while ( *it )
+    if ( ! columns )
+        return;
+
+    if ( _data.isEmpty() )
+        _data.reserve( end - first );
+
+    const time_t  * mtimes = columns->mtimes();
+    const quint16 * modes  = columns->modes();
+
+    for ( int i = first; i < end; ++i )
     {
-	FileInfo * item = *it;
-
-	if ( item->hasChildren() )
-	{
-	    collect( item );
-	}
-	else if ( item->isFile() )
-	{
-            _data << item->mtime();
-	}
-	// Disregard symlinks, block devices and other special files
-
-	++it;
+        // Disregard symlinks, block devices and other special files
+
+        if ( S_ISREG( modes[i] ) )
+            _data << mtimes[i];
     }
 }
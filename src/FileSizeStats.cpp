@@ -9,9 +9,11 @@
 
 #include <math.h>       // ceil()
 #include <algorithm>
+#include <ctype.h>      // tolower()
+#include <string.h>     // strlen()
 
 #include "FileSizeStats.h"
-#include "FileInfoIterator.h"
+#include "FileColumns.h"
 #include "DirTree.h"
 #include "Exception.h"
 
@@ -44,29 +46,28 @@ void FileSizeStats::collect( FileInfo * subtree )
 {
     Q_CHECK_PTR( subtree );
 
-    if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
-
-    if ( subtree->isFile() )
+    if ( subtree->isFile() && ! subtree->isAggregate() )
         _data << subtree->size();
 
-    FileInfoIterator it( subtree );
+    int first = 0;
+    int end   = 0;
+    const FileColumns * columns = FileColumns::forSubtree( subtree, first, end );
+
+    if ( ! columns )
+        return;
+
+    if ( _data.isEmpty() )
+        _data.reserve( end - first );
+
+    const FileSize * sizes = columns->sizes();
+    const quint16  * modes = columns->modes();
 
-    while ( *it )
+    for ( int i = first; i < end; ++i )
     {
-	FileInfo * item = *it;
-
-	if ( item->hasChildren() )
-	{
-	    collect( item );
-	}
-	else if ( item->isFile() )
-	{
-            _data << item->size();
-	}
-	// Disregard symlinks, block devices and other special files
-
-	++it;
+        // Disregard symlinks, block devices and other special files
+
+        if ( S_ISREG( modes[i] ) )
+            _data << sizes[i];
     }
 }
 
@@ -89,31 +90,54 @@ void FileSizeStats::collect( FileInfo * subtree, const QString & suffix )
 {
     Q_CHECK_PTR( subtree );
 
-    if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
-
-    if ( subtree->isFile() && subtree->name().toLower().endsWith( suffix ) )
+    if ( subtree->isFile() && ! subtree->isAggregate() &&
+         subtree->name().toLower().endsWith( suffix ) )
         _data << subtree->size();
 
-    FileInfoIterator it( subtree );
+    int first = 0;
+    int end   = 0;
+    const FileColumns * columns = FileColumns::forSubtree( subtree, first, end );
+
+    if ( ! columns )
+        return;
+
+    const FileSize *     sizes = columns->sizes();
+    const quint16  *     modes = columns->modes();
+    const char * const * names = columns->names();
+    QByteArray utf8Suffix = suffix.toUtf8();
+
+    for ( int i = first; i < end; ++i )
+    {
+        // Disregard symlinks, block devices and other special files
+
+        if ( S_ISREG( modes[i] ) && hasSuffix( names[i], utf8Suffix ) )
+            _data << sizes[i];
+    }
+}
+
+
+bool FileSizeStats::hasSuffix( const char * name, const QByteArray & lowerSuffix )
+{
+    int nameLen	  = strlen( name );
+    int suffixLen = lowerSuffix.size();
+
+    if ( nameLen < suffixLen )
+        return false;
+
+    const char * tail = name + nameLen - suffixLen;
 
-    while ( *it )
+    for ( int i = 0; i < suffixLen; ++i )
     {
-	FileInfo * item = *it;
-
-	if ( item->hasChildren() )
-	{
-	    collect( item, suffix );
-	}
-	else if ( item->isFile() )
-	{
-            if ( item->name().toLower().endsWith( suffix ) )
-                _data << item->size();
-	}
-	// Disregard symlinks, block devices and other special files
-
-	++it;
+        unsigned char c = (unsigned char) tail[i];
+
+        if ( c >= 0x80 )        // Non-ASCII: Let QString handle the case folding
+            return QString::fromUtf8( name ).toLower().endsWith( QString::fromUtf8( lowerSuffix ) );
+
+        if ( tolower( c ) != (unsigned char) lowerSuffix[i] )
+            return false;
     }
+
+    return true;
 }
 
 
@@ -87,6 +87,14 @@ namespace QDirStat
         QRealList fillBuckets( int bucketCount,
                                int startPercentile,
                                int endPercentile );
+
+    protected:
+
+        /**
+         * Return 'true' if the UTF-8 'name' converted to lowercase ends with
+         * 'lowerSuffix' (UTF-8).
+         **/
+        static bool hasSuffix( const char * name, const QByteArray & lowerSuffix );
     };
 
 }	// namespace QDirStat
@@ -7,9 +7,11 @@
  */
 
 
+#include <string.h>	// strrchr()
+
 #include "FileTypeStats.h"
 #include "DirTree.h"
-#include "FileInfoIterator.h"
+#include "FileColumns.h"
 #include "MimeCategorizer.h"
 #include "Logger.h"
 #include "Exception.h"
@@ -109,70 +111,75 @@ void FileTypeStats::collect( FileInfo * dir )
     if ( ! dir )
 	return;
 
-    FileInfoIterator it( dir );
+    int first = 0;
+    int end   = 0;
+    const FileColumns * columns = FileColumns::forSubtree( dir, first, end );
+
+    if ( ! columns )
+	return;
 
-    while ( *it )
+    const FileSize *	 sizes = columns->sizes();
+    const quint16  *	 modes = columns->modes();
+    const char * const * names = columns->names();
+
+    for ( int i = first; i < end; ++i )
     {
-	FileInfo * item = *it;
+	// Disregard symlinks, block devices and other special files
 
-	if ( item->hasChildren() )
-	{
-	    collect( item );
-	}
-	else if ( item->isFile() )
+	if ( ! S_ISREG( modes[i] ) )
+	    continue;
+
+	const char * name = names[i];
+	QString suffix;
+
+	// First attempt: Try the MIME categorizer.
+	//
+	// If it knows the file's suffix, it can much easier find the
+	// correct one in case there are multiple to choose from, for
+	// example ".tar.bz2", not ".bz2" for a bzipped tarball. But on
+	// Linux systems, having multiple dots in filenames is very common,
+	// e.g. in .deb or .rpm packages, so the longest possible suffix is
+	// not always the useful one (because it might contain version
+	// numbers and all kinds of irrelevant information).
+	//
+	// The suffixes the MIME categorizer knows are carefully
+	// hand-crafted, so if it knows anything about a suffix, it's the
+	// best choice.
+
+	MimeCategory * category = _mimeCategorizer->category( name, &suffix );
+
+	if ( ! category )
+	    category = _otherCategory;
+
+	_categorySum[ category ] += sizes[i];
+	++_categoryCount[ category ];
+
+	if ( suffix.isEmpty() )
 	{
-	    QString suffix;
-
-	    // First attempt: Try the MIME categorizer.
-	    //
-	    // If it knows the file's suffix, it can much easier find the
-	    // correct one in case there are multiple to choose from, for
-	    // example ".tar.bz2", not ".bz2" for a bzipped tarball. But on
-	    // Linux systems, having multiple dots in filenames is very common,
-	    // e.g. in .deb or .rpm packages, so the longest possible suffix is
-	    // not always the useful one (because it might contain version
-	    // numbers and all kinds of irrelevant information).
-	    //
-	    // The suffixes the MIME categorizer knows are carefully
-	    // hand-crafted, so if it knows anything about a suffix, it's the
-	    // best choice.
-
-	    MimeCategory * category = _mimeCategorizer->category( item->name(), &suffix );
-
-	    if ( ! category )
-		category = _otherCategory;
-
-	    _categorySum[ category ] += item->size();
-	    ++_categoryCount[ category ];
-
-	    if ( suffix.isEmpty() )
+	    const char * lastDot = strrchr( name, '.' );
+
+	    if ( lastDot && name[0] != '.' )
 	    {
-		if ( item->name().contains( '.' ) && ! item->name().startsWith( '.' ) )
-		{
-		    // Fall back to the last (i.e. the shortest) suffix if the
-		    // MIME categorizer didn't know it: Use section -1 (the
-		    // last one, ignoring any trailing '.' separator).
-		    //
-		    // The downside is that this would not find a ".tar.bz",
-		    // but just the ".bz" for a compressed tarball. But it's
-		    // much better than getting a ".eab7d88df-git.deb" rather
-		    // than a ".deb".
-
-		    suffix = item->name().section( '.', -1 );
-		}
+		// Fall back to the last (i.e. the shortest) suffix if the
+		// MIME categorizer didn't know it: Use section -1 (the
+		// last one, ignoring any trailing '.' separator).
+		//
+		// The downside is that this would not find a ".tar.bz",
+		// but just the ".bz" for a compressed tarball. But it's
+		// much better than getting a ".eab7d88df-git.deb" rather
+		// than a ".deb".
+
+		suffix = QString::fromUtf8( lastDot + 1 );
 	    }
+	}
 
-	    suffix = suffix.toLower();
-
-	    if ( suffix.isEmpty() )
-		suffix = NO_SUFFIX;
+	suffix = suffix.toLower();
 
-	    _suffixSum[ suffix ] += item->size();
-	    ++_suffixCount[ suffix ];
-	}
-	// Disregard symlinks, block devices and other special files
+	if ( suffix.isEmpty() )
+	    suffix = NO_SUFFIX;
 
-	++it;
+	_suffixSum[ suffix ] += sizes[i];
+	++_suffixCount[ suffix ];
     }
 }
 
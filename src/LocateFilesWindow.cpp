@@ -108,7 +108,25 @@ void LocateFilesWindow::populate( FileInfo * newSubtree )
     // For better Performance: Disable sorting while inserting many items
     _ui->treeWidget->setSortingEnabled( false );
 
-    populateRecursive( newSubtree ? newSubtree : _subtree() );
+    FileInfo * subtree = newSubtree ? newSubtree : _subtree();
+    int first = 0;
+    int end   = 0;
+    const FileColumns * columns = FileColumns::forSubtree( subtree, first, end );
+
+    if ( columns )
+    {
+        // Much faster for large trees than going through the tree items
+
+        for ( int i = first; i < end; ++i )
+        {
+            if ( _treeWalker->checkColumns( *columns, i ) )
+                addItem( columns->item( i ) );
+        }
+    }
+    else
+    {
+        populateRecursive( subtree );
+    }
 
     _ui->treeWidget->setSortingEnabled( true );
     _ui->treeWidget->sortByColumn( LocateListPathCol, Qt::AscendingOrder );
@@ -138,6 +156,16 @@ void LocateFilesWindow::populate( FileInfo * newSubtree )
 }
 
 
+void LocateFilesWindow::addItem( FileInfo * item )
+{
+    LocateListItem * locateListItem =
+        new LocateListItem( item->url(), item->size(), item->mtime() );
+    CHECK_NEW( locateListItem );
+
+    _ui->treeWidget->addTopLevelItem( locateListItem );
+}
+
+
 void LocateFilesWindow::populateRecursive( FileInfo * dir )
 {
     if ( ! dir )
@@ -149,14 +177,8 @@ void LocateFilesWindow::populateRecursive( FileInfo * dir )
     {
 	FileInfo * item = *it;
 
-        if ( _treeWalker->check( item ) )
-        {
-            LocateListItem * locateListItem =
-                new LocateListItem( item->url(), item->size(), item->mtime() );
-            CHECK_NEW( locateListItem );
-
-            _ui->treeWidget->addTopLevelItem( locateListItem );
-        }
+        if ( ! item->isAggregate() && _treeWalker->check( item ) )
+            addItem( item );
 
 	if ( item->hasChildren() )
 	{
@@ -146,6 +146,11 @@ namespace QDirStat
 	 **/
 	void populateRecursive( FileInfo * dir );
 
+	/**
+	 * Create a search result item for 'item'.
+	 **/
+	void addItem( FileInfo * item );
+
 
 	//
 	// Data members
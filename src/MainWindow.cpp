@@ -34,6 +34,7 @@
 #include "FileSizeStatsWindow.h"
 #include "HeaderTweaker.h"
 #include "Logger.h"
+#include "MemoryReport.h"
 #include "MimeCategorizer.h"
 #include "MimeCategoryConfigPage.h"
 #include "OpenDirDialog.h"
@@ -202,6 +203,9 @@ void MainWindow::connectSignals()
     connect( _dirTreeModel->tree(),	SIGNAL( aborted()	  ),
 	     this,			SLOT  ( readingAborted()  ) );
 
+    connect( _dirTreeModel->tree(),	SIGNAL( cacheWritten( QString, bool ) ),
+	     this,			SLOT  ( cacheWritten( QString, bool ) ) );
+
     connect( _selectionModel,		SIGNAL( selectionChanged() ),
 	     this,			SLOT  ( updateActions()	   ) );
 
@@ -328,6 +332,7 @@ void MainWindow::connectActions()
     _ui->actionFileTypeStats->setShortcutContext( Qt::ApplicationShortcut );
 
     CONNECT_ACTION( _ui->actionShowFilesystems,	   this, showFilesystems() );
+    CONNECT_ACTION( _ui->actionShowMemoryReport,   this, showMemoryReport() );
 
 
 
@@ -428,8 +433,9 @@ void MainWindow::updateActions()
     bool oneDirSelected	   = selSize == 1 && sel && sel->isDir() && ! sel->isPkgInfo();
     bool pseudoDirSelected = selectedItems.containsPseudoDir();
     bool pkgSelected	   = selectedItems.containsPkg();
+    bool aggrSelected	   = selectedItems.containsAggregate();
 
-    _ui->actionMoveToTrash->setEnabled( sel && ! pseudoDirSelected && ! pkgSelected && ! reading );
+    _ui->actionMoveToTrash->setEnabled( sel && ! pseudoDirSelected && ! pkgSelected && ! aggrSelected && ! reading );
     _ui->actionRefreshSelected->setEnabled( selSize == 1 && ! sel->isExcluded() && ! sel->isMountPoint() && ! pkgView );
     _ui->actionContinueReadingAtMountPoint->setEnabled( oneDirSelected && sel->isMountPoint() );
     _ui->actionReadExcludedDirectory->setEnabled      ( oneDirSelected && sel->isExcluded()   );
@@ -690,6 +696,10 @@ void MainWindow::readingFinished()
     QString elapsedTime = formatTime( _stopWatch.elapsed() );
     _ui->statusBar->showMessage( tr( "Finished. Elapsed time: %1").arg( elapsedTime ), LONG_MESSAGE );
     logInfo() << "Reading finished after " << elapsedTime << endl;
+    MemoryReport( _dirTreeModel->tree(), _dirTreeModel ).log();
+
+    if ( _memoryReportWindow )
+	_memoryReportWindow->refresh();
 
     if ( _dirTreeModel->tree()->firstToplevel() &&
 	 _dirTreeModel->tree()->firstToplevel()->errSubDirCount() > 0 )
@@ -978,18 +988,25 @@ void MainWindow::askWriteCache()
 						     DEFAULT_CACHE_NAME );
     if ( ! fileName.isEmpty() )
     {
-	bool ok = _dirTreeModel->tree()->writeCache( fileName );
+	// The tree stays usable while it is written in the background
 
-	if ( ok )
-	{
-	    showProgress( tr( "Directory tree written to file %1" ).arg( fileName ) );
-	}
-	else
-	{
-	    QMessageBox::critical( this,
-				   tr( "Error" ), // Title
-				   tr( "ERROR writing cache file %1").arg( fileName ) );
-	}
+	_dirTreeModel->tree()->startWritingCache( fileName );
+	showProgress( tr( "Writing cache file %1..." ).arg( fileName ) );
+    }
+}
+
+
+void MainWindow::cacheWritten( const QString & fileName, bool ok )
+{
+    if ( ok )
+    {
+	showProgress( tr( "Directory tree written to file %1" ).arg( fileName ) );
+    }
+    else
+    {
+	QMessageBox::critical( this,
+			       tr( "Error" ), // Title
+			       tr( "ERROR writing cache file %1").arg( fileName ) );
     }
 }
 
@@ -1278,6 +1295,25 @@ void MainWindow::showFilesystems()
 }
 
 
+void MainWindow::showMemoryReport()
+{
+    if ( ! _memoryReportWindow )
+    {
+	// This deletes itself when the user closes it. The associated QPointer
+	// keeps track of that and sets the pointer to 0 when it happens.
+
+	_memoryReportWindow = new MemoryReportWindow( _dirTreeModel, this );
+    }
+    else
+    {
+	_memoryReportWindow->refresh();
+    }
+
+    _memoryReportWindow->show();
+    _memoryReportWindow->raise();
+}
+
+
 void MainWindow::discoverLargestFiles()
 {
     discoverFiles( new QDirStat::LargestFilesTreeWalker(),
@@ -19,6 +19,7 @@
 #include "ui_main-window.h"
 #include "FileTypeStatsWindow.h"
 #include "FilesystemsWindow.h"
+#include "MemoryReportWindow.h"
 #include "LocateFilesWindow.h"
 #include "TreeWalker.h"
 #include "PanelMessage.h"
@@ -48,6 +49,7 @@ using QDirStat::FileTypeStatsWindow;
 using QDirStat::PanelMessage;
 using QDirStat::UnreadableDirsWindow;
 using QDirStat::FilesystemsWindow;
+using QDirStat::MemoryReportWindow;
 using QDirStat::LocateFilesWindow;
 
 
@@ -147,10 +149,15 @@ public slots:
 
     /**
      * Open a file selection dialog and save the current tree to the selected
-     * file.
+     * file. This is done in the background; see cacheWritten().
      **/
     void askWriteCache();
 
+    /**
+     * Notification that writing cache file 'fileName' is finished.
+     **/
+    void cacheWritten( const QString & fileName, bool ok );
+
     /**
      * Update the window title: Show "[root]" if running as root and add the
      * URL if that is configured.
@@ -340,6 +347,11 @@ protected slots:
      **/
     void showFilesystems();
 
+    /**
+     * Show how much memory the directory tree uses in a separate window.
+     **/
+    void showMemoryReport();
+
     /**
      * Change the main window layout. If no name is passed, the function tries
      * to check if the sender is a QAction and use its data().
@@ -485,6 +497,7 @@ private:
     QPointer<FileTypeStatsWindow>  _fileTypeStatsWindow;
     QPointer<FilesystemsWindow>    _filesystemsWindow;
     QPointer<LocateFilesWindow>    _locateFilesWindow;
+    QPointer<MemoryReportWindow>   _memoryReportWindow;
     QPointer<PanelMessage>	   _dirPermissionsWarning;
     QPointer<UnreadableDirsWindow> _unreadableDirsWindow;
     QString			   _dUrl;
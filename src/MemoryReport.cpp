@@ -0,0 +1,187 @@
+/*
+ *   File name: MemoryReport.cpp
+ *   Summary:	Memory usage statistics of a DirTree for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QModelIndex>
+
+#include "MemoryReport.h"
+#include "DirTree.h"
+#include "DirTreeModel.h"
+#include "FileInfo.h"
+#include "DirInfo.h"
+#include "DotEntry.h"
+#include "Attic.h"
+#include "SlabPool.h"
+#include "NamePool.h"
+#include "NodeAttrTable.h"
+#include "NodeFile.h"
+#include "ChildNameIndex.h"
+#include "TreemapTile.h"
+#include "Logger.h"
+
+// Estimated size of one persistent model index: The private data with its
+// QModelIndex and reference count plus the entry in the model's hash
+#define PERSISTENT_INDEX_BYTES	( 2 * sizeof( QModelIndex ) + 4 * sizeof( void * ) )
+
+// Estimated size of one entry in a child name index: Next pointer, hash
+// value, key and value
+#define CHILD_INDEX_ENTRY_BYTES	( 2 * sizeof( void * ) + 2 * sizeof( uint ) )
+
+// Estimated size of one entry in the hash of the sorted rows: Next
+// pointer, hash value, key and value
+#define SORTED_ROW_ENTRY_BYTES	( 3 * sizeof( void * ) + sizeof( uint ) )
+
+// Estimated overhead of one sort cache list: The QList itself and its
+// private data header
+#define SORT_CACHE_BYTES	( sizeof( FileInfoList ) + 4 * sizeof( int ) )
+
+using namespace QDirStat;
+
+
+MemoryReport::MemoryReport( DirTree * tree, DirTreeModel * model ):
+    _nodeFileBytes( NodeFile::instance()->mappedBytes() )
+{
+    if ( tree )
+    {
+	add( tree->fileInfoPool()  );
+	add( tree->dirInfoPool()   );
+	add( tree->dotEntryPool()  );
+	add( tree->atticPool()	   );
+	add( tree->aggregatePool() );
+	add( QObject::tr( "Names" ), tree->namePool() );
+    }
+
+    add( QObject::tr( "Other names" ), NamePool::globalPool() );
+
+    qint64 attrs  = NodeAttrTable::count();
+    qint64 chunks = ( attrs + NODE_ATTR_CHUNK_SIZE - 1 ) >> NODE_ATTR_CHUNK_BITS;
+
+    add( QObject::tr( "Inode attributes" ),
+	 attrs,
+	 attrs  * sizeof( NodeAttr ),
+	 chunks * NODE_ATTR_CHUNK_SIZE * sizeof( NodeAttr ) );
+
+    qint64 sortCaches = DirInfo::sortCacheCount();
+    qint64 sortBytes  = sortCaches * SORT_CACHE_BYTES +
+	(qint64) DirInfo::sortCacheEntries() * sizeof( FileInfo * );
+
+    add( QObject::tr( "Sort caches" ), sortCaches, sortBytes, sortBytes );
+
+    qint64 rows	    = DirInfo::sortedRowEntries();
+    qint64 rowBytes = rows * SORTED_ROW_ENTRY_BYTES;
+
+    add( QObject::tr( "Sorted row hashes" ), rows, rowBytes, rowBytes );
+
+    qint64 indexed	   = ChildNameIndex::indexedChildren();
+    qint64 childIndexBytes = indexed * CHILD_INDEX_ENTRY_BYTES;
+
+    add( QObject::tr( "Child name indexes" ), indexed, childIndexBytes, childIndexBytes );
+
+    if ( tree )
+    {
+	qint64 columnBytes = tree->fileColumnsMemory();
+	add( QObject::tr( "File columns" ), -1, columnBytes, columnBytes );
+    }
+
+    qint64 tiles     = TreemapTile::tileCount();
+    qint64 tileBytes = tiles * sizeof( TreemapTile );
+
+    add( QObject::tr( "Treemap tiles" ), tiles, tileBytes, tileBytes );
+    add( QObject::tr( "Treemap cushions" ), -1,
+	 TreemapTile::cushionBytes(),
+	 TreemapTile::cushionBytes() );
+
+    if ( model )
+    {
+	qint64 indexes	  = model->persistentIndexList().size();
+	qint64 indexBytes = indexes * PERSISTENT_INDEX_BYTES;
+
+	add( QObject::tr( "Persistent indexes" ), indexes, indexBytes, indexBytes );
+    }
+}
+
+
+void MemoryReport::add( const QString & name,
+			qint64		count,
+			qint64		usedBytes,
+			qint64		allocatedBytes )
+{
+    MemoryReportItem item;
+    item.name		= name;
+    item.count		= count;
+    item.usedBytes	= usedBytes;
+    item.allocatedBytes = allocatedBytes;
+
+    _items << item;
+}
+
+
+void MemoryReport::add( const SlabPool * pool )
+{
+    add( pool->name(),
+	 pool->objectCount(),
+	 (qint64) pool->objectCount() * pool->objectSize(),
+	 (qint64) pool->slabCount()   * SLAB_SIZE );
+}
+
+
+void MemoryReport::add( const QString & name, const NamePool * pool )
+{
+    add( name, -1, pool->usedBytes(), pool->allocatedBytes() );
+    add( name + QObject::tr( " hash" ),
+	 pool->dedupCount(),
+	 pool->dedupBytes(),
+	 pool->dedupBytes() );
+}
+
+
+qint64 MemoryReport::totalUsedBytes() const
+{
+    qint64 sum = 0;
+
+    foreach ( const MemoryReportItem & item, _items )
+	sum += item.usedBytes;
+
+    return sum;
+}
+
+
+qint64 MemoryReport::totalAllocatedBytes() const
+{
+    qint64 sum = 0;
+
+    foreach ( const MemoryReportItem & item, _items )
+	sum += item.allocatedBytes;
+
+    return sum;
+}
+
+
+void MemoryReport::log() const
+{
+    logInfo() << "Memory usage:" << endl;
+
+    foreach ( const MemoryReportItem & item, _items )
+    {
+	logInfo() << QString( "  %1" ).arg( item.name, -20 )
+		  << QString( "%1" ).arg( item.count < 0 ? QString() : QString::number( item.count ), 10 )
+		  << QString( "%1" ).arg( formatSize( item.usedBytes ), 12 )
+		  << " used "
+		  << QString( "%1" ).arg( formatSize( item.allocatedBytes ), 12 )
+		  << " allocated" << endl;
+    }
+
+    logInfo() << QString( "  %1" ).arg( QObject::tr( "Total" ), -30 )
+	      << QString( "%1" ).arg( formatSize( totalUsedBytes() ), 12 )
+	      << " used "
+	      << QString( "%1" ).arg( formatSize( totalAllocatedBytes() ), 12 )
+	      << " allocated" << endl;
+
+    if ( _nodeFileBytes > 0 )
+	logInfo() << "  Mapped from the node file: " << formatSize( _nodeFileBytes ) << endl;
+}
@@ -0,0 +1,119 @@
+/*
+ *   File name: MemoryReport.h
+ *   Summary:	Memory usage statistics of a DirTree for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef MemoryReport_h
+#define MemoryReport_h
+
+
+#include <QString>
+#include <QList>
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirTreeModel;
+    class SlabPool;
+    class NamePool;
+
+    /**
+     * One line of a memory report: One kind of data with the number of
+     * objects (-1 if that does not apply) and the bytes used and allocated
+     * for them.
+     **/
+    struct MemoryReportItem
+    {
+	QString name;
+	qint64	count;
+	qint64	usedBytes;
+	qint64	allocatedBytes;
+    };
+
+
+    /**
+     * Snapshot of how much memory a DirTree and the views on it use, broken
+     * down into the tree nodes of each type, the name storage, the sort
+     * caches, the treemap tiles and the persistent model indexes.
+     *
+     * Some of the numbers are only estimates: Qt containers and
+     * QGraphicsItems have private data that can't be measured from the
+     * outside.
+     **/
+    class MemoryReport
+    {
+    public:
+
+	/**
+	 * Constructor. This collects the numbers for 'tree' and, if
+	 * specified, for 'model'.
+	 **/
+	MemoryReport( DirTree * tree, DirTreeModel * model = 0 );
+
+	/**
+	 * Return the items of this report.
+	 **/
+	const QList<MemoryReportItem> & items() const { return _items; }
+
+	/**
+	 * Return the sum of the used bytes of all items.
+	 **/
+	qint64 totalUsedBytes() const;
+
+	/**
+	 * Return the sum of the allocated bytes of all items.
+	 **/
+	qint64 totalAllocatedBytes() const;
+
+	/**
+	 * Return the number of bytes that are mapped from the node file
+	 * (see NodeFile). Those are already part of the allocated bytes of
+	 * the items.
+	 **/
+	qint64 nodeFileBytes() const { return _nodeFileBytes; }
+
+	/**
+	 * Write this report to the log.
+	 **/
+	void log() const;
+
+
+    protected:
+
+	/**
+	 * Add an item.
+	 **/
+	void add( const QString & name,
+		  qint64	  count,
+		  qint64	  usedBytes,
+		  qint64	  allocatedBytes );
+
+	/**
+	 * Add an item for the objects of a slab pool.
+	 **/
+	void add( const SlabPool * pool );
+
+	/**
+	 * Add items for the names and the deduplication hash of a name pool.
+	 **/
+	void add( const QString & name, const NamePool * pool );
+
+
+	//
+	// Data members
+	//
+
+	QList<MemoryReportItem> _items;
+	qint64			_nodeFileBytes;
+
+    };	// class MemoryReport
+
+}	// namespace QDirStat
+
+
+#endif // ifndef MemoryReport_h
@@ -0,0 +1,117 @@
+/*
+ *   File name: MemoryReportWindow.cpp
+ *   Summary:	QDirStat "Memory Usage" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "MemoryReportWindow.h"
+#include "MemoryReport.h"
+#include "DirTreeModel.h"
+#include "FileInfo.h"	// formatSize()
+#include "SettingsHelpers.h"
+#include "HeaderTweaker.h"
+#include "Logger.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+MemoryReportWindow::MemoryReportWindow( DirTreeModel * model, QWidget * parent ):
+    QDialog( parent ),
+    _ui( new Ui::MemoryReportWindow ),
+    _model( model )
+{
+    CHECK_NEW( _ui );
+    CHECK_PTR( _model );
+
+    _ui->setupUi( this );
+    initWidgets();
+    readWindowSettings( this, "MemoryReportWindow" );
+    refresh();
+}
+
+
+MemoryReportWindow::~MemoryReportWindow()
+{
+    writeWindowSettings( this, "MemoryReportWindow" );
+}
+
+
+void MemoryReportWindow::initWidgets()
+{
+    QStringList headers;
+    headers << tr( "Data" )
+	    << tr( "Count" )
+	    << tr( "Used" )
+	    << tr( "Allocated" );
+
+    _ui->memoryTree->setHeaderLabels( headers );
+    _ui->memoryTree->header()->setStretchLastSection( false );
+
+    QTreeWidgetItem * hItem = _ui->memoryTree->headerItem();
+
+    for ( int col = 0; col < headers.size(); ++col )
+	hItem->setTextAlignment( col, Qt::AlignHCenter );
+
+    connect( _ui->refreshButton, SIGNAL( clicked() ),
+	     this,		 SLOT  ( refresh() ) );
+}
+
+
+void MemoryReportWindow::refresh()
+{
+    _ui->memoryTree->clear();
+
+    MemoryReport report( _model->tree(), _model );
+
+    foreach ( const MemoryReportItem & item, report.items() )
+	addItem( item.name, item.count, item.usedBytes, item.allocatedBytes );
+
+    QTreeWidgetItem * total = addItem( tr( "Total" ), -1,
+				       report.totalUsedBytes(),
+				       report.totalAllocatedBytes() );
+    QFont font = total->font( MR_NameCol );
+    font.setBold( true );
+
+    for ( int col = MR_NameCol; col <= MR_AllocatedCol; ++col )
+	total->setFont( col, font );
+
+    if ( report.nodeFileBytes() > 0 )
+	addItem( tr( "Mapped from the node file" ), -1, -1, report.nodeFileBytes() );
+
+    HeaderTweaker::resizeToContents( _ui->memoryTree->header() );
+}
+
+
+QTreeWidgetItem * MemoryReportWindow::addItem( const QString & name,
+					       qint64	       count,
+					       qint64	       usedBytes,
+					       qint64	       allocatedBytes )
+{
+    QTreeWidgetItem * item = new QTreeWidgetItem( _ui->memoryTree );
+    CHECK_NEW( item );
+
+    item->setText( MR_NameCol, name );
+
+    if ( count >= 0 )
+	item->setText( MR_CountCol, QString::number( count ) );
+
+    if ( usedBytes >= 0 )
+	item->setText( MR_UsedCol, formatSize( usedBytes ) );
+
+    item->setText( MR_AllocatedCol, formatSize( allocatedBytes ) );
+
+    for ( int col = MR_CountCol; col <= MR_AllocatedCol; ++col )
+	item->setTextAlignment( col, Qt::AlignRight );
+
+    return item;
+}
+
+
+void MemoryReportWindow::reject()
+{
+    deleteLater();
+}
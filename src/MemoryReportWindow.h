@@ -0,0 +1,105 @@
+/*
+ *   File name: MemoryReportWindow.h
+ *   Summary:	QDirStat "Memory Usage" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef MemoryReportWindow_h
+#define MemoryReportWindow_h
+
+#include <QDialog>
+
+#include "ui_memory-report-window.h"
+
+
+namespace QDirStat
+{
+    class DirTreeModel;
+
+    /**
+     * Modeless dialog to display how much memory the directory tree and
+     * the views on it use; see MemoryReport.
+     **/
+    class MemoryReportWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 *
+	 * It is advised to use a QPointer for storing a pointer to an instance
+	 * of this class. The QPointer will keep track of this window
+	 * auto-deleting itself when closed.
+	 **/
+	MemoryReportWindow( DirTreeModel * model, QWidget * parent );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~MemoryReportWindow();
+
+
+    public slots:
+
+	/**
+	 * Refresh (reload) all data.
+	 **/
+	void refresh();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Cancel" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+
+    protected:
+
+	/**
+	 * One-time initialization of the widgets in this window.
+	 **/
+	void initWidgets();
+
+	/**
+	 * Add one line to the tree widget.
+	 **/
+	QTreeWidgetItem * addItem( const QString & name,
+				   qint64	   count,
+				   qint64	   usedBytes,
+				   qint64	   allocatedBytes );
+
+
+	//
+	// Data members
+	//
+
+	Ui::MemoryReportWindow * _ui;
+	DirTreeModel *		 _model;
+
+    };	// class MemoryReportWindow
+
+
+    /**
+     * Column numbers for the memory report tree widget
+     **/
+    enum MemoryReportColumns
+    {
+	MR_NameCol = 0,
+	MR_CountCol,
+	MR_UsedCol,
+	MR_AllocatedCol
+    };
+
+}	// namespace QDirStat
+
+#endif	// MemoryReportWindow_h
@@ -7,6 +7,8 @@
  */
 
 
+#include <string.h>	// strchr()
+
 #include "MimeCategorizer.h"
 #include "FileInfo.h"
 #include "Settings.h"
@@ -17,6 +19,22 @@
 using namespace QDirStat;
 
 
+/**
+ * Return 'suffix' (UTF-8) in lower case. Only non-ASCII suffixes need to
+ * be decoded for that.
+ **/
+static QByteArray lowerSuffix( const QByteArray & suffix )
+{
+    for ( int i = 0; i < suffix.size(); ++i )
+    {
+	if ( suffix.at( i ) & 0x80 )
+	    return QString::fromUtf8( suffix ).toLower().toUtf8();
+    }
+
+    return suffix.toLower();
+}
+
+
 MimeCategorizer * MimeCategorizer::_instance = 0;
 
 
@@ -64,7 +82,7 @@ MimeCategory * MimeCategorizer::category( FileInfo * item )
     if ( item->isDir() || item->isDirInfo() )
 	return 0;
     else
-	return category( item->name() );
+	return category( item->rawName() );
 }
 
 
@@ -119,6 +137,48 @@ MimeCategory * MimeCategorizer::category( const QString & filename,
 }
 
 
+MimeCategory * MimeCategorizer::category( const char * rawName,
+					  QString    * suffix_ret )
+{
+    if ( suffix_ret )
+	*suffix_ret = "";
+
+    if ( ! rawName || ! *rawName )
+	return 0;
+
+    if ( _mapsDirty )
+	buildMaps();
+
+    MimeCategory * category = 0;
+
+    // Exactly the same suffixes as for a QString filename: Everything
+    // after the first '.', then after the next one etc.
+
+    const char * dot = strchr( rawName, '.' );
+
+    while ( dot && dot[1] )
+    {
+	const char * suffix = dot + 1;
+	QByteArray   key    = QByteArray::fromRawData( suffix, qstrlen( suffix ) );
+
+	category = _rawCaseSensitiveSuffixMap.value( key, 0 );
+
+	if ( ! category )
+	    category = _rawCaseInsensitiveSuffixMap.value( lowerSuffix( key ), 0 );
+
+	if ( category && suffix_ret )
+	    *suffix_ret = QString::fromUtf8( suffix );
+
+	dot = strchr( suffix, '.' );
+    }
+
+    if ( ! category ) // No match yet?
+	category = matchPatterns( QString::fromUtf8( rawName ) );
+
+    return category;
+}
+
+
 MimeCategory * MimeCategorizer::matchPatterns( const QString & filename ) const
 {
     foreach ( MimeCategory * category, _categories )
@@ -169,6 +229,17 @@ void MimeCategorizer::buildMaps()
 	addSuffixes( _caseSensitiveSuffixMap,	category, category->caseSensitiveSuffixList()	);
     }
 
+    _rawCaseInsensitiveSuffixMap.clear();
+    _rawCaseSensitiveSuffixMap.clear();
+
+    QMap<QString, MimeCategory *>::const_iterator it;
+
+    for ( it = _caseInsensitiveSuffixMap.constBegin(); it != _caseInsensitiveSuffixMap.constEnd(); ++it )
+	_rawCaseInsensitiveSuffixMap.insert( it.key().toUtf8(), it.value() );
+
+    for ( it = _caseSensitiveSuffixMap.constBegin(); it != _caseSensitiveSuffixMap.constEnd(); ++it )
+	_rawCaseSensitiveSuffixMap.insert( it.key().toUtf8(), it.value() );
+
     _mapsDirty = false;
 }
 
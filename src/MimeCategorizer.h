@@ -11,6 +11,8 @@
 
 #include <QObject>
 #include <QMap>
+#include <QHash>
+#include <QByteArray>
 
 #include "MimeCategory.h"
 
@@ -73,6 +75,13 @@ namespace QDirStat
 	 **/
 	MimeCategory * category( const QString & filename, QString * suffix_ret = 0 );
 
+	/**
+	 * Return the MimeCategory for a filename in UTF-8 like the above, but
+	 * without decoding it unless no suffix rule matches: Use this with
+	 * FileInfo::rawName() for many files.
+	 **/
+	MimeCategory * category( const char * rawName, QString * suffix_ret = 0 );
+
 	/**
 	 * Add a MimeCategory.
 	 **/
@@ -152,6 +161,10 @@ namespace QDirStat
 	QMap<QString, MimeCategory *>	_caseInsensitiveSuffixMap;
 	QMap<QString, MimeCategory *>	_caseSensitiveSuffixMap;
 
+	// The same in UTF-8 for category( const char * )
+	QHash<QByteArray, MimeCategory *> _rawCaseInsensitiveSuffixMap;
+	QHash<QByteArray, MimeCategory *> _rawCaseSensitiveSuffixMap;
+
     };	// class MimeCategorizer
 
 }	// namespace QDirStat
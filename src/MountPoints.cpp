@@ -73,6 +73,39 @@ bool MountPoint::isNetworkMount() const
 }
 
 
+bool MountPoint::isRotational() const
+{
+    if ( ! _device.startsWith( "/dev/" ) )
+	return false;
+
+    // Resolve symlinks like /dev/mapper/vg-root -> /dev/dm-0
+
+    QString devPath = QFileInfo( _device ).canonicalFilePath();
+
+    if ( devPath.isEmpty() )
+	devPath = _device;
+
+    QString devName = QFileInfo( devPath ).fileName();	// "sda1", "dm-0", "nvme0n1p2"
+
+    // A partition like /sys/class/block/sda1 does not have a queue directory
+    // of its own; it uses the one of the whole disk one level up.
+
+    QStringList candidates;
+    candidates << QString( "/sys/class/block/%1/queue/rotational"    ).arg( devName )
+	       << QString( "/sys/class/block/%1/../queue/rotational" ).arg( devName );
+
+    foreach ( const QString & fileName, candidates )
+    {
+	QFile file( fileName );
+
+	if ( file.open( QIODevice::ReadOnly ) )
+	    return file.readAll().trimmed() == "1";
+    }
+
+    return false;
+}
+
+
 bool MountPoint::isSystemMount() const
 {
     // All normal block have a path with a slash like "/dev/something" or on some
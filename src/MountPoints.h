@@ -91,6 +91,15 @@ namespace QDirStat
 	 **/
 	bool isNetworkMount() const;
 
+	/**
+	 * Return 'true' if the block device of this mount point is a
+	 * rotational disk, i.e. not an SSD or NVMe device. This is what the
+	 * kernel reports in /sys/class/block/<dev>/queue/rotational; if that
+	 * information is not available (network mounts, system mounts), this
+	 * returns 'false'.
+	 **/
+	bool isRotational() const;
+
 	/**
 	 * Return 'true' if this is a system mount, i.e. one of the known
 	 * system mount points like /dev, /proc, /sys, or if the device name
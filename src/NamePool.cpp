@@ -0,0 +1,251 @@
+/*
+ *   File name: NamePool.cpp
+ *   Summary:	Interned UTF-8 file names for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memcpy(), memcmp(), strlen()
+
+#include "NamePool.h"
+#include "NodeFile.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    uint qHash( const NamePool::Key & key )
+    {
+	// FNV-1a
+
+	uint hash = 2166136261u;
+
+	for ( int i=0; i < key.len; ++i )
+	{
+	    hash ^= (unsigned char) key.str[i];
+	    hash *= 16777619u;
+	}
+
+	return hash;
+    }
+}
+
+
+bool NamePool::Key::operator==( const Key & other ) const
+{
+    return len == other.len && memcmp( str, other.str, len ) == 0;
+}
+
+
+
+
+NamePool::NamePool():
+    _pos( 0 ),
+    _end( 0 ),
+    _allocatedBytes( 0 ),
+    _usedBytes( 0 ),
+    _dedupHits( 0 ),
+    _releaseCount( 0 ),
+    _pins( 0 )
+{
+    // NOP
+}
+
+
+NamePool::~NamePool()
+{
+    // Nobody can use any name of this pool any more
+
+    _pins = 0;
+    clear();
+    freeChunks( _retiredChunks, _retiredChunkSizes );
+}
+
+
+void NamePool::clear()
+{
+    if ( _pins > 0 )
+    {
+	// Keep the chunks until unpin(); the names released so far are in
+	// them, too.
+
+	_retiredChunks	   += _chunks;
+	_retiredChunkSizes += _chunkSizes;
+	_chunks.clear();
+	_chunkSizes.clear();
+	_pinnedNames.clear();
+    }
+    else
+    {
+	freeChunks( _chunks, _chunkSizes );
+    }
+
+    _dedup.clear();
+    _freeNames.clear();
+    _pos	    = 0;
+    _end	    = 0;
+    _allocatedBytes = 0;
+    _usedBytes	    = 0;
+    _dedupHits	    = 0;
+}
+
+
+void NamePool::unpin()
+{
+    if ( _pins <= 0 || --_pins > 0 )
+	return;
+
+    foreach ( char * str, _pinnedNames )
+	_freeNames[ strlen( str ) ] << str;
+
+    _pinnedNames.clear();
+    freeChunks( _retiredChunks, _retiredChunkSizes );
+}
+
+
+void NamePool::freeChunks( QList<char *> & chunks, QList<int> & chunkSizes )
+{
+    NodeFile * nodeFile = NodeFile::instance();
+
+    for ( int i=0; i < chunks.size(); ++i )
+    {
+	if ( nodeFile->isMapped( chunks[i] ) )
+	    nodeFile->unmap( chunks[i], chunkSizes[i] );
+	else
+	    delete[] chunks[i];
+    }
+
+    chunks.clear();
+    chunkSizes.clear();
+}
+
+
+NamePool * NamePool::globalPool()
+{
+    static NamePool pool;
+
+    return &pool;
+}
+
+
+const char * NamePool::intern( const QString & name )
+{
+    QByteArray utf8 = name.toUtf8();
+
+    return intern( utf8.constData(), utf8.size() );
+}
+
+
+const char * NamePool::intern( const char * name )
+{
+    return name ? intern( name, strlen( name ) ) : intern( "", 0 );
+}
+
+
+const char * NamePool::intern( const char * name, int len )
+{
+    if ( len == 0 )
+	return "";	// Not in the pool, so it survives clear()
+
+    if ( len > NAME_POOL_DEDUP_MAX_LEN )
+	return store( name, len );
+
+    QSet<Key>::const_iterator it = _dedup.constFind( Key( name, len ) );
+
+    if ( it != _dedup.constEnd() )
+    {
+	++_dedupHits;
+	return it->str;
+    }
+
+    const char * str = store( name, len );
+    _dedup.insert( Key( str, len ) );
+
+    return str;
+}
+
+
+void NamePool::release( const char * name )
+{
+    int len = name ? strlen( name ) : 0;
+
+    if ( len <= NAME_POOL_DEDUP_MAX_LEN )
+	return;
+
+    char * str = const_cast<char *>( name );
+    _usedBytes -= len + 1;
+    ++_releaseCount;
+
+    if ( _pins > 0 )
+	_pinnedNames << str;	// Reused only after unpin()
+    else if ( str + len + 1 == _pos )
+	_pos = str;	// The last name in the current chunk
+    else
+	_freeNames[ len ] << str;
+}
+
+
+const char * NamePool::store( const char * name, int len )
+{
+    if ( len > NAME_POOL_DEDUP_MAX_LEN && ! _freeNames.isEmpty() )
+    {
+	QHash<int, QList<char *> >::iterator it = _freeNames.find( len );
+
+	if ( it != _freeNames.end() )
+	{
+	    char * str = it->takeLast();
+
+	    if ( it->isEmpty() )
+		_freeNames.erase( it );
+
+	    memcpy( str, name, len );
+	    _usedBytes += len + 1;
+
+	    return str;
+	}
+    }
+
+    if ( _end - _pos < len + 1 )
+    {
+	int chunkSize = qMax( NAME_POOL_CHUNK_SIZE, len + 1 );
+
+	// The node file can only map whole pages
+	chunkSize = ( chunkSize + NAME_POOL_CHUNK_SIZE - 1 ) & ~( NAME_POOL_CHUNK_SIZE - 1 );
+
+	char * chunk = (char *) NodeFile::instance()->map( chunkSize, NAME_POOL_CHUNK_SIZE );
+
+	if ( ! chunk )
+	{
+	    chunk = new char[ chunkSize ];
+	    CHECK_NEW( chunk );
+	}
+
+	_chunks << chunk;
+	_chunkSizes << chunkSize;
+	_pos = chunk;
+	_end = chunk + chunkSize;
+	_allocatedBytes += chunkSize;
+    }
+
+    char * str = _pos;
+    memcpy( str, name, len );
+    str[ len ] = '\0';
+    _pos += len + 1;
+    _usedBytes += len + 1;
+
+    return str;
+}
+
+
+qint64 NamePool::dedupBytes() const
+{
+    // One bucket pointer per bucket plus one node (next pointer, hash
+    // value and key) for each entry
+
+    return (qint64) _dedup.capacity() * sizeof( void * ) +
+	(qint64) _dedup.size() * ( sizeof( void * ) + sizeof( uint ) + sizeof( Key ) );
+}
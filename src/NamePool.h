@@ -0,0 +1,219 @@
+/*
+ *   File name: NamePool.h
+ *   Summary:	Interned UTF-8 file names for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef NamePool_h
+#define NamePool_h
+
+
+#include <QString>
+#include <QSet>
+#include <QList>
+#include <QHash>
+
+
+// Size of one chunk of name storage
+#define NAME_POOL_CHUNK_SIZE	( 64 * 1024 )
+
+// Names up to this length (in bytes) are deduplicated. Short names like
+// "index.js", "__init__.py", ".git" or "Makefile" are very likely to be
+// found many times in a tree; long names rarely are, and deduplicating them
+// would only cost memory for the hash.
+#define NAME_POOL_DEDUP_MAX_LEN	32
+
+
+namespace QDirStat
+{
+    /**
+     * Storage for the names of the FileInfo items of a DirTree: All names
+     * are stored as 0-terminated UTF-8 strings in large chunks of memory,
+     * and short names are deduplicated, so each one of them is stored only
+     * once no matter how many items have that name. This needs a lot less
+     * memory than a QString (UTF-16, separately allocated, refcounted) for
+     * each item.
+     *
+     * A name stays valid until the pool is cleared or it is released.
+     * Only long names that are not deduplicated can be released one by one,
+     * since nothing else can share them; see release(). DirTree releases
+     * the names of items that are deleted, and it clears its pool when the
+     * complete tree is cleared.
+     *
+     * While the pool is pinned, no name becomes invalid, not even if it is
+     * released or if the pool is cleared: Somebody in another thread still
+     * uses the names (see pin()).
+     *
+     * In out-of-core mode, the chunks are mapped from the NodeFile.
+     *
+     * This is not thread-safe: Tree nodes are only created in the main
+     * thread.
+     **/
+    class NamePool
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	NamePool();
+
+	/**
+	 * Destructor.
+	 **/
+	~NamePool();
+
+	/**
+	 * Store 'name' (UTF-8, 'len' bytes, not necessarily 0-terminated)
+	 * and return a pointer to the 0-terminated copy in the pool, or to
+	 * an existing copy if the same name was stored before.
+	 **/
+	const char * intern( const char * name, int len );
+
+	/**
+	 * Store 'name' (UTF-8, 0-terminated) in the pool.
+	 **/
+	const char * intern( const char * name );
+
+	/**
+	 * Store 'name' in the pool as UTF-8.
+	 **/
+	const char * intern( const QString & name );
+
+	/**
+	 * Release 'name' that was returned by intern() if it is longer than
+	 * NAME_POOL_DEDUP_MAX_LEN, so its space is reused for another name of
+	 * the same length. Shorter names might be shared with other items, so
+	 * they stay until clear().
+	 *
+	 * The pointer becomes invalid, and it may be returned again by a
+	 * later intern() for a different name.
+	 **/
+	void release( const char * name );
+
+	/**
+	 * Return the number of names that were released so far. This is never
+	 * reset, not even by clear(), so anybody who keeps name pointers can
+	 * find out if they might have become invalid.
+	 **/
+	qint64 releaseCount() const { return _releaseCount; }
+
+	/**
+	 * Release all names. All pointers previously returned by intern()
+	 * become invalid, except the one for the empty name.
+	 **/
+	void clear();
+
+	/**
+	 * Keep all names that were returned by intern() so far valid and
+	 * unchanged until unpin(), even if they are released or the pool is
+	 * cleared in the meantime: Their space is only reused or freed by
+	 * unpin(). This is for a snapshot of the tree that is still used in
+	 * another thread (see CacheSnapshot).
+	 *
+	 * Pins can be nested; each pin() needs its unpin().
+	 **/
+	void pin() { ++_pins; }
+
+	/**
+	 * Undo one pin(). When the last pin is gone, this reuses the space
+	 * of the names that were released while the pool was pinned and
+	 * frees the chunks of the pool when it was cleared in the meantime.
+	 **/
+	void unpin();
+
+	/**
+	 * Return 'true' if the pool is pinned.
+	 **/
+	bool isPinned() const { return _pins > 0; }
+
+	/**
+	 * Return the number of bytes allocated for name storage.
+	 **/
+	qint64 allocatedBytes() const { return _allocatedBytes; }
+
+	/**
+	 * Return the number of bytes actually used for names.
+	 **/
+	qint64 usedBytes() const { return _usedBytes; }
+
+	/**
+	 * Return the number of intern() calls that found an existing name.
+	 **/
+	qint64 dedupHits() const { return _dedupHits; }
+
+	/**
+	 * Return the number of different names in the deduplication hash.
+	 **/
+	int dedupCount() const { return _dedup.size(); }
+
+	/**
+	 * Return the approximate number of bytes used by the deduplication
+	 * hash.
+	 **/
+	qint64 dedupBytes() const;
+
+	/**
+	 * Return the pool for items that don't belong to any tree.
+	 **/
+	static NamePool * globalPool();
+
+
+    protected:
+
+	/**
+	 * Copy 'len' bytes of 'name' plus a terminating 0 into the pool and
+	 * return the copy.
+	 **/
+	const char * store( const char * name, int len );
+
+	/**
+	 * Free the chunks in 'chunks' with the sizes in 'chunkSizes' and
+	 * clear both lists.
+	 **/
+	static void freeChunks( QList<char *> & chunks, QList<int> & chunkSizes );
+
+	/**
+	 * Key for the deduplication hash: A name in the pool.
+	 **/
+	struct Key
+	{
+	    Key( const char * s = 0, int l = 0 ): str( s ), len( l ) {}
+
+	    bool operator==( const Key & other ) const;
+
+	    const char * str;
+	    int		 len;
+	};
+
+	friend uint qHash( const Key & key );
+
+
+	//
+	// Data members
+	//
+
+	QList<char *>	_chunks;
+	QList<int>	_chunkSizes;
+	char *		_pos;		// Next free byte in the current chunk
+	char *		_end;		// End of the current chunk
+	QSet<Key>	_dedup;
+	QHash<int, QList<char *> > _freeNames;	// Released names by length
+	qint64		_allocatedBytes;
+	qint64		_usedBytes;
+	qint64		_dedupHits;
+	qint64		_releaseCount;
+	int		_pins;
+	QList<char *>	_pinnedNames;	// Released while pinned
+	QList<char *>	_retiredChunks;	// Cleared while pinned
+	QList<int>	_retiredChunkSizes;
+
+    };	// class NamePool
+
+}	// namespace QDirStat
+
+
+#endif // ifndef NamePool_h
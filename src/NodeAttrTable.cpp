@@ -0,0 +1,72 @@
+/*
+ *   File name: NodeAttrTable.cpp
+ *   Summary:	Deduplicated inode attributes for the DirTree nodes of QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QHash>
+
+#include "NodeAttrTable.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+// The first chunk is static so index 0 (all zeroes) is always valid.
+
+NodeAttr   NodeAttrTable::_firstChunk[ NODE_ATTR_CHUNK_SIZE ];
+NodeAttr * NodeAttrTable::_chunks[ NODE_ATTR_MAX_CHUNKS ] = { NodeAttrTable::_firstChunk };
+quint32	   NodeAttrTable::_count = 1;
+
+
+namespace QDirStat
+{
+    uint qHash( const NodeAttr & attr )
+    {
+	return ::qHash( (quint64) attr.device ) ^
+	    ( (uint) attr.links << 24 ) ^
+	    ( (uint) attr.uid	<< 8  ) ^
+	    (uint) attr.gid;
+    }
+}
+
+
+quint32 NodeAttrTable::index( dev_t device, nlink_t links, uid_t uid, gid_t gid )
+{
+    static QHash<NodeAttr, quint32> entries;
+
+    NodeAttr attr;
+    attr.device = device;
+    attr.links	= links;
+    attr.uid	= uid;
+    attr.gid	= gid;
+
+    if ( device == 0 && links == 0 && uid == 0 && gid == 0 )
+	return 0;
+
+    QHash<NodeAttr, quint32>::const_iterator it = entries.constFind( attr );
+
+    if ( it != entries.constEnd() )
+	return it.value();
+
+    quint32 chunk = _count >> NODE_ATTR_CHUNK_BITS;
+
+    if ( chunk >= NODE_ATTR_MAX_CHUNKS )
+	THROW( Exception( "Too many different inode attributes" ) );
+
+    if ( ! _chunks[ chunk ] )
+    {
+	_chunks[ chunk ] = new NodeAttr[ NODE_ATTR_CHUNK_SIZE ];
+	CHECK_NEW( _chunks[ chunk ] );
+    }
+
+    quint32 index = _count;
+    _chunks[ chunk ][ index & ( NODE_ATTR_CHUNK_SIZE - 1 ) ] = attr;
+    _count++;
+    entries.insert( attr, index );
+
+    return index;
+}
@@ -0,0 +1,101 @@
+/*
+ *   File name: NodeAttrTable.h
+ *   Summary:	Deduplicated inode attributes for the DirTree nodes of QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef NodeAttrTable_h
+#define NodeAttrTable_h
+
+
+#include <sys/types.h>
+
+#include <QtGlobal>
+
+
+// Number of entries in one chunk of the table (a power of 2)
+#define NODE_ATTR_CHUNK_BITS	10
+#define NODE_ATTR_CHUNK_SIZE	( 1 << NODE_ATTR_CHUNK_BITS )
+
+// Max. number of chunks, i.e. max. 16M different entries
+#define NODE_ATTR_MAX_CHUNKS	( 16 * 1024 )
+
+
+namespace QDirStat
+{
+    /**
+     * Inode attributes that are only very rarely different between the
+     * items of one directory tree: Almost all files of a tree are on a few
+     * devices, belong to a few users and groups, and have just one hard
+     * link.
+     **/
+    struct NodeAttr
+    {
+	dev_t	device;
+	nlink_t links;
+	uid_t	uid;
+	gid_t	gid;
+
+	bool operator==( const NodeAttr & other ) const
+	{
+	    return device == other.device
+		&& links  == other.links
+		&& uid	  == other.uid
+		&& gid	  == other.gid;
+	}
+    };
+
+
+    uint qHash( const NodeAttr & attr );
+
+
+    /**
+     * Table of all different NodeAttr values in use: FileInfo only stores
+     * a 32 bit index into this table instead of the attributes themselves.
+     *
+     * There is only one table for all trees; it only ever grows, but the
+     * number of different entries is tiny compared to the number of tree
+     * nodes.
+     *
+     * Entries are stored in chunks that are never moved, so other threads
+     * may read the entries of existing tree nodes while new entries are
+     * added. Adding entries is only done in the main thread (where the tree
+     * nodes are created).
+     **/
+    class NodeAttrTable
+    {
+    public:
+
+	/**
+	 * Return the index of the entry for these attributes. Create a new
+	 * entry if there is none yet. Index 0 is the entry with all zeroes.
+	 **/
+	static quint32 index( dev_t device, nlink_t links, uid_t uid, gid_t gid );
+
+	/**
+	 * Return the entry with index 'index'.
+	 **/
+	static const NodeAttr & at( quint32 index )
+	    { return _chunks[ index >> NODE_ATTR_CHUNK_BITS ][ index & ( NODE_ATTR_CHUNK_SIZE - 1 ) ]; }
+
+	/**
+	 * Return the number of entries.
+	 **/
+	static quint32 count() { return _count; }
+
+
+    protected:
+
+	static NodeAttr	  _firstChunk[ NODE_ATTR_CHUNK_SIZE ];
+	static NodeAttr * _chunks[ NODE_ATTR_MAX_CHUNKS ];
+	static quint32	  _count;
+
+    };	// class NodeAttrTable
+
+}	// namespace QDirStat
+
+
+#endif // ifndef NodeAttrTable_h
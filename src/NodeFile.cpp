@@ -0,0 +1,283 @@
+/*
+ *   File name: NodeFile.cpp
+ *   Summary:	Memory-mapped backing file for the DirTree nodes of QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/mman.h>	// mmap(), munmap(), madvise()
+#include <fcntl.h>	// fallocate(), posix_fallocate()
+#include <unistd.h>	// ftruncate(), unlink(), close()
+#include <stdlib.h>	// mkstemp()
+#include <string.h>	// strerror()
+#include <stdint.h>	// uintptr_t
+
+#include "NodeFile.h"
+#include "Logger.h"
+#include "FileInfo.h"	// formatSize()
+
+using namespace QDirStat;
+
+
+NodeFile * NodeFile::instance()
+{
+    // Never destroyed: The static SlabPools and NamePools may still release
+    // their memory during program exit.
+
+    static NodeFile * nodeFile = new NodeFile();
+
+    return nodeFile;
+}
+
+
+NodeFile::NodeFile():
+    _fd( -1 ),
+    _failed( false ),
+    _exhausted( false ),
+    _noSpace( false ),
+    _base( 0 ),
+    _reservedSize( 0 ),
+    _fileSize( 0 ),
+    _mappedBytes( 0 )
+{
+    // NOP
+}
+
+
+NodeFile::~NodeFile()
+{
+    // Anything that is still mapped stays valid until the process exits;
+    // only the file descriptor is not needed for that.
+
+    if ( _fd >= 0 )
+	::close( _fd );
+}
+
+
+void NodeFile::setDirectory( const QString & dir )
+{
+    if ( dir == _dir )
+	return;
+
+    if ( ! dir.isEmpty() )
+	logInfo() << "Mapping the tree nodes from a file in " << dir << endl;
+
+    _dir    = dir;
+    _failed = false;
+    closeIfUnused();
+}
+
+
+bool NodeFile::open()
+{
+    if ( _fd >= 0 )
+	return true;
+
+    if ( _failed )
+	return false;
+
+    QByteArray fileName = ( _dir + "/qdirstat-nodes-XXXXXX" ).toUtf8();
+    _fd = ::mkstemp( fileName.data() );
+
+    if ( _fd < 0 )
+    {
+	logError() << "Can't create node file in " << _dir << ": " << formatErrno() << endl;
+	_failed = true;
+
+	return false;
+    }
+
+    // Nobody else needs that file, and it should disappear when we exit
+    ::unlink( fileName.constData() );
+    ::fcntl( _fd, F_SETFD, FD_CLOEXEC );
+
+    _fileSize  = 0;
+    _exhausted = false;
+    _freeRanges.clear();
+
+    if ( ! reserve() )
+    {
+	::close( _fd );
+	_fd	= -1;
+	_failed = true;
+
+	return false;
+    }
+
+    logInfo() << "Created node file " << fileName
+	      << " for up to " << formatSize( _reservedSize ) << endl;
+
+    return true;
+}
+
+
+bool NodeFile::reserve()
+{
+    // mmap() only guarantees page alignment: Reserve some more address
+    // space to find an aligned address in it, map the file there and give
+    // back the rest. The file is still empty, but that's no problem as long
+    // as nothing beyond its end is accessed: map() extends it first.
+
+    for ( qint64 size = NODE_FILE_RESERVE_SIZE; size >= NODE_FILE_MIN_RESERVE_SIZE; size /= 2 )
+    {
+	size_t reserveSize = size + NODE_FILE_MAX_ALIGNMENT;
+	char * reserved = (char *) ::mmap( 0, reserveSize, PROT_NONE,
+					   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+
+	if ( reserved == MAP_FAILED )
+	    continue;
+
+	char * aligned = (char *) ( ( (uintptr_t) reserved + NODE_FILE_MAX_ALIGNMENT - 1 ) &
+				    ~( (uintptr_t) NODE_FILE_MAX_ALIGNMENT - 1 ) );
+	void * mem = ::mmap( aligned, size, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_FIXED, _fd, 0 );
+
+	if ( mem == MAP_FAILED )
+	{
+	    logError() << "Can't map the node file: " << formatErrno() << endl;
+	    ::munmap( reserved, reserveSize );
+
+	    return false;
+	}
+
+	if ( aligned > reserved )
+	    ::munmap( reserved, aligned - reserved );
+
+	if ( aligned + size < reserved + reserveSize )
+	    ::munmap( aligned + size, ( reserved + reserveSize ) - ( aligned + size ) );
+
+	_base	      = aligned;
+	_reservedSize = size;
+
+	return true;
+    }
+
+    logError() << "Can't reserve address space for the node file: " << formatErrno() << endl;
+
+    return false;
+}
+
+
+void NodeFile::closeIfUnused()
+{
+    if ( _fd >= 0 && _mappedBytes == 0 )
+    {
+	::munmap( _base, _reservedSize );
+	::close( _fd );
+	_fd	      = -1;
+	_base	      = 0;
+	_reservedSize = 0;
+	_fileSize     = 0;
+	_freeRanges.clear();
+    }
+}
+
+
+qint64 NodeFile::allocRange( size_t size, size_t alignment )
+{
+    QMap<qint64, QList<qint64> >::iterator it = _freeRanges.find( size );
+
+    if ( it != _freeRanges.end() )
+    {
+	QList<qint64> & offsets = it.value();
+
+	for ( int i = offsets.size() - 1; i >= 0; --i )
+	{
+	    if ( offsets.at( i ) % alignment == 0 )
+		return offsets.takeAt( i );
+	}
+    }
+
+    // Any gap for the alignment is just a hole in the file
+
+    qint64 offset = ( _fileSize + alignment - 1 ) & ~( (qint64) alignment - 1 );
+
+    if ( offset + (qint64) size > _reservedSize )
+    {
+	if ( ! _exhausted )
+	{
+	    logWarning() << "Node file is full at " << formatSize( _reservedSize )
+			 << "; using normal memory" << endl;
+	    _exhausted = true;
+	}
+
+	return -1;
+    }
+
+    if ( ::ftruncate( _fd, offset + size ) < 0 )
+    {
+	logError() << "Can't extend the node file to " << offset + size
+		   << " bytes: " << formatErrno() << endl;
+	return -1;
+    }
+
+    _fileSize = offset + size;
+
+    return offset;
+}
+
+
+void * NodeFile::map( size_t size, size_t alignment )
+{
+    if ( _dir.isEmpty() || alignment > NODE_FILE_MAX_ALIGNMENT || ! open() )
+	return 0;
+
+    qint64 offset = allocRange( size, alignment );
+
+    if ( offset < 0 )
+	return 0;
+
+    // The file is sparse, and a released range is a punched hole: Allocate
+    // the disk space now. Otherwise the first write to a page of the range
+    // would raise SIGBUS if the filesystem is full.
+
+    int err = ::posix_fallocate( _fd, offset, size );
+
+    if ( err != 0 )
+    {
+	if ( ! _noSpace )
+	{
+	    logWarning() << "Can't allocate " << formatSize( size ) << " in the node file: "
+			 << strerror( err ) << "; using normal memory" << endl;
+	    _noSpace = true;
+	}
+
+	_freeRanges[ size ] << offset;
+	closeIfUnused();
+
+	return 0;
+    }
+
+    _noSpace = false;
+    _mappedBytes += size;
+
+    return _base + offset;
+}
+
+
+void NodeFile::unmap( void * mem, size_t size )
+{
+    if ( ! isMapped( mem ) )
+    {
+	logError() << "Not mapped from the node file: " << mem << endl;
+	return;
+    }
+
+    qint64 offset = (char *) mem - _base;
+    _mappedBytes -= size;
+
+    // Give the disk space and the pages back, but keep the file size so the
+    // offset can be reused for the next mapping of the same size. The
+    // address range stays mapped.
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    ::fallocate( _fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size );
+#else
+    ::madvise( mem, size, MADV_DONTNEED );
+#endif
+
+    _freeRanges[ size ] << offset;
+    closeIfUnused();
+}
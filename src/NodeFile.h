@@ -0,0 +1,179 @@
+/*
+ *   File name: NodeFile.h
+ *   Summary:	Memory-mapped backing file for the DirTree nodes of QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef NodeFile_h
+#define NodeFile_h
+
+
+#include <stddef.h>	// size_t
+
+#include <QString>
+#include <QMap>
+#include <QList>
+
+
+// Address space to reserve for the backing file. This costs nothing but
+// address space; the file itself only grows as needed.
+#define NODE_FILE_RESERVE_SIZE		( sizeof( void * ) > 4 ? ( 1LL << 40 ) : ( 1LL << 30 ) )
+
+// Smallest reservation to fall back to if that fails
+#define NODE_FILE_MIN_RESERVE_SIZE	( 64LL * 1024 * 1024 )
+
+// Alignment of the reserved address range
+#define NODE_FILE_MAX_ALIGNMENT		( 2 * 1024 * 1024 )
+
+
+namespace QDirStat
+{
+    /**
+     * Backing file for the memory of the tree nodes for trees that don't
+     * fit into RAM ("out-of-core mode"): If a directory is set, the slabs
+     * of the SlabPools (the fixed-size FileInfo / DirInfo records) and the
+     * chunks of the NamePools (the string heap for the names) are mapped
+     * from a file in that directory instead of being taken from anonymous
+     * memory.
+     *
+     * The tree nodes are still normal C++ objects, so nothing else in the
+     * application has to know about this. But the kernel can write their
+     * pages back to that file and drop them from RAM when memory gets
+     * tight, and page them in again only when that part of the tree is
+     * accessed, without needing any swap space.
+     *
+     * The file is deleted right after it is created, so it disappears when
+     * the program exits, even after a crash.
+     *
+     * The complete file is mapped into one large range of address space
+     * that is reserved when the file is created, and map() only extends
+     * the file and hands out a part of that range. So the kernel only has
+     * one mapping to manage no matter how many slabs and chunks there are
+     * (see vm.max_map_count).
+     *
+     * This is not thread-safe: Tree nodes are only created and deleted in
+     * the main thread.
+     **/
+    class NodeFile
+    {
+    public:
+
+	/**
+	 * Return the singleton instance of this class.
+	 **/
+	static NodeFile * instance();
+
+	/**
+	 * Set the directory for the backing file. An empty string switches
+	 * the out-of-core mode off for all memory that is allocated from now
+	 * on. As long as anything is still mapped from an existing backing
+	 * file, that file is also used for new mappings.
+	 **/
+	void setDirectory( const QString & dir );
+
+	/**
+	 * Return the directory for the backing file or an empty string if
+	 * the out-of-core mode is off.
+	 **/
+	QString directory() const { return _dir; }
+
+	/**
+	 * Return 'true' if the out-of-core mode is on.
+	 **/
+	bool isEnabled() const { return ! _dir.isEmpty(); }
+
+	/**
+	 * Map 'size' bytes from the backing file at an address that is a
+	 * multiple of 'alignment' (a power of 2 and a multiple of the page
+	 * size, max. NODE_FILE_MAX_ALIGNMENT). The disk space for it is
+	 * allocated right away. Return 0 if the out-of-core mode is off or if
+	 * that failed, e.g. because the filesystem is full; the caller should
+	 * then use normal memory instead.
+	 **/
+	void * map( size_t size, size_t alignment );
+
+	/**
+	 * Unmap memory that was returned by map() and release its space in
+	 * the backing file.
+	 **/
+	void unmap( void * mem, size_t size );
+
+	/**
+	 * Return 'true' if 'mem' is in the memory of the backing file, i.e.
+	 * if it was returned by map().
+	 **/
+	bool isMapped( void * mem ) const
+	    { return _base && (char *) mem >= _base && (char *) mem < _base + _reservedSize; }
+
+	/**
+	 * Return the number of bytes currently mapped.
+	 **/
+	qint64 mappedBytes() const { return _mappedBytes; }
+
+	/**
+	 * Return the size of the backing file.
+	 **/
+	qint64 fileSize() const { return _fileSize; }
+
+
+    protected:
+
+	/**
+	 * Constructor. Use instance() instead.
+	 **/
+	NodeFile();
+
+	/**
+	 * Destructor.
+	 **/
+	~NodeFile();
+
+	/**
+	 * Create the backing file in _dir if it is not open yet.
+	 * Return 'true' on success.
+	 **/
+	bool open();
+
+	/**
+	 * Reserve the address range for the backing file and map the file
+	 * into it. Return 'true' on success.
+	 **/
+	bool reserve();
+
+	/**
+	 * Close the backing file if nothing is mapped from it anymore.
+	 **/
+	void closeIfUnused();
+
+	/**
+	 * Return a file offset that is a multiple of 'alignment' for 'size'
+	 * bytes: A released one if there is one, otherwise from the end of
+	 * the file, which is extended. Return -1 on error.
+	 **/
+	qint64 allocRange( size_t size, size_t alignment );
+
+
+	//
+	// Data members
+	//
+
+	QString				_dir;
+	int				_fd;
+	bool				_failed;	// Don't retry open() for this _dir
+	bool				_exhausted;	// No more room in the address range
+	bool				_noSpace;	// Last posix_fallocate() failed
+	char *				_base;		// Where the file is mapped
+	qint64				_reservedSize;
+	qint64				_fileSize;
+	qint64				_mappedBytes;
+	QMap<qint64, QList<qint64> >	_freeRanges;	// Released offsets by size
+
+    };	// class NodeFile
+
+}	// namespace QDirStat
+
+
+#endif // ifndef NodeFile_h
@@ -51,6 +51,7 @@ PkgInfo::PkgInfo( DirTree *       tree,
     _multiArch( false )
 {
     // logDebug() << "Creating " << this << endl;
+    registerHeapOwner();
 }
 
 
@@ -60,9 +61,16 @@ PkgInfo::~PkgInfo()
 }
 
 
+void PkgInfo::setTree( DirTree * tree )
+{
+    _tree = tree;
+    registerHeapOwner();
+}
+
+
 QString PkgInfo::url() const
 {
-    QString name = _name;
+    QString name = this->name();
 
     if ( isPkgUrl( name ) )
         name = "";
@@ -99,7 +107,7 @@ FileInfo * PkgInfo::locate( const QString & path )
 
         QString pkgName = components.takeFirst();
 
-        if ( pkgName != _name )
+        if ( pkgName != name() )
         {
             logError() << "Path " << path << " does not belong to " << this << endl;
             return 0;
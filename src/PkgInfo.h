@@ -45,6 +45,14 @@ namespace QDirStat
          **/
         virtual ~PkgInfo();
 
+        /**
+         * Allocate from the general heap: Packages are few, and unlike the
+         * other items they are cleaned up individually when their tree is
+         * cleared (see DirTree::addHeapOwner()).
+         **/
+        static void * operator new( size_t size ) { return ::operator new( size ); }
+        static void operator delete( void * ptr ) { ::operator delete( ptr ); }
+
         /**
          * Return the package's base name, i.e. the short name without any
          * version number or architecture information. This may be different
@@ -61,7 +69,7 @@ namespace QDirStat
          * for multiple architectures; in that case, it is advisable to use the
          * base name plus either the version or the architecture or both.
          **/
-        void setName( const QString & newName ) { _name = newName; }
+        void setName( const QString & newName ) { FileInfo::setName( newName ); }
 
         /**
          * Return the version of this package.
@@ -81,7 +89,7 @@ namespace QDirStat
         /**
          * Set the parent DirTree for this pkg.
          **/
-        void setTree( DirTree * tree ) { _tree = tree; }
+        void setTree( DirTree * tree );
 
         /**
          * Return 'true' if this package is installed for more than one
@@ -453,7 +453,7 @@ FileInfo * PkgReadJob::createItem( const QStringList & pathComponents,
 
     if ( S_ISDIR( statInfo->st_mode ) )		// directory?
     {
-	DirInfo * dir = new DirInfo( name, statInfo, tree, parent );
+	DirInfo * dir = new ( tree ) DirInfo( name, statInfo, tree, parent );
 	CHECK_NEW( dir );
 
 	if ( parent )
@@ -463,7 +463,7 @@ FileInfo * PkgReadJob::createItem( const QStringList & pathComponents,
     }
     else					// no directory
     {
-	FileInfo * file = new FileInfo( name, statInfo, tree, parent );
+	FileInfo * file = new ( tree ) FileInfo( name, statInfo, tree, parent );
 	CHECK_NEW( file );
 
 	if ( parent )
@@ -15,11 +15,14 @@
 #include "RpmPkgManager.h"
 #include "PkgFileListCache.h"
 #include "Settings.h"
-#include "MessagePanel.h"
-#include "PanelMessage.h"
 #include "Logger.h"
 #include "Exception.h"
 
+#ifdef QT_WIDGETS_LIB
+#  include "MessagePanel.h"
+#  include "PanelMessage.h"
+#endif
+
 #define LONG_CMD_TIMEOUT_SEC		30
 
 
@@ -250,6 +253,8 @@ void RpmPkgManager::rebuildRpmDbWarning()
 	logWarning()  << "rpm is very slow. Run	  sudo rpm --rebuilddb"	  << endl;
     }
 
+#ifdef QT_WIDGETS_LIB
+
     // Add a panel message so the user is sure to see this message.
     //
     // This is a bit out of place in this class, but a full-fledged user
@@ -273,5 +278,7 @@ void RpmPkgManager::rebuildRpmDbWarning()
 	MessagePanel::firstInstance()->add( panelMessage );
     }
 
+#endif
+
     issuedWarning = true;
 }
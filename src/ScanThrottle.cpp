@@ -0,0 +1,274 @@
+/*
+ *   File name: ScanThrottle.cpp
+ *   Summary:	Rate limiting for low-impact directory scans in QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <QFile>
+#include <QThread>
+#include <QMutexLocker>
+#include <QThreadStorage>
+
+#include "ScanThrottle.h"
+#include "Logger.h"
+
+// Interval for checking the system load and the I/O pressure
+#define PRESSURE_CHECK_MILLISEC		1000
+
+// Never go below this fraction of the configured rates
+#define MIN_SPEED_FACTOR		( 1.0 / 16 )
+
+// From <linux/ioprio.h> which is not available everywhere
+#ifndef IOPRIO_CLASS_SHIFT
+#  define IOPRIO_CLASS_SHIFT		13
+#  define IOPRIO_PRIO_VALUE( class, data ) ( ( (class) << IOPRIO_CLASS_SHIFT ) | (data) )
+#  define IOPRIO_CLASS_NONE		0
+#  define IOPRIO_CLASS_IDLE		3
+#  define IOPRIO_WHO_PROCESS		1
+#endif
+
+using namespace QDirStat;
+
+
+static QThreadStorage<bool> threadIdleIoPriority;
+
+
+ScanThrottle::ScanThrottle():
+    _enabled( false ),
+    _maxStatsPerSec( DEFAULT_MAX_STATS_PER_SEC ),
+    _maxDirsPerSec( DEFAULT_MAX_DIRS_PER_SEC ),
+    _maxLoadPerCpu( DEFAULT_MAX_LOAD_PER_CPU ),
+    _maxIoPressure( DEFAULT_MAX_IO_PRESSURE ),
+    _statTokens( 0.0 ),
+    _dirTokens( 0.0 ),
+    _speedFactor( 1.0 ),
+    _lastRefill( 0 ),
+    _lastPressureCheck( 0 )
+{
+    _clock.start();
+}
+
+
+void ScanThrottle::setEnabled( bool enabled )
+{
+    QMutexLocker locker( &_mutex );
+
+    if ( enabled != _enabled )
+    {
+	logInfo() << "Low-impact scan mode " << ( enabled ? "on" : "off" ) << endl;
+
+	if ( enabled )
+	{
+	    logInfo() << "Max. " << _maxDirsPerSec  << " dirs/sec, "
+		      << _maxStatsPerSec << " lstat() calls/sec" << endl;
+	}
+    }
+
+    _enabled	 = enabled;
+    _statTokens	 = _maxStatsPerSec;
+    _dirTokens	 = _maxDirsPerSec;
+    _speedFactor = 1.0;
+    _lastRefill	 = _clock.elapsed();
+
+    // Waiting workers may continue right away if disabled
+    _wakeUp.wakeAll();
+}
+
+
+bool ScanThrottle::startJob()
+{
+    QMutexLocker locker( &_mutex );
+
+    if ( ! _enabled )
+	return true;
+
+    checkPressure();
+    refill();
+
+    if ( _dirTokens < 1.0 || _statTokens <= 0.0 )
+	return false;
+
+    _dirTokens -= 1.0;
+
+    return true;
+}
+
+
+void ScanThrottle::jobDone( int statCount )
+{
+    QMutexLocker locker( &_mutex );
+
+    if ( _enabled )
+	_statTokens -= statCount;
+}
+
+
+bool ScanThrottle::waitForStats( int count, const QAtomicInt * canceled )
+{
+    QMutexLocker locker( &_mutex );
+
+    while ( true )
+    {
+	// Checking the flag with the mutex locked means wakeAll() can't slip
+	// in between this and the wait below.
+
+	if ( canceled && canceled->load() != 0 )
+	    return false;
+
+	if ( ! _enabled )
+	    return true;
+
+	checkPressure();
+	refill();
+
+	if ( _statTokens > 0.0 )
+	{
+	    _statTokens -= count;
+	    return true;
+	}
+
+	_wakeUp.wait( &_mutex, delay() );
+    }
+}
+
+
+void ScanThrottle::wakeAll()
+{
+    QMutexLocker locker( &_mutex );
+    _wakeUp.wakeAll();
+}
+
+
+int ScanThrottle::delayMillisec() const
+{
+    QMutexLocker locker( &_mutex );
+
+    return delay();
+}
+
+
+int ScanThrottle::delay() const
+{
+    double dirsPerSec  = _maxDirsPerSec  * _speedFactor;
+    double statsPerSec = _maxStatsPerSec * _speedFactor;
+    double sec = 0.0;
+
+    if ( _dirTokens < 1.0 )
+	sec = qMax( sec, ( 1.0 - _dirTokens ) / dirsPerSec );
+
+    if ( _statTokens <= 0.0 )
+	sec = qMax( sec, ( 1.0 - _statTokens ) / statsPerSec );
+
+    return qBound( 1, (int) ( sec * 1000.0 ) + 1, PRESSURE_CHECK_MILLISEC );
+}
+
+
+void ScanThrottle::refill()
+{
+    qint64 now = _clock.elapsed();
+    double sec = ( now - _lastRefill ) / 1000.0;
+    _lastRefill = now;
+
+    // The buckets can hold one second worth of tokens
+
+    double maxStats = _maxStatsPerSec * _speedFactor;
+    double maxDirs  = _maxDirsPerSec  * _speedFactor;
+
+    _statTokens = qMin( _statTokens + sec * maxStats, maxStats );
+    _dirTokens	= qMin( _dirTokens	+ sec * maxDirs,  maxDirs  );
+}
+
+
+void ScanThrottle::checkPressure()
+{
+    qint64 now = _clock.elapsed();
+
+    if ( now - _lastPressureCheck < PRESSURE_CHECK_MILLISEC )
+	return;
+
+    _lastPressureCheck = now;
+
+    double load	    = _maxLoadPerCpu > 0.0 ? loadPerCpu() : -1.0;
+    double pressure = _maxIoPressure > 0.0 ? ioPressure() : -1.0;
+    double oldSpeed = _speedFactor;
+
+    if ( load > _maxLoadPerCpu || pressure > _maxIoPressure )
+	_speedFactor = qMax( _speedFactor / 2.0, MIN_SPEED_FACTOR );
+    else
+	_speedFactor = qMin( _speedFactor * 1.25, 1.0 );
+
+    if ( _speedFactor < oldSpeed )
+    {
+	logInfo() << "Backing off: load/CPU " << load
+		  << " I/O pressure " << pressure
+		  << " speed now " << _speedFactor << endl;
+    }
+}
+
+
+double ScanThrottle::loadPerCpu()
+{
+    QFile file( "/proc/loadavg" );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return -1.0;
+
+    bool ok = false;
+    double load = file.readLine().split( ' ' ).first().toDouble( &ok );
+
+    if ( ! ok )
+	return -1.0;
+
+    return load / qMax( QThread::idealThreadCount(), 1 );
+}
+
+
+double ScanThrottle::ioPressure()
+{
+    // Format:
+    //
+    //	 some avg10=0.12 avg60=0.05 avg300=0.01 total=123456
+    //	 full avg10=0.00 avg60=0.00 avg300=0.00 total=65432
+
+    QFile file( "/proc/pressure/io" );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return -1.0;
+
+    QList<QByteArray> fields = file.readLine().trimmed().split( ' ' );
+
+    if ( fields.size() < 2 || fields.at( 0 ) != "some" || ! fields.at( 1 ).startsWith( "avg10=" ) )
+	return -1.0;
+
+    bool ok = false;
+    double pressure = fields.at( 1 ).mid( 6 ).toDouble( &ok );
+
+    return ok ? pressure : -1.0;
+}
+
+
+void ScanThrottle::setThreadIdleIoPriority( bool idle )
+{
+    if ( threadIdleIoPriority.hasLocalData() && threadIdleIoPriority.localData() == idle )
+	return;
+
+    threadIdleIoPriority.setLocalData( idle );
+
+#ifdef SYS_ioprio_set
+
+    // For IOPRIO_WHO_PROCESS, 0 means the calling thread.
+
+    int prio = idle ?
+	IOPRIO_PRIO_VALUE( IOPRIO_CLASS_IDLE, 0 ) :
+	IOPRIO_PRIO_VALUE( IOPRIO_CLASS_NONE, 0 );
+
+    syscall( SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, prio );
+
+#endif
+}
@@ -0,0 +1,219 @@
+/*
+ *   File name: ScanThrottle.h
+ *   Summary:	Rate limiting for low-impact directory scans in QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanThrottle_h
+#define ScanThrottle_h
+
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QAtomicInt>
+
+
+// Default limits for low-impact scans
+#define DEFAULT_MAX_STATS_PER_SEC	2000
+#define DEFAULT_MAX_DIRS_PER_SEC	200
+#define DEFAULT_MAX_LOAD_PER_CPU	1.0
+#define DEFAULT_MAX_IO_PRESSURE		10.0
+
+
+namespace QDirStat
+{
+    /**
+     * Throttle for a low-impact scan that should not hurt the latency of
+     * other processes on a busy machine (e.g. a production server):
+     *
+     * - Two token buckets limit the number of directories and the number of
+     *	 lstat() calls per second.
+     *
+     * - The system load and the I/O pressure (PSI, /proc/pressure/io) are
+     *	 checked about once per second; if either of them is above its
+     *	 limit, the rates are halved (down to a minimum), otherwise they
+     *	 slowly recover.
+     *
+     * - Worker threads can switch themselves to the "idle" I/O scheduling
+     *	 class with setThreadIdleIoPriority().
+     *
+     * The DirReadJobQueue asks this before it starts reading a directory
+     * (startJob()). Worker threads call waitForStats() before each batch of
+     * lstat() calls, so even a directory with a huge number of entries is
+     * read at the configured rate. Directories read in the main thread
+     * report their lstat() calls when they are done (jobDone()). If
+     * disabled, startJob() always returns 'true'.
+     *
+     * This is thread-safe.
+     **/
+    class ScanThrottle
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	ScanThrottle();
+
+	/**
+	 * Enable or disable the low-impact scan mode.
+	 **/
+	void setEnabled( bool enabled );
+
+	/**
+	 * Return 'true' if the low-impact scan mode is enabled.
+	 **/
+	bool isEnabled() const { return _enabled; }
+
+	/**
+	 * Set the maximum number of lstat() calls per second.
+	 **/
+	void setMaxStatsPerSec( int maxStats )
+	    { QMutexLocker locker( &_mutex ); _maxStatsPerSec = qMax( maxStats, 1 ); }
+
+	/**
+	 * Return the maximum number of lstat() calls per second.
+	 **/
+	int maxStatsPerSec() const { return _maxStatsPerSec; }
+
+	/**
+	 * Set the maximum number of directories read per second.
+	 **/
+	void setMaxDirsPerSec( int maxDirs )
+	    { QMutexLocker locker( &_mutex ); _maxDirsPerSec = qMax( maxDirs, 1 ); }
+
+	/**
+	 * Return the maximum number of directories read per second.
+	 **/
+	int maxDirsPerSec() const { return _maxDirsPerSec; }
+
+	/**
+	 * Set the 1-minute load average per CPU above which to back off.
+	 * 0 means to ignore the load.
+	 **/
+	void setMaxLoadPerCpu( double maxLoad )
+	    { QMutexLocker locker( &_mutex ); _maxLoadPerCpu = maxLoad; }
+
+	/**
+	 * Return the 1-minute load average per CPU above which to back off.
+	 **/
+	double maxLoadPerCpu() const { return _maxLoadPerCpu; }
+
+	/**
+	 * Set the I/O pressure ("some avg10" in /proc/pressure/io, in
+	 * percent) above which to back off. 0 means to ignore it.
+	 **/
+	void setMaxIoPressure( double maxPressure )
+	    { QMutexLocker locker( &_mutex ); _maxIoPressure = maxPressure; }
+
+	/**
+	 * Return the I/O pressure above which to back off.
+	 **/
+	double maxIoPressure() const { return _maxIoPressure; }
+
+	/**
+	 * Check if reading another directory may start right now. If yes,
+	 * this takes one token from the directory bucket and returns 'true'.
+	 **/
+	bool startJob();
+
+	/**
+	 * Notification that a directory was read with 'statCount' lstat()
+	 * calls that were not already taken with waitForStats(). This may
+	 * take the lstat() bucket below zero; no more jobs are started until
+	 * it is refilled.
+	 **/
+	void jobDone( int statCount );
+
+	/**
+	 * Wait until there are tokens in the lstat() bucket, then take
+	 * 'count' of them and return 'true'. This blocks the calling thread,
+	 * so use it only in worker threads. If disabled, this returns
+	 * immediately.
+	 *
+	 * If 'canceled' is set to non-zero and wakeAll() is called, this
+	 * returns 'false' right away without taking any tokens.
+	 **/
+	bool waitForStats( int count, const QAtomicInt * canceled = 0 );
+
+	/**
+	 * Wake up all threads in waitForStats() so they can check their
+	 * cancel flag. Set that flag before calling this.
+	 **/
+	void wakeAll();
+
+	/**
+	 * Return the number of milliseconds until startJob() will most likely
+	 * succeed again.
+	 **/
+	int delayMillisec() const;
+
+	/**
+	 * Set the I/O scheduling class of the calling thread to "idle" if
+	 * 'idle' is 'true', back to the default otherwise. This does nothing
+	 * if the thread already has that class.
+	 **/
+	static void setThreadIdleIoPriority( bool idle );
+
+
+    protected:
+
+	/**
+	 * Return the number of milliseconds until startJob() will most likely
+	 * succeed again. The mutex has to be locked.
+	 **/
+	int delay() const;
+
+	/**
+	 * Refill both buckets according to the time since the last refill.
+	 **/
+	void refill();
+
+	/**
+	 * Check the system load and the I/O pressure if that was not done
+	 * during the last second, and adjust the speed factor.
+	 **/
+	void checkPressure();
+
+	/**
+	 * Return the 1-minute load average per CPU or -1.0 if unknown.
+	 **/
+	static double loadPerCpu();
+
+	/**
+	 * Return the "some avg10" value from /proc/pressure/io or -1.0 if
+	 * unknown (kernel without PSI).
+	 **/
+	static double ioPressure();
+
+
+	//
+	// Data members
+	//
+
+	bool		_enabled;
+	int		_maxStatsPerSec;
+	int		_maxDirsPerSec;
+	double		_maxLoadPerCpu;
+	double		_maxIoPressure;
+
+	double		_statTokens;
+	double		_dirTokens;
+	double		_speedFactor;	// 1.0 = full configured rate
+	qint64		_lastRefill;
+	qint64		_lastPressureCheck;
+	QElapsedTimer	_clock;
+	mutable QMutex	_mutex;
+	QWaitCondition	_wakeUp;	// For waitForStats()
+
+    };	// class ScanThrottle
+
+}	// namespace QDirStat
+
+
+#endif // ifndef ScanThrottle_h
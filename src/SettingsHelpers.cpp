@@ -8,9 +8,11 @@
 
 
 #include <QSettings>
-#include <QColor>
 #include <QRegExp>
-#include <QWidget>
+
+#ifdef QT_WIDGETS_LIB
+#  include <QWidget>
+#endif
 
 #include "SettingsHelpers.h"
 #include "Settings.h"
@@ -20,6 +22,8 @@
 
 namespace QDirStat
 {
+#ifdef QT_GUI_LIB
+
     QColor readColorEntry( const QSettings & settings,
 			   const char	   * entryName,
 			   const QColor	   & fallback )
@@ -116,6 +120,7 @@ namespace QDirStat
 	settings.setValue( entryName, font.toString() );
     }
 
+#endif	// QT_GUI_LIB
 
 
     int readEnumEntry( const QSettings & settings,
@@ -177,6 +182,8 @@ namespace QDirStat
     }
 
 
+#ifdef QT_WIDGETS_LIB
+
     void readWindowSettings( QWidget * widget, const QString & settingsGroup )
     {
         QDirStat::Settings settings;
@@ -204,5 +211,7 @@ namespace QDirStat
         settings.endGroup();
     }
 
+#endif	// QT_WIDGETS_LIB
+
 } // namespace QDirStat
 
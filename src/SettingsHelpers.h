@@ -9,15 +9,27 @@
 #ifndef SettingsHelpers_h
 #define SettingsHelpers_h
 
-#include <QColor>
-#include <QFont>
 #include <QList>
+#include <QMap>
+#include <QString>
+
+// The color, font and window helpers are only available if the program is
+// built with QtGui or QtWidgets, respectively, so the headless tools (see
+// cache-writer/) can use the rest without them.
+
+#ifdef QT_GUI_LIB
+#  include <QColor>
+#  include <QFont>
+#endif
 
 class QSettings;
+class QWidget;
 
 
 namespace QDirStat
 {
+#ifdef QT_GUI_LIB
+
     /**
      * Read a color in RGB format (#RRGGBB) from the settings.
      **/
@@ -64,6 +76,7 @@ namespace QDirStat
                          const char  * entryName,
                          const QFont & font );
 
+#endif	// QT_GUI_LIB
 
     /**
      * Read an enum value in string format from the settings.
@@ -88,6 +101,8 @@ namespace QDirStat
      **/
     QMap<int, QString> patternSyntaxMapping();
 
+#ifdef QT_WIDGETS_LIB
+
     /**
      * Read window settings (size and position) from the settings and apply
      * them.
@@ -100,7 +115,9 @@ namespace QDirStat
      **/
     void writeWindowSettings( QWidget *       widget,
                               const QString & settingsGroup );
-    
+
+#endif	// QT_WIDGETS_LIB
+
 }	// namespace QDirStat
 
 #endif	// SettingsHelpers_h
@@ -0,0 +1,209 @@
+/*
+ *   File name: SlabPool.cpp
+ *   Summary:	Slab allocator for the DirTree nodes of QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdlib.h>	// posix_memalign(), free()
+#include <stdint.h>	// uintptr_t
+#include <new>		// std::bad_alloc
+
+#include "SlabPool.h"
+#include "NodeFile.h"
+
+// Alignment of the objects in a slab
+#define SLAB_OBJECT_ALIGN	16
+
+using namespace QDirStat;
+
+
+static size_t alignUp( size_t size )
+{
+    return ( size + SLAB_OBJECT_ALIGN - 1 ) & ~( (size_t) SLAB_OBJECT_ALIGN - 1 );
+}
+
+
+SlabPool::SlabPool( size_t objectSize, const char * name ):
+    _objectSize( objectSize ),
+    _name( name ),
+    _current( 0 ),
+    _partial( 0 ),
+    _objectCount( 0 )
+{
+    // A free object has to be able to hold the pointer to the next one
+    if ( _objectSize < sizeof( void * ) )
+	_objectSize = sizeof( void * );
+}
+
+
+SlabPool::~SlabPool()
+{
+    // If any objects are left, they might still be deleted later during
+    // program exit; better leak the slabs than crash.
+
+    if ( _objectCount == 0 )
+	releaseAll();
+}
+
+
+void SlabPool::releaseAll()
+{
+    foreach ( Slab * slab, _slabs )
+	freeSlab( slab );
+
+    _slabs.clear();
+    _current	 = 0;
+    _partial	 = 0;
+    _objectCount = 0;
+}
+
+
+SlabPool::Slab * SlabPool::slabOf( const void * ptr )
+{
+    return (Slab *) ( (uintptr_t) ptr & ~( (uintptr_t) SLAB_SIZE - 1 ) );
+}
+
+
+SlabPool::Slab * SlabPool::newSlab()
+{
+    void * mem = NodeFile::instance()->map( SLAB_SIZE, SLAB_SIZE );
+    bool inNodeFile = mem != 0;
+
+    if ( ! mem && posix_memalign( &mem, SLAB_SIZE, SLAB_SIZE ) != 0 )
+	throw std::bad_alloc();
+
+    Slab * slab	      = (Slab *) mem;
+    slab->pool	      = this;
+    slab->prev	      = 0;
+    slab->next	      = 0;
+    slab->freeList    = 0;
+    slab->bump	      = (char *) mem + alignUp( sizeof( Slab ) );
+    slab->end	      = (char *) mem + SLAB_SIZE;
+    slab->objectCount = 0;
+    slab->inNodeFile  = inNodeFile;
+    _slabs.insert( slab );
+
+    return slab;
+}
+
+
+void SlabPool::freeSlab( Slab * slab )
+{
+    if ( slab->inNodeFile )
+	NodeFile::instance()->unmap( slab, SLAB_SIZE );
+    else
+	::free( slab );
+}
+
+
+void SlabPool::linkPartial( Slab * slab )
+{
+    slab->prev = 0;
+    slab->next = _partial;
+
+    if ( _partial )
+	_partial->prev = slab;
+
+    _partial = slab;
+}
+
+
+void SlabPool::unlinkPartial( Slab * slab )
+{
+    if ( slab->prev )
+	slab->prev->next = slab->next;
+    else
+	_partial = slab->next;
+
+    if ( slab->next )
+	slab->next->prev = slab->prev;
+
+    slab->prev = 0;
+    slab->next = 0;
+}
+
+
+void * SlabPool::alloc( size_t size )
+{
+    // Objects of derived classes without their own pool have to be
+    // released with ::operator delete() again; see FileInfo::operator delete()
+
+    if ( size > _objectSize )
+	return ::operator new( size );
+
+    void * ptr = 0;
+
+    if ( _partial )
+    {
+	// Reuse a deleted object
+
+	Slab * slab = _partial;
+	ptr = slab->freeList;
+	slab->freeList = *( (void **) ptr );
+
+	if ( ! slab->freeList )
+	    unlinkPartial( slab );
+
+	slab->objectCount++;
+    }
+    else
+    {
+	size_t step = alignUp( _objectSize );
+
+	if ( ! _current || _current->bump + step > _current->end )
+	{
+	    if ( _current && _current->objectCount == 0 )
+	    {
+		// Can't have free objects: not in _partial
+
+		_slabs.remove( _current );
+		freeSlab( _current );
+	    }
+
+	    _current = newSlab();
+	}
+
+	ptr = _current->bump;
+	_current->bump += step;
+	_current->objectCount++;
+    }
+
+    ++_objectCount;
+
+    return ptr;
+}
+
+
+void SlabPool::releaseObject( void * ptr )
+{
+    if ( ptr )
+	slabOf( ptr )->pool->release( ptr );
+}
+
+
+void SlabPool::release( void * ptr )
+{
+    Slab * slab = slabOf( ptr );
+    --_objectCount;
+
+    if ( --slab->objectCount == 0 && slab != _current )
+    {
+	// The complete slab is unused now: Return it to the system
+
+	if ( slab->freeList )
+	    unlinkPartial( slab );
+
+	_slabs.remove( slab );
+	freeSlab( slab );
+	return;
+    }
+
+    if ( ! slab->freeList )
+	linkPartial( slab );
+
+    *( (void **) ptr ) = slab->freeList;
+    slab->freeList = ptr;
+}
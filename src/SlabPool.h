@@ -0,0 +1,174 @@
+/*
+ *   File name: SlabPool.h
+ *   Summary:	Slab allocator for the DirTree nodes of QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SlabPool_h
+#define SlabPool_h
+
+
+#include <stddef.h>	// size_t
+
+#include <QSet>
+
+
+// Size of one slab. Slabs are aligned to this size, so it must be a power
+// of 2.
+#define SLAB_SIZE	( 256 * 1024 )
+
+
+namespace QDirStat
+{
+    /**
+     * Memory pool for objects of one fixed size, typically all objects of
+     * one class like FileInfo or DirInfo of one DirTree; the classes use it
+     * in their own operator new() and operator delete().
+     *
+     * Memory is taken from the system in large slabs. Allocating an object
+     * is just a pointer bump in the current slab, or taking one from the
+     * free list of a slab where objects were deleted before; there is no
+     * per-object overhead. When the last object of a slab is deleted, the
+     * complete slab is returned to the system, so clearing a large tree
+     * does not leave the heap fragmented with lots of small holes. And all
+     * slabs can be released at once, without deleting the objects one by
+     * one (see DirTree::clear()).
+     *
+     * Requests for a different size (objects of derived classes that don't
+     * have their own pool) are passed on to the global operator new().
+     *
+     * In out-of-core mode, the slabs are mapped from the NodeFile.
+     *
+     * This is not thread-safe: Tree nodes are only created and deleted in
+     * the main thread.
+     **/
+    class SlabPool
+    {
+    public:
+
+	/**
+	 * Constructor. 'name' is only used for logging.
+	 **/
+	SlabPool( size_t objectSize, const char * name );
+
+	/**
+	 * Destructor. This returns all slabs to the system, but only if no
+	 * objects are left.
+	 **/
+	~SlabPool();
+
+	/**
+	 * Allocate memory for one object of 'size' bytes.
+	 **/
+	void * alloc( size_t size );
+
+	/**
+	 * Release the memory of one object that was allocated from the slabs
+	 * of this pool.
+	 **/
+	void release( void * ptr );
+
+	/**
+	 * Release the memory of one object that was allocated from the slabs
+	 * of any pool.
+	 **/
+	static void releaseObject( void * ptr );
+
+	/**
+	 * Return all slabs to the system at once, no matter if there are any
+	 * objects left in them. The caller has to make sure that none of
+	 * them is used anymore; their destructors are not called.
+	 **/
+	void releaseAll();
+
+	/**
+	 * Return 'true' if 'ptr' is an object in the slabs of this pool. This
+	 * does not access the memory 'ptr' points to, so this can also be
+	 * used for pointers to objects that are not from any pool.
+	 **/
+	bool owns( const void * ptr ) const { return _slabs.contains( slabOf( ptr ) ); }
+
+	/**
+	 * Return the number of objects currently allocated from slabs.
+	 **/
+	size_t objectCount() const { return _objectCount; }
+
+	/**
+	 * Return the number of slabs currently in use.
+	 **/
+	size_t slabCount() const { return _slabs.size(); }
+
+	/**
+	 * Return the name of this pool.
+	 **/
+	const char * name() const { return _name; }
+
+	/**
+	 * Return the size of the objects of this pool.
+	 **/
+	size_t objectSize() const { return _objectSize; }
+
+
+    protected:
+
+	/**
+	 * Header at the start of each slab.
+	 **/
+	struct Slab
+	{
+	    SlabPool *	pool;
+	    Slab *	prev;		// In the list of slabs with free objects
+	    Slab *	next;
+	    void *	freeList;	// Deleted objects in this slab
+	    char *	bump;		// Next never-used object
+	    char *	end;
+	    size_t	objectCount;	// Objects in use in this slab
+	    bool	inNodeFile;	// Mapped from the NodeFile
+	};
+
+	/**
+	 * Return the slab that 'ptr' belongs to.
+	 **/
+	static Slab * slabOf( const void * ptr );
+
+	/**
+	 * Get a new slab from the system.
+	 **/
+	Slab * newSlab();
+
+	/**
+	 * Return a slab to the system.
+	 **/
+	void freeSlab( Slab * slab );
+
+	/**
+	 * Add 'slab' to the list of slabs that have free objects.
+	 **/
+	void linkPartial( Slab * slab );
+
+	/**
+	 * Remove 'slab' from the list of slabs that have free objects.
+	 **/
+	void unlinkPartial( Slab * slab );
+
+
+	//
+	// Data members
+	//
+
+	size_t		_objectSize;
+	const char *	_name;
+	Slab *		_current;	// Slab for bump allocation
+	Slab *		_partial;	// Slabs with free objects
+	QSet<Slab *>	_slabs;		// All slabs
+	size_t		_objectCount;
+
+    };	// class SlabPool
+
+}	// namespace QDirStat
+
+
+#endif // ifndef SlabPool_h
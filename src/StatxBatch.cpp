@@ -0,0 +1,209 @@
+/*
+ *   File name: StatxBatch.cpp
+ *   Summary:	Batched statx() calls via io_uring for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>	// makedev()
+#include <string.h>		// memset()
+#include <stdint.h>		// intptr_t
+
+#include <QThreadStorage>
+
+#include "StatxBatch.h"
+#include "DirReadJob.h"
+
+// Number of entries of the io_uring submission queue
+#define STATX_QUEUE_DEPTH	256
+
+using namespace QDirStat;
+
+
+static QThreadStorage<StatxBatch *> threadBatches;
+
+
+StatxBatch::StatxBatch():
+    _ok( false ),
+    _maxInFlight( 0 )
+{
+#if HAVE_IO_URING
+
+    if ( io_uring_queue_init( STATX_QUEUE_DEPTH, &_ring, 0 ) == 0 )
+    {
+	// IORING_OP_STATX needs kernel 5.6 or later
+
+	struct io_uring_probe * probe = io_uring_get_probe_ring( &_ring );
+	_ok = probe && io_uring_opcode_supported( probe, IORING_OP_STATX );
+
+	if ( probe )
+	    io_uring_free_probe( probe );
+
+	// Never have more requests in flight than the completion queue can
+	// hold; otherwise io_uring_submit() fails with EBUSY.
+
+	_maxInFlight = *_ring.cq.kring_entries;
+
+	if ( ! _ok )
+	    io_uring_queue_exit( &_ring );
+    }
+#endif
+}
+
+
+StatxBatch::~StatxBatch()
+{
+#if HAVE_IO_URING
+    if ( _ok )
+	io_uring_queue_exit( &_ring );
+#endif
+}
+
+
+StatxBatch * StatxBatch::forCurrentThread()
+{
+    if ( ! threadBatches.hasLocalData() )
+	threadBatches.setLocalData( new StatxBatch() );
+
+    return threadBatches.localData();
+}
+
+
+#if HAVE_IO_URING
+
+/**
+ * Convert the result of a statx() call to a struct stat like lstat() would
+ * have returned it.
+ **/
+static void statxToStat( const struct statx & stx, struct stat * statInfo )
+{
+    memset( statInfo, 0, sizeof( struct stat ) );
+
+    statInfo->st_dev	   = makedev( stx.stx_dev_major,  stx.stx_dev_minor  );
+    statInfo->st_rdev	   = makedev( stx.stx_rdev_major, stx.stx_rdev_minor );
+    statInfo->st_ino	   = stx.stx_ino;
+    statInfo->st_mode	   = stx.stx_mode;
+    statInfo->st_nlink	   = stx.stx_nlink;
+    statInfo->st_uid	   = stx.stx_uid;
+    statInfo->st_gid	   = stx.stx_gid;
+    statInfo->st_size	   = stx.stx_size;
+    statInfo->st_blksize   = stx.stx_blksize;
+    statInfo->st_blocks	   = stx.stx_blocks;
+    statInfo->st_atime	   = stx.stx_atime.tv_sec;
+    statInfo->st_mtime	   = stx.stx_mtime.tv_sec;
+    statInfo->st_ctime	   = stx.stx_ctime.tv_sec;
+}
+
+
+void StatxBatch::drain( int count )
+{
+    struct io_uring_cqe * cqe;
+
+    while ( count-- > 0 && io_uring_wait_cqe( &_ring, &cqe ) == 0 )
+	io_uring_cqe_seen( &_ring, cqe );
+}
+
+#endif
+
+
+bool StatxBatch::statAll( int dirFd, QVector<LocalDirEntry> & entries, int flags )
+{
+#if HAVE_IO_URING
+
+    if ( ! _ok )
+	return false;
+
+    int count = entries.size();
+
+    // The result buffers (and the names in the entries) need to stay valid
+    // until the kernel is done with them, i.e. until all completions are
+    // reaped.
+
+    QVector<struct statx>   results( count );
+
+    int prepared  = 0;
+    int submitted = 0;
+    int completed = 0;
+
+    while ( completed < count )
+    {
+	// Fill the submission queue as far as possible, but never beyond
+	// what the completion queue can take
+
+	while ( prepared < count && prepared - completed < _maxInFlight )
+	{
+	    struct io_uring_sqe * sqe = io_uring_get_sqe( &_ring );
+
+	    if ( ! sqe )	// Submission queue full
+		break;
+
+	    io_uring_prep_statx( sqe, dirFd, entries[ prepared ].name,
+				 flags, STATX_BASIC_STATS, &results[ prepared ] );
+	    io_uring_sqe_set_data( sqe, (void *) (intptr_t) prepared );
+	    ++prepared;
+	}
+
+	if ( prepared > submitted )
+	{
+	    int result = io_uring_submit( &_ring );
+
+	    if ( result < 0 )
+	    {
+		// Nothing more can be done with this ring. Wait for the
+		// requests that are already in the kernel since they write
+		// to our buffers, then let the caller fall back to fstatat().
+
+		drain( submitted - completed );
+		_ok = false;
+
+		return false;
+	    }
+
+	    submitted += result;
+	}
+
+	// Reap one completion
+
+	struct io_uring_cqe * cqe;
+
+	if ( io_uring_wait_cqe( &_ring, &cqe ) != 0 )
+	{
+	    drain( submitted - completed );
+	    _ok = false;
+
+	    return false;
+	}
+
+	int index = (int) (intptr_t) io_uring_cqe_get_data( cqe );
+	LocalDirEntry & entry = entries[ index ];
+
+	if ( cqe->res < 0 )
+	{
+	    entry.statErrno = -cqe->res;
+	}
+	else
+	{
+	    statxToStat( results[ index ], &entry.statInfo );
+	    entry.statErrno = 0;
+	}
+
+	io_uring_cqe_seen( &_ring, cqe );
+	++completed;
+    }
+
+    return true;
+
+#else
+
+    Q_UNUSED( dirFd   );
+    Q_UNUSED( entries );
+    Q_UNUSED( flags   );
+
+    return false;
+
+#endif
+}
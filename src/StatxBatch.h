@@ -0,0 +1,97 @@
+/*
+ *   File name: StatxBatch.h
+ *   Summary:	Batched statx() calls via io_uring for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef StatxBatch_h
+#define StatxBatch_h
+
+
+#include <QVector>
+
+#ifndef HAVE_IO_URING
+#  define HAVE_IO_URING 0
+#endif
+
+#if HAVE_IO_URING
+#  include <liburing.h>
+#endif
+
+
+namespace QDirStat
+{
+    struct LocalDirEntry;
+
+
+    /**
+     * Class to lstat() all entries of a directory in one batch: All statx()
+     * calls are submitted at once through an io_uring submission queue, so
+     * the kernel can overlap the i-node reads. This helps most on flash
+     * storage and with cold dentry caches.
+     *
+     * Each thread needs its own instance; use forCurrentThread() to get it.
+     *
+     * If QDirStat was built without liburing or if the running kernel does
+     * not support IORING_OP_STATX, isOk() returns 'false' and statAll()
+     * does nothing, so the caller has to fall back to plain fstatat() calls.
+     **/
+    class StatxBatch
+    {
+    public:
+
+	/**
+	 * Constructor. This sets up the io_uring if possible.
+	 **/
+	StatxBatch();
+
+	/**
+	 * Destructor.
+	 **/
+	~StatxBatch();
+
+	/**
+	 * Return the instance for the current thread. It is created upon the
+	 * first call in each thread and deleted when the thread exits.
+	 **/
+	static StatxBatch * forCurrentThread();
+
+	/**
+	 * Return 'true' if io_uring with statx() can be used.
+	 **/
+	bool isOk() const { return _ok; }
+
+	/**
+	 * Stat all 'entries' relative to the directory 'dirFd' with 'flags'
+	 * (AT_SYMLINK_NOFOLLOW etc.) and fill in their 'statInfo' and
+	 * 'statErrno' fields.
+	 *
+	 * Return 'true' if that worked, 'false' if io_uring could not be used;
+	 * in that case, the caller has to stat all entries itself.
+	 **/
+	bool statAll( int dirFd, QVector<LocalDirEntry> & entries, int flags );
+
+
+    protected:
+
+#if HAVE_IO_URING
+	/**
+	 * Wait for 'count' outstanding completions and discard them.
+	 **/
+	void drain( int count );
+
+	struct io_uring	_ring;
+#endif
+
+	bool		_ok;
+	int		_maxInFlight;	// Limit of requests not yet reaped
+
+    };	// class StatxBatch
+
+}	// namespace QDirStat
+
+
+#endif // ifndef StatxBatch_h
@@ -0,0 +1,280 @@
+/*
+ *   File name: TreeFinalizer.cpp
+ *   Summary:	Parallel finalizing of large DirTree subtrees for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>	// std::stable_sort()
+
+#include <QThread>
+#include <QRunnable>
+
+#include "TreeFinalizer.h"
+#include "DirInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Runnable for QThreadPool that finalizes one task subtree. The main
+     * thread detaches the subtree from its parent before and reattaches it
+     * afterwards.
+     **/
+    class FinalizeTask: public QRunnable
+    {
+    public:
+
+	FinalizeTask( TreeFinalizer * finalizer, DirInfo * dir ):
+	    _finalizer( finalizer ),
+	    _dir( dir ),
+	    _parent( dir->parent() )
+	{
+	    setAutoDelete( false );
+	}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    DirInfo::deferDeletes();
+	    _dir->finalizeAll();
+	    _deletedNodes = DirInfo::takeDeferredDeletes();
+
+	    QMetaObject::invokeMethod( _finalizer, "taskDone", Qt::QueuedConnection );
+	}
+
+	DirInfo *    dir()	    const { return _dir; }
+	DirInfo *    parent()	    const { return _parent; }
+	FileInfoList deletedNodes() const { return _deletedNodes; }
+
+    protected:
+
+	TreeFinalizer * _finalizer;
+	DirInfo *	_dir;
+	DirInfo *	_parent;
+	FileInfoList	_deletedNodes;
+    };
+}
+
+
+static bool largerSubtree( DirInfo * a, DirInfo * b )
+{
+    return a->totalItems() > b->totalItems();
+}
+
+
+TreeFinalizer::TreeFinalizer( DirInfo * subtree, QObject * parent ):
+    QObject( parent ),
+    _subtree( subtree ),
+    _pendingTasks( 0 ),
+    _totalItems( 0 ),
+    _started( false ),
+    _finished( false )
+{
+    CHECK_PTR( _subtree );
+}
+
+
+TreeFinalizer::~TreeFinalizer()
+{
+    wait();
+}
+
+
+void TreeFinalizer::finalize( DirInfo * subtree )
+{
+    TreeFinalizer finalizer( subtree );
+
+    finalizer.start();
+    finalizer.wait();
+}
+
+
+void TreeFinalizer::start()
+{
+    if ( _started )
+	return;
+
+    _started	= true;
+    _totalItems = _subtree->totalItems();
+    _timer.start();
+    _subtree->lock();
+
+    int threads = QThread::idealThreadCount();
+
+    if ( threads >= 2 && _totalItems >= PARALLEL_FINALIZE_MIN_ITEMS )
+    {
+	int maxTaskItems = qMax( _totalItems / ( threads * FINALIZE_TASKS_PER_THREAD ),
+				 FINALIZE_MIN_TASK_ITEMS );
+	QList<DirInfo *> taskDirs;
+	split( _subtree, maxTaskItems, _spine, taskDirs );
+
+	// Start with the largest subtrees so the small ones fill the gaps at
+	// the end. The summary fields are still up to date at this point, so
+	// this does not trigger any recalc().
+
+	std::stable_sort( taskDirs.begin(), taskDirs.end(), largerSubtree );
+
+	foreach ( DirInfo * dir, taskDirs )
+	{
+	    FinalizeTask * task = new FinalizeTask( this, dir );
+	    CHECK_NEW( task );
+
+	    dir->setParent( 0 );
+	    _tasks << task;
+	}
+
+	_pendingTasks = _tasks.size();
+	_pool.setMaxThreadCount( threads );
+
+	foreach ( FinalizeTask * task, _tasks )
+	    _pool.start( task );
+    }
+
+    // Without any tasks, everything is done in the main thread, but not
+    // before the caller is back in the event loop.
+
+    if ( _pendingTasks == 0 )
+	QMetaObject::invokeMethod( this, "finishAndNotify", Qt::QueuedConnection );
+}
+
+
+void TreeFinalizer::wait()
+{
+    if ( ! _started || _finished )
+	return;
+
+    _pool.waitForDone();
+    finish();
+}
+
+
+void TreeFinalizer::taskDone()
+{
+    if ( --_pendingTasks == 0 )
+	finishAndNotify();
+}
+
+
+void TreeFinalizer::finishAndNotify()
+{
+    if ( _finished )	// wait() was faster
+	return;
+
+    finish();
+    emit finished( _subtree );
+}
+
+
+void TreeFinalizer::finish()
+{
+    _finished = true;
+    _subtree->unlock();
+
+    if ( _tasks.isEmpty() )
+    {
+	_subtree->finalizeAll();
+	return;
+    }
+
+    int deletedCount = 0;
+
+    foreach ( FinalizeTask * task, _tasks )
+    {
+	task->dir()->setParent( task->parent() );
+
+	foreach ( FileInfo * node, task->deletedNodes() )
+	{
+	    delete node;
+	    ++deletedCount;
+	}
+
+	delete task;
+    }
+
+    int taskCount = _tasks.size();
+    _tasks.clear();
+
+
+    // Detach the subtree, too: All changes of the spine are passed on to
+    // its ancestors only once at the end.
+
+    DirInfo * parent = _subtree->parent();
+    SummaryDelta before;
+
+    if ( parent )
+	before.add( _subtree );
+
+    _subtree->setParent( 0 );
+
+
+    // Finalize the spine bottom-up. Its summary fields don't know yet what
+    // changed in the task subtrees below it.
+
+    for ( int i = _spine.size() - 1; i >= 0; --i )
+    {
+	DirInfo * dir = _spine.at( i );
+
+	dir->recalc();
+	dir->dropSortCache();
+	dir->finalizeLocal();
+    }
+
+
+    // Reattach the subtree and tell its ancestors what changed
+
+    _subtree->setParent( parent );
+
+    if ( parent )
+    {
+	SummaryDelta after;
+	after.add( _subtree );
+
+	parent->addToSummary( before, -1 );
+	parent->addToSummary( after,   1 );
+
+	if ( ! _subtree->isPseudoDir() )
+	    parent->checkIgnored();
+    }
+
+    logDebug() << "Finalized " << _totalItems << " items in " << _subtree
+	       << " in " << taskCount << " tasks with " << _pool.maxThreadCount() << " threads"
+	       << " and " << _spine.size() << " spine dirs"
+	       << "; deleted " << deletedCount << " obsolete nodes"
+	       << " in " << _timer.elapsed() << " millisec" << endl;
+
+    _spine.clear();
+}
+
+
+void TreeFinalizer::split( DirInfo *	      dir,
+			   int		      maxTaskItems,
+			   QList<DirInfo *> & spine,
+			   QList<DirInfo *> & tasks )
+{
+    if ( dir->totalItems() <= maxTaskItems )
+    {
+	tasks << dir;
+	return;
+    }
+
+    spine << dir;
+
+    // Just like DirInfo::finalizeAll(): Only the subdirectories, not the
+    // dot entry or the attic; finalizeLocal() takes care of those.
+
+    FileInfo * child = dir->firstChild();
+
+    while ( child )
+    {
+	if ( child->isDirInfo() && ! child->isDotEntry() )
+	    split( child->toDirInfo(), maxTaskItems, spine, tasks );
+
+	child = child->next();
+    }
+}
@@ -0,0 +1,162 @@
+/*
+ *   File name: TreeFinalizer.h
+ *   Summary:	Parallel finalizing of large DirTree subtrees for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeFinalizer_h
+#define TreeFinalizer_h
+
+
+#include <QObject>
+#include <QList>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+
+// Minimum number of items in a subtree to finalize it with worker threads
+#define PARALLEL_FINALIZE_MIN_ITEMS	100000
+
+// Number of tasks to create for each thread so the threads that get the
+// smaller subtrees can take over more of them
+#define FINALIZE_TASKS_PER_THREAD	8
+
+// Minimum number of items of one task
+#define FINALIZE_MIN_TASK_ITEMS		5000
+
+
+namespace QDirStat
+{
+    class DirInfo;
+    class FinalizeTask;
+
+    /**
+     * Finalize a complete subtree (i.e. DirInfo::finalizeAll(): clean up
+     * the dot entries and attics and cascade the 'ignored' state) after
+     * reading it from a cache file, using all CPU cores for large trees.
+     *
+     * The subtree is split into disjoint subtrees of roughly similar size
+     * that are finalized in a thread pool, largest first, and the
+     * directories above them (the "spine") are finalized in the main
+     * thread afterwards, bottom-up.
+     *
+     * While a task is running, its subtree is detached from its parent, so
+     * all summary updates and the 'ignored' cascade stay inside the
+     * subtree; the spine is recalculated afterwards. Dot entries and
+     * attics that become obsolete in a task are deleted in the main thread
+     * when all tasks are done (see DirInfo::deferDeletes()).
+     *
+     * The main thread does not wait for the tasks: start() returns right
+     * away, and finished() is emitted when everything is done. Until then
+     * the subtree is locked, so the views don't show it in a
+     * half-finalized state, and nobody else may modify it.
+     *
+     * Reading directories does not need this: Each directory is finalized
+     * as soon as its read job is done.
+     **/
+    class TreeFinalizer: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This does not start anything yet.
+	 **/
+	TreeFinalizer( DirInfo * subtree, QObject * parent = 0 );
+
+	/**
+	 * Destructor. This waits for any running tasks.
+	 **/
+	virtual ~TreeFinalizer();
+
+	/**
+	 * Start finalizing the subtree: In worker threads if it is large,
+	 * otherwise in the main thread when control returns to the event
+	 * loop.
+	 **/
+	void start();
+
+	/**
+	 * Wait for the worker threads and finish the subtree right now if
+	 * that is not done yet. This does not emit finished().
+	 **/
+	void wait();
+
+	/**
+	 * Return 'true' if the subtree is completely finalized.
+	 **/
+	bool isFinished() const { return _finished; }
+
+	/**
+	 * Return the subtree.
+	 **/
+	DirInfo * subtree() const { return _subtree; }
+
+	/**
+	 * Finalize 'subtree' and everything below it and wait until that is
+	 * done.
+	 **/
+	static void finalize( DirInfo * subtree );
+
+    signals:
+
+	/**
+	 * Emitted when the subtree is completely finalized unless wait()
+	 * did that before.
+	 **/
+	void finished( DirInfo * subtree );
+
+    protected slots:
+
+	/**
+	 * Notification that a task is done. This is invoked (queued) from
+	 * the worker threads.
+	 **/
+	void taskDone();
+
+	/**
+	 * Finish the subtree if that is not done yet and emit finished().
+	 **/
+	void finishAndNotify();
+
+    protected:
+
+	/**
+	 * Delete the nodes that the tasks left over, finalize the spine
+	 * bottom-up and tell the ancestors of the subtree what changed.
+	 **/
+	void finish();
+
+	/**
+	 * Sort 'dir' and its subdirectories into the spine (in pre-order)
+	 * and the task subtrees with max. 'maxTaskItems' items each.
+	 **/
+	static void split( DirInfo *	     dir,
+			   int		     maxTaskItems,
+			   QList<DirInfo *> & spine,
+			   QList<DirInfo *> & tasks );
+
+	//
+	// Data members
+	//
+
+	DirInfo *		_subtree;
+	QThreadPool		_pool;
+	QList<FinalizeTask *>	_tasks;
+	QList<DirInfo *>	_spine;
+	int			_pendingTasks;	// Tasks that are not done yet
+	int			_totalItems;
+	bool			_started;
+	bool			_finished;
+	QElapsedTimer		_timer;
+
+    };	// class TreeFinalizer
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreeFinalizer_h
@@ -11,6 +11,7 @@
 #define TreeWalker_h
 
 #include "FileInfo.h"
+#include "FileColumns.h"
 
 
 namespace QDirStat
@@ -56,6 +57,17 @@ namespace QDirStat
          **/
         virtual bool check( FileInfo * item ) = 0;
 
+        /**
+         * Check if item no. 'index' of 'columns' fits into the category.
+         *
+         * Derived classes that only need the data in the columns should
+         * reimplement this: That is a lot faster for large trees than
+         * going through the tree items. This default implementation uses
+         * check() with the tree item.
+         **/
+        virtual bool checkColumns( const FileColumns & columns, int index )
+            { return check( columns.item( index ) ); }
+
     };  // class TreeWalker
 
 
@@ -74,6 +86,9 @@ namespace QDirStat
         virtual bool check( FileInfo * item )
             { return item && item->isFile() && item->size() >= _threshold; }
 
+        virtual bool checkColumns( const FileColumns & columns, int index )
+            { return columns.isFile( index ) && columns.sizes()[ index ] >= _threshold; }
+
     protected:
 
         FileSize _threshold;
@@ -95,6 +110,9 @@ namespace QDirStat
         virtual bool check( FileInfo * item )
             { return item && item->isFile() && item->mtime() >= _threshold; }
 
+        virtual bool checkColumns( const FileColumns & columns, int index )
+            { return columns.isFile( index ) && columns.mtimes()[ index ] >= _threshold; }
+
     protected:
 
         time_t _threshold;
@@ -116,6 +134,9 @@ namespace QDirStat
         virtual bool check( FileInfo * item )
             { return item && item->isFile() && item->mtime() <= _threshold; }
 
+        virtual bool checkColumns( const FileColumns & columns, int index )
+            { return columns.isFile( index ) && columns.mtimes()[ index ] <= _threshold; }
+
     protected:
 
         time_t _threshold;
@@ -131,6 +152,9 @@ namespace QDirStat
 
         virtual bool check( FileInfo * item )
             { return item && item->isFile() && item->links() > 1; }
+
+        virtual bool checkColumns( const FileColumns & columns, int index )
+            { return columns.isFile( index ) && ( columns.flags()[ index ] & FileColumns::HardLinked ); }
     };
 
 
@@ -154,6 +178,9 @@ namespace QDirStat
 
         virtual bool check( FileInfo * item )
             { return item && item->isFile() && item->isSparseFile(); }
+
+        virtual bool checkColumns( const FileColumns & columns, int index )
+            { return columns.isFile( index ) && ( columns.flags()[ index ] & FileColumns::SparseFile ); }
     };
 
 }       // namespace QDirStat
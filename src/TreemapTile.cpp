@@ -25,6 +25,10 @@
 using namespace QDirStat;
 
 
+int    TreemapTile::_tileCount	  = 0;
+qint64 TreemapTile::_cushionBytes = 0;
+
+
 TreemapTile::TreemapTile( TreemapView *	 parentView,
 			  TreemapTile *	 parentTile,
 			  FileInfo *	 orig,
@@ -71,6 +75,11 @@ TreemapTile::~TreemapTile()
     // DO NOT try to delete the _highlighter: It is owned by the TreemapView /
     // QGraphicsScene and deleted together with all other QGraphicsItems
     // in the TreemapView destructor.
+
+    _tileCount--;
+
+    if ( ! _cushion.isNull() )
+	_cushionBytes -= _cushion.width() * _cushion.height() * ( _cushion.depth() / 8 );
 }
 
 
@@ -79,6 +88,8 @@ void TreemapTile::init()
     // Set up height (z coordinate) - one level higher than the parent so this
     // will be closer to the foreground.
 
+    _tileCount++;
+
     setZValue( _parentTile ? ( _parentTile->zValue() + 1.0 ) : 0.0 );
 
     setBrush( QColor( 0x60, 0x60, 0x60 ) );
@@ -377,7 +388,10 @@ void TreemapTile::paint( QPainter			* painter,
 	else
 	{
 	    if ( _cushion.isNull() )
+	    {
 		_cushion = renderCushion();
+		_cushionBytes += _cushion.width() * _cushion.height() * ( _cushion.depth() / 8 );
+	    }
 
 	    QRectF rect = QGraphicsRectItem::rect();
 
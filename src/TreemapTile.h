@@ -190,6 +190,16 @@ namespace QDirStat
 	 **/
 	CushionSurface & cushionSurface() { return _cushionSurface; }
 
+	/**
+	 * Return the number of existing tiles of all treemaps.
+	 **/
+	static int tileCount() { return _tileCount; }
+
+	/**
+	 * Return the number of bytes of all rendered cushion pixmaps.
+	 **/
+	static qint64 cushionBytes() { return _cushionBytes; }
+
 
     protected:
 
@@ -366,6 +376,9 @@ namespace QDirStat
 	QPixmap		_cushion;
 	HighlightRect * _highlighter;
 
+	static int	_tileCount;
+	static qint64	_cushionBytes;
+
     }; // class TreemapTile
 
 
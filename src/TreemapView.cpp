@@ -13,6 +13,7 @@
 
 #include "TreemapView.h"
 #include "DirTree.h"
+#include "DirInfo.h"
 #include "Exception.h"
 #include "Logger.h"
 #include "SelectionModel.h"
@@ -318,6 +319,17 @@ void TreemapView::rebuildTreemap( FileInfo *	 newRoot,
 	newSize = visibleSize();
 
 
+    // If the user zoomed into a subtree that is still being read, read that
+    // first.
+
+    if ( _tree && newRoot && newRoot->isDirInfo() && newRoot->isBusy() )
+	_tree->prioritize( newRoot->toDirInfo() );
+
+    // The same if its subtree is still in a cache file
+
+    if ( _tree && newRoot && newRoot->isDirInfo() && newRoot->toDirInfo()->subtreePending() )
+	_tree->loadSubtree( newRoot->toDirInfo() );
+
     // Delete all old stuff.
     clear();
 
@@ -29,7 +29,8 @@ void usage( const QStringList & argList )
     cerr << "\n"
 	 << "Usage: \n"
 	 << "\n"
-	 << "  " << progName << " [--slow-update|-s] [<directory-name>]\n"
+	 << "  " << progName << " [--slow-update|-s] [--low-impact|-l] [--structure-only|-S]\n"
+	 << "           [<directory-name>]\n"
 	 << "  " << progName << " pkg:/pkgpattern\n"
 	 << "  " << progName << " unpkg:/dir\n"
 	 << "  " << progName << " --dont-ask|-d\n"
@@ -45,6 +46,14 @@ void usage( const QStringList & argList )
          << "- Exact match: \"pkg:/=mypkg\"\n"
          << "- All packages: \"pkg:/\"\n"
 	 << "\n"
+	 << "\n"
+	 << "--low-impact: Scan gently on a busy server: Idle I/O priority,\n"
+	 << "  limited directories and lstat() calls per second, and backing off\n"
+	 << "  when the system load or the I/O pressure is high.\n"
+	 << "\n"
+	 << "--structure-only: Only count files and directories; don't get the\n"
+	 << "  file sizes. They are filled in when a branch is opened.\n"
+	 << "\n"
 	 << std::endl;
 
     logError() << "FATAL: Bad command line args: " << argList.join( " " ) << endl;
@@ -113,6 +122,12 @@ int main( int argc, char *argv[] )
     if ( commandLineSwitch( "--slow-update", "-s", argList ) )
 	mainWin->dirTreeModel()->setSlowUpdate();
 
+    if ( commandLineSwitch( "--low-impact", "-l", argList ) )
+	mainWin->dirTreeModel()->tree()->scanThrottle()->setEnabled( true );
+
+    if ( commandLineSwitch( "--structure-only", "-S", argList ) )
+	mainWin->dirTreeModel()->tree()->setStructureOnly( true );
+
     if ( argList.isEmpty() )
     {
         if ( ! dont_ask )
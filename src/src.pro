@@ -46,13 +46,27 @@ INSTALLS	+= TARGET desktop icons
 QMAKE_CXXFLAGS	+=  -Wno-deprecated -Wno-deprecated-declarations
 
 
+# Optional: Use io_uring (liburing) for batched statx() calls while reading
+# directories. Without it, QDirStat uses one fstatat() call per entry.
+
+packagesExist( liburing ) {
+    CONFIG	+= link_pkgconfig
+    PKGCONFIG	+= liburing
+    DEFINES	+= HAVE_IO_URING=1
+}
+
+
 SOURCES	  = main.cpp			\
 	    ActionManager.cpp		\
 	    AdaptiveTimer.cpp		\
 	    Attic.cpp			\
+	    BinaryCache.cpp		\
 	    BreadcrumbNavigator.cpp	\
 	    BucketsTableModel.cpp	\
 	    BusyPopup.cpp		\
+	    CacheBlocks.cpp		\
+	    CacheSnapshot.cpp		\
+	    ChildNameIndex.cpp		\
 	    Cleanup.cpp			\
 	    CleanupCollection.cpp	\
 	    CleanupConfigPage.cpp	\
@@ -76,6 +90,8 @@ SOURCES	  = main.cpp			\
 	    ExcludeRulesConfigPage.cpp	\
 	    ExistingDirCompleter.cpp	\
 	    ExistingDirValidator.cpp	\
+	    FileAggregate.cpp		\
+	    FileColumns.cpp		\
 	    FileDetailsView.cpp		\
 	    FileInfo.cpp		\
 	    FileInfoIterator.cpp	\
@@ -99,11 +115,16 @@ SOURCES	  = main.cpp			\
 	    LocateFileTypeWindow.cpp	\
 	    Logger.cpp			\
 	    MainWindow.cpp		\
+	    MemoryReport.cpp		\
+	    MemoryReportWindow.cpp	\
 	    MessagePanel.cpp		\
 	    MimeCategorizer.cpp		\
 	    MimeCategory.cpp		\
 	    MimeCategoryConfigPage.cpp	\
 	    MountPoints.cpp		\
+	    NamePool.cpp		\
+	    NodeAttrTable.cpp		\
+	    NodeFile.cpp		\
 	    OpenDirDialog.cpp		\
 	    OpenPkgDialog.cpp		\
 	    OutputWindow.cpp		\
@@ -123,16 +144,20 @@ SOURCES	  = main.cpp			\
 	    ProcessStarter.cpp		\
 	    Refresher.cpp		\
 	    RpmPkgManager.cpp		\
+	    ScanThrottle.cpp		\
 	    SelectionModel.cpp		\
 	    Settings.cpp		\
 	    SettingsHelpers.cpp		\
 	    ShowUnpkgFilesDialog.cpp	\
 	    SizeColDelegate.cpp		\
+	    SlabPool.cpp		\
+	    StatxBatch.cpp		\
 	    StdCleanup.cpp		\
 	    Subtree.cpp			\
 	    SysUtil.cpp			\
 	    SystemFileChecker.cpp	\
 	    Trash.cpp			\
+	    TreeFinalizer.cpp		\
 	    TreemapTile.cpp		\
 	    TreemapView.cpp		\
             TreeWalker.cpp              \
@@ -144,9 +169,13 @@ HEADERS	  =				\
 	    ActionManager.h		\
 	    AdaptiveTimer.h		\
 	    Attic.h			\
+	    BinaryCache.h		\
 	    BreadcrumbNavigator.h	\
 	    BucketsTableModel.h		\
 	    BusyPopup.h			\
+	    CacheBlocks.h		\
+	    CacheSnapshot.h		\
+	    ChildNameIndex.h		\
 	    Cleanup.h			\
 	    CleanupCollection.h		\
 	    CleanupConfigPage.h		\
@@ -171,6 +200,8 @@ HEADERS	  =				\
 	    ExcludeRulesConfigPage.h	\
 	    ExistingDirCompleter.h	\
 	    ExistingDirValidator.h	\
+	    FileAggregate.h		\
+	    FileColumns.h		\
 	    FileDetailsView.h		\
 	    FileInfo.h			\
 	    FileInfoIterator.h		\
@@ -193,11 +224,16 @@ HEADERS	  =				\
 	    LocateFileTypeWindow.h	\
 	    Logger.h			\
 	    MainWindow.h		\
+	    MemoryReport.h		\
+	    MemoryReportWindow.h	\
 	    MessagePanel.h		\
 	    MimeCategorizer.h		\
 	    MimeCategory.h		\
 	    MimeCategoryConfigPage.h	\
 	    MountPoints.h		\
+	    NamePool.h		\
+	    NodeAttrTable.h		\
+	    NodeFile.h			\
 	    OpenDirDialog.h		\
 	    OpenPkgDialog.h		\
 	    OutputWindow.h		\
@@ -218,17 +254,21 @@ HEADERS	  =				\
 	    Qt4Compat.h			\
 	    Refresher.h			\
 	    RpmPkgManager.h		\
+	    ScanThrottle.h		\
 	    SelectionModel.h		\
 	    Settings.h			\
 	    SettingsHelpers.h		\
 	    ShowUnpkgFilesDialog.h	\
 	    SignalBlocker.h		\
 	    SizeColDelegate.h		\
+	    SlabPool.h			\
+	    StatxBatch.h		\
 	    StdCleanup.h		\
 	    Subtree.h			\
 	    SysUtil.h			\
 	    SystemFileChecker.h		\
 	    Trash.h			\
+	    TreeFinalizer.h		\
 	    TreemapTile.h		\
             TreemapView.h		\
             TreeWalker.h                \
@@ -250,6 +290,7 @@ FORMS	  = main-window.ui		   \
 	    filesystems-window.ui	   \
 	    locate-files-window.ui	   \
 	    locate-file-type-window.ui	   \
+	    memory-report-window.ui	   \
 	    open-dir-dialog.ui		   \
 	    open-pkg-dialog.ui		   \
 	    show-unpkg-files-dialog.ui	   \